@@ -0,0 +1,39 @@
+#!/bin/sh
+# Dispatch cost of switch statements against case count.
+# Usage: switch.sh <compiler> <simulator>
+compiler=$1
+simulator=$2
+
+program() {
+    cases=$1
+    stride=$2
+    iterations=$3
+    echo "int main() {"
+    echo "  int r <= 0;"
+    echo "  int i <= 0;"
+    echo "  while (i < $iterations) do {"
+    echo "    switch ((i - i / $cases * $cases) * $stride) {"
+    k=0
+    while [ $k -lt $cases ]; do
+        echo "      case $((k * stride)): r = r + $k; break;"
+        k=$((k + 1))
+    done
+    echo "    };"
+    echo "    i = i + 1;"
+    echo "  };"
+    echo "  return r;"
+    echo "}"
+}
+
+instructions() {
+    program "$@" | $compiler --no-cache | $simulator |
+        sed -n 's/^instructions: //p'
+}
+
+printf "%8s %12s %12s\n" cases dense sparse
+for cases in 2 4 8 16 32 64 128; do
+    dense=$(( $(instructions $cases 1 2000) - $(instructions $cases 1 1000) ))
+    sparse=$(( $(instructions $cases 7 2000) - $(instructions $cases 7 1000) ))
+    awk "BEGIN { printf \"%8d %12.2f %12.2f\\n\", \
+        $cases, $dense / 1000, $sparse / 1000 }"
+done
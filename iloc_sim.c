@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "include/iloc.h"
+#include "include/jit.h"
+#include "include/link.h"
+#include "include/simulate.h"
+
+static void usage(char* name) {
+    fprintf(stderr,
+            "usage: %s [--latency FILE] [--branch-penalty N] [--memory BYTES] "
+            "[--max-steps N] [--profile] [--branch-profile FILE] [--jit] "
+            "[--time] [FILE]\n",
+            name);
+    exit(2);
+}
+
+static bool is_object(struct module* module) {
+    return module->length > 0 && (module->operations[0].opcode == LABEL ||
+                                  module->operations[0].opcode == GLOBAL_DECL);
+}
+
+int main(int argc, char** argv) {
+    struct sim_config config = default_sim_config();
+    bool profile = false;
+    bool timed = false;
+    bool jit = false;
+    char* path = 0;
+    char* branch_path = 0;
+
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+            if (!load_latencies(&config, argv[++i])) {
+                fprintf(stderr, "Cannot load latencies from %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--branch-penalty") == 0 &&
+                   i + 1 < argc) {
+            config.branch_penalty = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc) {
+            config.memory_size = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) {
+            config.max_steps = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profile = true;
+        } else if (strcmp(argv[i], "--branch-profile") == 0 &&
+                   i + 1 < argc) {
+            branch_path = argv[++i];
+        } else if (strcmp(argv[i], "--time") == 0) {
+            timed = true;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            jit = true;
+        } else if (argv[i][0] != '-' && path == 0) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (jit && branch_path != 0) {
+        usage(argv[0]);
+    }
+
+    FILE* in = path != 0 ? fopen(path, "r") : stdin;
+    if (in == 0) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+
+    struct module* module = read_module(in);
+    if (in != stdin) {
+        fclose(in);
+    }
+    if (module == 0) {
+        return SIM_INVALID_PROGRAM;
+    }
+
+    if (is_object(module)) {
+        struct link_result linked = link_modules(&module, 1, 0);
+        free_module(module);
+        if (linked.status != LINK_SUCCESS) {
+            return linked.status;
+        }
+        module = linked.program;
+    }
+
+    struct sim_program* program = decode_program(module);
+    if (program == 0) {
+        free_module(module);
+        return SIM_INVALID_PROGRAM;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct sim_result result;
+    if (jit) {
+        result = run_jit(program, &config);
+    } else if (profile || branch_path != 0 || program->uses_pc) {
+        result = simulate(program, &config);
+    } else {
+        result = simulate_threaded(program, &config);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (jit) {
+        printf("status: %s\n", sim_status_name(result.status));
+        printf("exit value: %d\n", result.exit_value);
+    } else {
+        print_sim_report(stdout, &result, profile);
+    }
+
+    if (timed) {
+        double seconds = (end.tv_sec - start.tv_sec) +
+                         (end.tv_nsec - start.tv_nsec) / 1e9;
+        fprintf(stderr, "time: %.3f s", seconds);
+        if (!jit && seconds > 0) {
+            fprintf(stderr,
+                    " (%.1fM instructions/s)",
+                    result.instructions / seconds / 1e6);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    if (branch_path != 0) {
+        FILE* out = fopen(branch_path, "w");
+        if (out == 0) {
+            fprintf(stderr, "Cannot open %s\n", branch_path);
+        } else {
+            print_branch_profile(out, module, &result);
+            fclose(out);
+        }
+    }
+
+    int status = result.status;
+    free_module(module);
+    free_sim_result(&result);
+    free_sim_program(program);
+    return status;
+}
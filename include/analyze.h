@@ -1,3 +1,5 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
 #include "node.h"
 
 enum status {
@@ -87,3 +89,5 @@ struct analyze_result analyze_ternary(struct ternary_exp ternary_exp,
 struct analyze_result analyze_input(struct in_cmd in_cmd, struct table* table);
 struct analyze_result analyze_output(struct out_cmd out_cmd,
                                      struct table* table);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef CACHE_H
+#define CACHE_H
+#include <stdbool.h>
+#include <stdio.h>
+
+#define CACHE_DEFAULT_SIZE (64L * 1024 * 1024)
+
+struct cache {
+    char* dir;
+    long max_size;
+};
+
+struct cache_key {
+    char hex[33];
+};
+
+struct cache_entry {
+    int status;
+    char* diagnostics;
+    size_t diagnostics_size;
+    char* code;
+    size_t code_size;
+};
+
+struct cache_stats {
+    long hits;
+    long misses;
+    long entries;
+    long size;
+};
+
+struct capture {
+    int saved_fd;
+    FILE* file;
+};
+
+struct cache* alloc_cache(char* dir, long max_size);
+void free_cache(struct cache* cache);
+
+struct cache_key hash_key(const char* version,
+                          const char* options,
+                          const char* source,
+                          size_t size);
+
+bool cache_lookup(struct cache* cache,
+                  struct cache_key key,
+                  struct cache_entry* entry);
+bool cache_store(struct cache* cache,
+                 struct cache_key key,
+                 struct cache_entry* entry);
+void free_cache_entry(struct cache_entry* entry);
+
+struct cache_stats get_cache_stats(struct cache* cache);
+void print_cache_stats(struct cache* cache, FILE* out);
+
+struct capture begin_capture(FILE* stream);
+char* end_capture(struct capture capture, FILE* stream, size_t* size);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef CFG_H
+#define CFG_H
+#include <stdbool.h>
+#include "iloc.h"
+
+#define CFG_NO_REG (ILOC_RPC - 1)
+#define CFG_MAX_USES 3
+
+struct block {
+    int start;
+    int end;
+    int* succs;
+    int succ_count;
+    int* preds;
+    int pred_count;
+    int idom;
+};
+
+struct cfg {
+    struct module* module;
+    int start;
+    int end;
+    struct block* blocks;
+    int count;
+    int* order;
+    int order_count;
+    int frame;
+};
+
+struct loop {
+    int header;
+    bool* body;
+    int size;
+    bool has_call;
+};
+
+struct cfg* build_cfg(struct module* module, int start, int end);
+void free_cfg(struct cfg* cfg);
+bool dominates(struct cfg* cfg, int a, int b);
+int find_loops(struct cfg* cfg, struct loop** loops);
+void free_loops(struct loop* loops, int count);
+
+bool is_call(struct operation* operation);
+bool is_branch(struct operation* operation);
+int operation_uses(struct operation* operation, int* regs);
+int operation_defines(struct operation* operation);
+int max_local_label(struct module* module);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef EMIT_C_H
+#define EMIT_C_H
+#include <stdbool.h>
+#include <stdio.h>
+#include "analyze.h"
+
+bool emit_c(FILE* out, struct node* node);
+
+#endif
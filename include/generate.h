@@ -1,3 +1,6 @@
+#ifndef GENERATE_H
+#define GENERATE_H
+#include <stdio.h>
 #include "node.h"
 
 enum instruction_constant {
@@ -20,10 +23,35 @@ enum instruction_constant {
     FLABEL,
     I2I,
     ADD_I,
-    JUMP
+    JUMP,
+    HALT,
+    NOP,
+    SUB_I,
+    RSUB_I,
+    MULT_I,
+    DIV_I,
+    RDIV_I,
+    LSHIFT,
+    LSHIFT_I,
+    RSHIFT,
+    RSHIFT_I,
+    AND,
+    AND_I,
+    OR,
+    OR_I,
+    XOR,
+    XOR_I,
+    LOAD,
+    LOAD_AO,
+    STORE,
+    STORE_AO,
+    LOAD_GLOBAL,
+    STORE_GLOBAL,
+    LOAD_LABEL,
+    GLOBAL_DECL
 };
 
-enum scope { GLOBAL, LOCAL };
+enum scope { GLOBAL, LOCAL, REGISTER };
 
 struct address {
     char* id;
@@ -39,6 +67,15 @@ struct offset_table {
 struct offset_table* alloc_offset_table();
 void free_offset_table(struct offset_table* table);
 
+extern const char* instruction[];
+extern int unroll_factor;
+extern int inline_limit;
+extern bool tail_calls;
+extern bool shrink_wrap;
+extern bool if_conversion;
+extern int call_registers;
+
+void import_global(char* id);
 void generate_code(struct node* node);
 void generate(struct node* node,
               struct offset_table* table,
@@ -55,10 +92,19 @@ void generate_binary(struct binary_exp binary_exp,
                      struct offset_table* table,
                      char* l_true,
                      char* l_false);
+void generate_ternary(struct ternary_exp ternary_exp,
+                      struct offset_table* table);
 void generate_if(struct if_cmd if_cmd, struct offset_table* table);
 void generate_while(struct while_cmd while_cmd, struct offset_table* table);
 void generate_do_while(struct do_while_cmd do_while_cmd,
                        struct offset_table* table);
+void generate_for(struct for_cmd for_cmd, struct offset_table* table);
+void generate_foreach(struct foreach_cmd foreach_cmd,
+                      struct offset_table* table);
+void generate_switch(struct switch_cmd switch_cmd, struct offset_table* table);
+void generate_case(struct node* node);
+void generate_break();
+void generate_continue();
 void generate_function_def(struct function_def function_def,
                            struct offset_table* table);
 void generate_return(struct return_cmd return_cmd, struct offset_table* table);
@@ -75,7 +121,11 @@ struct code {
     struct ins* last;
 };
 
+extern struct code code;
+
 char* alloc_line();
 void append_ins(char* line);
 void free_code(struct ins* head);
-void print_code();
+void print_code(FILE* out);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef ILOC_H
+#define ILOC_H
+#include <stdbool.h>
+#include <stdio.h>
+#include "generate.h"
+
+#define ILOC_RFP -1
+#define ILOC_RSP -2
+#define ILOC_RBSS -3
+#define ILOC_RPC -4
+#define OPCODE_COUNT (GLOBAL_DECL + 1)
+
+enum operand_type {
+    OPERAND_NONE,
+    OPERAND_REG,
+    OPERAND_IMM,
+    OPERAND_LABEL,
+    OPERAND_SYMBOL
+};
+
+struct operand {
+    enum operand_type type;
+    int val;
+    char* name;
+};
+
+struct operation {
+    enum instruction_constant opcode;
+    struct operand src[2];
+    struct operand dst[2];
+};
+
+struct module {
+    struct operation* operations;
+    int length;
+    int capacity;
+};
+
+struct label_map {
+    char** names;
+    int* indexes;
+    int capacity;
+    int count;
+};
+
+extern const char* mnemonic[];
+
+struct operand make_reg(int reg);
+struct operand make_imm(int val);
+struct operand make_label(const char* name);
+struct operand make_symbol(const char* name);
+struct operand copy_operand(struct operand operand);
+void free_operand(struct operand* operand);
+struct operation copy_operation(struct operation* operation);
+void free_operation(struct operation* operation);
+bool is_local_label(const char* name);
+bool is_function_label(struct operation* operation);
+int function_end(struct module* module, int start);
+int find_function(struct module* module, const char* name);
+bool parse_operation(const char* line, struct operation* operation);
+void print_operation(FILE* out, struct operation* operation);
+
+struct module* alloc_module();
+void free_module(struct module* module);
+void append_operation(struct module* module, struct operation operation);
+struct module* read_module(FILE* in);
+struct module* code_to_module(struct ins* head);
+void print_module(FILE* out, struct module* module);
+
+struct label_map* alloc_label_map();
+void free_label_map(struct label_map* map);
+bool add_label(struct label_map* map, const char* name, int index);
+int find_label(struct label_map* map, const char* name);
+
+#endif
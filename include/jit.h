@@ -0,0 +1,10 @@
+#ifndef JIT_H
+#define JIT_H
+#include <stdbool.h>
+#include "simulate.h"
+
+bool jit_supported();
+struct sim_result run_jit(struct sim_program* program,
+                          struct sim_config* config);
+
+#endif
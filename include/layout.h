@@ -0,0 +1,25 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+#include <stdio.h>
+#include "iloc.h"
+#include "opt.h"
+
+struct branch_count {
+    char* on_true;
+    char* on_false;
+    long taken;
+    long not_taken;
+};
+
+struct branch_profile {
+    struct branch_count* counts;
+    int count;
+};
+
+extern struct branch_profile* layout_profile;
+
+struct branch_profile* read_branch_profile(FILE* in);
+void free_branch_profile(struct branch_profile* profile);
+void layout_module(struct module* module, struct opt_stats* stats);
+
+#endif
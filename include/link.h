@@ -0,0 +1,25 @@
+#ifndef LINK_H
+#define LINK_H
+#include "iloc.h"
+#include "lto.h"
+
+#define STACK_BASE 1024
+
+enum link_status {
+    LINK_SUCCESS = 0,
+    LINK_UNDEFINED = 60,
+    LINK_DUPLICATE = 61,
+    LINK_MISMATCHED_GLOBAL = 62
+};
+
+struct link_result {
+    enum link_status status;
+    struct module* program;
+    struct lto_stats stats;
+};
+
+struct link_result link_modules(struct module** modules,
+                                int count,
+                                int passes);
+
+#endif
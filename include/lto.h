@@ -0,0 +1,28 @@
+#ifndef LTO_H
+#define LTO_H
+#include <stdio.h>
+#include "iloc.h"
+
+#define INLINE_THRESHOLD 64
+
+enum lto_pass {
+    LTO_INLINE = 1,
+    LTO_DEAD_FUNCTIONS = 2,
+    LTO_CONST_GLOBALS = 4,
+    LTO_ALL = 7
+};
+
+struct lto_stats {
+    int inlined_calls;
+    int removed_functions;
+    int removed_operations;
+    int folded_loads;
+};
+
+int parse_lto_passes(const char* list);
+void optimize_program(struct module* program,
+                      int passes,
+                      struct lto_stats* stats);
+void print_lto_stats(FILE* out, struct lto_stats* stats);
+
+#endif
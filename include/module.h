@@ -0,0 +1,89 @@
+#ifndef MODULE_H
+#define MODULE_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "analyze.h"
+
+#define INTERFACE_MAGIC 0x31494d50
+#define INTERFACE_VERSION 3
+
+struct interface_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t class_count;
+    uint32_t field_count;
+    uint32_t global_count;
+    uint32_t function_count;
+    uint32_t param_count;
+    uint32_t string_size;
+};
+
+struct interface_class {
+    uint32_t name;
+    int32_t line;
+    int32_t column;
+    uint32_t first_field;
+    uint32_t field_count;
+    uint32_t size;
+};
+
+struct interface_field {
+    uint32_t name;
+    int32_t line;
+    int32_t column;
+    int32_t access;
+    uint32_t type_key;
+    uint32_t type_val;
+    uint32_t offset;
+};
+
+struct interface_global {
+    uint32_t name;
+    int32_t line;
+    int32_t column;
+    int32_t size;
+    uint32_t is_static;
+    uint32_t type_key;
+    uint32_t type_val;
+};
+
+struct interface_function {
+    uint32_t name;
+    int32_t line;
+    int32_t column;
+    uint32_t type_key;
+    uint32_t type_val;
+    uint32_t first_param;
+    uint32_t param_count;
+};
+
+struct interface_param {
+    uint32_t name;
+    int32_t line;
+    int32_t column;
+    uint32_t is_const;
+    uint32_t type_key;
+    uint32_t type_val;
+};
+
+struct interface {
+    void* map;
+    size_t map_size;
+    const struct interface_header* header;
+    const struct interface_class* classes;
+    const struct interface_field* fields;
+    const struct interface_global* globals;
+    const struct interface_function* functions;
+    const struct interface_param* params;
+    const char* strings;
+    struct node* field_nodes;
+    struct node* param_nodes;
+};
+
+bool save_interface(struct node* node, FILE* out);
+struct interface* load_interface(const char* path);
+void import_interface(struct interface* interface, struct table* table);
+void free_interface(struct interface* interface);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef OPT_H
+#define OPT_H
+#include <stdio.h>
+#include "iloc.h"
+
+#define DEFAULT_UNROLL_FACTOR 4
+#define DEFAULT_INLINE_LIMIT 32
+
+enum opt_pass {
+    OPT_LICM = 1,
+    OPT_UNROLL = 2,
+    OPT_STRENGTH = 4,
+    OPT_INLINE = 8,
+    OPT_TAIL_CALLS = 16,
+    OPT_SHRINK_WRAP = 32,
+    OPT_IF_CONVERT = 64,
+    OPT_LAYOUT = 128,
+    OPT_GVN = 256,
+    OPT_ALL = 511
+};
+
+struct function_stats {
+    char* name;
+    int eliminated;
+};
+
+struct opt_stats {
+    int hoisted_operations;
+    int strength_reduced;
+    int preheaders;
+    int threaded_jumps;
+    int removed_jumps;
+    int unreachable_operations;
+    int removed_labels;
+    int eliminated_operations;
+    struct function_stats* functions;
+    int function_count;
+};
+
+int parse_opt_passes(const char* list);
+void optimize_module(struct module* module,
+                     int passes,
+                     struct opt_stats* stats);
+void print_opt_stats(FILE* out, struct opt_stats* stats);
+void free_opt_stats(struct opt_stats* stats);
+
+#endif
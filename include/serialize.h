@@ -0,0 +1,54 @@
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "node.h"
+
+#define AST_MAGIC 0x31545341
+#define AST_VERSION 1
+#define AST_NONE 0xffffffffu
+
+enum ast_flag {
+    AST_STATIC = 1,
+    AST_CONST = 2,
+    AST_CUSTOM = 4
+};
+
+struct ast_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t node_count;
+    uint32_t root;
+    uint32_t string_size;
+};
+
+struct ast_token {
+    int32_t line;
+    int32_t column;
+    int32_t type;
+    uint32_t val;
+};
+
+struct ast_record {
+    uint16_t type;
+    uint16_t flags;
+    int32_t op;
+    uint32_t child[4];
+    struct ast_token token;
+    uint32_t type_val;
+    uint32_t str;
+};
+
+struct ast {
+    void* map;
+    size_t map_size;
+    struct node* nodes;
+    struct node* root;
+};
+
+bool save_ast(struct node* node, FILE* out);
+struct ast* load_ast(const char* path);
+void free_ast(struct ast* ast);
+
+#endif
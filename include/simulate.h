@@ -0,0 +1,87 @@
+#ifndef SIMULATE_H
+#define SIMULATE_H
+#include <stdbool.h>
+#include <stdio.h>
+#include "iloc.h"
+
+#define SIM_MEMORY_SIZE (1 << 20)
+#define SIM_MAX_STEPS 1000000000L
+#define SIM_SPECIAL_REGISTERS 4
+#define SIM_MAX_REGISTERS (1 << 20)
+
+enum sim_status {
+    SIM_HALTED = 0,
+    SIM_INVALID_PROGRAM = 70,
+    SIM_INVALID_ADDRESS = 71,
+    SIM_INVALID_JUMP = 72,
+    SIM_DIVISION_BY_ZERO = 73,
+    SIM_STEP_LIMIT = 74
+};
+
+struct sim_config {
+    int latency[OPCODE_COUNT];
+    int branch_penalty;
+    size_t memory_size;
+    long max_steps;
+};
+
+struct sim_ins {
+    int opcode;
+    int a;
+    int b;
+    int c;
+    int function;
+    int entry;
+};
+
+struct sim_program {
+    struct sim_ins* code;
+    int length;
+    int register_count;
+    char** functions;
+    int function_count;
+    bool uses_pc;
+};
+
+struct function_profile {
+    char* name;
+    long calls;
+    long instructions;
+    long cycles;
+};
+
+struct sim_result {
+    enum sim_status status;
+    int exit_value;
+    long instructions;
+    long cycles;
+    long loads;
+    long stores;
+    long mispredictions;
+    long counts[OPCODE_COUNT];
+    long* branches;
+    struct function_profile* functions;
+    int function_count;
+};
+
+struct sim_config default_sim_config();
+bool load_latencies(struct sim_config* config, const char* path);
+int register_slot(int reg);
+int sim_divide(int dividend, int divisor);
+bool predict_branch(unsigned char* counter, bool taken);
+
+struct sim_program* decode_program(struct module* program);
+void free_sim_program(struct sim_program* program);
+
+struct sim_result simulate(struct sim_program* program,
+                           struct sim_config* config);
+struct sim_result simulate_threaded(struct sim_program* program,
+                                    struct sim_config* config);
+void free_sim_result(struct sim_result* result);
+const char* sim_status_name(enum sim_status status);
+void print_sim_report(FILE* out, struct sim_result* result, bool profile);
+void print_branch_profile(FILE* out,
+                          struct module* module,
+                          struct sim_result* result);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef X86_H
+#define X86_H
+#include <stdbool.h>
+#include <stdio.h>
+#include "simulate.h"
+
+bool print_x86_program(FILE* out,
+                       struct sim_program* program,
+                       size_t memory_size);
+
+#endif
@@ -1,30 +1,589 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "include/analyze.h"
+#include "include/cache.h"
+#include "include/emit_c.h"
 #include "include/generate.h"
+#include "include/iloc.h"
+#include "include/jit.h"
+#include "include/layout.h"
 #include "include/lex.yy.h"
+#include "include/link.h"
+#include "include/module.h"
+#include "include/opt.h"
 #include "include/parser.tab.h"
+#include "include/serialize.h"
+#include "include/x86.h"
 
-int main(int argc, char** argv) {
-    (void)argc;
-    (void)argv;
+#define COMPILER_VERSION "etapa6 " __DATE__ " " __TIME__
+#define MAX_IMPORTS 16
 
-    struct node* node = 0;
-    int status = yyparse(&node);
+static char* imports[MAX_IMPORTS];
+static int import_count = 0;
+static char* layout_profile_path = 0;
+static bool emit_object = false;
+static int lto_passes = 0;
+static bool lto_stats = false;
+static int opt_passes = 0;
+static bool opt_stats = false;
+static int opt_unroll_factor = DEFAULT_UNROLL_FACTOR;
+static int call_register_count = 0;
+static bool run = false;
+static bool emit_x86 = false;
+static bool emit_c_source = false;
+
+static void usage(char* name) {
+    fprintf(stderr,
+            "usage: %s [--cache-dir DIR] [--cache-size BYTES] "
+            "[--cache-stats] [--no-cache] [--import FILE]... "
+            "[-O] [--opt-passes LIST] [--opt-stats] [--unroll-factor N] "
+            "[--layout-profile FILE] [--call-registers N] [--emit-object] "
+            "[--lto] "
+            "[--lto-passes LIST] [--lto-stats] "
+            "[--run] [--emit-x86] [--emit-c] < source\n"
+            "       %s --emit-ast FILE < source\n"
+            "       %s [--import FILE]... [--emit-object] --load-ast FILE\n"
+            "       %s [--import FILE]... --emit-interface FILE < source\n"
+            "       %s [--lto] [--lto-passes LIST] [--lto-stats] "
+            "--link OBJECT...\n",
+            name,
+            name,
+            name,
+            name,
+            name);
+    exit(2);
+}
 
-    if (status != 0) {
-        free_node(node);
-        yylex_destroy();
-        exit(status);
+static char* read_source(FILE* in, size_t* size) {
+    size_t capacity = 4096;
+    char* source = malloc(capacity);
+    *size = 0;
+
+    size_t n;
+    while ((n = fread(source + *size, 1, capacity - *size, in)) > 0) {
+        *size += n;
+        if (*size == capacity) {
+            capacity *= 2;
+            source = realloc(source, capacity);
+        }
     }
 
+    return source;
+}
+
+static int import_interfaces(struct interface** interfaces,
+                             struct table* table) {
+    int status = SUCCESS;
+
+    int i;
+    for (i = 0; i < import_count; i++) {
+        interfaces[i] = load_interface(imports[i]);
+        if (interfaces[i] == 0) {
+            fprintf(stderr, "Cannot load interface %s\n", imports[i]);
+            status = 1;
+        } else {
+            import_interface(interfaces[i], table);
+        }
+    }
+
+    return status;
+}
+
+static void free_interfaces(struct interface** interfaces) {
+    int i;
+    for (i = 0; i < import_count; i++) {
+        free_interface(interfaces[i]);
+    }
+}
+
+static int run_program(struct module* program, FILE* out) {
+    struct sim_program* decoded = decode_program(program);
+    if (decoded == 0) {
+        return SIM_INVALID_PROGRAM;
+    }
+
+    struct sim_config config = default_sim_config();
+    struct sim_result result = run_jit(decoded, &config);
+    if (result.status != SIM_HALTED) {
+        fprintf(stderr,
+                "Program stopped: %s\n",
+                sim_status_name(result.status));
+    }
+    fprintf(out, "%d\n", result.exit_value);
+
+    free_sim_program(decoded);
+    return result.status;
+}
+
+static long count_instructions(struct module** modules,
+                               int count,
+                               int passes) {
+    struct link_result linked = link_modules(modules, count, passes);
+    if (linked.status != LINK_SUCCESS) {
+        return -1;
+    }
+
+    long instructions = -1;
+    struct sim_program* decoded = decode_program(linked.program);
+    if (decoded != 0) {
+        struct sim_config config = default_sim_config();
+        struct sim_result result = simulate_threaded(decoded, &config);
+        if (result.status == SIM_HALTED) {
+            instructions = result.instructions;
+        }
+        free_sim_result(&result);
+        free_sim_program(decoded);
+    }
+    free_module(linked.program);
+    return instructions;
+}
+
+static void print_lto_counts(struct module** modules, int count) {
+    static const int steps[] = {LTO_INLINE,
+                                LTO_DEAD_FUNCTIONS,
+                                LTO_CONST_GLOBALS};
+    static const char* names[] = {"inline",
+                                  "dead-functions",
+                                  "const-globals"};
+    int passes = 0;
+    long before = count_instructions(modules, count, passes);
+    if (before == -1) {
+        fprintf(stderr, "dynamic instructions: not measured\n");
+        return;
+    }
+    fprintf(stderr, "dynamic instructions: %ld\n", before);
+
+    int i;
+    for (i = 0; i < 3; i++) {
+        if (!(lto_passes & steps[i])) {
+            continue;
+        }
+        passes |= steps[i];
+        long after = count_instructions(modules, count, passes);
+        if (after == -1) {
+            fprintf(stderr, "  after %s: not measured\n", names[i]);
+            return;
+        }
+        fprintf(stderr,
+                "  after %s: %ld (%+ld)\n",
+                names[i],
+                after,
+                after - before);
+        before = after;
+    }
+}
+
+static int emit_native(struct module* program, FILE* out) {
+    struct sim_program* decoded = decode_program(program);
+    if (decoded == 0) {
+        return SIM_INVALID_PROGRAM;
+    }
+
+    int status = print_x86_program(out, decoded, SIM_MEMORY_SIZE)
+                     ? SUCCESS
+                     : SIM_INVALID_PROGRAM;
+    free_sim_program(decoded);
+    return status;
+}
+
+static int emit_module(struct module* module, FILE* out) {
+    if (emit_object) {
+        print_module(out, module);
+        return LINK_SUCCESS;
+    }
+
+    struct link_result result = link_modules(&module, 1, lto_passes);
+    int status = result.status;
+    if (status == LINK_SUCCESS) {
+        if (run) {
+            status = run_program(result.program, out);
+        } else if (emit_x86) {
+            status = emit_native(result.program, out);
+        } else {
+            print_module(out, result.program);
+        }
+        free_module(result.program);
+    }
+    if (lto_stats) {
+        print_lto_stats(stderr, &result.stats);
+        if (result.status == LINK_SUCCESS) {
+            print_lto_counts(&module, 1);
+        }
+    }
+    return status;
+}
+
+static int compile_node(struct node* node, FILE* out) {
     struct table* table = alloc_table();
-    struct analyze_result result = analyze_node(node, table);
+    struct interface* interfaces[MAX_IMPORTS];
+    int status = import_interfaces(interfaces, table);
+
+    if (status == SUCCESS) {
+        status = analyze_node(node, table).status;
+    }
 
-    generate_code(node);
+    if (status == SUCCESS && emit_c_source) {
+        if (import_count > 0) {
+            fprintf(stderr, "--emit-c cannot be combined with --import\n");
+            status = 1;
+        } else {
+            status = emit_c(out, node) ? SUCCESS : 1;
+        }
+    } else if (status == SUCCESS) {
+        unroll_factor = opt_passes & OPT_UNROLL ? opt_unroll_factor : 0;
+        inline_limit = opt_passes & OPT_INLINE ? DEFAULT_INLINE_LIMIT : 0;
+        tail_calls = (opt_passes & OPT_TAIL_CALLS) != 0;
+        shrink_wrap = (opt_passes & OPT_SHRINK_WRAP) != 0;
+        if_conversion = (opt_passes & OPT_IF_CONVERT) != 0;
+        call_registers = call_register_count;
+        generate_code(node);
+        struct module* module = code_to_module(code.head);
+        free_code(code.head);
+
+        if (module != 0 && opt_passes != 0) {
+            struct opt_stats stats;
+            memset(&stats, 0, sizeof stats);
+            optimize_module(module, opt_passes, &stats);
+            if (opt_stats) {
+                print_opt_stats(stderr, &stats);
+            }
+            free_opt_stats(&stats);
+        }
+
+        status = module != 0 ? emit_module(module, out) : 1;
+        free_module(module);
+    }
 
     free_table(table);
+    free_interfaces(interfaces);
+    return status;
+}
+
+static int compile(FILE* out) {
+    struct node* node = 0;
+    int status = yyparse(&node);
+
+    if (status == 0) {
+        status = compile_node(node, out);
+    }
+
     free_node(node);
     yylex_destroy();
+    return status;
+}
 
-    return result.status;
+static int emit_ast(char* path) {
+    struct node* node = 0;
+    int status = yyparse(&node);
+
+    if (status == 0) {
+        FILE* out = fopen(path, "wb");
+        if (out == 0 || !save_ast(node, out)) {
+            fprintf(stderr, "Cannot write AST to %s\n", path);
+            status = 1;
+        }
+        if (out != 0 && fclose(out) != 0) {
+            status = 1;
+        }
+    }
+
+    free_node(node);
+    yylex_destroy();
+    return status;
+}
+
+static int emit_interface(char* path) {
+    struct node* node = 0;
+    int status = yyparse(&node);
+
+    if (status == 0) {
+        struct table* table = alloc_table();
+        struct interface* interfaces[MAX_IMPORTS];
+        status = import_interfaces(interfaces, table);
+        if (status == SUCCESS) {
+            status = analyze_node(node, table).status;
+        }
+        free_table(table);
+        free_interfaces(interfaces);
+    }
+
+    if (status == 0) {
+        FILE* out = fopen(path, "wb");
+        if (out == 0 || !save_interface(node, out)) {
+            fprintf(stderr, "Cannot write interface to %s\n", path);
+            status = 1;
+        }
+        if (out != 0 && fclose(out) != 0) {
+            status = 1;
+        }
+    }
+
+    free_node(node);
+    yylex_destroy();
+    return status;
+}
+
+static int compile_ast(char* path, FILE* out) {
+    struct ast* ast = load_ast(path);
+    if (ast == 0) {
+        fprintf(stderr, "Cannot load AST from %s\n", path);
+        return 1;
+    }
+
+    int status = compile_node(ast->root, out);
+    free_ast(ast);
+    return status;
+}
+
+static int link_objects(char** paths, int count) {
+    struct module** modules = calloc(count > 0 ? count : 1, sizeof *modules);
+    int status = LINK_SUCCESS;
+
+    int i;
+    for (i = 0; i < count && status == LINK_SUCCESS; i++) {
+        FILE* in = fopen(paths[i], "r");
+        if (in == 0) {
+            fprintf(stderr, "Cannot open object %s\n", paths[i]);
+            status = 1;
+            break;
+        }
+
+        modules[i] = read_module(in);
+        fclose(in);
+        if (modules[i] == 0) {
+            fprintf(stderr, "Cannot read object %s\n", paths[i]);
+            status = 1;
+        }
+    }
+
+    if (status == LINK_SUCCESS) {
+        struct link_result result = link_modules(modules, count, lto_passes);
+        status = result.status;
+        if (status == LINK_SUCCESS) {
+            print_module(stdout, result.program);
+            free_module(result.program);
+        }
+        if (lto_stats) {
+            print_lto_stats(stderr, &result.stats);
+            if (result.status == LINK_SUCCESS) {
+                print_lto_counts(modules, count);
+            }
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        free_module(modules[i]);
+    }
+    free(modules);
+    return status;
+}
+
+static void add_file_key(char* options,
+                         size_t size,
+                         const char* option,
+                         const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == 0) {
+        return;
+    }
+
+    size_t length;
+    char* bytes = read_source(file, &length);
+    fclose(file);
+
+    struct cache_key key = hash_key("", "", bytes, length);
+    size_t used = strlen(options);
+    snprintf(options + used, size - used, " %s %s", option, key.hex);
+    free(bytes);
+}
+
+static void add_import_keys(char* options, size_t size) {
+    int i;
+    for (i = 0; i < import_count; i++) {
+        add_file_key(options, size, "--import", imports[i]);
+    }
+    if (layout_profile_path != 0) {
+        add_file_key(options, size, "--layout-profile", layout_profile_path);
+    }
+}
+
+static int compile_cached(struct cache* cache, char* options) {
+    size_t size;
+    char* source = read_source(stdin, &size);
+    struct cache_key key = hash_key(COMPILER_VERSION, options, source, size);
+
+    struct cache_entry entry;
+    if (!cache_lookup(cache, key, &entry)) {
+        yy_scan_bytes(source, size);
+
+        FILE* out = open_memstream(&entry.code, &entry.code_size);
+        struct capture capture = begin_capture(stderr);
+        entry.status = compile(out);
+        entry.diagnostics =
+            end_capture(capture, stderr, &entry.diagnostics_size);
+        fclose(out);
+
+        cache_store(cache, key, &entry);
+    }
+
+    fwrite(entry.diagnostics, 1, entry.diagnostics_size, stderr);
+    fwrite(entry.code, 1, entry.code_size, stdout);
+
+    int status = entry.status;
+    free_cache_entry(&entry);
+    free(source);
+    return status;
+}
+
+int main(int argc, char** argv) {
+    char* cache_dir = getenv("ETAPA6_CACHE_DIR");
+    char* cache_size = getenv("ETAPA6_CACHE_SIZE");
+    bool cache_stats = false;
+    char* emit_path = 0;
+    char* load_path = 0;
+    char* interface_path = 0;
+    char options[1024] = "";
+    int link_index = 0;
+
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc) {
+            cache_size = argv[++i];
+        } else if (strcmp(argv[i], "--cache-stats") == 0) {
+            cache_stats = true;
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            cache_dir = 0;
+        } else if (strcmp(argv[i], "--emit-ast") == 0 && i + 1 < argc) {
+            emit_path = argv[++i];
+        } else if (strcmp(argv[i], "--load-ast") == 0 && i + 1 < argc) {
+            load_path = argv[++i];
+        } else if (strcmp(argv[i], "--emit-interface") == 0 && i + 1 < argc) {
+            interface_path = argv[++i];
+        } else if (strcmp(argv[i], "--import") == 0 && i + 1 < argc &&
+                   import_count < MAX_IMPORTS) {
+            imports[import_count++] = argv[++i];
+        } else if (strcmp(argv[i], "--emit-object") == 0) {
+            emit_object = true;
+            strcat(options, " --emit-object");
+        } else if (strcmp(argv[i], "-O") == 0) {
+            opt_passes = OPT_ALL;
+        } else if (strcmp(argv[i], "--opt-passes") == 0 && i + 1 < argc) {
+            opt_passes = parse_opt_passes(argv[++i]);
+            if (opt_passes == -1) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--opt-stats") == 0) {
+            opt_stats = true;
+        } else if (strcmp(argv[i], "--layout-profile") == 0 &&
+                   i + 1 < argc) {
+            layout_profile_path = argv[++i];
+        } else if (strcmp(argv[i], "--unroll-factor") == 0 && i + 1 < argc) {
+            opt_unroll_factor = atoi(argv[++i]);
+            if (opt_unroll_factor < 1) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--call-registers") == 0 &&
+                   i + 1 < argc) {
+            call_register_count = atoi(argv[++i]);
+            if (call_register_count < 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--lto") == 0) {
+            lto_passes = LTO_ALL;
+        } else if (strcmp(argv[i], "--lto-passes") == 0 && i + 1 < argc) {
+            lto_passes = parse_lto_passes(argv[++i]);
+            if (lto_passes == -1) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--lto-stats") == 0) {
+            lto_stats = true;
+        } else if (strcmp(argv[i], "--run") == 0) {
+            run = true;
+        } else if (strcmp(argv[i], "--emit-x86") == 0) {
+            emit_x86 = true;
+            strcat(options, " --emit-x86");
+        } else if (strcmp(argv[i], "--emit-c") == 0) {
+            emit_c_source = true;
+            strcat(options, " --emit-c");
+        } else if (strcmp(argv[i], "--link") == 0) {
+            link_index = i + 1;
+            break;
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (layout_profile_path != 0) {
+        FILE* file = fopen(layout_profile_path, "r");
+        if (file == 0) {
+            fprintf(stderr,
+                    "Cannot open branch profile %s\n",
+                    layout_profile_path);
+            return 1;
+        }
+        layout_profile = read_branch_profile(file);
+        fclose(file);
+        if (layout_profile == 0) {
+            return 1;
+        }
+    }
+
+    if (link_index != 0) {
+        return link_objects(argv + link_index, argc - link_index);
+    }
+
+    size_t used = strlen(options);
+    snprintf(options + used,
+             sizeof options - used,
+             " --opt-passes %d%s --unroll-factor %d --call-registers %d"
+             " --lto-passes %d",
+             opt_passes,
+             opt_stats ? " --opt-stats" : "",
+             opt_unroll_factor,
+             call_register_count,
+             lto_passes);
+
+    if (interface_path != 0) {
+        return emit_interface(interface_path);
+    }
+
+    if (emit_path != 0) {
+        return emit_ast(emit_path);
+    }
+
+    if (load_path != 0) {
+        return compile_ast(load_path, stdout);
+    }
+
+    /* Running the program, or simulating it for --lto-stats, depends on
+     * its input as well as the source, so the output is never cached. */
+    if ((run || lto_stats) && !cache_stats) {
+        return compile(stdout);
+    }
+
+    if (cache_dir == 0 || cache_dir[0] == '\0') {
+        if (cache_stats) {
+            usage(argv[0]);
+        }
+        return compile(stdout);
+    }
+
+    struct cache* cache = alloc_cache(
+        cache_dir, cache_size != 0 ? atol(cache_size) : CACHE_DEFAULT_SIZE);
+
+    add_import_keys(options, sizeof options);
+
+    int status;
+    if (cache_stats) {
+        print_cache_stats(cache, stdout);
+        status = 0;
+    } else {
+        status = compile_cached(cache, options);
+    }
+
+    free_cache(cache);
+    return status;
 }
@@ -0,0 +1,385 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include "../include/cache.h"
+
+#define CACHE_MAGIC "etapa6-cache 1\n"
+
+typedef unsigned __int128 uint128;
+
+struct cache_file {
+    char* path;
+    long size;
+    struct timespec mtime;
+};
+
+struct cache* alloc_cache(char* dir, long max_size) {
+    struct cache* cache = malloc(sizeof *cache);
+    cache->dir = strdup(dir);
+    cache->max_size = max_size;
+    mkdir(cache->dir, 0755);
+    return cache;
+}
+
+void free_cache(struct cache* cache) {
+    free(cache->dir);
+    free(cache);
+}
+
+static uint128 fnv1a(uint128 hash, const char* bytes, size_t size) {
+    const uint128 prime = ((uint128)1 << 88) | 0x13b;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        hash ^= (unsigned char)bytes[i];
+        hash *= prime;
+    }
+    return hash;
+}
+
+struct cache_key hash_key(const char* version,
+                          const char* options,
+                          const char* source,
+                          size_t size) {
+    uint128 hash =
+        ((uint128)0x6c62272e07bb0142ULL << 64) | 0x62b821756295c58dULL;
+    hash = fnv1a(hash, version, strlen(version) + 1);
+    hash = fnv1a(hash, options, strlen(options) + 1);
+    hash = fnv1a(hash, source, size);
+
+    struct cache_key key;
+    snprintf(key.hex,
+             sizeof key.hex,
+             "%016llx%016llx",
+             (unsigned long long)(hash >> 64),
+             (unsigned long long)hash);
+    return key;
+}
+
+static char* cache_path(struct cache* cache, const char* name) {
+    size_t size = strlen(cache->dir) + strlen(name) + 2;
+    char* path = malloc(size);
+    snprintf(path, size, "%s/%s", cache->dir, name);
+    return path;
+}
+
+static char* entry_path(struct cache* cache, struct cache_key key) {
+    char name[64];
+    snprintf(name, sizeof name, "%s.entry", key.hex);
+    return cache_path(cache, name);
+}
+
+static int lock_cache(struct cache* cache) {
+    char* path = cache_path(cache, "lock");
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    free(path);
+    if (fd != -1) {
+        flock(fd, LOCK_EX);
+    }
+    return fd;
+}
+
+static void unlock_cache(int fd) {
+    if (fd != -1) {
+        flock(fd, LOCK_UN);
+        close(fd);
+    }
+}
+
+static void read_counters(struct cache* cache, long* hits, long* misses) {
+    *hits = 0;
+    *misses = 0;
+
+    char* path = cache_path(cache, "stats");
+    FILE* file = fopen(path, "r");
+    free(path);
+    if (file != 0) {
+        if (fscanf(file, "hits %ld misses %ld", hits, misses) != 2) {
+            *hits = 0;
+            *misses = 0;
+        }
+        fclose(file);
+    }
+}
+
+static void count(struct cache* cache, bool hit) {
+    int fd = lock_cache(cache);
+
+    long hits, misses;
+    read_counters(cache, &hits, &misses);
+    if (hit) {
+        hits++;
+    } else {
+        misses++;
+    }
+
+    char* path = cache_path(cache, "stats");
+    FILE* file = fopen(path, "w");
+    free(path);
+    if (file != 0) {
+        fprintf(file, "hits %ld\nmisses %ld\n", hits, misses);
+        fclose(file);
+    }
+
+    unlock_cache(fd);
+}
+
+static char* read_file(FILE* file, size_t* size) {
+    size_t capacity = 4096;
+    char* buffer = malloc(capacity);
+    *size = 0;
+
+    size_t n;
+    while ((n = fread(buffer + *size, 1, capacity - *size - 1, file)) > 0) {
+        *size += n;
+        if (capacity - *size == 1) {
+            capacity *= 2;
+            buffer = realloc(buffer, capacity);
+        }
+    }
+
+    buffer[*size] = '\0';
+    return buffer;
+}
+
+static char* copy_bytes(const char* bytes, size_t size) {
+    char* copy = malloc(size + 1);
+    memcpy(copy, bytes, size);
+    copy[size] = '\0';
+    return copy;
+}
+
+bool cache_lookup(struct cache* cache,
+                  struct cache_key key,
+                  struct cache_entry* entry) {
+    char* path = entry_path(cache, key);
+    FILE* file = fopen(path, "rb");
+    if (file == 0) {
+        free(path);
+        count(cache, false);
+        return false;
+    }
+
+    size_t size;
+    char* buffer = read_file(file, &size);
+    fclose(file);
+
+    size_t magic = strlen(CACHE_MAGIC);
+    int header = 0;
+    bool valid = size > magic && memcmp(buffer, CACHE_MAGIC, magic) == 0 &&
+                 sscanf(buffer + magic,
+                        "status %d\ndiagnostics %zu\ncode %zu\n%n",
+                        &entry->status,
+                        &entry->diagnostics_size,
+                        &entry->code_size,
+                        &header) == 3 &&
+                 header > 0 &&
+                 magic + header + entry->diagnostics_size + entry->code_size ==
+                     size;
+
+    if (valid) {
+        char* data = buffer + magic + header;
+        entry->diagnostics = copy_bytes(data, entry->diagnostics_size);
+        entry->code =
+            copy_bytes(data + entry->diagnostics_size, entry->code_size);
+        utime(path, 0);
+    }
+
+    free(buffer);
+    free(path);
+    count(cache, valid);
+    return valid;
+}
+
+static int compare_files(const void* a, const void* b) {
+    const struct cache_file* x = a;
+    const struct cache_file* y = b;
+    if (x->mtime.tv_sec != y->mtime.tv_sec) {
+        return x->mtime.tv_sec < y->mtime.tv_sec ? -1 : 1;
+    }
+    if (x->mtime.tv_nsec != y->mtime.tv_nsec) {
+        return x->mtime.tv_nsec < y->mtime.tv_nsec ? -1 : 1;
+    }
+    return 0;
+}
+
+static struct cache_file* list_entries(struct cache* cache,
+                                       int* length,
+                                       long* total) {
+    int capacity = 16;
+    struct cache_file* files = malloc(capacity * sizeof *files);
+    *length = 0;
+    *total = 0;
+
+    DIR* dir = opendir(cache->dir);
+    if (dir == 0) {
+        return files;
+    }
+
+    struct dirent* dirent;
+    while ((dirent = readdir(dir)) != 0) {
+        size_t n = strlen(dirent->d_name);
+        if (n < 6 || strcmp(dirent->d_name + n - 6, ".entry") != 0) {
+            continue;
+        }
+
+        char* path = cache_path(cache, dirent->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0) {
+            free(path);
+            continue;
+        }
+
+        if (*length == capacity) {
+            capacity *= 2;
+            files = realloc(files, capacity * sizeof *files);
+        }
+
+        files[*length].path = path;
+        files[*length].size = st.st_size;
+        files[*length].mtime = st.st_mtim;
+        *total += st.st_size;
+        *length += 1;
+    }
+
+    closedir(dir);
+    return files;
+}
+
+static void free_entries(struct cache_file* files, int length) {
+    int i;
+    for (i = 0; i < length; i++) {
+        free(files[i].path);
+    }
+    free(files);
+}
+
+static void evict(struct cache* cache) {
+    int length;
+    long total;
+    struct cache_file* files = list_entries(cache, &length, &total);
+
+    qsort(files, length, sizeof *files, compare_files);
+
+    int i;
+    for (i = 0; i < length && total > cache->max_size; i++) {
+        if (unlink(files[i].path) == 0) {
+            total -= files[i].size;
+        }
+    }
+
+    free_entries(files, length);
+}
+
+bool cache_store(struct cache* cache,
+                 struct cache_key key,
+                 struct cache_entry* entry) {
+    char name[96];
+    snprintf(name, sizeof name, "%s.tmp.%ld", key.hex, (long)getpid());
+    char* temp = cache_path(cache, name);
+
+    FILE* file = fopen(temp, "wb");
+    if (file == 0) {
+        free(temp);
+        return false;
+    }
+
+    fprintf(file,
+            CACHE_MAGIC "status %d\ndiagnostics %zu\ncode %zu\n",
+            entry->status,
+            entry->diagnostics_size,
+            entry->code_size);
+    fwrite(entry->diagnostics, 1, entry->diagnostics_size, file);
+    fwrite(entry->code, 1, entry->code_size, file);
+
+    bool written = fflush(file) == 0 && ferror(file) == 0;
+    written = fclose(file) == 0 && written;
+
+    char* path = entry_path(cache, key);
+    if (!written || rename(temp, path) != 0) {
+        unlink(temp);
+        written = false;
+    }
+
+    if (written) {
+        int fd = lock_cache(cache);
+        evict(cache);
+        unlock_cache(fd);
+    }
+
+    free(path);
+    free(temp);
+    return written;
+}
+
+void free_cache_entry(struct cache_entry* entry) {
+    free(entry->diagnostics);
+    free(entry->code);
+    entry->diagnostics = 0;
+    entry->code = 0;
+}
+
+struct cache_stats get_cache_stats(struct cache* cache) {
+    struct cache_stats stats;
+    int fd = lock_cache(cache);
+
+    read_counters(cache, &stats.hits, &stats.misses);
+
+    int length;
+    struct cache_file* files = list_entries(cache, &length, &stats.size);
+    stats.entries = length;
+    free_entries(files, length);
+
+    unlock_cache(fd);
+    return stats;
+}
+
+void print_cache_stats(struct cache* cache, FILE* out) {
+    struct cache_stats stats = get_cache_stats(cache);
+    long lookups = stats.hits + stats.misses;
+
+    fprintf(out, "cache directory: %s\n", cache->dir);
+    fprintf(out, "hits: %ld\n", stats.hits);
+    fprintf(out, "misses: %ld\n", stats.misses);
+    fprintf(out,
+            "hit rate: %.1f%%\n",
+            lookups == 0 ? 0.0 : 100.0 * stats.hits / lookups);
+    fprintf(out, "entries: %ld\n", stats.entries);
+    fprintf(out, "size: %ld / %ld bytes\n", stats.size, cache->max_size);
+}
+
+struct capture begin_capture(FILE* stream) {
+    struct capture capture;
+    fflush(stream);
+    capture.file = tmpfile();
+    capture.saved_fd = -1;
+
+    if (capture.file != 0) {
+        capture.saved_fd = dup(fileno(stream));
+        dup2(fileno(capture.file), fileno(stream));
+    }
+
+    return capture;
+}
+
+char* end_capture(struct capture capture, FILE* stream, size_t* size) {
+    fflush(stream);
+
+    if (capture.file == 0) {
+        *size = 0;
+        return copy_bytes("", 0);
+    }
+
+    dup2(capture.saved_fd, fileno(stream));
+    close(capture.saved_fd);
+
+    rewind(capture.file);
+    char* buffer = read_file(capture.file, size);
+    fclose(capture.file);
+
+    return buffer;
+}
@@ -0,0 +1,374 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../include/cfg.h"
+
+static bool is_reg(struct operand* operand, int reg) {
+    return operand->type == OPERAND_REG && operand->val == reg;
+}
+
+bool is_call(struct operation* operation) {
+    return operation->opcode == JUMP_I &&
+           !is_local_label(operation->dst[0].name);
+}
+
+bool is_branch(struct operation* operation) {
+    return operation->opcode == CBR || operation->opcode == JUMP_I ||
+           operation->opcode == JUMP || operation->opcode == HALT;
+}
+
+static bool is_store(struct operation* operation) {
+    return operation->opcode == STORE || operation->opcode == STORE_AI ||
+           operation->opcode == STORE_AO;
+}
+
+int operation_uses(struct operation* operation, int* regs) {
+    int count = 0;
+    int j;
+    for (j = 0; j < 2; j++) {
+        if (operation->src[j].type == OPERAND_REG) {
+            regs[count++] = operation->src[j].val;
+        }
+    }
+
+    if (is_store(operation) || operation->opcode == JUMP) {
+        for (j = 0; j < 2; j++) {
+            if (operation->dst[j].type == OPERAND_REG) {
+                regs[count++] = operation->dst[j].val;
+            }
+        }
+    }
+
+    return count;
+}
+
+int operation_defines(struct operation* operation) {
+    if (is_store(operation) || is_branch(operation) ||
+        operation->dst[0].type != OPERAND_REG) {
+        return CFG_NO_REG;
+    }
+    return operation->dst[0].val;
+}
+
+int max_local_label(struct module* module) {
+    int max = -1;
+    int i;
+    for (i = 0; i < module->length; i++) {
+        struct operation* operation = &module->operations[i];
+        if (operation->opcode == LABEL &&
+            is_local_label(operation->src[0].name) &&
+            strchr(operation->src[0].name, '_') == 0) {
+            int n = atoi(operation->src[0].name + 1);
+            max = n > max ? n : max;
+        }
+    }
+    return max;
+}
+
+static bool is_return_jump(struct cfg* cfg, struct block* block) {
+    struct operation* jump = &cfg->module->operations[block->end - 1];
+    int i;
+    for (i = block->end - 2; i >= block->start; i--) {
+        struct operation* operation = &cfg->module->operations[i];
+        if (operation_defines(operation) == jump->dst[0].val) {
+            return operation->opcode == LOAD_AI &&
+                   (is_reg(&operation->src[0], ILOC_RFP) ||
+                    is_reg(&operation->src[0], ILOC_RSP)) &&
+                   operation->src[1].type == OPERAND_IMM &&
+                   operation->src[1].val == 0;
+        }
+    }
+    return false;
+}
+
+static bool is_return_address(struct cfg* cfg, int i) {
+    struct operation* ops = &cfg->module->operations[i];
+    return i + 1 < cfg->end && ops[1].opcode == STORE_AI &&
+           ops[1].src[0].type == OPERAND_REG &&
+           is_reg(&ops[0].dst[0], ops[1].src[0].val) &&
+           is_reg(&ops[1].dst[0], ILOC_RSP) &&
+           ops[1].dst[1].type == OPERAND_IMM && ops[1].dst[1].val == 0;
+}
+
+static void add_edge(struct cfg* cfg, int from, int to) {
+    struct block* a = &cfg->blocks[from];
+    struct block* b = &cfg->blocks[to];
+
+    int i;
+    for (i = 0; i < a->succ_count; i++) {
+        if (a->succs[i] == to) {
+            return;
+        }
+    }
+
+    a->succs = realloc(a->succs, (a->succ_count + 1) * sizeof *a->succs);
+    a->succs[a->succ_count++] = to;
+    b->preds = realloc(b->preds, (b->pred_count + 1) * sizeof *b->preds);
+    b->preds[b->pred_count++] = from;
+}
+
+static void add_label_edge(struct cfg* cfg,
+                           struct label_map* labels,
+                           int from,
+                           struct operand* label) {
+    int to = find_label(labels, label->name);
+    if (to != -1) {
+        add_edge(cfg, from, to);
+    }
+}
+
+static void link_blocks(struct cfg* cfg, struct label_map* labels) {
+    int* targets = malloc(cfg->count * sizeof *targets);
+    int target_count = 0;
+
+    int i;
+    for (i = cfg->start; i < cfg->end; i++) {
+        struct operation* operation = &cfg->module->operations[i];
+        if (operation->opcode == LOAD_I &&
+            operation->src[0].type == OPERAND_LABEL &&
+            !is_return_address(cfg, i)) {
+            int to = find_label(labels, operation->src[0].name);
+            if (to != -1) {
+                targets[target_count++] = to;
+            }
+        }
+    }
+
+    int b;
+    for (b = 0; b < cfg->count; b++) {
+        struct block* block = &cfg->blocks[b];
+        struct operation* last = &cfg->module->operations[block->end - 1];
+
+        if (last->opcode == CBR) {
+            add_label_edge(cfg, labels, b, &last->dst[0]);
+            add_label_edge(cfg, labels, b, &last->dst[1]);
+        } else if (last->opcode == JUMP_I && !is_call(last)) {
+            add_label_edge(cfg, labels, b, &last->dst[0]);
+        } else if (last->opcode == JUMP) {
+            if (!is_return_jump(cfg, block)) {
+                for (i = 0; i < target_count; i++) {
+                    add_edge(cfg, b, targets[i]);
+                }
+            }
+        } else if (last->opcode != HALT && b + 1 < cfg->count) {
+            add_edge(cfg, b, b + 1);
+        }
+    }
+
+    free(targets);
+}
+
+static void visit(struct cfg* cfg, int b, bool* seen, int* post, int* count) {
+    seen[b] = true;
+    int i;
+    for (i = 0; i < cfg->blocks[b].succ_count; i++) {
+        if (!seen[cfg->blocks[b].succs[i]]) {
+            visit(cfg, cfg->blocks[b].succs[i], seen, post, count);
+        }
+    }
+    post[(*count)++] = b;
+}
+
+static int intersect(struct cfg* cfg, int* rpo, int a, int b) {
+    while (a != b) {
+        while (rpo[a] > rpo[b]) {
+            a = cfg->blocks[a].idom;
+        }
+        while (rpo[b] > rpo[a]) {
+            b = cfg->blocks[b].idom;
+        }
+    }
+    return a;
+}
+
+static void compute_dominators(struct cfg* cfg) {
+    bool* seen = calloc(cfg->count, sizeof *seen);
+    int* post = malloc(cfg->count * sizeof *post);
+    int* rpo = malloc(cfg->count * sizeof *rpo);
+    int count = 0;
+    visit(cfg, 0, seen, post, &count);
+
+    cfg->order = malloc(count * sizeof *cfg->order);
+    cfg->order_count = count;
+    int i;
+    for (i = 0; i < count; i++) {
+        cfg->order[i] = post[count - 1 - i];
+        rpo[cfg->order[i]] = i;
+    }
+
+    cfg->blocks[0].idom = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (i = 1; i < count; i++) {
+            struct block* block = &cfg->blocks[cfg->order[i]];
+            int idom = -1;
+            int p;
+            for (p = 0; p < block->pred_count; p++) {
+                int pred = block->preds[p];
+                if (cfg->blocks[pred].idom == -1) {
+                    continue;
+                }
+                idom = idom == -1 ? pred : intersect(cfg, rpo, pred, idom);
+            }
+            if (idom != block->idom) {
+                block->idom = idom;
+                changed = true;
+            }
+        }
+    }
+
+    free(seen);
+    free(post);
+    free(rpo);
+}
+
+struct cfg* build_cfg(struct module* module, int start, int end) {
+    struct cfg* cfg = malloc(sizeof *cfg);
+    cfg->module = module;
+    cfg->start = start;
+    cfg->end = end;
+    cfg->blocks = malloc((end - start) * sizeof *cfg->blocks);
+    cfg->count = 0;
+
+    cfg->frame = ILOC_RSP;
+
+    struct label_map* labels = alloc_label_map();
+    int i, j;
+    for (i = start; i < end; i++) {
+        struct operation* operation = &module->operations[i];
+        for (j = 0; j < 2; j++) {
+            if (is_reg(&operation->src[j], ILOC_RFP) ||
+                is_reg(&operation->dst[j], ILOC_RFP)) {
+                cfg->frame = ILOC_RFP;
+            }
+        }
+
+        bool leader = i == start || operation->opcode == LABEL ||
+                      is_branch(&module->operations[i - 1]);
+
+        if (leader && (cfg->count == 0 ||
+                       cfg->blocks[cfg->count - 1].start != i)) {
+            struct block* block = &cfg->blocks[cfg->count++];
+            memset(block, 0, sizeof *block);
+            block->start = i;
+            block->idom = -1;
+        }
+        cfg->blocks[cfg->count - 1].end = i + 1;
+
+        if (operation->opcode == LABEL) {
+            add_label(labels, operation->src[0].name, cfg->count - 1);
+        }
+    }
+
+    link_blocks(cfg, labels);
+    free_label_map(labels);
+    compute_dominators(cfg);
+    return cfg;
+}
+
+void free_cfg(struct cfg* cfg) {
+    int i;
+    for (i = 0; i < cfg->count; i++) {
+        free(cfg->blocks[i].succs);
+        free(cfg->blocks[i].preds);
+    }
+    free(cfg->blocks);
+    free(cfg->order);
+    free(cfg);
+}
+
+bool dominates(struct cfg* cfg, int a, int b) {
+    if (cfg->blocks[b].idom == -1) {
+        return false;
+    }
+
+    while (b != a && b != 0) {
+        b = cfg->blocks[b].idom;
+    }
+    return b == a;
+}
+
+static void grow_loop(struct cfg* cfg, struct loop* loop, int latch) {
+    int* stack = malloc(cfg->count * sizeof *stack);
+    int top = 0;
+
+    if (!loop->body[latch]) {
+        loop->body[latch] = true;
+        stack[top++] = latch;
+    }
+
+    while (top > 0) {
+        struct block* block = &cfg->blocks[stack[--top]];
+        int p;
+        for (p = 0; p < block->pred_count; p++) {
+            int pred = block->preds[p];
+            if (!loop->body[pred] && cfg->blocks[pred].idom != -1) {
+                loop->body[pred] = true;
+                stack[top++] = pred;
+            }
+        }
+    }
+
+    free(stack);
+}
+
+static int compare_loops(const void* a, const void* b) {
+    return ((const struct loop*)a)->size - ((const struct loop*)b)->size;
+}
+
+int find_loops(struct cfg* cfg, struct loop** loops) {
+    int count = 0;
+    *loops = 0;
+
+    int b, s;
+    for (b = 0; b < cfg->count; b++) {
+        struct block* block = &cfg->blocks[b];
+        for (s = 0; s < block->succ_count; s++) {
+            int header = block->succs[s];
+            if (!dominates(cfg, header, b)) {
+                continue;
+            }
+
+            int i;
+            for (i = 0; i < count && (*loops)[i].header != header; i++) {
+            }
+            if (i == count) {
+                *loops = realloc(*loops, (count + 1) * sizeof **loops);
+                (*loops)[count].header = header;
+                (*loops)[count].body = calloc(cfg->count, sizeof(bool));
+                (*loops)[count].body[header] = true;
+                count++;
+            }
+            grow_loop(cfg, &(*loops)[i], b);
+        }
+    }
+
+    int i, j;
+    for (i = 0; i < count; i++) {
+        struct loop* loop = &(*loops)[i];
+        loop->size = 0;
+        loop->has_call = false;
+        for (b = 0; b < cfg->count; b++) {
+            if (!loop->body[b]) {
+                continue;
+            }
+            loop->size++;
+            for (j = cfg->blocks[b].start; j < cfg->blocks[b].end; j++) {
+                if (is_call(&cfg->module->operations[j])) {
+                    loop->has_call = true;
+                }
+            }
+        }
+    }
+
+    qsort(*loops, count, sizeof **loops, compare_loops);
+    return count;
+}
+
+void free_loops(struct loop* loops, int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        free(loops[i].body);
+    }
+    free(loops);
+}
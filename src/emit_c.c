@@ -0,0 +1,798 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/emit_c.h"
+#include "../include/parser.tab.h"
+
+#define PREFIX "e6_"
+
+struct emitter {
+    FILE* out;
+    struct table* table;
+    int indent;
+    int temporaries;
+    struct node* dot;
+    bool valid;
+};
+
+static const char* prelude =
+    "#include <math.h>\n"
+    "#include <stdbool.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "\n"
+    "static inline int e6_div(int a, int b) {\n"
+    "    if (b == 0) {\n"
+    "        exit(73);\n"
+    "    }\n"
+    "    return b == -1 ? (int)(0u - (unsigned)a) : a / b;\n"
+    "}\n"
+    "\n"
+    "static inline int e6_mod(int a, int b) {\n"
+    "    if (b == 0) {\n"
+    "        exit(73);\n"
+    "    }\n"
+    "    return b == -1 ? 0 : a % b;\n"
+    "}\n"
+    "\n"
+    "static inline int e6_pow(int base, int exponent) {\n"
+    "    unsigned result = 1;\n"
+    "    while (exponent-- > 0) {\n"
+    "        result *= (unsigned)base;\n"
+    "    }\n"
+    "    return (int)result;\n"
+    "}\n";
+
+static void unsupported(struct emitter* e, const char* what) {
+    fprintf(stderr, "Cannot emit %s as C\n", what);
+    e->valid = false;
+}
+
+static void print_indent(struct emitter* e) {
+    int i;
+    for (i = 0; i < e->indent; i++) {
+        fprintf(e->out, "    ");
+    }
+}
+
+static bool is_primitive(struct type type, int primitive) {
+    return type.key == PRIMITIVE && type.val.primitive == primitive;
+}
+
+static struct type type_of(struct emitter* e, struct node* exp) {
+    return analyze_node(exp, e->table).type;
+}
+
+static bool is_symbol(struct emitter* e, char* id) {
+    struct symbol* symbol = e->table->head;
+    while (symbol != 0) {
+        if (strcmp(symbol->id, id) == 0) {
+            return true;
+        }
+        symbol = symbol->next;
+    }
+    return false;
+}
+
+static void print_type(struct emitter* e, struct type type) {
+    if (type.key == CUSTOM) {
+        fprintf(e->out, "struct " PREFIX "%s", type.val.custom);
+        return;
+    }
+
+    switch (type.val.primitive) {
+        case INT:
+            fprintf(e->out, "int");
+            break;
+        case FLOAT:
+            fprintf(e->out, "float");
+            break;
+        case BOOL:
+            fprintf(e->out, "bool");
+            break;
+        case CHAR:
+            fprintf(e->out, "char");
+            break;
+        case STRING:
+            fprintf(e->out, "const char*");
+            break;
+    }
+}
+
+static void print_zero(struct emitter* e, struct type type) {
+    if (type.key == CUSTOM) {
+        fprintf(e->out, "{0}");
+    } else if (type.val.primitive == STRING) {
+        fprintf(e->out, "\"\"");
+    } else {
+        fprintf(e->out, "0");
+    }
+}
+
+static void print_char(FILE* out, char c) {
+    if (isprint((unsigned char)c) && c != '"' && c != '\\' && c != '\'') {
+        fputc(c, out);
+    } else {
+        fprintf(out, "\\%03o", (unsigned char)c);
+    }
+}
+
+static void emit_literal(struct emitter* e, struct token token) {
+    char* c;
+    switch (token.type) {
+        case INT:
+            fprintf(e->out, "%d", token.val.int_v);
+            break;
+        case FLOAT:
+            fprintf(e->out, "((float)%.9g)", token.val.float_v);
+            break;
+        case CHAR:
+            fprintf(e->out, "'");
+            print_char(e->out, token.val.char_v);
+            fprintf(e->out, "'");
+            break;
+        case STRING:
+            fprintf(e->out, "\"");
+            for (c = token.val.string_v; *c != '\0'; c++) {
+                print_char(e->out, *c);
+            }
+            fprintf(e->out, "\"");
+            break;
+        case BOOL:
+            fprintf(e->out, token.val.bool_v ? "true" : "false");
+            break;
+    }
+}
+
+static const char* binary_operator(int op) {
+    switch (op) {
+        case OR_OP:
+            return "||";
+        case AND_OP:
+            return "&&";
+        case EQ_OP:
+            return "==";
+        case NE_OP:
+            return "!=";
+        case LE_OP:
+            return "<=";
+        case GE_OP:
+            return ">=";
+        case '+':
+            return "+";
+        case '-':
+            return "-";
+        case '*':
+            return "*";
+        case '/':
+            return "/";
+        case '<':
+            return "<";
+        case '>':
+            return ">";
+        case '&':
+            return "&";
+        case '|':
+            return "|";
+    }
+    return 0;
+}
+
+static void emit_exp(struct emitter* e, struct node* node);
+
+static void emit_piped(struct emitter* e,
+                       struct node* value,
+                       struct node* exp) {
+    struct node* dot = e->dot;
+    e->dot = value;
+    emit_exp(e, exp);
+    e->dot = dot;
+}
+
+static void emit_binary(struct emitter* e, struct binary_exp binary_exp) {
+    if (binary_exp.op == FORWARD_PIPE || binary_exp.op == BASH_PIPE) {
+        emit_piped(e, binary_exp.left, binary_exp.right);
+        return;
+    }
+
+    bool is_float =
+        is_primitive(type_of(e, binary_exp.left), FLOAT) ||
+        is_primitive(type_of(e, binary_exp.right), FLOAT);
+    const char* function = 0;
+    if (binary_exp.op == '/' && !is_float) {
+        function = PREFIX "div";
+    } else if (binary_exp.op == '%') {
+        function = is_float ? "fmodf" : PREFIX "mod";
+    } else if (binary_exp.op == '^') {
+        function = is_float ? "powf" : PREFIX "pow";
+    }
+
+    if (function != 0) {
+        fprintf(e->out, "%s(", function);
+        emit_exp(e, binary_exp.left);
+        fprintf(e->out, ", ");
+        emit_exp(e, binary_exp.right);
+        fprintf(e->out, ")");
+        return;
+    }
+
+    const char* op = binary_operator(binary_exp.op);
+    if (op == 0) {
+        unsupported(e, "binary operator");
+        return;
+    }
+
+    fprintf(e->out, "(");
+    emit_exp(e, binary_exp.left);
+    fprintf(e->out, " %s ", op);
+    emit_exp(e, binary_exp.right);
+    fprintf(e->out, ")");
+}
+
+static void emit_var(struct emitter* e, struct var var) {
+    fprintf(e->out, PREFIX "%s", var.token.val.string_v);
+    if (var.array_access != 0) {
+        fprintf(e->out, "[");
+        emit_exp(e, var.array_access);
+        fprintf(e->out, "]");
+    }
+    if (var.field_access != 0) {
+        fprintf(e->out, "." PREFIX "%s", var.field_access);
+    }
+}
+
+static void emit_call(struct emitter* e, struct function_cmd function_cmd) {
+    fprintf(e->out, PREFIX "%s(", function_cmd.token.val.string_v);
+
+    struct node* arg = function_cmd.arg_list;
+    while (arg != 0) {
+        emit_exp(e, arg->val.arg_list.arg);
+        arg = arg->val.arg_list.next;
+        if (arg != 0) {
+            fprintf(e->out, ", ");
+        }
+    }
+
+    fprintf(e->out, ")");
+}
+
+static void emit_exp(struct emitter* e, struct node* node) {
+    switch (node->type) {
+        case N_LITERAL:
+            emit_literal(e, node->val.token);
+            break;
+        case N_UNARY_EXP:
+            if (strchr("+-!", node->val.unary_exp.op) == 0) {
+                unsupported(e, "unary operator");
+                break;
+            }
+            fprintf(e->out, "(%c", node->val.unary_exp.op);
+            emit_exp(e, node->val.unary_exp.operand);
+            fprintf(e->out, ")");
+            break;
+        case N_BINARY_EXP:
+            emit_binary(e, node->val.binary_exp);
+            break;
+        case N_TERNARY_EXP:
+            fprintf(e->out, "(");
+            emit_exp(e, node->val.ternary_exp.condition);
+            fprintf(e->out, " ? ");
+            emit_exp(e, node->val.ternary_exp.exp1);
+            fprintf(e->out, " : ");
+            emit_exp(e, node->val.ternary_exp.exp2);
+            fprintf(e->out, ")");
+            break;
+        case N_DOT_ARG:
+            if (e->dot == 0) {
+                unsupported(e, "'.' outside a pipe");
+                break;
+            }
+            emit_exp(e, e->dot);
+            break;
+        case N_FUNCTION:
+            emit_call(e, node->val.function_cmd);
+            break;
+        case N_PIPE:
+            emit_piped(e,
+                       node->val.pipe_cmd.pipe_cmd,
+                       node->val.pipe_cmd.function_cmd);
+            break;
+        case N_VAR:
+            emit_var(e, node->val.var);
+            break;
+        default:
+            unsupported(e, "expression");
+            break;
+    }
+}
+
+static void emit_cmd(struct emitter* e, struct node* node);
+
+static void emit_block(struct emitter* e, struct node* node) {
+    fprintf(e->out, "{\n");
+    e->indent++;
+    if (node != 0) {
+        emit_cmd(e, node->val.cmd_block.high_list);
+    }
+    e->indent--;
+    print_indent(e);
+    fprintf(e->out, "}");
+}
+
+/* Update commands of a for loop are emitted as a comma expression. */
+static void emit_update(struct emitter* e, struct node* node) {
+    switch (node->type) {
+        case N_CMD_LIST:
+            emit_update(e, node->val.cmd_list.cmd_list);
+            fprintf(e->out, ", ");
+            emit_update(e, node->val.cmd_list.cmd);
+            break;
+        case N_ATTRIBUTION:
+            emit_exp(e, node->val.attr_cmd.var);
+            fprintf(e->out, " = ");
+            emit_exp(e, node->val.attr_cmd.exp);
+            break;
+        case N_SHIFT:
+            emit_exp(e, node->val.shift_cmd.var);
+            fprintf(e->out,
+                    node->val.shift_cmd.shift_op == SL_OP ? " <<= " : " >>= ");
+            emit_exp(e, node->val.shift_cmd.exp);
+            break;
+        case N_FUNCTION:
+        case N_PIPE:
+            emit_exp(e, node);
+            break;
+        default:
+            unsupported(e, "for loop update");
+            break;
+    }
+}
+
+static void emit_output(struct emitter* e, struct node* exp) {
+    struct type type = type_of(e, exp);
+    const char* format = "%d";
+    if (type.key == CUSTOM) {
+        unsupported(e, "output of a class value");
+        return;
+    } else if (type.val.primitive == FLOAT) {
+        format = "%g";
+    } else if (type.val.primitive == CHAR) {
+        format = "%c";
+    } else if (type.val.primitive == STRING) {
+        format = "%s";
+    }
+
+    print_indent(e);
+    fprintf(e->out, "printf(\"%s\\n\", ", format);
+    emit_exp(e, exp);
+    fprintf(e->out, ");\n");
+}
+
+static void emit_input(struct emitter* e, struct node* exp) {
+    struct type type = type_of(e, exp);
+    if (exp->type != N_VAR || type.key == CUSTOM ||
+        type.val.primitive == STRING) {
+        unsupported(e, "input command");
+        return;
+    }
+
+    const char* format = "%d";
+    const char* temporary = "int";
+    if (type.val.primitive == FLOAT) {
+        format = "%f";
+        temporary = "float";
+    } else if (type.val.primitive == CHAR) {
+        format = " %c";
+        temporary = "char";
+    }
+
+    print_indent(e);
+    fprintf(e->out,
+            "{ %s t; if (scanf(\"%s\", &t) == 1) { ",
+            temporary,
+            format);
+    emit_exp(e, exp);
+    fprintf(e->out, " = t; } }\n");
+}
+
+static void emit_foreach(struct emitter* e, struct foreach_cmd foreach) {
+    int count = 0;
+    struct node* item;
+    for (item = foreach.exp_list; item != 0;
+         item = item->val.exp_list.exp_list) {
+        count++;
+    }
+
+    int index = e->temporaries++;
+    print_indent(e);
+    fprintf(e->out, "{\n");
+    e->indent++;
+    if (!is_symbol(e, foreach.item)) {
+        print_indent(e);
+        print_type(e, type_of(e, foreach.exp_list->val.exp_list.exp));
+        fprintf(e->out, " " PREFIX "%s;\n", foreach.item);
+    }
+
+    print_indent(e);
+    fprintf(e->out,
+            "for (int i%d = 0; i%d < %d; i%d++) {\n",
+            index,
+            index,
+            count,
+            index);
+    e->indent++;
+    print_indent(e);
+    fprintf(e->out, "switch (i%d) {\n", index);
+
+    int i = 0;
+    for (item = foreach.exp_list; item != 0;
+         item = item->val.exp_list.exp_list) {
+        print_indent(e);
+        fprintf(e->out, "    case %d: " PREFIX "%s = ", i++, foreach.item);
+        emit_exp(e, item->val.exp_list.exp);
+        fprintf(e->out, "; break;\n");
+    }
+
+    print_indent(e);
+    fprintf(e->out, "}\n");
+    print_indent(e);
+    emit_block(e, foreach.cmd_block);
+    fprintf(e->out, "\n");
+    e->indent--;
+    print_indent(e);
+    fprintf(e->out, "}\n");
+    e->indent--;
+    print_indent(e);
+    fprintf(e->out, "}\n");
+}
+
+static void emit_cmd(struct emitter* e, struct node* node) {
+    if (node == 0) {
+        return;
+    }
+
+    switch (node->type) {
+        case N_HIGH_LIST:
+            emit_cmd(e, node->val.high_list.high_list);
+            emit_cmd(e, node->val.high_list.cmd);
+            break;
+        case N_CMD_LIST:
+            emit_cmd(e, node->val.cmd_list.cmd_list);
+            emit_cmd(e, node->val.cmd_list.cmd);
+            break;
+        case N_CMD_BLOCK:
+            print_indent(e);
+            emit_block(e, node);
+            fprintf(e->out, "\n");
+            break;
+        case N_LOCAL_VAR_DECL:
+            if (node->val.local_var_decl.init != 0 &&
+                !(node->val.local_var_decl.is_static &&
+                  node->val.local_var_decl.init->type == N_LITERAL)) {
+                print_indent(e);
+                fprintf(e->out,
+                        PREFIX "%s = ",
+                        node->val.local_var_decl.token.val.string_v);
+                emit_exp(e, node->val.local_var_decl.init);
+                fprintf(e->out, ";\n");
+            }
+            break;
+        case N_ATTRIBUTION:
+        case N_SHIFT:
+        case N_FUNCTION:
+        case N_PIPE:
+            print_indent(e);
+            emit_update(e, node);
+            fprintf(e->out, ";\n");
+            break;
+        case N_RETURN:
+            print_indent(e);
+            fprintf(e->out, "return ");
+            emit_exp(e, node->val.return_cmd.exp);
+            fprintf(e->out, ";\n");
+            break;
+        case N_BREAK:
+            print_indent(e);
+            fprintf(e->out, "break;\n");
+            break;
+        case N_CONTINUE:
+            print_indent(e);
+            fprintf(e->out, "continue;\n");
+            break;
+        case N_CASE:
+            print_indent(e);
+            fprintf(e->out, "case %d:;\n", node->val.case_label.case_val);
+            break;
+        case N_INPUT:
+            emit_input(e, node->val.in_cmd.exp);
+            break;
+        case N_OUTPUT: {
+            struct node* exp = node->val.out_cmd.exp_list;
+            for (; exp != 0; exp = exp->val.exp_list.exp_list) {
+                emit_output(e, exp->val.exp_list.exp);
+            }
+            break;
+        }
+        case N_IF:
+            print_indent(e);
+            fprintf(e->out, "if (");
+            emit_exp(e, node->val.if_cmd.condition);
+            fprintf(e->out, ") ");
+            emit_block(e, node->val.if_cmd.then_cmd_block);
+            if (node->val.if_cmd.else_cmd_block != 0) {
+                fprintf(e->out, " else ");
+                emit_block(e, node->val.if_cmd.else_cmd_block);
+            }
+            fprintf(e->out, "\n");
+            break;
+        case N_WHILE:
+            print_indent(e);
+            fprintf(e->out, "while (");
+            emit_exp(e, node->val.while_cmd.condition);
+            fprintf(e->out, ") ");
+            emit_block(e, node->val.while_cmd.cmd_block);
+            fprintf(e->out, "\n");
+            break;
+        case N_DO_WHILE:
+            print_indent(e);
+            fprintf(e->out, "do ");
+            emit_block(e, node->val.do_while_cmd.cmd_block);
+            fprintf(e->out, " while (");
+            emit_exp(e, node->val.do_while_cmd.condition);
+            fprintf(e->out, ");\n");
+            break;
+        case N_FOR:
+            emit_cmd(e, node->val.for_cmd.initialization);
+            print_indent(e);
+            fprintf(e->out, "for (; ");
+            emit_exp(e, node->val.for_cmd.condition);
+            fprintf(e->out, "; ");
+            emit_update(e, node->val.for_cmd.update);
+            fprintf(e->out, ") ");
+            emit_block(e, node->val.for_cmd.cmd_block);
+            fprintf(e->out, "\n");
+            break;
+        case N_FOREACH:
+            emit_foreach(e, node->val.foreach_cmd);
+            break;
+        case N_SWITCH:
+            print_indent(e);
+            fprintf(e->out, "switch (");
+            emit_exp(e, node->val.switch_cmd.control_exp);
+            fprintf(e->out, ") ");
+            emit_block(e, node->val.switch_cmd.cmd_block);
+            fprintf(e->out, "\n");
+            break;
+        default:
+            unsupported(e, "command");
+            break;
+    }
+}
+
+/* Locals are function-scoped in the source language, so they are all
+   declared at the top of the C function. */
+static void declare_locals(struct emitter* e, struct node* node) {
+    if (node == 0) {
+        return;
+    }
+
+    switch (node->type) {
+        case N_HIGH_LIST:
+            declare_locals(e, node->val.high_list.high_list);
+            declare_locals(e, node->val.high_list.cmd);
+            break;
+        case N_CMD_LIST:
+            declare_locals(e, node->val.cmd_list.cmd_list);
+            declare_locals(e, node->val.cmd_list.cmd);
+            break;
+        case N_CMD_BLOCK:
+            declare_locals(e, node->val.cmd_block.high_list);
+            break;
+        case N_IF:
+            declare_locals(e, node->val.if_cmd.then_cmd_block);
+            declare_locals(e, node->val.if_cmd.else_cmd_block);
+            break;
+        case N_WHILE:
+            declare_locals(e, node->val.while_cmd.cmd_block);
+            break;
+        case N_DO_WHILE:
+            declare_locals(e, node->val.do_while_cmd.cmd_block);
+            break;
+        case N_FOR:
+            declare_locals(e, node->val.for_cmd.initialization);
+            declare_locals(e, node->val.for_cmd.update);
+            declare_locals(e, node->val.for_cmd.cmd_block);
+            break;
+        case N_FOREACH:
+            declare_locals(e, node->val.foreach_cmd.cmd_block);
+            break;
+        case N_SWITCH:
+            declare_locals(e, node->val.switch_cmd.cmd_block);
+            break;
+        case N_LOCAL_VAR_DECL: {
+            struct local_var_decl decl = node->val.local_var_decl;
+            declare_local_var(decl, e->table);
+
+            print_indent(e);
+            if (decl.is_static) {
+                fprintf(e->out, "static ");
+            }
+            print_type(e, decl.type);
+            fprintf(e->out, " " PREFIX "%s = ", decl.token.val.string_v);
+            if (decl.is_static && decl.init != 0 &&
+                decl.init->type == N_LITERAL) {
+                emit_literal(e, decl.init->val.token);
+            } else {
+                print_zero(e, decl.type);
+            }
+            fprintf(e->out, ";\n");
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void emit_prototype(struct emitter* e, struct function_def function) {
+    if (function.is_static) {
+        fprintf(e->out, "static ");
+    }
+    print_type(e, function.type);
+    fprintf(e->out, " " PREFIX "%s(", function.token.val.string_v);
+
+    struct node* param = function.params;
+    if (param == 0) {
+        fprintf(e->out, "void");
+    }
+    while (param != 0) {
+        if (param->val.parameter.is_const) {
+            fprintf(e->out, "const ");
+        }
+        print_type(e, param->val.parameter.type);
+        fprintf(e->out,
+                " " PREFIX "%s",
+                param->val.parameter.token.val.string_v);
+        param = param->val.parameter.next;
+        if (param != 0) {
+            fprintf(e->out, ", ");
+        }
+    }
+
+    fprintf(e->out, ")");
+}
+
+static void emit_function(struct emitter* e, struct function_def function) {
+    define_function(function, e->table);
+
+    emit_prototype(e, function);
+    fprintf(e->out, " {\n");
+    e->indent++;
+    declare_locals(e, function.cmd_block);
+    emit_cmd(e, function.cmd_block->val.cmd_block.high_list);
+
+    print_indent(e);
+    if (function.type.key == CUSTOM) {
+        fprintf(e->out, "return (");
+        print_type(e, function.type);
+        fprintf(e->out, "){0};\n");
+    } else {
+        fprintf(e->out, "return ");
+        print_zero(e, function.type);
+        fprintf(e->out, ";\n");
+    }
+    e->indent--;
+    fprintf(e->out, "}\n\n");
+
+    pop_context(e->table);
+}
+
+static void emit_class(struct emitter* e, struct class_def class_def) {
+    define_class(class_def, e->table);
+
+    fprintf(e->out, "struct " PREFIX "%s {\n", class_def.token.val.string_v);
+    struct node* field;
+    for (field = class_def.field_list; field != 0;
+         field = field->val.field.next) {
+        fprintf(e->out, "    ");
+        print_type(e, field->val.field.type);
+        fprintf(e->out,
+                " " PREFIX "%s;\n",
+                field->val.field.token.val.string_v);
+    }
+    fprintf(e->out, "};\n\n");
+}
+
+static void emit_global(struct emitter* e, struct global_var_decl global) {
+    declare_global_var(global, e->table);
+
+    if (global.is_static) {
+        fprintf(e->out, "static ");
+    }
+    print_type(e, global.type);
+    fprintf(e->out, " " PREFIX "%s", global.token.val.string_v);
+    if (global.size >= 0) {
+        fprintf(e->out, "[%d]", global.size);
+    }
+    fprintf(e->out, ";\n\n");
+}
+
+/* Classes and prototypes go first so that definitions can appear in
+   source order. */
+static void emit_declarations(struct emitter* e, struct node* node) {
+    if (node == 0) {
+        return;
+    }
+
+    if (node->type == N_UNIT) {
+        emit_declarations(e, node->val.unit.unit);
+        emit_declarations(e, node->val.unit.element);
+    } else if (node->type == N_CLASS_DEF) {
+        emit_class(e, node->val.class_def);
+    } else if (node->type == N_FUNCTION_DEF) {
+        emit_prototype(e, node->val.function_def);
+        fprintf(e->out, ";\n\n");
+    }
+}
+
+static void emit_definitions(struct emitter* e, struct node* node) {
+    if (node == 0) {
+        return;
+    }
+
+    if (node->type == N_UNIT) {
+        emit_definitions(e, node->val.unit.unit);
+        emit_definitions(e, node->val.unit.element);
+    } else if (node->type == N_GLOBAL_VAR_DECL) {
+        emit_global(e, node->val.global_var_decl);
+    } else if (node->type == N_FUNCTION_DEF) {
+        emit_function(e, node->val.function_def);
+    }
+}
+
+static struct node* find_main(struct node* node) {
+    if (node == 0) {
+        return 0;
+    }
+
+    if (node->type == N_UNIT) {
+        struct node* main = find_main(node->val.unit.element);
+        return main != 0 ? main : find_main(node->val.unit.unit);
+    }
+
+    if (node->type == N_FUNCTION_DEF &&
+        strcmp(node->val.function_def.token.val.string_v, "main") == 0) {
+        return node;
+    }
+    return 0;
+}
+
+bool emit_c(FILE* out, struct node* node) {
+    struct emitter e;
+    e.out = out;
+    e.table = alloc_table();
+    e.indent = 0;
+    e.temporaries = 0;
+    e.dot = 0;
+    e.valid = true;
+
+    fprintf(out, "/* Generated by etapa6; compile with -fwrapv -lm. */\n");
+    fprintf(out, "%s\n", prelude);
+    emit_declarations(&e, node);
+    emit_definitions(&e, node);
+
+    struct node* main = find_main(node);
+    if (main != 0) {
+        fprintf(out, "int main(void) {\n");
+        if (main->val.function_def.type.key == CUSTOM) {
+            fprintf(out, "    " PREFIX "main();\n");
+            fprintf(out, "    printf(\"0\\n\");\n");
+        } else {
+            fprintf(out, "    printf(\"%%d\\n\", (int)" PREFIX "main());\n");
+        }
+        fprintf(out, "    return 0;\n");
+        fprintf(out, "}\n");
+    }
+
+    free_table(e.table);
+    return e.valid;
+}
@@ -1,14 +1,127 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "../include/generate.h"
 #include "../include/parser.tab.h"
 
-static int global_offset = 0;
+#define LINEAR_CASES 4
+#define TABLE_CASES 16
+#define TABLE_DENSITY 2
+#define UNROLL_BUDGET 128
+#define INLINE_SINGLE_SITE_SIZE 256
+#define INLINE_MAX_DEPTH 4
+#define CALL_NEED (1 << 16)
+#define SELECT_ARM_SIZE 8
+#define CALL_SIZE 10
+
+struct switch_case {
+    int val;
+    char* label;
+    struct node* node;
+};
+
+struct switch_cases {
+    struct switch_case* cases;
+    int count;
+    int capacity;
+};
+
+struct inline_function {
+    char* name;
+    struct function_def* def;
+    struct address* scope;
+    bool generated;
+    int size;
+    int sites;
+    bool* calls;
+    bool recursive;
+};
+
+struct inline_functions {
+    struct inline_function* functions;
+    int count;
+    int capacity;
+};
+
+struct lifetime {
+    char* id;
+    int start;
+    int end;
+    int offset;
+};
+
+struct lifetimes {
+    struct lifetime* items;
+    int count;
+    int capacity;
+};
+
+enum nonterminal { NT_REG, NT_IMM, NT_COUNT };
+
+enum rule_form {
+    FORM_LOAD_I,
+    FORM_FOLD,
+    FORM_REG_REG,
+    FORM_REG_IMM,
+    FORM_IMM_REG,
+    FORM_IDENTITY,
+    FORM_SHIFT_DIVISION
+};
+
+struct rule {
+    enum nonterminal result;
+    int op;
+    enum nonterminal left;
+    enum nonterminal right;
+    enum rule_form form;
+    int opcode;
+    int cost;
+    bool (*applies)(int val);
+    int (*encode)(int val);
+};
+
+struct label {
+    int cost[NT_COUNT];
+    const struct rule* rule[NT_COUNT];
+    int val;
+    int need;
+};
+
 static int local_offset = 0;
+static int frame_size = 0;
+static struct lifetimes slots = {0, 0, 0};
 static int register_offset = 0;
+/* Values held while their sibling operands or later arguments are
+ * generated. No other value stays in a register from one statement to
+ * the next, so a call saves the register parameters and the pending
+ * registers and nothing else. */
+static int* pending = 0;
+static int pending_count = 0;
+static int pending_capacity = 0;
 static int label_offset = 0;
-static int ins = 0;
+static bool in_main = false;
+static char* current_function = 0;
+static char* l_break = 0;
+static char* l_continue = 0;
+static struct switch_cases* current_cases = 0;
+static struct address* imported_globals = 0;
+static struct inline_functions inline_functions = {0, 0, 0};
+static int inline_depth = 0;
+static char* l_inline_exit = 0;
+static int inline_result = 0;
+static char* l_tail = 0;
+static bool tail_framed = false;
+static char* frame_reg = "rfp";
+static bool framed = true;
+static int register_params = 0;
+
+int unroll_factor = 0;
+int inline_limit = 0;
+bool tail_calls = false;
+bool shrink_wrap = false;
+bool if_conversion = false;
+int call_registers = 0;
 
 struct code code;
 
@@ -19,6 +132,9 @@ const char* instruction[] = {[STORE_AI] = "storeAI %s => %s, %d\n",
                              [SUB] = "sub %s, %s => %s\n",
                              [MULT] = "mult %s, %s => %s\n",
                              [DIV] = "div %s, %s => %s\n",
+                             [AND] = "and %s, %s => %s\n",
+                             [OR] = "or %s, %s => %s\n",
+                             [XOR] = "xor %s, %s => %s\n",
                              [CMP_LT] = "cmp_LT %s, %s -> %s\n",
                              [CMP_LE] = "cmp_LE %s, %s -> %s\n",
                              [CMP_GT] = "cmp_GT %s, %s -> %s\n",
@@ -31,7 +147,20 @@ const char* instruction[] = {[STORE_AI] = "storeAI %s => %s, %d\n",
                              [LABEL] = "%s:\n",
                              [FLABEL] = "l%s:\n",
                              [I2I] = "i2i %s => %s\n",
-                             [ADD_I] = "addI %s, %d => %s\n"};
+                             [ADD_I] = "addI %s, %d => %s\n",
+                             [SUB_I] = "subI %s, %d => %s\n",
+                             [RSUB_I] = "rsubI %s, %d => %s\n",
+                             [MULT_I] = "multI %s, %d => %s\n",
+                             [DIV_I] = "divI %s, %d => %s\n",
+                             [RDIV_I] = "rdivI %s, %d => %s\n",
+                             [LSHIFT_I] = "lshiftI %s, %d => %s\n",
+                             [RSHIFT_I] = "rshiftI %s, %d => %s\n",
+                             [AND_I] = "andI %s, %d => %s\n",
+                             [HALT] = "halt\n",
+                             [LOAD_GLOBAL] = "loadAI %s, @%s => %s\n",
+                             [STORE_GLOBAL] = "storeAI %s => %s, @%s\n",
+                             [LOAD_LABEL] = "loadI %s => %s\n",
+                             [GLOBAL_DECL] = ".global %s %d\n"};
 
 struct offset_table* alloc_offset_table() {
     struct offset_table* table = malloc(sizeof *table);
@@ -51,36 +180,437 @@ void free_offset_table(struct offset_table* table) {
     free(table);
 };
 
+void import_global(char* id) {
+    struct address* var = malloc(sizeof *var);
+    var->id = id;
+    var->scope = GLOBAL;
+    var->offset = 0;
+
+    var->next = imported_globals;
+    imported_globals = var;
+}
+
+static void generate_imported_globals(struct address* var) {
+    if (var != 0) {
+        generate_imported_globals(var->next);
+
+        char* line = alloc_line();
+        sprintf(line, instruction[GLOBAL_DECL], var->id, 4);
+        append_ins(line);
+    }
+}
+
+static void collect_functions(struct node* node) {
+    if (node == 0) {
+        return;
+    }
+
+    if (node->type == N_UNIT) {
+        collect_functions(node->val.unit.unit);
+        collect_functions(node->val.unit.element);
+    } else if (node->type == N_FUNCTION_DEF) {
+        struct inline_functions* list = &inline_functions;
+        if (list->count == list->capacity) {
+            list->capacity = list->capacity > 0 ? 2 * list->capacity : 8;
+            list->functions =
+                realloc(list->functions,
+                        list->capacity * sizeof *list->functions);
+        }
+
+        struct inline_function* function = &list->functions[list->count++];
+        memset(function, 0, sizeof *function);
+        function->name = node->val.function_def.token.val.string_v;
+        function->def = &node->val.function_def;
+    }
+}
+
+static struct inline_function* find_inline_function(char* name) {
+    int i;
+    for (i = 0; i < inline_functions.count; i++) {
+        if (strcmp(inline_functions.functions[i].name, name) == 0) {
+            return &inline_functions.functions[i];
+        }
+    }
+    return 0;
+}
+
+static int node_children(struct node* node, struct node** children) {
+    union node_value* val = &node->val;
+    switch (node->type) {
+        case N_UNARY_EXP:
+            children[0] = val->unary_exp.operand;
+            return 1;
+        case N_BINARY_EXP:
+            children[0] = val->binary_exp.left;
+            children[1] = val->binary_exp.right;
+            return 2;
+        case N_TERNARY_EXP:
+            children[0] = val->ternary_exp.condition;
+            children[1] = val->ternary_exp.exp1;
+            children[2] = val->ternary_exp.exp2;
+            return 3;
+        case N_EXP_LIST:
+            children[0] = val->exp_list.exp_list;
+            children[1] = val->exp_list.exp;
+            return 2;
+        case N_SWITCH:
+            children[0] = val->switch_cmd.control_exp;
+            children[1] = val->switch_cmd.cmd_block;
+            return 2;
+        case N_DO_WHILE:
+            children[0] = val->do_while_cmd.cmd_block;
+            children[1] = val->do_while_cmd.condition;
+            return 2;
+        case N_WHILE:
+            children[0] = val->while_cmd.condition;
+            children[1] = val->while_cmd.cmd_block;
+            return 2;
+        case N_FOR:
+            children[0] = val->for_cmd.initialization;
+            children[1] = val->for_cmd.condition;
+            children[2] = val->for_cmd.update;
+            children[3] = val->for_cmd.cmd_block;
+            return 4;
+        case N_FOREACH:
+            children[0] = val->foreach_cmd.exp_list;
+            children[1] = val->foreach_cmd.cmd_block;
+            return 2;
+        case N_ARG_LIST:
+            children[0] = val->arg_list.arg;
+            children[1] = val->arg_list.next;
+            return 2;
+        case N_FUNCTION:
+            children[0] = val->function_cmd.arg_list;
+            return 1;
+        case N_PIPE:
+            children[0] = val->pipe_cmd.pipe_cmd;
+            children[1] = val->pipe_cmd.function_cmd;
+            return 2;
+        case N_IF:
+            children[0] = val->if_cmd.condition;
+            children[1] = val->if_cmd.then_cmd_block;
+            children[2] = val->if_cmd.else_cmd_block;
+            return 3;
+        case N_OUTPUT:
+            children[0] = val->out_cmd.exp_list;
+            return 1;
+        case N_INPUT:
+            children[0] = val->in_cmd.exp;
+            return 1;
+        case N_RETURN:
+            children[0] = val->return_cmd.exp;
+            return 1;
+        case N_SHIFT:
+            children[0] = val->shift_cmd.var;
+            children[1] = val->shift_cmd.exp;
+            return 2;
+        case N_VAR:
+            children[0] = val->var.array_access;
+            return 1;
+        case N_ATTRIBUTION:
+            children[0] = val->attr_cmd.var;
+            children[1] = val->attr_cmd.exp;
+            return 2;
+        case N_LOCAL_VAR_DECL:
+            children[0] = val->local_var_decl.init;
+            return 1;
+        case N_CMD_LIST:
+            children[0] = val->cmd_list.cmd_list;
+            children[1] = val->cmd_list.cmd;
+            return 2;
+        case N_HIGH_LIST:
+            children[0] = val->high_list.high_list;
+            children[1] = val->high_list.cmd;
+            return 2;
+        case N_CMD_BLOCK:
+            children[0] = val->cmd_block.high_list;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int scan_calls(struct node* node, struct inline_function* caller) {
+    if (node == 0) {
+        return 0;
+    }
+
+    if (node->type == N_FUNCTION) {
+        struct inline_function* callee =
+            find_inline_function(node->val.function_cmd.token.val.string_v);
+        if (callee != 0) {
+            callee->sites++;
+            caller->calls[callee - inline_functions.functions] = true;
+        }
+    }
+
+    struct node* children[4];
+    int count = node_children(node, children);
+    int size = 1;
+    int i;
+    for (i = 0; i < count; i++) {
+        size += scan_calls(children[i], caller);
+    }
+    return size;
+}
+
+static bool has_tail_call(struct node* node, char* name) {
+    if (node == 0) {
+        return false;
+    }
+
+    if (node->type == N_RETURN) {
+        struct node* exp = node->val.return_cmd.exp;
+        return exp != 0 && exp->type == N_FUNCTION &&
+               strcmp(exp->val.function_cmd.token.val.string_v, name) == 0;
+    }
+
+    struct node* children[4];
+    int count = node_children(node, children);
+    int i;
+    for (i = 0; i < count; i++) {
+        if (has_tail_call(children[i], name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool has_continue(struct node* node) {
+    if (node == 0) {
+        return false;
+    }
+
+    if (node->type == N_CONTINUE) {
+        return true;
+    }
+
+    struct node* children[4];
+    int count = node_children(node, children);
+    int i;
+    for (i = 0; i < count; i++) {
+        if (has_continue(children[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool reaches(int from, int target, bool* seen) {
+    int i;
+    for (i = 0; i < inline_functions.count; i++) {
+        if (!inline_functions.functions[from].calls[i] || seen[i]) {
+            continue;
+        }
+        if (i == target) {
+            return true;
+        }
+        seen[i] = true;
+        if (reaches(i, target, seen)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void analyze_inlining(struct node* node) {
+    collect_functions(node);
+
+    int count = inline_functions.count;
+    int i;
+    for (i = 0; i < count; i++) {
+        inline_functions.functions[i].calls = calloc(count, sizeof(bool));
+    }
+    for (i = 0; i < count; i++) {
+        struct inline_function* function = &inline_functions.functions[i];
+        function->size = scan_calls(function->def->cmd_block, function);
+    }
+
+    bool* seen = malloc(count * sizeof *seen);
+    for (i = 0; i < count; i++) {
+        memset(seen, 0, count * sizeof *seen);
+        inline_functions.functions[i].recursive = reaches(i, i, seen);
+    }
+    free(seen);
+}
+
+static void free_inlining() {
+    int i;
+    for (i = 0; i < inline_functions.count; i++) {
+        free(inline_functions.functions[i].calls);
+    }
+    free(inline_functions.functions);
+    inline_functions.functions = 0;
+    inline_functions.count = 0;
+    inline_functions.capacity = 0;
+}
+
+static struct lifetime* add_lifetime(struct lifetimes* list,
+                                     char* id,
+                                     int position) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity > 0 ? 2 * list->capacity : 8;
+        list->items =
+            realloc(list->items, list->capacity * sizeof *list->items);
+    }
+
+    struct lifetime* lifetime = &list->items[list->count++];
+    lifetime->id = id;
+    lifetime->start = position;
+    lifetime->end = position;
+    lifetime->offset = 0;
+    return lifetime;
+}
+
+static struct lifetime* find_lifetime(struct lifetimes* list, char* id) {
+    int i;
+    for (i = list->count - 1; i >= 0; i--) {
+        if (strcmp(list->items[i].id, id) == 0) {
+            return &list->items[i];
+        }
+    }
+    return 0;
+}
+
+static void mention(struct lifetimes* vars, char* id, int position) {
+    struct lifetime* var = find_lifetime(vars, id);
+    if (var != 0 && var->end < position) {
+        var->end = position;
+    }
+}
+
+static void scan_lifetimes(struct node* node,
+                           struct lifetimes* vars,
+                           struct lifetimes* loops,
+                           int* position) {
+    if (node == 0) {
+        return;
+    }
+
+    int start = ++*position;
+    struct node* children[4];
+    int count = node_children(node, children);
+    if (node->type == N_FOR) {
+        children[2] = node->val.for_cmd.cmd_block;
+        children[3] = node->val.for_cmd.update;
+    }
+
+    if (node->type == N_FOREACH) {
+        char* item = node->val.foreach_cmd.item;
+        if (find_lifetime(vars, item) == 0) {
+            add_lifetime(vars, item, start)->end = INT_MAX;
+        }
+        mention(vars, item, start);
+    }
+
+    int loop_start = start;
+    int i;
+    for (i = 0; i < count; i++) {
+        scan_lifetimes(children[i], vars, loops, position);
+        if (node->type == N_FOR && i == 0) {
+            loop_start = *position + 1;
+        }
+    }
+
+    if (node->type == N_LOCAL_VAR_DECL) {
+        struct local_var_decl* decl = &node->val.local_var_decl;
+        struct lifetime* var =
+            add_lifetime(vars, decl->token.val.string_v, ++*position);
+        if (decl->init == 0) {
+            var->start = 0;
+            var->end = INT_MAX;
+        }
+    } else if (node->type == N_VAR) {
+        mention(vars, node->val.var.token.val.string_v, start);
+    } else if (node->type == N_WHILE || node->type == N_DO_WHILE ||
+               node->type == N_FOR || node->type == N_FOREACH) {
+        add_lifetime(loops, 0, loop_start)->end = *position;
+    }
+}
+
+static int compare_lifetimes(const void* a, const void* b) {
+    return ((const struct lifetime*)a)->start -
+           ((const struct lifetime*)b)->start;
+}
+
+static int assign_slots(struct node* cmd_block, int base) {
+    struct lifetimes loops = {0, 0, 0};
+    int position = 0;
+    slots.count = 0;
+    scan_lifetimes(cmd_block, &slots, &loops, &position);
+
+    int i, j;
+    for (i = 0; i < slots.count; i++) {
+        struct lifetime* var = &slots.items[i];
+        for (j = 0; j < loops.count; j++) {
+            struct lifetime* loop = &loops.items[j];
+            if (var->start <= loop->end && var->end >= loop->start &&
+                (var->start < loop->start || var->end > loop->end)) {
+                var->start = var->start < loop->start ? var->start
+                                                      : loop->start;
+                var->end = var->end > loop->end ? var->end : loop->end;
+            }
+        }
+    }
+    free(loops.items);
+
+    qsort(slots.items, slots.count, sizeof *slots.items, compare_lifetimes);
+
+    int* ends = malloc((slots.count + 1) * sizeof *ends);
+    int count = 0;
+    for (i = 0; i < slots.count; i++) {
+        struct lifetime* var = &slots.items[i];
+        for (j = 0; j < count && ends[j] >= var->start; j++) {
+        }
+        if (j == count) {
+            count++;
+        }
+        ends[j] = var->end;
+        var->offset = base + 4 * j;
+    }
+    free(ends);
+
+    return base + 4 * count;
+}
+
+static int alloc_slot(char* id) {
+    int i;
+    for (i = 0; id != 0 && i < slots.count; i++) {
+        if (slots.items[i].id == id) {
+            return slots.items[i].offset;
+        }
+    }
+
+    int offset = local_offset;
+    local_offset += 4;
+    if (local_offset > frame_size) {
+        frame_size = local_offset;
+    }
+    return offset;
+}
+
 void generate_code(struct node* node) {
     struct offset_table* table = alloc_offset_table();
+    table->head = imported_globals;
+    imported_globals = 0;
     code.head = 0;
     code.last = 0;
 
-    char* line = alloc_line();
-    sprintf(line, instruction[LOAD_I], 1024, "rfp");
-    append_ins(line);
-    ins++;
-
-    line = alloc_line();
-    sprintf(line, instruction[LOAD_I], 1024, "rsp");
-    append_ins(line);
-    ins++;
-
-    line = alloc_line();
-    sprintf(line, instruction[LOAD_I], 0, "rbss");
-    append_ins(line);
-    ins++;
-
-    line = alloc_line();
-    sprintf(line, instruction[JUMP_I], "lmain");
-    append_ins(line);
-    ins++;
+    if (inline_limit > 0) {
+        analyze_inlining(node);
+    }
 
+    generate_imported_globals(table->head);
     generate(node, table, 0, 0);
 
-    print_code();
-    free_code(code.head);
-
+    free_inlining();
+    free(slots.items);
+    slots.items = 0;
+    slots.count = 0;
+    slots.capacity = 0;
+    free(pending);
+    pending = 0;
+    pending_capacity = 0;
     free_offset_table(table);
 }
 
@@ -102,9 +632,30 @@ void generate(struct node* node,
             case N_WHILE:
                 generate_while(node->val.while_cmd, table);
                 break;
+            case N_FOR:
+                generate_for(node->val.for_cmd, table);
+                break;
+            case N_FOREACH:
+                generate_foreach(node->val.foreach_cmd, table);
+                break;
+            case N_TERNARY_EXP:
+                generate_ternary(node->val.ternary_exp, table);
+                break;
             case N_IF:
                 generate_if(node->val.if_cmd, table);
                 break;
+            case N_SWITCH:
+                generate_switch(node->val.switch_cmd, table);
+                break;
+            case N_CASE:
+                generate_case(node);
+                break;
+            case N_BREAK:
+                generate_break();
+                break;
+            case N_CONTINUE:
+                generate_continue();
+                break;
             case N_VAR:
                 generate_var(node->val.var, table);
                 break;
@@ -129,6 +680,10 @@ void generate(struct node* node,
                 generate(node->val.high_list.high_list, table, 0, 0);
                 generate(node->val.high_list.cmd, table, 0, 0);
                 break;
+            case N_CMD_LIST:
+                generate(node->val.cmd_list.cmd_list, table, 0, 0);
+                generate(node->val.cmd_list.cmd, table, 0, 0);
+                break;
             case N_FUNCTION_DEF:
                 generate_function_def(node->val.function_def, table);
                 break;
@@ -183,11 +738,14 @@ void generate_global_var(struct global_var_decl global_var,
     struct address* var = malloc(sizeof *var);
     var->id = global_var.token.val.string_v;
     var->scope = GLOBAL;
-    var->offset = global_offset;
-    global_offset += 4;
+    var->offset = 0;
 
     var->next = table->head;
     table->head = var;
+
+    char* line = alloc_line();
+    sprintf(line, instruction[GLOBAL_DECL], var->id, 4);
+    append_ins(line);
 }
 
 void generate_local_var(struct local_var_decl local_var,
@@ -195,8 +753,7 @@ void generate_local_var(struct local_var_decl local_var,
     struct address* var = malloc(sizeof *var);
     var->id = local_var.token.val.string_v;
     var->scope = LOCAL;
-    var->offset = local_offset;
-    local_offset += 4;
+    var->offset = alloc_slot(local_var.token.val.string_v);
 
     var->next = table->head;
     table->head = var;
@@ -204,31 +761,34 @@ void generate_local_var(struct local_var_decl local_var,
     if (local_var.init != 0) {
         char* reg = get_reg(register_offset - 1);
         char* line = alloc_line();
-        sprintf(line, instruction[STORE_AI], reg, "rfp", var->offset);
+        sprintf(line, instruction[STORE_AI], reg, frame_reg, var->offset);
         append_ins(line);
-        ins++;
         free(reg);
     }
 }
 
-void generate_attribution(struct attr_cmd attr, struct offset_table* table) {
-    struct address* var =
-        get_address(attr.var->val.var.token.val.string_v, table);
-
+static void generate_store(struct address* var) {
     char* reg = get_reg(register_offset - 1);
 
     char* line = alloc_line();
     if (var->scope == GLOBAL) {
-        sprintf(line, instruction[STORE_AI], reg, "rbss", var->offset);
+        sprintf(line, instruction[STORE_GLOBAL], reg, "rbss", var->id);
+    } else if (var->scope == REGISTER) {
+        char* param = get_reg(var->offset);
+        sprintf(line, instruction[I2I], reg, param);
+        free(param);
     } else {
-        sprintf(line, instruction[STORE_AI], reg, "rfp", var->offset);
+        sprintf(line, instruction[STORE_AI], reg, frame_reg, var->offset);
     }
     append_ins(line);
-    ins++;
 
     free(reg);
 }
 
+void generate_attribution(struct attr_cmd attr, struct offset_table* table) {
+    generate_store(get_address(attr.var->val.var.token.val.string_v, table));
+}
+
 void generate_literal(struct token literal) {
     int val = literal.val.int_v;
     char* reg = get_reg(register_offset);
@@ -237,7 +797,6 @@ void generate_literal(struct token literal) {
     char* line = alloc_line();
     sprintf(line, instruction[LOAD_I], val, reg);
     append_ins(line);
-    ins++;
     free(reg);
 }
 
@@ -248,434 +807,2024 @@ void generate_var(struct var var, struct offset_table* table) {
 
     char* line = alloc_line();
     if (addr->scope == GLOBAL) {
-        sprintf(line, instruction[LOAD_AI], "rbss", addr->offset, reg);
+        sprintf(line, instruction[LOAD_GLOBAL], "rbss", addr->id, reg);
+    } else if (addr->scope == REGISTER) {
+        char* param = get_reg(addr->offset);
+        sprintf(line, instruction[I2I], param, reg);
+        free(param);
     } else {
-        sprintf(line, instruction[LOAD_AI], "rfp", addr->offset, reg);
+        sprintf(line, instruction[LOAD_AI], frame_reg, addr->offset, reg);
     }
     append_ins(line);
-    ins++;
 
     free(reg);
 }
 
-void generate_binary(struct binary_exp binary_exp,
-                     struct offset_table* table,
-                     char* l_true,
-                     char* l_false) {
-    if (binary_exp.op == AND_OP) {
-        char* l_and = get_label();
-        generate(binary_exp.left, table, l_and, l_false);
-        char* line = alloc_line();
-        sprintf(line, instruction[LABEL], l_and);
-        append_ins(line);
-        generate(binary_exp.right, table, l_true, l_false);
-        free(l_and);
-    } else if (binary_exp.op == OR_OP) {
-        char* l_or = get_label();
-        generate(binary_exp.left, table, l_true, l_or);
-        char* line = alloc_line();
-        sprintf(line, instruction[LABEL], l_or);
-        append_ins(line);
-        generate(binary_exp.right, table, l_true, l_false);
-        free(l_or);
-    } else {
-        generate(binary_exp.left, table, l_true, l_false);
-        char* reg1 = get_reg(register_offset - 1);
-        generate(binary_exp.right, table, l_true, l_false);
-        char* reg2 = get_reg(register_offset - 1);
-
-        char* reg3 = get_reg(register_offset);
-        register_offset += 1;
+static bool is_literal(struct node* node) {
+    return node != 0 && node->type == N_LITERAL;
+}
 
-        char* line = alloc_line();
-        switch (binary_exp.op) {
-            case '+':
-                sprintf(line, instruction[ADD], reg1, reg2, reg3);
-                append_ins(line);
-                ins++;
-                break;
-            case '-':
-                sprintf(line, instruction[SUB], reg1, reg2, reg3);
-                append_ins(line);
-                ins++;
-                break;
-            case '*':
-                sprintf(line, instruction[MULT], reg1, reg2, reg3);
-                append_ins(line);
-                ins++;
-                break;
-            case '/':
-                sprintf(line, instruction[DIV], reg1, reg2, reg3);
-                append_ins(line);
-                ins++;
-                break;
-            case '<':
-                sprintf(line, instruction[CMP_LT], reg1, reg2, reg3);
-                append_ins(line);
-                ins++;
-                line = alloc_line();
-                sprintf(line, instruction[CBR], reg3, l_true, l_false);
-                append_ins(line);
-                ins++;
-                break;
-            case '>':
-                sprintf(line, instruction[CMP_GT], reg1, reg2, reg3);
-                append_ins(line);
-                ins++;
-                line = alloc_line();
-                sprintf(line, instruction[CBR], reg3, l_true, l_false);
-                append_ins(line);
-                ins++;
-                break;
-            case LE_OP:
-                sprintf(line, instruction[CMP_LE], reg1, reg2, reg3);
-                append_ins(line);
-                ins++;
-                line = alloc_line();
-                sprintf(line, instruction[CBR], reg3, l_true, l_false);
-                append_ins(line);
-                ins++;
-                break;
-            case GE_OP:
-                sprintf(line, instruction[CMP_GE], reg1, reg2, reg3);
-                append_ins(line);
-                ins++;
-                line = alloc_line();
-                sprintf(line, instruction[CBR], reg3, l_true, l_false);
-                append_ins(line);
-                ins++;
-                break;
-            case EQ_OP:
-                sprintf(line, instruction[CMP_EQ], reg1, reg2, reg3);
-                append_ins(line);
-                ins++;
-                line = alloc_line();
-                sprintf(line, instruction[CBR], reg3, l_true, l_false);
-                append_ins(line);
-                ins++;
-                break;
-            case NE_OP:
-                sprintf(line, instruction[CMP_NE], reg1, reg2, reg3);
-                append_ins(line);
-                ins++;
-                line = alloc_line();
-                sprintf(line, instruction[CBR], reg3, l_true, l_false);
-                append_ins(line);
-                ins++;
-                break;
-            default:
-                break;
-        }
+static bool is_power_of_two(int val) {
+    return val > 0 && (val & (val - 1)) == 0;
+}
 
-        free(reg1);
-        free(reg2);
-        free(reg3);
+static int log2_int(int val) {
+    int shift = 0;
+    while (val > 1) {
+        val >>= 1;
+        shift++;
     }
+    return shift;
 }
 
-void generate_if(struct if_cmd if_cmd, struct offset_table* table) {
-    char* l_true = get_label();
-    char* l_false = get_label();
+static char* next_reg() {
+    char* reg = get_reg(register_offset);
+    register_offset += 1;
+    return reg;
+}
+
+static void generate_shift_division(char* src, int shift) {
+    char* sign = next_reg();
+    char* line = alloc_line();
+    sprintf(line, instruction[RSHIFT_I], src, 31, sign);
+    append_ins(line);
+
+    char* bias = next_reg();
+    line = alloc_line();
+    sprintf(line, instruction[AND_I], sign, (1 << shift) - 1, bias);
+    append_ins(line);
+
+    char* sum = next_reg();
+    line = alloc_line();
+    sprintf(line, instruction[ADD], src, bias, sum);
+    append_ins(line);
+
+    char* dst = next_reg();
+    line = alloc_line();
+    sprintf(line, instruction[RSHIFT_I], sum, shift, dst);
+    append_ins(line);
+
+    free(sign);
+    free(bias);
+    free(sum);
+    free(dst);
+}
+
+static bool is_arithmetic(int op) {
+    return op == '+' || op == '-' || op == '*' || op == '/';
+}
+
+static bool is_zero(int val) {
+    return val == 0;
+}
+
+static bool is_one(int val) {
+    return val == 1;
+}
+
+static bool is_nonzero(int val) {
+    return val != 0;
+}
+
+static bool is_shift_divisor(int val) {
+    return val > 1 && is_power_of_two(val);
+}
+
+static const struct rule rules[] = {
+    {NT_REG, 0, NT_IMM, NT_IMM, FORM_LOAD_I, LOAD_I, 1, 0, 0},
+    {NT_IMM, '+', NT_IMM, NT_IMM, FORM_FOLD, 0, 0, 0, 0},
+    {NT_IMM, '-', NT_IMM, NT_IMM, FORM_FOLD, 0, 0, 0, 0},
+    {NT_IMM, '*', NT_IMM, NT_IMM, FORM_FOLD, 0, 0, 0, 0},
+    {NT_IMM, '/', NT_IMM, NT_IMM, FORM_FOLD, 0, 0, is_nonzero, 0},
+    {NT_REG, '+', NT_REG, NT_REG, FORM_REG_REG, ADD, 1, 0, 0},
+    {NT_REG, '+', NT_REG, NT_IMM, FORM_REG_IMM, ADD_I, 1, 0, 0},
+    {NT_REG, '+', NT_IMM, NT_REG, FORM_IMM_REG, ADD_I, 1, 0, 0},
+    {NT_REG, '+', NT_REG, NT_IMM, FORM_IDENTITY, 0, 0, is_zero, 0},
+    {NT_REG, '+', NT_IMM, NT_REG, FORM_IDENTITY, 0, 0, is_zero, 0},
+    {NT_REG, '-', NT_REG, NT_REG, FORM_REG_REG, SUB, 1, 0, 0},
+    {NT_REG, '-', NT_REG, NT_IMM, FORM_REG_IMM, SUB_I, 1, 0, 0},
+    {NT_REG, '-', NT_IMM, NT_REG, FORM_IMM_REG, RSUB_I, 1, 0, 0},
+    {NT_REG, '-', NT_REG, NT_IMM, FORM_IDENTITY, 0, 0, is_zero, 0},
+    {NT_REG, '*', NT_REG, NT_REG, FORM_REG_REG, MULT, 3, 0, 0},
+    {NT_REG, '*', NT_REG, NT_IMM, FORM_REG_IMM, MULT_I, 3, 0, 0},
+    {NT_REG, '*', NT_IMM, NT_REG, FORM_IMM_REG, MULT_I, 3, 0, 0},
+    {NT_REG, '*', NT_REG, NT_IMM, FORM_REG_IMM, LSHIFT_I, 1,
+     is_power_of_two, log2_int},
+    {NT_REG, '*', NT_IMM, NT_REG, FORM_IMM_REG, LSHIFT_I, 1,
+     is_power_of_two, log2_int},
+    {NT_REG, '*', NT_REG, NT_IMM, FORM_IDENTITY, 0, 0, is_one, 0},
+    {NT_REG, '*', NT_IMM, NT_REG, FORM_IDENTITY, 0, 0, is_one, 0},
+    {NT_REG, '/', NT_REG, NT_REG, FORM_REG_REG, DIV, 5, 0, 0},
+    {NT_REG, '/', NT_REG, NT_IMM, FORM_REG_IMM, DIV_I, 5, 0, 0},
+    {NT_REG, '/', NT_IMM, NT_REG, FORM_IMM_REG, RDIV_I, 5, 0, 0},
+    {NT_REG, '/', NT_REG, NT_IMM, FORM_SHIFT_DIVISION, 0, 4,
+     is_shift_divisor, log2_int},
+    {NT_REG, '/', NT_REG, NT_IMM, FORM_IDENTITY, 0, 0, is_one, 0}};
+
+static int fold(int op, int left, int right) {
+    switch (op) {
+        case '+':
+            return (unsigned)left + (unsigned)right;
+        case '-':
+            return (unsigned)left - (unsigned)right;
+        case '*':
+            return (unsigned)left * (unsigned)right;
+        default:
+            return right == -1 ? 0u - (unsigned)left : left / right;
+    }
+}
+
+static int combine_need(int op, int left, int right) {
+    if (left == right && op != AND_OP && op != OR_OP) {
+        return left + 1;
+    }
+    return left > right ? left : right;
+}
+
+static void apply_chain_rules(struct label* label) {
+    size_t i;
+    for (i = 0; i < sizeof rules / sizeof *rules; i++) {
+        const struct rule* rule = &rules[i];
+        if (rule->op != 0 || label->cost[rule->left] == INT_MAX) {
+            continue;
+        }
+        int cost = label->cost[rule->left] + rule->cost;
+        if (cost < label->cost[rule->result]) {
+            label->cost[rule->result] = cost;
+            label->rule[rule->result] = rule;
+        }
+    }
+}
+
+static struct label match_rules(int op, struct label left, struct label right) {
+    struct label label = {{INT_MAX, INT_MAX}, {0, 0}, 0, 0};
+    size_t i;
+    for (i = 0; i < sizeof rules / sizeof *rules; i++) {
+        const struct rule* rule = &rules[i];
+        if (rule->op != op || left.cost[rule->left] == INT_MAX ||
+            right.cost[rule->right] == INT_MAX) {
+            continue;
+        }
+        int val = rule->right == NT_IMM ? right.val : left.val;
+        if (rule->applies != 0 && !rule->applies(val)) {
+            continue;
+        }
+        int cost =
+            rule->cost + left.cost[rule->left] + right.cost[rule->right];
+        if (cost < label.cost[rule->result]) {
+            label.cost[rule->result] = cost;
+            label.rule[rule->result] = rule;
+            if (rule->form == FORM_FOLD) {
+                label.val = fold(op, left.val, right.val);
+            }
+        }
+    }
+    apply_chain_rules(&label);
+
+    const struct rule* rule = label.rule[NT_REG];
+    if (rule->form == FORM_LOAD_I) {
+        label.need = 1;
+    } else if (rule->form == FORM_REG_REG) {
+        label.need = combine_need(op, left.need, right.need);
+    } else {
+        label.need = rule->right == NT_IMM ? left.need : right.need;
+    }
+    return label;
+}
+
+static struct label label_node(struct node* node) {
+    struct label label = {{1, INT_MAX}, {0, 0}, 0, 1};
+    if (node == 0) {
+        label.need = 0;
+    } else if (node->type == N_FUNCTION) {
+        label.need = CALL_NEED;
+    } else if (is_literal(node)) {
+        label.cost[NT_REG] = INT_MAX;
+        label.cost[NT_IMM] = 0;
+        label.val = node->val.token.val.int_v;
+        apply_chain_rules(&label);
+    } else if (node->type == N_BINARY_EXP) {
+        struct binary_exp binary_exp = node->val.binary_exp;
+        struct label left = label_node(binary_exp.left);
+        struct label right = label_node(binary_exp.right);
+        if (is_arithmetic(binary_exp.op)) {
+            return match_rules(binary_exp.op, left, right);
+        }
+        label.need = combine_need(binary_exp.op, left.need, right.need);
+    }
+    return label;
+}
+
+static void push_pending(int reg) {
+    if (pending_count == pending_capacity) {
+        pending_capacity = pending_capacity > 0 ? 2 * pending_capacity : 16;
+        pending = realloc(pending, pending_capacity * sizeof *pending);
+    }
+    pending[pending_count++] = reg;
+}
+
+static bool contains_call(struct node* node) {
+    if (node == 0) {
+        return false;
+    }
+    if (node->type == N_FUNCTION) {
+        return true;
+    }
+
+    struct node* children[4];
+    int count = node_children(node, children);
+    int i;
+    for (i = 0; i < count; i++) {
+        if (contains_call(children[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool observes_state(struct node* node, struct offset_table* table) {
+    if (node == 0) {
+        return false;
+    }
+    if (node->type == N_FUNCTION) {
+        return true;
+    }
+    if (node->type == N_VAR) {
+        struct address* var =
+            get_address(node->val.var.token.val.string_v, table);
+        if (var == 0 || var->scope == GLOBAL) {
+            return true;
+        }
+    }
+
+    struct node* children[4];
+    int count = node_children(node, children);
+    int i;
+    for (i = 0; i < count; i++) {
+        if (observes_state(children[i], table)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int register_need(struct node* node) {
+    return label_node(node).need;
+}
+
+static bool evaluate_right_first(struct binary_exp binary_exp,
+                                 struct offset_table* table) {
+    if (register_need(binary_exp.right) <= register_need(binary_exp.left)) {
+        return false;
+    }
+    return !(contains_call(binary_exp.right) &&
+             observes_state(binary_exp.left, table)) &&
+           !(contains_call(binary_exp.left) &&
+             observes_state(binary_exp.right, table));
+}
+
+static void generate_operands(struct binary_exp binary_exp,
+                              struct offset_table* table,
+                              char* l_true,
+                              char* l_false,
+                              int* left,
+                              int* right) {
+    bool swap = evaluate_right_first(binary_exp, table);
+    generate(swap ? binary_exp.right : binary_exp.left,
+             table,
+             l_true,
+             l_false);
+    int first = register_offset - 1;
+    push_pending(first);
+    generate(swap ? binary_exp.left : binary_exp.right,
+             table,
+             l_true,
+             l_false);
+    pending_count--;
+    int second = register_offset - 1;
+
+    *left = swap ? second : first;
+    *right = swap ? first : second;
+}
+
+static void select_binary(struct binary_exp binary_exp,
+                          struct offset_table* table) {
+    struct label left = label_node(binary_exp.left);
+    struct label right = label_node(binary_exp.right);
+    struct label label = match_rules(binary_exp.op, left, right);
+    const struct rule* rule = label.rule[NT_REG];
+
+    char* line;
+    char* dst;
+    if (rule->form == FORM_LOAD_I) {
+        dst = next_reg();
+        line = alloc_line();
+        sprintf(line, instruction[LOAD_I], label.val, dst);
+        append_ins(line);
+        free(dst);
+        return;
+    }
+
+    if (rule->form == FORM_REG_REG) {
+        int reg1, reg2;
+        generate_operands(binary_exp, table, 0, 0, &reg1, &reg2);
+        char* src1 = get_reg(reg1);
+        char* src2 = get_reg(reg2);
+        dst = next_reg();
+        line = alloc_line();
+        sprintf(line, instruction[rule->opcode], src1, src2, dst);
+        append_ins(line);
+        free(src1);
+        free(src2);
+        free(dst);
+        return;
+    }
+
+    bool imm_right = rule->right == NT_IMM;
+    generate(imm_right ? binary_exp.left : binary_exp.right, table, 0, 0);
+    if (rule->form == FORM_IDENTITY) {
+        return;
+    }
+
+    int val = imm_right ? right.val : left.val;
+    if (rule->encode != 0) {
+        val = rule->encode(val);
+    }
+
+    char* src = get_reg(register_offset - 1);
+    if (rule->form == FORM_SHIFT_DIVISION) {
+        generate_shift_division(src, val);
+    } else {
+        dst = next_reg();
+        line = alloc_line();
+        sprintf(line, instruction[rule->opcode], src, val, dst);
+        append_ins(line);
+        free(dst);
+    }
+    free(src);
+}
+
+void generate_binary(struct binary_exp binary_exp,
+                     struct offset_table* table,
+                     char* l_true,
+                     char* l_false) {
+    if (binary_exp.op == AND_OP) {
+        char* l_and = get_label();
+        generate(binary_exp.left, table, l_and, l_false);
+        char* line = alloc_line();
+        sprintf(line, instruction[LABEL], l_and);
+        append_ins(line);
+        generate(binary_exp.right, table, l_true, l_false);
+        free(l_and);
+    } else if (binary_exp.op == OR_OP) {
+        char* l_or = get_label();
+        generate(binary_exp.left, table, l_true, l_or);
+        char* line = alloc_line();
+        sprintf(line, instruction[LABEL], l_or);
+        append_ins(line);
+        generate(binary_exp.right, table, l_true, l_false);
+        free(l_or);
+    } else if (is_arithmetic(binary_exp.op)) {
+        select_binary(binary_exp, table);
+    } else {
+        int left, right;
+        generate_operands(binary_exp, table, l_true, l_false, &left, &right);
+
+        char* reg1 = get_reg(left);
+        char* reg2 = get_reg(right);
+
+        char* reg3 = get_reg(register_offset);
+        register_offset += 1;
+
+        char* line = alloc_line();
+        switch (binary_exp.op) {
+            case '<':
+                sprintf(line, instruction[CMP_LT], reg1, reg2, reg3);
+                append_ins(line);
+                line = alloc_line();
+                sprintf(line, instruction[CBR], reg3, l_true, l_false);
+                append_ins(line);
+                break;
+            case '>':
+                sprintf(line, instruction[CMP_GT], reg1, reg2, reg3);
+                append_ins(line);
+                line = alloc_line();
+                sprintf(line, instruction[CBR], reg3, l_true, l_false);
+                append_ins(line);
+                break;
+            case LE_OP:
+                sprintf(line, instruction[CMP_LE], reg1, reg2, reg3);
+                append_ins(line);
+                line = alloc_line();
+                sprintf(line, instruction[CBR], reg3, l_true, l_false);
+                append_ins(line);
+                break;
+            case GE_OP:
+                sprintf(line, instruction[CMP_GE], reg1, reg2, reg3);
+                append_ins(line);
+                line = alloc_line();
+                sprintf(line, instruction[CBR], reg3, l_true, l_false);
+                append_ins(line);
+                break;
+            case EQ_OP:
+                sprintf(line, instruction[CMP_EQ], reg1, reg2, reg3);
+                append_ins(line);
+                line = alloc_line();
+                sprintf(line, instruction[CBR], reg3, l_true, l_false);
+                append_ins(line);
+                break;
+            case NE_OP:
+                sprintf(line, instruction[CMP_NE], reg1, reg2, reg3);
+                append_ins(line);
+                line = alloc_line();
+                sprintf(line, instruction[CBR], reg3, l_true, l_false);
+                append_ins(line);
+                break;
+            default:
+                break;
+        }
+
+        free(reg1);
+        free(reg2);
+        free(reg3);
+    }
+}
+
+static int comparison_opcode(int op) {
+    switch (op) {
+        case '<':
+            return CMP_LT;
+        case '>':
+            return CMP_GT;
+        case LE_OP:
+            return CMP_LE;
+        case GE_OP:
+            return CMP_GE;
+        case EQ_OP:
+            return CMP_EQ;
+        case NE_OP:
+            return CMP_NE;
+        default:
+            return -1;
+    }
+}
+
+static int node_size(struct node* node) {
+    if (node == 0) {
+        return 0;
+    }
+
+    struct node* children[4];
+    int count = node_children(node, children);
+    int size = 1;
+    int i;
+    for (i = 0; i < count; i++) {
+        size += node_size(children[i]);
+    }
+    return size;
+}
+
+static bool is_select_condition(struct node* node);
+
+static bool is_speculatable(struct node* node) {
+    if (node == 0) {
+        return false;
+    }
+
+    switch (node->type) {
+        case N_LITERAL:
+            return true;
+        case N_VAR:
+            return node->val.var.array_access == 0;
+        case N_TERNARY_EXP:
+            return is_select_condition(node->val.ternary_exp.condition) &&
+                   is_speculatable(node->val.ternary_exp.exp1) &&
+                   is_speculatable(node->val.ternary_exp.exp2);
+        case N_BINARY_EXP:
+            break;
+        default:
+            return false;
+    }
+
+    struct binary_exp binary_exp = node->val.binary_exp;
+    if (!is_arithmetic(binary_exp.op)) {
+        return false;
+    }
+    if (binary_exp.op == '/') {
+        struct label divisor = label_node(binary_exp.right);
+        if (divisor.cost[NT_IMM] == INT_MAX || divisor.val == 0) {
+            return false;
+        }
+    }
+    return is_speculatable(binary_exp.left) &&
+           is_speculatable(binary_exp.right);
+}
+
+static bool is_select_condition(struct node* node) {
+    if (node == 0 || node->type != N_BINARY_EXP) {
+        return false;
+    }
+
+    struct binary_exp binary_exp = node->val.binary_exp;
+    if (binary_exp.op == AND_OP || binary_exp.op == OR_OP) {
+        return is_select_condition(binary_exp.left) &&
+               is_select_condition(binary_exp.right);
+    }
+    return comparison_opcode(binary_exp.op) != -1 &&
+           is_speculatable(binary_exp.left) &&
+           is_speculatable(binary_exp.right);
+}
+
+static bool can_select(struct node* condition,
+                       struct node* exp1,
+                       struct node* exp2) {
+    return if_conversion && is_select_condition(condition) &&
+           is_speculatable(exp1) && is_speculatable(exp2) &&
+           node_size(exp1) <= SELECT_ARM_SIZE &&
+           node_size(exp2) <= SELECT_ARM_SIZE;
+}
+
+static void generate_condition_value(struct node* node,
+                                     struct offset_table* table) {
+    struct binary_exp binary_exp = node->val.binary_exp;
+    int left, right;
+    int opcode;
+    if (binary_exp.op == AND_OP || binary_exp.op == OR_OP) {
+        generate_condition_value(binary_exp.left, table);
+        left = register_offset - 1;
+        generate_condition_value(binary_exp.right, table);
+        right = register_offset - 1;
+        opcode = binary_exp.op == AND_OP ? AND : OR;
+    } else {
+        generate_operands(binary_exp, table, 0, 0, &left, &right);
+        opcode = comparison_opcode(binary_exp.op);
+    }
+
+    char* reg1 = get_reg(left);
+    char* reg2 = get_reg(right);
+    char* dst = next_reg();
+    char* line = alloc_line();
+    sprintf(line, instruction[opcode], reg1, reg2, dst);
+    append_ins(line);
+
+    free(reg1);
+    free(reg2);
+    free(dst);
+}
+
+static void generate_select(struct node* condition,
+                            struct node* exp1,
+                            struct node* exp2,
+                            struct offset_table* table) {
+    generate_condition_value(condition, table);
+    char* flag = get_reg(register_offset - 1);
+    char* mask = next_reg();
+    char* line = alloc_line();
+    sprintf(line, instruction[RSUB_I], flag, 0, mask);
+    append_ins(line);
+
+    generate(exp1, table, 0, 0);
+    char* reg1 = get_reg(register_offset - 1);
+    generate(exp2, table, 0, 0);
+    char* reg2 = get_reg(register_offset - 1);
+
+    char* diff = next_reg();
+    line = alloc_line();
+    sprintf(line, instruction[XOR], reg1, reg2, diff);
+    append_ins(line);
+
+    char* chosen = next_reg();
+    line = alloc_line();
+    sprintf(line, instruction[AND], diff, mask, chosen);
+    append_ins(line);
+
+    char* dst = next_reg();
+    line = alloc_line();
+    sprintf(line, instruction[XOR], reg2, chosen, dst);
+    append_ins(line);
+
+    free(flag);
+    free(mask);
+    free(reg1);
+    free(reg2);
+    free(diff);
+    free(chosen);
+    free(dst);
+}
+
+void generate_ternary(struct ternary_exp ternary_exp,
+                      struct offset_table* table) {
+    if (can_select(ternary_exp.condition, ternary_exp.exp1, ternary_exp.exp2)) {
+        generate_select(ternary_exp.condition,
+                        ternary_exp.exp1,
+                        ternary_exp.exp2,
+                        table);
+        return;
+    }
+
+    char* l_true = get_label();
+    char* l_false = get_label();
     char* l_done = get_label();
+    int result = register_offset;
+    register_offset += 1;
+    char* reg = get_reg(result);
+
+    generate(ternary_exp.condition, table, l_true, l_false);
+    char* line = alloc_line();
+    sprintf(line, instruction[LABEL], l_true);
+    append_ins(line);
+    generate(ternary_exp.exp1, table, 0, 0);
+    char* src = get_reg(register_offset - 1);
+    line = alloc_line();
+    sprintf(line, instruction[I2I], src, reg);
+    append_ins(line);
+    free(src);
+    line = alloc_line();
+    sprintf(line, instruction[JUMP_I], l_done);
+    append_ins(line);
+
+    line = alloc_line();
+    sprintf(line, instruction[LABEL], l_false);
+    append_ins(line);
+    generate(ternary_exp.exp2, table, 0, 0);
+    src = get_reg(register_offset - 1);
+    line = alloc_line();
+    sprintf(line, instruction[I2I], src, reg);
+    append_ins(line);
+    free(src);
+
+    line = alloc_line();
+    sprintf(line, instruction[LABEL], l_done);
+    append_ins(line);
+    char* dst = next_reg();
+    line = alloc_line();
+    sprintf(line, instruction[I2I], reg, dst);
+    append_ins(line);
+
+    free(reg);
+    free(dst);
+    free(l_true);
+    free(l_false);
+    free(l_done);
+}
+
+static struct node* single_assignment(struct node* cmd_block) {
+    if (cmd_block == 0) {
+        return 0;
+    }
+    struct node* list = cmd_block->val.cmd_block.high_list;
+    if (list == 0 || list->type != N_ATTRIBUTION ||
+        list->val.attr_cmd.var->val.var.array_access != 0) {
+        return 0;
+    }
+    return list;
+}
+
+static bool same_var(struct node* a, struct node* b) {
+    return strcmp(a->val.var.token.val.string_v,
+                  b->val.var.token.val.string_v) == 0;
+}
+
+static bool convert_if(struct if_cmd if_cmd, struct offset_table* table) {
+    struct node* then_attr = single_assignment(if_cmd.then_cmd_block);
+    struct node* else_attr = single_assignment(if_cmd.else_cmd_block);
+    if (then_attr == 0 || else_attr == 0 ||
+        !same_var(then_attr->val.attr_cmd.var, else_attr->val.attr_cmd.var) ||
+        !can_select(if_cmd.condition,
+                    then_attr->val.attr_cmd.exp,
+                    else_attr->val.attr_cmd.exp)) {
+        return false;
+    }
+
+    generate_select(if_cmd.condition,
+                    then_attr->val.attr_cmd.exp,
+                    else_attr->val.attr_cmd.exp,
+                    table);
+    generate_attribution(then_attr->val.attr_cmd, table);
+    return true;
+}
+
+void generate_if(struct if_cmd if_cmd, struct offset_table* table) {
+    if (convert_if(if_cmd, table)) {
+        return;
+    }
+
+    char* l_true = get_label();
+    char* l_false = get_label();
+    char* l_done = get_label();
+
+    generate(if_cmd.condition, table, l_true, l_false);
+    char* line = alloc_line();
+    sprintf(line, instruction[LABEL], l_true);
+    append_ins(line);
+    generate(if_cmd.then_cmd_block, table, 0, 0);
+    line = alloc_line();
+    sprintf(line, instruction[JUMP_I], l_done);
+    append_ins(line);
+    line = alloc_line();
+    sprintf(line, instruction[LABEL], l_false);
+    append_ins(line);
+    generate(if_cmd.else_cmd_block, table, 0, 0);
+    line = alloc_line();
+    sprintf(line, instruction[LABEL], l_done);
+    append_ins(line);
+
+    free(l_true);
+    free(l_false);
+    free(l_done);
+}
+
+static char* continue_label(struct node* body) {
+    return has_continue(body) ? get_label() : 0;
+}
+
+static void end_continue(char* l_outer) {
+    if (l_continue != 0) {
+        char* line = alloc_line();
+        sprintf(line, instruction[LABEL], l_continue);
+        append_ins(line);
+        free(l_continue);
+    }
+    l_continue = l_outer;
+}
+
+/* Continue jumps to a label placed right after the body, ahead of the
+ * update and the loop test. */
+static void generate_body(struct node* body,
+                          char* l_exit,
+                          struct offset_table* table) {
+    char* l_outer = l_break;
+    char* l_outer_continue = l_continue;
+    l_break = l_exit;
+    l_continue = continue_label(body);
+    generate(body, table, 0, 0);
+    l_break = l_outer;
+    end_continue(l_outer_continue);
+}
+
+static void generate_loop(struct node* condition,
+                          struct node* cmd_block,
+                          struct node* update,
+                          struct offset_table* table) {
+    char* l_true = get_label();
+    char* l_false = get_label();
+
+    generate(condition, table, l_true, l_false);
+    char* line = alloc_line();
+    sprintf(line, instruction[LABEL], l_true);
+    append_ins(line);
+    generate_body(cmd_block, l_false, table);
+    generate(update, table, 0, 0);
+    generate(condition, table, l_true, l_false);
+    line = alloc_line();
+    sprintf(line, instruction[LABEL], l_false);
+    append_ins(line);
+
+    free(l_true);
+    free(l_false);
+}
+
+void generate_while(struct while_cmd while_cmd, struct offset_table* table) {
+    generate_loop(while_cmd.condition, while_cmd.cmd_block, 0, table);
+}
+
+static bool is_var(struct node* node, char* name) {
+    return node != 0 && node->type == N_VAR &&
+           strcmp(node->val.var.token.val.string_v, name) == 0;
+}
+
+static bool assigns(struct node* node, char* name) {
+    if (node == 0) {
+        return false;
+    }
+
+    switch (node->type) {
+        case N_ATTRIBUTION:
+            return is_var(node->val.attr_cmd.var, name);
+        case N_LOCAL_VAR_DECL:
+            return strcmp(node->val.local_var_decl.token.val.string_v,
+                          name) == 0;
+        case N_SHIFT:
+            return is_var(node->val.shift_cmd.var, name);
+        case N_CMD_BLOCK:
+            return assigns(node->val.cmd_block.high_list, name);
+        case N_HIGH_LIST:
+            return assigns(node->val.high_list.high_list, name) ||
+                   assigns(node->val.high_list.cmd, name);
+        case N_CMD_LIST:
+            return assigns(node->val.cmd_list.cmd_list, name) ||
+                   assigns(node->val.cmd_list.cmd, name);
+        case N_IF:
+            return assigns(node->val.if_cmd.then_cmd_block, name) ||
+                   assigns(node->val.if_cmd.else_cmd_block, name);
+        case N_WHILE:
+            return assigns(node->val.while_cmd.cmd_block, name);
+        case N_DO_WHILE:
+            return assigns(node->val.do_while_cmd.cmd_block, name);
+        case N_FOR:
+            return assigns(node->val.for_cmd.initialization, name) ||
+                   assigns(node->val.for_cmd.update, name) ||
+                   assigns(node->val.for_cmd.cmd_block, name);
+        case N_FOREACH:
+            return strcmp(node->val.foreach_cmd.item, name) == 0 ||
+                   assigns(node->val.foreach_cmd.cmd_block, name);
+        case N_SWITCH:
+            return assigns(node->val.switch_cmd.cmd_block, name);
+        case N_RETURN:
+        case N_BREAK:
+        case N_CONTINUE:
+        case N_CASE:
+        case N_FUNCTION:
+        case N_OUTPUT:
+            return false;
+        default:
+            return true;
+    }
+}
+
+static long trip_count(struct for_cmd for_cmd, struct offset_table* table) {
+    struct node* init = for_cmd.initialization;
+    if (init != 0 && init->type == N_CMD_LIST) {
+        init = init->val.cmd_list.cmd;
+    }
+
+    char* name;
+    long first;
+    if (init != 0 && init->type == N_ATTRIBUTION &&
+        is_literal(init->val.attr_cmd.exp)) {
+        name = init->val.attr_cmd.var->val.var.token.val.string_v;
+        first = init->val.attr_cmd.exp->val.token.val.int_v;
+    } else if (init != 0 && init->type == N_LOCAL_VAR_DECL &&
+               is_literal(init->val.local_var_decl.init)) {
+        name = init->val.local_var_decl.token.val.string_v;
+        first = init->val.local_var_decl.init->val.token.val.int_v;
+    } else {
+        return -1;
+    }
+
+    struct address* var = get_address(name, table);
+    struct node* cond = for_cmd.condition;
+    struct node* update = for_cmd.update;
+    if (var == 0 || var->scope != LOCAL || cond->type != N_BINARY_EXP ||
+        !is_var(cond->val.binary_exp.left, name) ||
+        !is_literal(cond->val.binary_exp.right) || update == 0 ||
+        update->type != N_ATTRIBUTION ||
+        !is_var(update->val.attr_cmd.var, name) ||
+        update->val.attr_cmd.exp->type != N_BINARY_EXP ||
+        assigns(for_cmd.cmd_block, name)) {
+        return -1;
+    }
+
+    struct binary_exp step_exp = update->val.attr_cmd.exp->val.binary_exp;
+    long step;
+    if (step_exp.op == '+' && is_var(step_exp.left, name) &&
+        is_literal(step_exp.right)) {
+        step = step_exp.right->val.token.val.int_v;
+    } else if (step_exp.op == '+' && is_literal(step_exp.left) &&
+               is_var(step_exp.right, name)) {
+        step = step_exp.left->val.token.val.int_v;
+    } else if (step_exp.op == '-' && is_var(step_exp.left, name) &&
+               is_literal(step_exp.right)) {
+        step = -(long)step_exp.right->val.token.val.int_v;
+    } else {
+        return -1;
+    }
+
+    long last = cond->val.binary_exp.right->val.token.val.int_v;
+    long span = last - first;
+    long trips;
+    switch (cond->val.binary_exp.op) {
+        case '<':
+            trips = step <= 0 ? -1 : span <= 0 ? 0 : (span + step - 1) / step;
+            break;
+        case LE_OP:
+            trips = step <= 0 ? -1 : span < 0 ? 0 : span / step + 1;
+            break;
+        case '>':
+            trips = step >= 0 ? -1 : span >= 0 ? 0 : (span + step + 1) / step;
+            break;
+        case GE_OP:
+            trips = step >= 0 ? -1 : span > 0 ? 0 : span / step + 1;
+            break;
+        case NE_OP:
+            trips = step == 0 || span % step != 0 || span / step < 0
+                        ? -1
+                        : span / step;
+            break;
+        default:
+            trips = -1;
+            break;
+    }
+
+    long end = first + trips * step;
+    return end > INT_MAX || end < INT_MIN ? -1 : trips;
+}
+
+static int estimate_size(struct node* node) {
+    if (node == 0) {
+        return 0;
+    }
+
+    int size;
+    switch (node->type) {
+        case N_CMD_LIST:
+        case N_HIGH_LIST:
+        case N_CMD_BLOCK:
+        case N_EXP_LIST:
+            size = 0;
+            break;
+        case N_VAR:
+            size = node->val.var.array_access != 0 ? 4 : 1;
+            break;
+        case N_BINARY_EXP:
+        case N_CASE:
+            size = 2;
+            break;
+        case N_TERNARY_EXP:
+        case N_IF:
+        case N_RETURN:
+            size = 4;
+            break;
+        case N_SWITCH:
+        case N_DO_WHILE:
+        case N_WHILE:
+        case N_FOR:
+        case N_FOREACH:
+            size = 6;
+            break;
+        case N_FUNCTION:
+            size = CALL_SIZE;
+            break;
+        default:
+            size = 1;
+            break;
+    }
+
+    struct node* children[4];
+    int count = node_children(node, children);
+    int i;
+    for (i = 0; i < count; i++) {
+        size += estimate_size(children[i]);
+    }
+    return size;
+}
+
+static void generate_counted_loop(struct for_cmd for_cmd,
+                                  long trips,
+                                  struct offset_table* table) {
+    long size = estimate_size(for_cmd.cmd_block) +
+                estimate_size(for_cmd.update);
+    char* l_exit = get_label();
+
+    long i;
+    if (trips * size <= UNROLL_BUDGET) {
+        for (i = 0; i < trips; i++) {
+            generate_body(for_cmd.cmd_block, l_exit, table);
+            generate(for_cmd.update, table, 0, 0);
+        }
+    } else if (unroll_factor > 1 && trips >= unroll_factor &&
+               size * unroll_factor <= UNROLL_BUDGET) {
+        for (i = 0; i < trips % unroll_factor; i++) {
+            generate_body(for_cmd.cmd_block, l_exit, table);
+            generate(for_cmd.update, table, 0, 0);
+        }
+
+        char* l_top = get_label();
+        char* line = alloc_line();
+        sprintf(line, instruction[LABEL], l_top);
+        append_ins(line);
+        for (i = 0; i < unroll_factor; i++) {
+            generate_body(for_cmd.cmd_block, l_exit, table);
+            generate(for_cmd.update, table, 0, 0);
+        }
+        generate(for_cmd.condition, table, l_top, l_exit);
+        free(l_top);
+    } else {
+        generate_loop(for_cmd.condition,
+                      for_cmd.cmd_block,
+                      for_cmd.update,
+                      table);
+    }
+
+    char* line = alloc_line();
+    sprintf(line, instruction[LABEL], l_exit);
+    append_ins(line);
+    free(l_exit);
+}
+
+void generate_for(struct for_cmd for_cmd, struct offset_table* table) {
+    generate(for_cmd.initialization, table, 0, 0);
+
+    long trips = unroll_factor > 0 ? trip_count(for_cmd, table) : -1;
+    if (trips >= 0) {
+        generate_counted_loop(for_cmd, trips, table);
+    } else {
+        generate_loop(for_cmd.condition,
+                      for_cmd.cmd_block,
+                      for_cmd.update,
+                      table);
+    }
+}
+
+void generate_do_while(struct do_while_cmd do_while_cmd,
+                       struct offset_table* table) {
+    char* l_true = get_label();
+    char* l_false = get_label();
+
+    char* line = alloc_line();
+    sprintf(line, instruction[LABEL], l_true);
+    append_ins(line);
+    generate_body(do_while_cmd.cmd_block, l_false, table);
+    generate(do_while_cmd.condition, table, l_true, l_false);
+    line = alloc_line();
+    sprintf(line, instruction[LABEL], l_false);
+    append_ins(line);
+
+    free(l_true);
+    free(l_false);
+}
+
+static bool can_inline(struct inline_function* callee, int depth) {
+    return callee != 0 && callee->generated && !callee->recursive &&
+           depth < INLINE_MAX_DEPTH &&
+           (callee->size <= inline_limit ||
+            (callee->sites == 1 && callee->size <= INLINE_SINGLE_SITE_SIZE));
+}
+
+static bool should_inline(struct inline_function* callee) {
+    return can_inline(callee, inline_depth);
+}
+
+static bool is_tail_call(struct node* exp) {
+    return tail_calls && !in_main && inline_depth == 0 && exp != 0 &&
+           exp->type == N_FUNCTION &&
+           !should_inline(
+               find_inline_function(exp->val.function_cmd.token.val.string_v));
+}
+
+static bool makes_calls(struct node* node, int depth) {
+    if (node == 0) {
+        return false;
+    }
+
+    if (node->type == N_RETURN && depth == 0 &&
+        is_tail_call(node->val.return_cmd.exp)) {
+        struct node* call = node->val.return_cmd.exp;
+        return makes_calls(call->val.function_cmd.arg_list, depth);
+    }
+
+    if (node->type == N_FUNCTION) {
+        struct inline_function* callee =
+            find_inline_function(node->val.function_cmd.token.val.string_v);
+        if (!can_inline(callee, depth) ||
+            makes_calls(callee->def->cmd_block, depth + 1)) {
+            return true;
+        }
+    }
+
+    struct node* children[4];
+    int count = node_children(node, children);
+    int i;
+    for (i = 0; i < count; i++) {
+        if (makes_calls(children[i], depth)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int collect_statements(struct node* list, struct node** statements) {
+    if (list == 0) {
+        return 0;
+    }
+
+    if (list->type != N_HIGH_LIST) {
+        if (statements != 0) {
+            statements[0] = list;
+        }
+        return 1;
+    }
+
+    int count = collect_statements(list->val.high_list.high_list, statements);
+    if (statements != 0) {
+        statements[count] = list->val.high_list.cmd;
+    }
+    return count + 1;
+}
+
+static char* generate_prologue() {
+    char* line = alloc_line();
+    sprintf(line, instruction[STORE_AI], "rsp", "rsp", 4);
+    append_ins(line);
+
+    line = alloc_line();
+    sprintf(line, instruction[STORE_AI], "rfp", "rsp", 8);
+    append_ins(line);
+
+    line = alloc_line();
+    sprintf(line, instruction[I2I], "rsp", "rfp");
+    append_ins(line);
+
+    char* addI = alloc_line();
+    append_ins(addI);
+
+    frame_reg = "rfp";
+    framed = true;
+    return addI;
+}
+
+static void generate_epilogue() {
+    char* reg = next_reg();
+
+    char* line = alloc_line();
+    sprintf(line, instruction[LOAD_AI], frame_reg, 0, reg);
+    append_ins(line);
+
+    if (framed) {
+        line = alloc_line();
+        sprintf(line, instruction[LOAD_AI], "rfp", 4, "rsp");
+        append_ins(line);
+
+        line = alloc_line();
+        sprintf(line, instruction[LOAD_AI], "rfp", 8, "rfp");
+        append_ins(line);
+    }
+
+    line = alloc_line();
+    sprintf(line, instruction[JUMP], reg);
+    append_ins(line);
+
+    free(reg);
+}
+
+void generate_function_def(struct function_def function_def,
+                           struct offset_table* table) {
+    char* line = alloc_line();
+    sprintf(line, instruction[FLABEL], function_def.token.val.string_v);
+    append_ins(line);
+
+    bool is_main = strcmp(function_def.token.val.string_v, "main") == 0;
+    in_main = is_main;
+    current_function = function_def.token.val.string_v;
+
+    struct inline_function* function =
+        find_inline_function(function_def.token.val.string_v);
+    if (function != 0) {
+        function->scope = table->head;
+        function->generated = true;
+    }
+
+    local_offset = 16;
+    register_params = 0;
+    struct node* param = function_def.params;
+    struct address* var = 0;
+    while (param != 0) {
+        var = malloc(sizeof *var);
+        var->id = param->val.parameter.token.val.string_v;
+        if (register_params < call_registers) {
+            var->scope = REGISTER;
+            var->offset = register_params++;
+        } else {
+            var->scope = LOCAL;
+            var->offset = local_offset;
+        }
+        local_offset += 4;
+
+        var->next = table->head;
+        table->head = var;
+
+        param = param->val.parameter.next;
+    }
+    local_offset = assign_slots(function_def.cmd_block, local_offset);
+    frame_size = local_offset;
+
+    struct node* list = function_def.cmd_block->val.cmd_block.high_list;
+    int count = collect_statements(list, 0);
+    struct node** statements = malloc(count * sizeof *statements);
+    collect_statements(list, statements);
+
+    int split = 0;
+    if (shrink_wrap && !is_main) {
+        while (split < count && !makes_calls(statements[split], 0)) {
+            split++;
+        }
+    }
+
+    char* addI = 0;
+    frame_reg = "rsp";
+    framed = false;
+    if (is_main) {
+        addI = alloc_line();
+        append_ins(addI);
+        frame_reg = "rfp";
+        framed = true;
+    } else if (split == 0) {
+        addI = generate_prologue();
+    }
+
+    if (!is_main && tail_calls &&
+        has_tail_call(function_def.cmd_block, current_function)) {
+        l_tail = get_label();
+        tail_framed = framed;
+        line = alloc_line();
+        sprintf(line, instruction[LABEL], l_tail);
+        append_ins(line);
+    }
+
+    register_offset = call_registers;
+    int i;
+    for (i = 0; i < count; i++) {
+        if (!framed && i == split) {
+            addI = generate_prologue();
+        }
+        generate(statements[i], table, 0, 0);
+    }
+    free(statements);
+
+    if (addI != 0) {
+        sprintf(addI, instruction[ADD_I], "rsp", frame_size, "rsp");
+    }
+
+    if (!is_main) {
+        generate_epilogue();
+    } else {
+        line = alloc_line();
+        sprintf(line, "%s", instruction[HALT]);
+        append_ins(line);
+    }
+
+    free(l_tail);
+    l_tail = 0;
+    frame_reg = "rfp";
+    framed = true;
+    register_params = 0;
+}
+
+static int generate_arguments(struct node* arg_list,
+                              struct offset_table* table,
+                              int** regs) {
+    int count = 0;
+    struct node* arg;
+    for (arg = arg_list; arg != 0; arg = arg->val.arg_list.next) {
+        count++;
+    }
+
+    *regs = malloc(count * sizeof **regs);
+    int i = 0;
+    for (arg = arg_list; arg != 0; arg = arg->val.arg_list.next) {
+        generate(arg->val.arg_list.arg, table, 0, 0);
+        (*regs)[i++] = register_offset - 1;
+        push_pending(register_offset - 1);
+    }
+    pending_count -= count;
+    return count;
+}
+
+static void pass_arguments(int* regs, int count, char* base) {
+    int i;
+    for (i = 0; i < count; i++) {
+        char* reg = get_reg(regs[i]);
+        char* line = alloc_line();
+        if (i < call_registers) {
+            char* param = get_reg(i);
+            sprintf(line, instruction[I2I], reg, param);
+            free(param);
+        } else {
+            sprintf(line, instruction[STORE_AI], reg, base, 16 + 4 * i);
+        }
+        append_ins(line);
+        free(reg);
+    }
+}
+
+static void generate_tail_call(struct function_cmd function_cmd,
+                               struct offset_table* table) {
+    int* regs;
+    int count = generate_arguments(function_cmd.arg_list, table, &regs);
+
+    bool self = l_tail != 0 &&
+                strcmp(function_cmd.token.val.string_v, current_function) == 0;
+    bool in_place = self && tail_framed;
+    char* base = in_place ? "rfp" : "rsp";
+    char* line;
+    if (framed && !in_place) {
+        line = alloc_line();
+        sprintf(line, instruction[I2I], "rfp", "rsp");
+        append_ins(line);
+
+        line = alloc_line();
+        sprintf(line, instruction[LOAD_AI], "rfp", 8, "rfp");
+        append_ins(line);
+    }
+
+    pass_arguments(regs, count, base);
+
+    char* target = self ? strdup(l_tail)
+                        : get_flabel(function_cmd.token.val.string_v);
+    line = alloc_line();
+    sprintf(line, instruction[JUMP_I], target);
+    append_ins(line);
+
+    free(target);
+    free(regs);
+}
+
+void generate_return(struct return_cmd return_cmd, struct offset_table* table) {
+    if (is_tail_call(return_cmd.exp)) {
+        generate_tail_call(return_cmd.exp->val.function_cmd, table);
+        return;
+    }
+
+    generate(return_cmd.exp, table, 0, 0);
+
+    char* reg = get_reg(register_offset - 1);
+
+    char* line = alloc_line();
+    if (l_inline_exit != 0) {
+        char* result = get_reg(inline_result);
+        sprintf(line, instruction[I2I], reg, result);
+        append_ins(line);
+        line = alloc_line();
+        sprintf(line, instruction[JUMP_I], l_inline_exit);
+        append_ins(line);
+        free(result);
+        free(reg);
+        return;
+    }
+
+    if (call_registers > 0 && !in_main) {
+        char* result = get_reg(0);
+        sprintf(line, instruction[I2I], reg, result);
+        free(result);
+    } else {
+        sprintf(line, instruction[STORE_AI], reg, frame_reg, 12);
+    }
+    append_ins(line);
+
+    free(reg);
+
+    if (in_main) {
+        line = alloc_line();
+        sprintf(line, "%s", instruction[HALT]);
+        append_ins(line);
+        return;
+    }
+
+    generate_epilogue();
+}
+
+static struct node* single_return(struct node* cmd_block) {
+    struct node* list = cmd_block->val.cmd_block.high_list;
+    if (list == 0 || list->type != N_RETURN) {
+        return 0;
+    }
+    return list->val.return_cmd.exp;
+}
+
+static void generate_inline(struct inline_function* callee,
+                            struct function_cmd function_cmd,
+                            struct offset_table* table) {
+    struct offset_table scope;
+    scope.head = callee->scope;
+    int outer_offset = local_offset;
+
+    struct node* param = callee->def->params;
+    struct node* arg = function_cmd.arg_list;
+    while (param != 0 && arg != 0) {
+        generate(arg->val.arg_list.arg, table, 0, 0);
+
+        struct address* var = malloc(sizeof *var);
+        var->id = param->val.parameter.token.val.string_v;
+        var->scope = LOCAL;
+        var->offset = alloc_slot(0);
+        generate_store(var);
+
+        var->next = scope.head;
+        scope.head = var;
+
+        param = param->val.parameter.next;
+        arg = arg->val.arg_list.next;
+    }
+
+    char* l_outer_break = l_break;
+    char* l_outer_continue = l_continue;
+    char* l_outer_exit = l_inline_exit;
+    int outer_result = inline_result;
+    l_break = 0;
+    l_continue = 0;
+    inline_depth++;
+
+    struct node* exp = single_return(callee->def->cmd_block);
+    if (exp != 0) {
+        l_inline_exit = 0;
+        generate(exp, &scope, 0, 0);
+    } else {
+        l_inline_exit = get_label();
+        inline_result = register_offset;
+        register_offset += 1;
+        generate(callee->def->cmd_block, &scope, 0, 0);
+
+        char* line = alloc_line();
+        sprintf(line, instruction[LABEL], l_inline_exit);
+        append_ins(line);
+
+        char* result = get_reg(inline_result);
+        char* reg = next_reg();
+        line = alloc_line();
+        sprintf(line, instruction[I2I], result, reg);
+        append_ins(line);
+
+        free(result);
+        free(reg);
+        free(l_inline_exit);
+    }
+
+    inline_depth--;
+    l_break = l_outer_break;
+    l_continue = l_outer_continue;
+    l_inline_exit = l_outer_exit;
+    inline_result = outer_result;
+
+    while (scope.head != callee->scope) {
+        struct address* next = scope.head->next;
+        free(scope.head);
+        scope.head = next;
+    }
+    local_offset = outer_offset;
+}
+
+static void spill_registers(int opcode, int offset) {
+    int i;
+    for (i = 0; i < register_params + pending_count; i++) {
+        char* reg = get_reg(i < register_params ? i
+                                                : pending[i - register_params]);
+        char* line = alloc_line();
+        if (opcode == STORE_AI) {
+            sprintf(line, instruction[STORE_AI], reg, frame_reg, offset);
+        } else {
+            sprintf(line, instruction[LOAD_AI], frame_reg, offset, reg);
+        }
+        append_ins(line);
+        offset += 4;
+        free(reg);
+    }
+}
+
+void generate_function(struct function_cmd function_cmd,
+                       struct offset_table* table) {
+    struct inline_function* callee =
+        find_inline_function(function_cmd.token.val.string_v);
+    if (should_inline(callee)) {
+        generate_inline(callee, function_cmd, table);
+        return;
+    }
+
+    int* regs;
+    int count = generate_arguments(function_cmd.arg_list, table, &regs);
+
+    char* l_return = get_label();
+    char* ins_reg = get_reg(register_offset);
+    register_offset++;
+    char* line = alloc_line();
+    sprintf(line, instruction[LOAD_LABEL], l_return, ins_reg);
+    append_ins(line);
+
+    line = alloc_line();
+    sprintf(line, instruction[STORE_AI], ins_reg, "rsp", 0);
+    append_ins(line);
+
+    spill_registers(STORE_AI, local_offset);
+    int save_end = local_offset + 4 * (register_params + pending_count);
+    if (save_end > frame_size) {
+        frame_size = save_end;
+    }
+    pass_arguments(regs, count, "rsp");
+    free(regs);
+
+    char* flabel = get_flabel(function_cmd.token.val.string_v);
+    line = alloc_line();
+    sprintf(line, instruction[JUMP_I], flabel);
+    append_ins(line);
+    free(flabel);
+
+    line = alloc_line();
+    sprintf(line, instruction[LABEL], l_return);
+    append_ins(line);
+    free(l_return);
+    free(ins_reg);
+
+    char* reg = get_reg(register_offset);
+    register_offset += 1;
+    line = alloc_line();
+    if (call_registers > 0) {
+        char* result = get_reg(0);
+        sprintf(line, instruction[I2I], result, reg);
+        append_ins(line);
+        free(result);
+    }
+
+    spill_registers(LOAD_AI, local_offset);
+
+    if (call_registers == 0) {
+        sprintf(line, instruction[LOAD_AI], "rsp", 12, reg);
+        append_ins(line);
+    }
+    free(reg);
+}
+
+char* alloc_line() {
+    char* line = malloc(64 * sizeof *line);
+    return line;
+}
+
+void append_ins(char* line) {
+    struct ins* ins = malloc(sizeof *ins);
+    ins->line = line;
+    ins->next = 0;
+
+    if (code.head == 0) {
+        code.head = ins;
+        code.last = ins;
+    } else {
+        code.last->next = ins;
+        code.last = ins;
+    }
+}
+
+void free_code(struct ins* head) {
+    if (head != 0) {
+        free(head->line);
+        free_code(head->next);
+    }
+
+    free(head);
+}
+
+void print_code(FILE* out) {
+    struct ins* ins = code.head;
+
+    while (ins != 0) {
+        fprintf(out, "%s", ins->line);
+        ins = ins->next;
+    }
+}
+
+static void collect_cases(struct node* node, struct switch_cases* cases) {
+    if (node == 0) {
+        return;
+    }
+
+    if (node->type == N_CMD_BLOCK) {
+        collect_cases(node->val.cmd_block.high_list, cases);
+    } else if (node->type == N_HIGH_LIST) {
+        collect_cases(node->val.high_list.high_list, cases);
+        collect_cases(node->val.high_list.cmd, cases);
+    } else if (node->type == N_CASE) {
+        if (cases->count == cases->capacity) {
+            cases->capacity = cases->capacity == 0 ? 8 : 2 * cases->capacity;
+            cases->cases = realloc(cases->cases,
+                                   cases->capacity * sizeof *cases->cases);
+        }
+
+        struct switch_case* item = &cases->cases[cases->count++];
+        item->val = node->val.case_label.case_val;
+        item->label = get_label();
+        item->node = node;
+    }
+}
+
+static int compare_cases(const void* a, const void* b) {
+    const struct switch_case* x = a;
+    const struct switch_case* y = b;
+    return (x->val > y->val) - (x->val < y->val);
+}
+
+static int unique_cases(struct switch_cases* cases, struct switch_case* out) {
+    int count = 0;
+    int i, j;
+    for (i = 0; i < cases->count; i++) {
+        for (j = 0; j < count; j++) {
+            if (out[j].val == cases->cases[i].val) {
+                break;
+            }
+        }
+        if (j == count) {
+            out[count++] = cases->cases[i];
+        }
+    }
+
+    qsort(out, count, sizeof *out, compare_cases);
+    return count;
+}
+
+static void generate_compare(int op,
+                             char* value,
+                             int val,
+                             char* l_true,
+                             char* l_false) {
+    char* reg = get_reg(register_offset);
+    char* cmp = get_reg(register_offset + 1);
+    register_offset += 2;
 
-    generate(if_cmd.condition, table, l_true, l_false);
     char* line = alloc_line();
-    sprintf(line, instruction[LABEL], l_true);
-    append_ins(line);
-    generate(if_cmd.then_cmd_block, table, 0, 0);
-    line = alloc_line();
-    sprintf(line, instruction[JUMP_I], l_done);
+    sprintf(line, instruction[LOAD_I], val, reg);
     append_ins(line);
-    ins++;
+
     line = alloc_line();
-    sprintf(line, instruction[LABEL], l_false);
+    sprintf(line, instruction[op], value, reg, cmp);
     append_ins(line);
-    generate(if_cmd.else_cmd_block, table, 0, 0);
+
     line = alloc_line();
-    sprintf(line, instruction[LABEL], l_done);
+    sprintf(line, instruction[CBR], cmp, l_true, l_false);
     append_ins(line);
 
-    free(l_true);
-    free(l_false);
-    free(l_done);
+    free(reg);
+    free(cmp);
 }
 
-void generate_while(struct while_cmd while_cmd, struct offset_table* table) {
-    char* l_true = get_label();
-    char* l_false = get_label();
-    char* l_begin = get_label();
+static void generate_case_chain(struct switch_case* cases,
+                                int count,
+                                char* value,
+                                char* l_default) {
+    int i;
+    for (i = 0; i < count; i++) {
+        if (i == count - 1) {
+            generate_compare(CMP_EQ, value, cases[i].val, cases[i].label,
+                             l_default);
+            break;
+        }
+
+        char* l_next = get_label();
+        generate_compare(CMP_EQ, value, cases[i].val, cases[i].label, l_next);
+
+        char* line = alloc_line();
+        sprintf(line, instruction[LABEL], l_next);
+        append_ins(line);
+        free(l_next);
+    }
+}
+
+static void generate_case_tree(struct switch_case* cases,
+                               int count,
+                               char* value,
+                               char* l_default) {
+    if (count <= LINEAR_CASES) {
+        generate_case_chain(cases, count, value, l_default);
+        return;
+    }
+
+    int middle = count / 2;
+    char* l_low = get_label();
+    char* l_high = get_label();
+
+    generate_compare(CMP_LT, value, cases[middle].val, l_low, l_high);
 
     char* line = alloc_line();
-    sprintf(line, instruction[LABEL], l_begin);
-    append_ins(line);
-    generate(while_cmd.condition, table, l_true, l_false);
-    line = alloc_line();
-    sprintf(line, instruction[LABEL], l_true);
-    append_ins(line);
-    generate(while_cmd.cmd_block, table, 0, 0);
-    line = alloc_line();
-    sprintf(line, instruction[JUMP_I], l_begin);
+    sprintf(line, instruction[LABEL], l_low);
     append_ins(line);
-    ins++;
+    generate_case_tree(cases, middle, value, l_default);
+
     line = alloc_line();
-    sprintf(line, instruction[LABEL], l_false);
+    sprintf(line, instruction[LABEL], l_high);
     append_ins(line);
+    generate_case_tree(cases + middle, count - middle, value, l_default);
 
-    free(l_true);
-    free(l_false);
-    free(l_begin);
+    free(l_low);
+    free(l_high);
 }
 
-void generate_do_while(struct do_while_cmd do_while_cmd,
-                       struct offset_table* table) {
-    char* l_true = get_label();
-    char* l_false = get_label();
+static void generate_jump_table(struct switch_case* cases,
+                                int count,
+                                char* value,
+                                char* l_default) {
+    int low = cases[0].val;
+    int size = (long long)cases[count - 1].val - low + 1;
+
+    char* name = malloc(64 * sizeof *name);
+    snprintf(name, 64 * sizeof *name, "%s.switch%d", current_function,
+             label_offset);
+    char* l_above = get_label();
+    char* l_check = get_label();
+    char* l_fill = get_label();
+    char* l_jump = get_label();
 
     char* line = alloc_line();
-    sprintf(line, instruction[LABEL], l_true);
+    sprintf(line, instruction[GLOBAL_DECL], name, 4 * size);
     append_ins(line);
-    generate(do_while_cmd.cmd_block, table, 0, 0);
-    generate(do_while_cmd.condition, table, l_true, l_false);
+
+    generate_compare(CMP_LT, value, low, l_default, l_above);
     line = alloc_line();
-    sprintf(line, instruction[LABEL], l_false);
+    sprintf(line, instruction[LABEL], l_above);
+    append_ins(line);
+    generate_compare(CMP_GT, value, cases[count - 1].val, l_default, l_check);
+    line = alloc_line();
+    sprintf(line, instruction[LABEL], l_check);
     append_ins(line);
 
-    free(l_true);
-    free(l_false);
-}
+    char* reg = get_reg(register_offset);
+    register_offset++;
+    line = alloc_line();
+    sprintf(line, instruction[LOAD_GLOBAL], "rbss", name, reg);
+    append_ins(line);
+    char* first = reg;
+    generate_compare(CMP_NE, first, 0, l_jump, l_fill);
+    free(first);
 
-void generate_function_def(struct function_def function_def,
-                           struct offset_table* table) {
-    char* line = alloc_line();
-    sprintf(line, instruction[FLABEL], function_def.token.val.string_v);
+    line = alloc_line();
+    sprintf(line, instruction[LABEL], l_fill);
     append_ins(line);
 
-    bool is_main = strcmp(function_def.token.val.string_v, "main") == 0;
+    int i, k = 0;
+    for (i = 0; i < size; i++) {
+        char* target = l_default;
+        if ((long long)cases[k].val - low == i) {
+            target = cases[k++].label;
+        }
+
+        reg = get_reg(register_offset);
+        char* addr = get_reg(register_offset + 1);
+        register_offset += 2;
 
-    if (!is_main) {
         line = alloc_line();
-        sprintf(line, instruction[STORE_AI], "rsp", "rsp", 4);
+        sprintf(line, instruction[LOAD_LABEL], target, reg);
         append_ins(line);
-        ins++;
 
         line = alloc_line();
-        sprintf(line, instruction[STORE_AI], "rfp", "rsp", 8);
+        sprintf(line, instruction[ADD_I], "rbss", 4 * i, addr);
         append_ins(line);
-        ins++;
 
         line = alloc_line();
-        sprintf(line, instruction[I2I], "rsp", "rfp");
+        sprintf(line, instruction[STORE_GLOBAL], reg, addr, name);
         append_ins(line);
-        ins++;
 
-        local_offset = 16;
-    } else {
-        local_offset = 0;
+        free(reg);
+        free(addr);
     }
 
-    char* addI = alloc_line();
-    append_ins(addI);
-    ins++;
-
-    struct node* param = function_def.params;
-    struct address* var = 0;
-    while (param != 0) {
-        var = malloc(sizeof *var);
-        var->id = param->val.parameter.token.val.string_v;
-        var->scope = LOCAL;
-        var->offset = local_offset;
-        local_offset += 4;
+    line = alloc_line();
+    sprintf(line, instruction[LABEL], l_jump);
+    append_ins(line);
 
-        var->next = table->head;
-        table->head = var;
+    char* index = value;
+    if (low != 0) {
+        index = get_reg(register_offset);
+        register_offset++;
 
-        param = param->val.parameter.next;
+        line = alloc_line();
+        sprintf(line, instruction[SUB_I], value, low, index);
+        append_ins(line);
     }
 
-    register_offset = 0;
-    generate(function_def.cmd_block, table, 0, 0);
+    char* offset = get_reg(register_offset);
+    char* addr = get_reg(register_offset + 1);
+    char* target = get_reg(register_offset + 2);
+    register_offset += 3;
 
-    sprintf(addI, instruction[ADD_I], "rsp", local_offset, "rsp");
+    line = alloc_line();
+    sprintf(line, instruction[LSHIFT_I], index, 2, offset);
+    append_ins(line);
 
-    if (!is_main) {
-        char *reg = get_reg(register_offset);
-        register_offset++;
+    line = alloc_line();
+    sprintf(line, instruction[ADD], "rbss", offset, addr);
+    append_ins(line);
 
-        line = alloc_line();
-        sprintf(line, instruction[LOAD_AI], "rfp", 0, reg);
-        append_ins(line);
-        ins++;
+    line = alloc_line();
+    sprintf(line, instruction[LOAD_GLOBAL], addr, name, target);
+    append_ins(line);
 
-        line = alloc_line();
-        sprintf(line, instruction[LOAD_AI], "rfp", 4, "rsp");
-        append_ins(line);
-        ins++;
+    line = alloc_line();
+    sprintf(line, instruction[JUMP], target);
+    append_ins(line);
 
-        line = alloc_line();
-        sprintf(line, instruction[LOAD_AI], "rfp", 8, "rfp");
-        append_ins(line);
-        ins++;
+    if (index != value) {
+        free(index);
+    }
+    free(offset);
+    free(addr);
+    free(target);
+    free(name);
+    free(l_above);
+    free(l_check);
+    free(l_fill);
+    free(l_jump);
+}
 
-        line = alloc_line();
-        sprintf(line, instruction[JUMP], reg);
-        append_ins(line);
-        ins++;
+static bool fits_table(struct switch_case* cases, int count) {
+    long long span = (long long)cases[count - 1].val - cases[0].val;
+    return count >= TABLE_CASES && span < (long long)TABLE_DENSITY * count;
+}
 
-        free(reg);
-    } else {
-        line = alloc_line();
-        sprintf(line, "halt\n");
+static void generate_dispatch(struct switch_case* cases,
+                              int count,
+                              char* value,
+                              char* l_default) {
+    if (count == 0) {
+        char* line = alloc_line();
+        sprintf(line, instruction[JUMP_I], l_default);
         append_ins(line);
-        ins++;
+    } else if (count <= LINEAR_CASES) {
+        generate_case_chain(cases, count, value, l_default);
+    } else if (fits_table(cases, count)) {
+        generate_jump_table(cases, count, value, l_default);
+    } else {
+        generate_case_tree(cases, count, value, l_default);
     }
 }
 
-void generate_return(struct return_cmd return_cmd, struct offset_table* table) {
-    generate(return_cmd.exp, table, 0, 0);
+void generate_switch(struct switch_cmd switch_cmd, struct offset_table* table) {
+    generate(switch_cmd.control_exp, table, 0, 0);
+    char* value = get_reg(register_offset - 1);
+    char* l_end = get_label();
 
-    char* reg = get_reg(register_offset - 1);
+    struct switch_cases cases = {0, 0, 0};
+    collect_cases(switch_cmd.cmd_block, &cases);
 
-    char* line = alloc_line();
-    sprintf(line, instruction[STORE_AI], reg, "rfp", 12);
-    append_ins(line);
-    ins++;
+    struct switch_case* sorted = malloc((cases.count + 1) * sizeof *sorted);
+    int count = unique_cases(&cases, sorted);
 
-    free(reg);
+    generate_dispatch(sorted, count, value, l_end);
+    free(sorted);
 
-    reg = get_reg(register_offset);
-    register_offset++;
+    struct switch_cases* outer_cases = current_cases;
+    char* outer_break = l_break;
+    current_cases = &cases;
+    l_break = l_end;
+    generate(switch_cmd.cmd_block, table, 0, 0);
+    current_cases = outer_cases;
+    l_break = outer_break;
 
-    line = alloc_line();
-    sprintf(line, instruction[LOAD_AI], "rfp", 0, reg);
+    char* line = alloc_line();
+    sprintf(line, instruction[LABEL], l_end);
     append_ins(line);
-    ins++;
 
-    line = alloc_line();
-    sprintf(line, instruction[LOAD_AI], "rfp", 4, "rsp");
-    append_ins(line);
-    ins++;
+    int i;
+    for (i = 0; i < cases.count; i++) {
+        free(cases.cases[i].label);
+    }
+    free(cases.cases);
+    free(value);
+    free(l_end);
+}
 
-    line = alloc_line();
-    sprintf(line, instruction[LOAD_AI], "rfp", 8, "rfp");
-    append_ins(line);
-    ins++;
+void generate_case(struct node* node) {
+    if (current_cases == 0) {
+        return;
+    }
 
-    line = alloc_line();
-    sprintf(line, instruction[JUMP], reg);
-    append_ins(line);
-    ins++;
+    int i;
+    for (i = 0; i < current_cases->count; i++) {
+        if (current_cases->cases[i].node == node) {
+            char* line = alloc_line();
+            sprintf(line, instruction[LABEL], current_cases->cases[i].label);
+            append_ins(line);
+            return;
+        }
+    }
+}
 
-    free(reg);
+void generate_break() {
+    if (l_break != 0) {
+        char* line = alloc_line();
+        sprintf(line, instruction[JUMP_I], l_break);
+        append_ins(line);
+    }
 }
 
-void generate_function(struct function_cmd function_cmd,
-                       struct offset_table* table) {
+void generate_continue() {
+    if (l_continue != 0) {
+        char* line = alloc_line();
+        sprintf(line, instruction[JUMP_I], l_continue);
+        append_ins(line);
+    }
+}
 
-    struct node* arg = function_cmd.arg_list;
-    char* reg;
-    char* line;
-    int param_offset = 16;
-    while (arg != 0) {
-        generate(arg->val.arg_list.arg, table, 0, 0);
+static void generate_unrolled_foreach(struct foreach_cmd foreach_cmd,
+                                      struct address* item,
+                                      struct offset_table* table) {
+    char* l_exit = get_label();
+
+    struct node* exp;
+    for (exp = foreach_cmd.exp_list; exp != 0;
+         exp = exp->val.exp_list.exp_list) {
+        generate(exp->val.exp_list.exp, table, 0, 0);
+        generate_store(item);
+        generate_body(foreach_cmd.cmd_block, l_exit, table);
+    }
 
-        reg = get_reg(register_offset - 1);
+    char* line = alloc_line();
+    sprintf(line, instruction[LABEL], l_exit);
+    append_ins(line);
+    free(l_exit);
+}
 
-        line = alloc_line();
-        sprintf(line, instruction[STORE_AI], reg, "rsp", param_offset);
-        append_ins(line);
-        ins++;
+void generate_foreach(struct foreach_cmd foreach_cmd,
+                      struct offset_table* table) {
+    struct address* item = get_address(foreach_cmd.item, table);
+    if (item == 0) {
+        item = malloc(sizeof *item);
+        item->id = foreach_cmd.item;
+        item->scope = LOCAL;
+        item->offset = alloc_slot(foreach_cmd.item);
+
+        item->next = table->head;
+        table->head = item;
+    }
 
-        param_offset += 4;
-        arg = arg->val.arg_list.next;
+    int count = 0;
+    struct node* exp;
+    for (exp = foreach_cmd.exp_list; exp != 0;
+         exp = exp->val.exp_list.exp_list) {
+        count++;
+    }
 
-        free(reg);
+    if (unroll_factor > 0 &&
+        count * estimate_size(foreach_cmd.cmd_block) <= UNROLL_BUDGET) {
+        generate_unrolled_foreach(foreach_cmd, item, table);
+        return;
+    }
+
+    int outer_offset = local_offset;
+    int index_offset = alloc_slot(0);
+
+    struct switch_case* items = malloc(count * sizeof *items);
+    int i = 0;
+    for (exp = foreach_cmd.exp_list; exp != 0;
+         exp = exp->val.exp_list.exp_list) {
+        items[i].val = i;
+        items[i].label = get_label();
+        items[i].node = exp->val.exp_list.exp;
+        i++;
     }
 
-    char* rsp = alloc_line();
-    append_ins(rsp);
-    ins++;
+    char* l_top = get_label();
+    char* l_loaded = get_label();
+    char* l_exit = get_label();
 
-    char* ins_reg = get_reg(register_offset);
+    char* reg = get_reg(register_offset);
     register_offset++;
+    char* line = alloc_line();
+    sprintf(line, instruction[LOAD_I], 0, reg);
+    append_ins(line);
     line = alloc_line();
-    sprintf(line, instruction[STORE_AI], ins_reg, "rsp", 0);
+    sprintf(line, instruction[STORE_AI], reg, frame_reg, index_offset);
     append_ins(line);
-    ins++;
-
-    int mem_offset = local_offset;
-    int i;
-    for (i = 0; i < register_offset; i++) {
-        reg = get_reg(i);
-        line = alloc_line();
-        sprintf(line, instruction[STORE_AI], reg, "rfp", local_offset);
-        append_ins(line);
-        ins++;
-        local_offset += 4;
-        free(reg);
-    }
+    free(reg);
 
-    char* flabel = get_flabel(function_cmd.token.val.string_v);
     line = alloc_line();
-    sprintf(line, instruction[JUMP_I], flabel);
+    sprintf(line, instruction[LABEL], l_top);
     append_ins(line);
-    ins++;
-    free(flabel);
 
-    sprintf(rsp, instruction[LOAD_I], ins, ins_reg);
-    free(ins_reg);
+    char* index = get_reg(register_offset);
+    register_offset++;
+    line = alloc_line();
+    sprintf(line, instruction[LOAD_AI], frame_reg, index_offset, index);
+    append_ins(line);
+    generate_dispatch(items, count, index, l_exit);
 
-    for (i = 0; i < register_offset; i++) {
-        reg = get_reg(i);
+    for (i = 0; i < count; i++) {
         line = alloc_line();
-        sprintf(line, instruction[LOAD_AI], "rfp", mem_offset, reg);
+        sprintf(line, instruction[LABEL], items[i].label);
         append_ins(line);
-        ins++;
-        mem_offset += 4;
-        free(reg);
+        generate(items[i].node, table, 0, 0);
+        generate_store(item);
+
+        if (i < count - 1) {
+            line = alloc_line();
+            sprintf(line, instruction[JUMP_I], l_loaded);
+            append_ins(line);
+        }
+        free(items[i].label);
     }
+    free(items);
 
-    reg = get_reg(register_offset);
-    register_offset += 1;
     line = alloc_line();
-    sprintf(line, instruction[LOAD_AI], "rsp", 12, reg);
+    sprintf(line, instruction[LABEL], l_loaded);
     append_ins(line);
-    ins++;
-    free(reg);
-}
-
-char* alloc_line() {
-    char* line = malloc(64 * sizeof *line);
-    return line;
-}
-
-void append_ins(char* line) {
-    struct ins* ins = malloc(sizeof *ins);
-    ins->line = line;
-    ins->next = 0;
-
-    if (code.head == 0) {
-        code.head = ins;
-        code.last = ins;
-    } else {
-        code.last->next = ins;
-        code.last = ins;
-    }
-}
-
-void free_code(struct ins* head) {
-    if (head != 0) {
-        free(head->line);
-        free_code(head->next);
-    }
+    generate_body(foreach_cmd.cmd_block, l_exit, table);
 
-    free(head);
-}
+    char* current = get_reg(register_offset);
+    char* next = get_reg(register_offset + 1);
+    register_offset += 2;
+    line = alloc_line();
+    sprintf(line, instruction[LOAD_AI], frame_reg, index_offset, current);
+    append_ins(line);
+    line = alloc_line();
+    sprintf(line, instruction[ADD_I], current, 1, next);
+    append_ins(line);
+    line = alloc_line();
+    sprintf(line, instruction[STORE_AI], next, frame_reg, index_offset);
+    append_ins(line);
+    generate_compare(CMP_LT, next, count, l_top, l_exit);
 
-void print_code() {
-    struct ins* ins = code.head;
+    line = alloc_line();
+    sprintf(line, instruction[LABEL], l_exit);
+    append_ins(line);
 
-    while (ins != 0) {
-        printf("%s", ins->line);
-        ins = ins->next;
-    }
+    free(index);
+    free(current);
+    free(next);
+    free(l_top);
+    free(l_loaded);
+    free(l_exit);
+    local_offset = outer_offset;
 }
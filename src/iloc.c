@@ -0,0 +1,560 @@
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/iloc.h"
+
+#define MAX_LINE 256
+
+const char* mnemonic[OPCODE_COUNT] = {[STORE_AI] = "storeAI",
+                                      [LOAD_I] = "loadI",
+                                      [LOAD_AI] = "loadAI",
+                                      [ADD] = "add",
+                                      [SUB] = "sub",
+                                      [MULT] = "mult",
+                                      [DIV] = "div",
+                                      [CMP_LT] = "cmp_LT",
+                                      [CMP_LE] = "cmp_LE",
+                                      [CMP_GT] = "cmp_GT",
+                                      [CMP_GE] = "cmp_GE",
+                                      [CMP_EQ] = "cmp_EQ",
+                                      [CMP_NE] = "cmp_NE",
+                                      [CBR] = "cbr",
+                                      [JUMP_I] = "jumpI",
+                                      [I2I] = "i2i",
+                                      [ADD_I] = "addI",
+                                      [JUMP] = "jump",
+                                      [HALT] = "halt",
+                                      [NOP] = "nop",
+                                      [SUB_I] = "subI",
+                                      [RSUB_I] = "rsubI",
+                                      [MULT_I] = "multI",
+                                      [DIV_I] = "divI",
+                                      [RDIV_I] = "rdivI",
+                                      [LSHIFT] = "lshift",
+                                      [LSHIFT_I] = "lshiftI",
+                                      [RSHIFT] = "rshift",
+                                      [RSHIFT_I] = "rshiftI",
+                                      [AND] = "and",
+                                      [AND_I] = "andI",
+                                      [OR] = "or",
+                                      [OR_I] = "orI",
+                                      [XOR] = "xor",
+                                      [XOR_I] = "xorI",
+                                      [LOAD] = "load",
+                                      [LOAD_AO] = "loadAO",
+                                      [STORE] = "store",
+                                      [STORE_AO] = "storeAO"};
+
+struct operand make_reg(int reg) {
+    struct operand operand;
+    operand.type = OPERAND_REG;
+    operand.val = reg;
+    operand.name = 0;
+    return operand;
+}
+
+struct operand make_imm(int val) {
+    struct operand operand;
+    operand.type = OPERAND_IMM;
+    operand.val = val;
+    operand.name = 0;
+    return operand;
+}
+
+struct operand make_label(const char* name) {
+    struct operand operand;
+    operand.type = OPERAND_LABEL;
+    operand.val = 0;
+    operand.name = strdup(name);
+    return operand;
+}
+
+struct operand make_symbol(const char* name) {
+    struct operand operand;
+    operand.type = OPERAND_SYMBOL;
+    operand.val = 0;
+    operand.name = strdup(name);
+    return operand;
+}
+
+struct operand copy_operand(struct operand operand) {
+    if (operand.name != 0) {
+        operand.name = strdup(operand.name);
+    }
+    return operand;
+}
+
+void free_operand(struct operand* operand) {
+    free(operand->name);
+    operand->name = 0;
+}
+
+struct operation copy_operation(struct operation* operation) {
+    struct operation copy = *operation;
+    int i;
+    for (i = 0; i < 2; i++) {
+        copy.src[i] = copy_operand(operation->src[i]);
+        copy.dst[i] = copy_operand(operation->dst[i]);
+    }
+    return copy;
+}
+
+void free_operation(struct operation* operation) {
+    int i;
+    for (i = 0; i < 2; i++) {
+        free_operand(&operation->src[i]);
+        free_operand(&operation->dst[i]);
+    }
+}
+
+static bool is_number(const char* text) {
+    if (*text == '\0') {
+        return false;
+    }
+
+    while (*text != '\0') {
+        if (!isdigit((unsigned char)*text)) {
+            return false;
+        }
+        text++;
+    }
+
+    return true;
+}
+
+bool is_local_label(const char* name) {
+    if (name[0] != 'l' || !isdigit((unsigned char)name[1])) {
+        return false;
+    }
+
+    const char* end = name + 1;
+    while (isdigit((unsigned char)*end)) {
+        end++;
+    }
+
+    return *end == '\0' || (*end == '_' && is_number(end + 1));
+}
+
+bool is_function_label(struct operation* operation) {
+    return operation->opcode == LABEL && !is_local_label(operation->src[0].name);
+}
+
+int function_end(struct module* module, int start) {
+    int i;
+    for (i = start + 1; i < module->length; i++) {
+        if (is_function_label(&module->operations[i])) {
+            break;
+        }
+    }
+    return i;
+}
+
+int find_function(struct module* module, const char* name) {
+    int i;
+    for (i = 0; i < module->length; i++) {
+        struct operation* operation = &module->operations[i];
+        if (is_function_label(operation) &&
+            strcmp(operation->src[0].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static char* trim(char* text) {
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+
+    char* end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+    *end = '\0';
+
+    return text;
+}
+
+static bool parse_operand(char* text, struct operand* operand) {
+    text = trim(text);
+
+    if (strcmp(text, "rfp") == 0) {
+        *operand = make_reg(ILOC_RFP);
+    } else if (strcmp(text, "rsp") == 0) {
+        *operand = make_reg(ILOC_RSP);
+    } else if (strcmp(text, "rbss") == 0) {
+        *operand = make_reg(ILOC_RBSS);
+    } else if (strcmp(text, "rpc") == 0) {
+        *operand = make_reg(ILOC_RPC);
+    } else if (text[0] == 'r' && is_number(text + 1)) {
+        *operand = make_reg(atoi(text + 1));
+    } else if (text[0] == '@' && text[1] != '\0') {
+        *operand = make_symbol(text + 1);
+    } else if (isdigit((unsigned char)text[0]) ||
+               (text[0] == '-' && is_number(text + 1))) {
+        *operand = make_imm(atoi(text));
+    } else if (isalpha((unsigned char)text[0]) || text[0] == '_') {
+        *operand = make_label(text);
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+static bool parse_operands(char* text, struct operand* operands) {
+    text = trim(text);
+    if (*text == '\0') {
+        return true;
+    }
+
+    int i;
+    for (i = 0; i < 2; i++) {
+        char* comma = strchr(text, ',');
+        if (comma != 0) {
+            *comma = '\0';
+        }
+
+        if (!parse_operand(text, &operands[i])) {
+            return false;
+        }
+
+        if (comma == 0) {
+            return true;
+        }
+        text = comma + 1;
+    }
+
+    return false;
+}
+
+bool parse_operation(const char* line, struct operation* operation) {
+    char buffer[MAX_LINE];
+    memset(operation, 0, sizeof *operation);
+
+    if (strlen(line) >= sizeof buffer) {
+        return false;
+    }
+    strcpy(buffer, line);
+
+    char* comment = strstr(buffer, "//");
+    if (comment != 0) {
+        *comment = '\0';
+    }
+
+    char* text = trim(buffer);
+    size_t length = strlen(text);
+
+    if (length > 1 && text[length - 1] == ':') {
+        text[length - 1] = '\0';
+        operation->opcode = LABEL;
+        return parse_operand(text, &operation->src[0]) &&
+               operation->src[0].type == OPERAND_LABEL;
+    }
+
+    if (strncmp(text, ".global", 7) == 0 && isspace((unsigned char)text[7])) {
+        char name[MAX_LINE];
+        int size;
+        if (sscanf(text + 7, "%255s %d", name, &size) != 2) {
+            return false;
+        }
+        operation->opcode = GLOBAL_DECL;
+        operation->src[0] = make_symbol(name);
+        operation->src[1] = make_imm(size);
+        return true;
+    }
+
+    char* args = text;
+    while (*args != '\0' && !isspace((unsigned char)*args)) {
+        args++;
+    }
+    if (*args != '\0') {
+        *args++ = '\0';
+    }
+
+    int opcode;
+    for (opcode = 0; opcode < OPCODE_COUNT; opcode++) {
+        if (mnemonic[opcode] != 0 && strcmp(mnemonic[opcode], text) == 0) {
+            break;
+        }
+    }
+    if (opcode == OPCODE_COUNT) {
+        return false;
+    }
+    operation->opcode = opcode;
+
+    char* arrow = strstr(args, "=>");
+    if (arrow == 0) {
+        arrow = strstr(args, "->");
+    }
+
+    if (arrow != 0) {
+        *arrow = '\0';
+        if (!parse_operands(arrow + 2, operation->dst)) {
+            free_operation(operation);
+            return false;
+        }
+    }
+
+    if (!parse_operands(args, operation->src)) {
+        free_operation(operation);
+        return false;
+    }
+
+    return true;
+}
+
+static void print_operand(FILE* out, struct operand* operand) {
+    switch (operand->type) {
+        case OPERAND_REG:
+            switch (operand->val) {
+                case ILOC_RFP:
+                    fprintf(out, "rfp");
+                    break;
+                case ILOC_RSP:
+                    fprintf(out, "rsp");
+                    break;
+                case ILOC_RBSS:
+                    fprintf(out, "rbss");
+                    break;
+                case ILOC_RPC:
+                    fprintf(out, "rpc");
+                    break;
+                default:
+                    fprintf(out, "r%d", operand->val);
+                    break;
+            }
+            break;
+        case OPERAND_IMM:
+            fprintf(out, "%d", operand->val);
+            break;
+        case OPERAND_LABEL:
+            fprintf(out, "%s", operand->name);
+            break;
+        case OPERAND_SYMBOL:
+            fprintf(out, "@%s", operand->name);
+            break;
+        case OPERAND_NONE:
+            break;
+    }
+}
+
+static void print_operands(FILE* out, struct operand* operands) {
+    print_operand(out, &operands[0]);
+    if (operands[1].type != OPERAND_NONE) {
+        fprintf(out, ", ");
+        print_operand(out, &operands[1]);
+    }
+}
+
+static bool is_control_flow(enum instruction_constant opcode) {
+    switch (opcode) {
+        case CMP_LT:
+        case CMP_LE:
+        case CMP_GT:
+        case CMP_GE:
+        case CMP_EQ:
+        case CMP_NE:
+        case CBR:
+        case JUMP_I:
+        case JUMP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void print_operation(FILE* out, struct operation* operation) {
+    if (operation->opcode == LABEL) {
+        fprintf(out, "%s:\n", operation->src[0].name);
+        return;
+    }
+
+    if (operation->opcode == GLOBAL_DECL) {
+        fprintf(out,
+                ".global %s %d\n",
+                operation->src[0].name,
+                operation->src[1].val);
+        return;
+    }
+
+    fprintf(out, "%s", mnemonic[operation->opcode]);
+
+    if (operation->src[0].type != OPERAND_NONE) {
+        fprintf(out, " ");
+        print_operands(out, operation->src);
+    }
+
+    if (operation->dst[0].type != OPERAND_NONE) {
+        fprintf(out, is_control_flow(operation->opcode) ? " -> " : " => ");
+        print_operands(out, operation->dst);
+    }
+
+    fprintf(out, "\n");
+}
+
+struct module* alloc_module() {
+    struct module* module = malloc(sizeof *module);
+    module->operations = 0;
+    module->length = 0;
+    module->capacity = 0;
+    return module;
+}
+
+void free_module(struct module* module) {
+    if (module != 0) {
+        int i;
+        for (i = 0; i < module->length; i++) {
+            free_operation(&module->operations[i]);
+        }
+        free(module->operations);
+        free(module);
+    }
+}
+
+void append_operation(struct module* module, struct operation operation) {
+    if (module->length == module->capacity) {
+        module->capacity = module->capacity > 0 ? 2 * module->capacity : 64;
+        module->operations =
+            realloc(module->operations,
+                    module->capacity * sizeof *module->operations);
+    }
+    module->operations[module->length++] = operation;
+}
+
+static bool is_blank(const char* line) {
+    while (isspace((unsigned char)*line)) {
+        line++;
+    }
+    return *line == '\0' || strncmp(line, "//", 2) == 0;
+}
+
+struct module* read_module(FILE* in) {
+    struct module* module = alloc_module();
+    char* line = 0;
+    size_t size = 0;
+    int number = 0;
+
+    while (getline(&line, &size, in) != -1) {
+        number++;
+        if (is_blank(line)) {
+            continue;
+        }
+
+        struct operation operation;
+        if (!parse_operation(line, &operation)) {
+            fprintf(stderr,
+                    "Invalid ILOC operation at line %d: %s",
+                    number,
+                    line);
+            free(line);
+            free_module(module);
+            return 0;
+        }
+        append_operation(module, operation);
+    }
+
+    free(line);
+    return module;
+}
+
+struct module* code_to_module(struct ins* head) {
+    struct module* module = alloc_module();
+
+    struct ins* ins;
+    for (ins = head; ins != 0; ins = ins->next) {
+        struct operation operation;
+        if (!parse_operation(ins->line, &operation)) {
+            fprintf(stderr, "Invalid ILOC operation: %s", ins->line);
+            free_module(module);
+            return 0;
+        }
+        append_operation(module, operation);
+    }
+
+    return module;
+}
+
+void print_module(FILE* out, struct module* module) {
+    int i;
+    for (i = 0; i < module->length; i++) {
+        print_operation(out, &module->operations[i]);
+    }
+}
+
+struct label_map* alloc_label_map() {
+    struct label_map* map = malloc(sizeof *map);
+    map->capacity = 64;
+    map->count = 0;
+    map->names = calloc(map->capacity, sizeof *map->names);
+    map->indexes = malloc(map->capacity * sizeof *map->indexes);
+    return map;
+}
+
+void free_label_map(struct label_map* map) {
+    int i;
+    for (i = 0; i < map->capacity; i++) {
+        free(map->names[i]);
+    }
+    free(map->names);
+    free(map->indexes);
+    free(map);
+}
+
+static int find_slot(char** names, int capacity, const char* name) {
+    uint32_t hash = 2166136261u;
+    const char* c;
+    for (c = name; *c != '\0'; c++) {
+        hash ^= (unsigned char)*c;
+        hash *= 16777619u;
+    }
+
+    int slot = hash & (capacity - 1);
+    while (names[slot] != 0 && strcmp(names[slot], name) != 0) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return slot;
+}
+
+static void grow_label_map(struct label_map* map) {
+    int capacity = 2 * map->capacity;
+    char** names = calloc(capacity, sizeof *names);
+    int* indexes = malloc(capacity * sizeof *indexes);
+
+    int i;
+    for (i = 0; i < map->capacity; i++) {
+        if (map->names[i] != 0) {
+            int slot = find_slot(names, capacity, map->names[i]);
+            names[slot] = map->names[i];
+            indexes[slot] = map->indexes[i];
+        }
+    }
+
+    free(map->names);
+    free(map->indexes);
+    map->names = names;
+    map->indexes = indexes;
+    map->capacity = capacity;
+}
+
+bool add_label(struct label_map* map, const char* name, int index) {
+    if (2 * (map->count + 1) > map->capacity) {
+        grow_label_map(map);
+    }
+
+    int slot = find_slot(map->names, map->capacity, name);
+    if (map->names[slot] != 0) {
+        return false;
+    }
+
+    map->names[slot] = strdup(name);
+    map->indexes[slot] = index;
+    map->count++;
+    return true;
+}
+
+int find_label(struct label_map* map, const char* name) {
+    int slot = find_slot(map->names, map->capacity, name);
+    return map->names[slot] != 0 ? map->indexes[slot] : -1;
+}
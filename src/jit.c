@@ -0,0 +1,499 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "../include/jit.h"
+
+#define EAX 0
+#define ECX 1
+#define EBX 3
+
+enum stub {
+    STUB_INVALID_JUMP,
+    STUB_INVALID_ADDRESS,
+    STUB_DIVISION_BY_ZERO,
+    STUB_STEP_LIMIT,
+    STUB_COUNT
+};
+
+struct jit_buffer {
+    unsigned char* bytes;
+    size_t length;
+    size_t capacity;
+};
+
+struct fixup {
+    size_t position;
+    int target;
+};
+
+struct assembler {
+    struct jit_buffer buffer;
+    struct fixup* fixups;
+    int fixup_count;
+    int fixup_capacity;
+    size_t* offsets;
+    size_t stubs[STUB_COUNT];
+};
+
+typedef int (*jit_entry)(int* registers,
+                         char* memory,
+                         void** targets,
+                         long budget);
+
+bool jit_supported() {
+#if defined(__x86_64__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+static void emit_byte(struct assembler* as, int byte) {
+    struct jit_buffer* buffer = &as->buffer;
+    if (buffer->length == buffer->capacity) {
+        buffer->capacity = buffer->capacity > 0 ? buffer->capacity * 2 : 4096;
+        buffer->bytes = realloc(buffer->bytes, buffer->capacity);
+    }
+    buffer->bytes[buffer->length++] = byte;
+}
+
+static void emit_bytes(struct assembler* as, const char* bytes, int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        emit_byte(as, (unsigned char)bytes[i]);
+    }
+}
+
+static void emit_int(struct assembler* as, int value) {
+    unsigned bits = value;
+    int i;
+    for (i = 0; i < 4; i++) {
+        emit_byte(as, (bits >> (8 * i)) & 0xff);
+    }
+}
+
+static int modrm(int mod, int reg, int rm) {
+    return (mod << 6) | (reg << 3) | rm;
+}
+
+/* Branch targets are instruction indexes, or -1 - stub for error exits. */
+static void emit_target(struct assembler* as, int target) {
+    if (as->fixup_count == as->fixup_capacity) {
+        as->fixup_capacity =
+            as->fixup_capacity > 0 ? as->fixup_capacity * 2 : 256;
+        as->fixups =
+            realloc(as->fixups, as->fixup_capacity * sizeof *as->fixups);
+    }
+    as->fixups[as->fixup_count].position = as->buffer.length;
+    as->fixups[as->fixup_count].target = target;
+    as->fixup_count++;
+    emit_int(as, 0);
+}
+
+static void emit_jump(struct assembler* as, int target) {
+    emit_byte(as, 0xe9);
+    emit_target(as, target);
+}
+
+static void emit_jump_if(struct assembler* as, int condition, int target) {
+    emit_byte(as, 0x0f);
+    emit_byte(as, 0x80 | condition);
+    emit_target(as, target);
+}
+
+static int stub_target(enum stub stub) {
+    return -1 - stub;
+}
+
+/* Registers live in an array addressed through rbx. */
+static void emit_register_op(struct assembler* as,
+                             int opcode,
+                             int host,
+                             int slot) {
+    emit_byte(as, opcode);
+    emit_byte(as, modrm(2, host, EBX));
+    emit_int(as, slot * 4);
+}
+
+static void load_register(struct assembler* as, int host, int slot) {
+    emit_register_op(as, 0x8b, host, slot);
+}
+
+static void store_register(struct assembler* as, int slot, int host) {
+    emit_register_op(as, 0x89, host, slot);
+}
+
+static void store_immediate(struct assembler* as, int slot, int value) {
+    emit_register_op(as, 0xc7, 0, slot);
+    emit_int(as, value);
+}
+
+static void load_immediate(struct assembler* as, int host, int value) {
+    emit_byte(as, 0xb8 + host);
+    emit_int(as, value);
+}
+
+static void emit_immediate_op(struct assembler* as, int digit, int value) {
+    emit_byte(as, 0x81);
+    emit_byte(as, modrm(3, digit, EAX));
+    emit_int(as, value);
+}
+
+static void emit_budget_check(struct assembler* as) {
+    emit_bytes(as, "\x49\xff\xce", 3);
+    emit_jump_if(as, 0x4, stub_target(STUB_STEP_LIMIT));
+}
+
+/* Leaves the address in eax and traps unless [r12 + rax] is in bounds. */
+static void emit_address(struct assembler* as,
+                         int base,
+                         int offset,
+                         bool offset_is_register,
+                         unsigned limit) {
+    load_register(as, EAX, base);
+    if (offset_is_register) {
+        emit_register_op(as, 0x03, EAX, offset);
+    } else if (offset != 0) {
+        emit_immediate_op(as, 0, offset);
+    }
+    emit_byte(as, 0x3d);
+    emit_int(as, limit);
+    emit_jump_if(as, 0x7, stub_target(STUB_INVALID_ADDRESS));
+}
+
+static void emit_load(struct assembler* as, int slot) {
+    emit_bytes(as, "\x41\x8b\x0c\x04", 4);
+    store_register(as, slot, ECX);
+}
+
+static void emit_store(struct assembler* as, int slot) {
+    load_register(as, ECX, slot);
+    emit_bytes(as, "\x41\x89\x0c\x04", 4);
+}
+
+static void emit_binary(struct assembler* as, int opcode, struct sim_ins* ins) {
+    load_register(as, EAX, ins->a);
+    emit_register_op(as, opcode, EAX, ins->b);
+    store_register(as, ins->c, EAX);
+}
+
+static void emit_immediate(struct assembler* as,
+                           int digit,
+                           struct sim_ins* ins) {
+    load_register(as, EAX, ins->a);
+    emit_immediate_op(as, digit, ins->b);
+    store_register(as, ins->c, EAX);
+}
+
+static void emit_shift(struct assembler* as,
+                       int digit,
+                       struct sim_ins* ins,
+                       bool immediate) {
+    load_register(as, EAX, ins->a);
+    if (immediate) {
+        emit_byte(as, 0xc1);
+        emit_byte(as, modrm(3, digit, EAX));
+        emit_byte(as, ins->b & 31);
+    } else {
+        load_register(as, ECX, ins->b);
+        emit_byte(as, 0xd3);
+        emit_byte(as, modrm(3, digit, EAX));
+    }
+    store_register(as, ins->c, EAX);
+}
+
+/* eax / ecx into eax; INT_MIN / -1 wraps instead of raising SIGFPE. */
+static void emit_divide(struct assembler* as, int slot) {
+    emit_bytes(as, "\x85\xc9", 2);
+    emit_jump_if(as, 0x4, stub_target(STUB_DIVISION_BY_ZERO));
+    emit_bytes(as, "\x83\xf9\xff\x75\x04\xf7\xd8\xeb\x03\x99\xf7\xf9", 12);
+    store_register(as, slot, EAX);
+}
+
+static void emit_compare(struct assembler* as,
+                         int condition,
+                         struct sim_ins* ins) {
+    load_register(as, EAX, ins->a);
+    emit_register_op(as, 0x3b, EAX, ins->b);
+    emit_byte(as, 0x0f);
+    emit_byte(as, 0x90 | condition);
+    emit_byte(as, 0xc0);
+    emit_bytes(as, "\x0f\xb6\xc0", 3);
+    store_register(as, ins->c, EAX);
+}
+
+static bool emit_operation(struct assembler* as,
+                           struct sim_program* program,
+                           struct sim_ins* ins,
+                           unsigned limit) {
+    switch (ins->opcode) {
+        case NOP:
+            break;
+        case HALT:
+            emit_bytes(as, "\x31\xc0", 2);
+            emit_jump(as, stub_target(STUB_COUNT));
+            break;
+        case LOAD_I:
+            store_immediate(as, ins->b, ins->a);
+            break;
+        case I2I:
+            load_register(as, EAX, ins->a);
+            store_register(as, ins->b, EAX);
+            break;
+        case LOAD:
+            emit_address(as, ins->a, 0, false, limit);
+            emit_load(as, ins->b);
+            break;
+        case LOAD_AI:
+            emit_address(as, ins->a, ins->b, false, limit);
+            emit_load(as, ins->c);
+            break;
+        case LOAD_AO:
+            emit_address(as, ins->a, ins->b, true, limit);
+            emit_load(as, ins->c);
+            break;
+        case STORE:
+            emit_address(as, ins->b, 0, false, limit);
+            emit_store(as, ins->a);
+            break;
+        case STORE_AI:
+            emit_address(as, ins->b, ins->c, false, limit);
+            emit_store(as, ins->a);
+            break;
+        case STORE_AO:
+            emit_address(as, ins->b, ins->c, true, limit);
+            emit_store(as, ins->a);
+            break;
+        case ADD:
+            emit_binary(as, 0x03, ins);
+            break;
+        case SUB:
+            emit_binary(as, 0x2b, ins);
+            break;
+        case MULT:
+            load_register(as, EAX, ins->a);
+            emit_byte(as, 0x0f);
+            emit_register_op(as, 0xaf, EAX, ins->b);
+            store_register(as, ins->c, EAX);
+            break;
+        case DIV:
+            load_register(as, EAX, ins->a);
+            load_register(as, ECX, ins->b);
+            emit_divide(as, ins->c);
+            break;
+        case ADD_I:
+            emit_immediate(as, 0, ins);
+            break;
+        case SUB_I:
+            emit_immediate(as, 5, ins);
+            break;
+        case RSUB_I:
+            load_immediate(as, EAX, ins->b);
+            emit_register_op(as, 0x2b, EAX, ins->a);
+            store_register(as, ins->c, EAX);
+            break;
+        case MULT_I:
+            load_register(as, EAX, ins->a);
+            emit_bytes(as, "\x69\xc0", 2);
+            emit_int(as, ins->b);
+            store_register(as, ins->c, EAX);
+            break;
+        case DIV_I:
+            load_register(as, EAX, ins->a);
+            load_immediate(as, ECX, ins->b);
+            emit_divide(as, ins->c);
+            break;
+        case RDIV_I:
+            load_immediate(as, EAX, ins->b);
+            load_register(as, ECX, ins->a);
+            emit_divide(as, ins->c);
+            break;
+        case LSHIFT:
+        case LSHIFT_I:
+            emit_shift(as, 4, ins, ins->opcode == LSHIFT_I);
+            break;
+        case RSHIFT:
+        case RSHIFT_I:
+            emit_shift(as, 7, ins, ins->opcode == RSHIFT_I);
+            break;
+        case AND:
+            emit_binary(as, 0x23, ins);
+            break;
+        case AND_I:
+            emit_immediate(as, 4, ins);
+            break;
+        case OR:
+            emit_binary(as, 0x0b, ins);
+            break;
+        case OR_I:
+            emit_immediate(as, 1, ins);
+            break;
+        case XOR:
+            emit_binary(as, 0x33, ins);
+            break;
+        case XOR_I:
+            emit_immediate(as, 6, ins);
+            break;
+        case CMP_LT:
+            emit_compare(as, 0xc, ins);
+            break;
+        case CMP_LE:
+            emit_compare(as, 0xe, ins);
+            break;
+        case CMP_GT:
+            emit_compare(as, 0xf, ins);
+            break;
+        case CMP_GE:
+            emit_compare(as, 0xd, ins);
+            break;
+        case CMP_EQ:
+            emit_compare(as, 0x4, ins);
+            break;
+        case CMP_NE:
+            emit_compare(as, 0x5, ins);
+            break;
+        case CBR:
+            emit_budget_check(as);
+            load_register(as, EAX, ins->a);
+            emit_bytes(as, "\x85\xc0", 2);
+            emit_jump_if(as, 0x5, ins->b);
+            emit_jump(as, ins->c);
+            break;
+        case JUMP_I:
+            emit_budget_check(as);
+            emit_jump(as, ins->a);
+            break;
+        case JUMP:
+            emit_budget_check(as);
+            load_register(as, EAX, ins->a);
+            emit_byte(as, 0x3d);
+            emit_int(as, program->length);
+            emit_jump_if(as, 0x3, stub_target(STUB_INVALID_JUMP));
+            emit_bytes(as, "\x41\xff\x64\xc5\x00", 5);
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+static bool assemble(struct assembler* as,
+                     struct sim_program* program,
+                     unsigned limit) {
+    emit_bytes(as, "\x53\x41\x54\x41\x55\x41\x56", 7);
+    emit_bytes(as, "\x48\x89\xfb\x49\x89\xf4\x49\x89\xd5\x49\x89\xce", 12);
+
+    int pc_slot = register_slot(ILOC_RPC);
+    int i;
+    for (i = 0; i < program->length; i++) {
+        as->offsets[i] = as->buffer.length;
+        if (program->uses_pc) {
+            store_immediate(as, pc_slot, i);
+        }
+        if (!emit_operation(as, program, &program->code[i], limit)) {
+            return false;
+        }
+    }
+
+    as->offsets[program->length] = as->buffer.length;
+    enum sim_status statuses[STUB_COUNT] = {SIM_INVALID_JUMP,
+                                            SIM_INVALID_ADDRESS,
+                                            SIM_DIVISION_BY_ZERO,
+                                            SIM_STEP_LIMIT};
+    for (i = 0; i < STUB_COUNT; i++) {
+        as->stubs[i] = as->buffer.length;
+        load_immediate(as, EAX, statuses[i]);
+        emit_jump(as, stub_target(STUB_COUNT));
+    }
+
+    size_t epilogue = as->buffer.length;
+    emit_bytes(as, "\x41\x5e\x41\x5d\x41\x5c\x5b\xc3", 8);
+
+    for (i = 0; i < as->fixup_count; i++) {
+        struct fixup* fixup = &as->fixups[i];
+        size_t target;
+        if (fixup->target == stub_target(STUB_COUNT)) {
+            target = epilogue;
+        } else if (fixup->target < 0) {
+            target = as->stubs[-1 - fixup->target];
+        } else if (fixup->target <= program->length) {
+            target = as->offsets[fixup->target];
+        } else {
+            target = as->stubs[STUB_INVALID_JUMP];
+        }
+
+        int displacement = (long)target - (long)(fixup->position + 4);
+        memcpy(as->buffer.bytes + fixup->position, &displacement, 4);
+    }
+
+    return true;
+}
+
+struct sim_result run_jit(struct sim_program* program,
+                          struct sim_config* config) {
+    struct sim_result result;
+    memset(&result, 0, sizeof result);
+
+    if (!jit_supported()) {
+        fprintf(stderr, "The JIT is only available on x86-64\n");
+        result.status = SIM_INVALID_PROGRAM;
+        return result;
+    }
+
+    if (config->memory_size < 4 || config->memory_size > INT_MAX) {
+        fprintf(stderr, "Invalid JIT memory size %zu\n", config->memory_size);
+        result.status = SIM_INVALID_PROGRAM;
+        return result;
+    }
+
+    struct assembler as;
+    memset(&as, 0, sizeof as);
+    as.offsets = malloc((program->length + 1) * sizeof *as.offsets);
+
+    if (!assemble(&as, program, config->memory_size - 4)) {
+        result.status = SIM_INVALID_PROGRAM;
+    } else {
+        size_t size = as.buffer.length;
+        void* region = mmap(0,
+                            size,
+                            PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS,
+                            -1,
+                            0);
+        if (region == MAP_FAILED) {
+            fprintf(stderr, "Cannot map JIT code\n");
+            result.status = SIM_INVALID_PROGRAM;
+        } else {
+            memcpy(region, as.buffer.bytes, size);
+            mprotect(region, size, PROT_READ | PROT_EXEC);
+
+            void** targets = malloc(program->length * sizeof *targets);
+            int i;
+            for (i = 0; i < program->length; i++) {
+                targets[i] = (char*)region + as.offsets[i];
+            }
+
+            int* r = calloc(program->register_count, sizeof *r);
+            char* memory = calloc(config->memory_size, 1);
+            jit_entry entry = (jit_entry)region;
+            result.status = entry(r, memory, targets, config->max_steps);
+
+            int address = r[register_slot(ILOC_RFP)] + 12;
+            if (result.status == SIM_HALTED && address >= 0 &&
+                (size_t)address + 4 <= config->memory_size) {
+                memcpy(&result.exit_value, memory + address, 4);
+            }
+
+            free(memory);
+            free(r);
+            free(targets);
+            munmap(region, size);
+        }
+    }
+
+    free(as.buffer.bytes);
+    free(as.fixups);
+    free(as.offsets);
+    return result;
+}
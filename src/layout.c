@@ -0,0 +1,526 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../include/cfg.h"
+#include "../include/layout.h"
+
+#define MAX_THREAD_STEPS 64
+#define LOOP_WEIGHT 8.0
+#define LIKELY_PROBABILITY 0.875
+#define FORCED_WEIGHT 1e300
+
+struct edge {
+    int from;
+    int to;
+    double weight;
+};
+
+struct successor {
+    int block;
+    double probability;
+    bool forced;
+};
+
+struct edges {
+    struct edge* items;
+    int count;
+    int capacity;
+};
+
+struct branch_profile* layout_profile = 0;
+
+struct branch_profile* read_branch_profile(FILE* in) {
+    struct branch_profile* profile = malloc(sizeof *profile);
+    profile->counts = 0;
+    profile->count = 0;
+
+    char line[256];
+    char on_true[64];
+    char on_false[64];
+    long taken;
+    long not_taken;
+    int number = 0;
+
+    while (fgets(line, sizeof line, in) != 0) {
+        number++;
+        char* comment = strchr(line, '#');
+        if (comment != 0) {
+            *comment = '\0';
+        }
+
+        int fields = sscanf(
+            line, "%63s %63s %ld %ld", on_true, on_false, &taken, &not_taken);
+        if (fields <= 0) {
+            continue;
+        }
+        if (fields != 4 || taken < 0 || not_taken < 0) {
+            fprintf(stderr, "Invalid branch profile at line %d\n", number);
+            free_branch_profile(profile);
+            return 0;
+        }
+
+        profile->counts =
+            realloc(profile->counts,
+                    (profile->count + 1) * sizeof *profile->counts);
+        struct branch_count* count = &profile->counts[profile->count++];
+        count->on_true = strdup(on_true);
+        count->on_false = strdup(on_false);
+        count->taken = taken;
+        count->not_taken = not_taken;
+    }
+
+    return profile;
+}
+
+void free_branch_profile(struct branch_profile* profile) {
+    if (profile != 0) {
+        int i;
+        for (i = 0; i < profile->count; i++) {
+            free(profile->counts[i].on_true);
+            free(profile->counts[i].on_false);
+        }
+        free(profile->counts);
+        free(profile);
+    }
+}
+
+static bool count_branch(struct operation* branch,
+                         long* taken,
+                         long* not_taken) {
+    *taken = 0;
+    *not_taken = 0;
+    if (layout_profile == 0) {
+        return false;
+    }
+
+    int i;
+    for (i = 0; i < layout_profile->count; i++) {
+        struct branch_count* count = &layout_profile->counts[i];
+        if (strcmp(count->on_true, branch->dst[0].name) == 0 &&
+            strcmp(count->on_false, branch->dst[1].name) == 0) {
+            *taken += count->taken;
+            *not_taken += count->not_taken;
+        }
+    }
+    return *taken + *not_taken > 0;
+}
+
+static bool is_jump(struct operation* operation) {
+    return operation->opcode == JUMP_I && !is_call(operation);
+}
+
+static bool set_label(struct operand* operand, const char* name) {
+    if (strcmp(operand->name, name) == 0) {
+        return false;
+    }
+    char* copy = strdup(name);
+    free(operand->name);
+    operand->name = copy;
+    return true;
+}
+
+static const char* thread_target(struct module* module,
+                                 struct label_map* labels,
+                                 const char* name) {
+    int steps;
+    for (steps = 0; steps < MAX_THREAD_STEPS; steps++) {
+        int i = find_label(labels, name);
+        if (i == -1) {
+            break;
+        }
+        while (i < module->length &&
+               module->operations[i].opcode == LABEL) {
+            i++;
+        }
+        if (i == module->length || !is_jump(&module->operations[i])) {
+            break;
+        }
+        name = module->operations[i].dst[0].name;
+    }
+    return name;
+}
+
+static void thread_jumps(struct module* module, struct opt_stats* stats) {
+    struct label_map* labels = alloc_label_map();
+    int i, j;
+    for (i = 0; i < module->length; i++) {
+        if (module->operations[i].opcode == LABEL) {
+            add_label(labels, module->operations[i].src[0].name, i);
+        }
+    }
+
+    for (i = 0; i < module->length; i++) {
+        struct operation* operation = &module->operations[i];
+        int targets = operation->opcode == CBR ? 2 : is_jump(operation);
+        for (j = 0; j < targets; j++) {
+            const char* target =
+                thread_target(module, labels, operation->dst[j].name);
+            if (set_label(&operation->dst[j], target)) {
+                stats->threaded_jumps++;
+            }
+        }
+    }
+
+    free_label_map(labels);
+}
+
+static bool jumps_to_next(struct module* module, int i) {
+    const char* target = module->operations[i].dst[0].name;
+    int k = i + 1;
+    while (k < module->length && module->operations[k].opcode != LABEL) {
+        k++;
+    }
+    for (; k < module->length && module->operations[k].opcode == LABEL; k++) {
+        if (strcmp(module->operations[k].src[0].name, target) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_unreferenced(struct operation* label,
+                            struct label_map* referenced) {
+    return is_local_label(label->src[0].name) &&
+           find_label(referenced, label->src[0].name) == -1;
+}
+
+static bool compact_module(struct module* module, struct opt_stats* stats) {
+    struct label_map* referenced = alloc_label_map();
+    int i, j;
+    for (i = 0; i < module->length; i++) {
+        struct operation* operation = &module->operations[i];
+        for (j = 0; j < 2 && operation->opcode != LABEL; j++) {
+            if (operation->src[j].type == OPERAND_LABEL) {
+                add_label(referenced, operation->src[j].name, i);
+            }
+            if (operation->dst[j].type == OPERAND_LABEL) {
+                add_label(referenced, operation->dst[j].name, i);
+            }
+        }
+    }
+
+    struct module* out = alloc_module();
+    bool changed = false;
+    bool dead = false;
+    for (i = 0; i < module->length; i++) {
+        struct operation* operation = &module->operations[i];
+        bool keep = true;
+        if (operation->opcode == LABEL) {
+            if (is_unreferenced(operation, referenced)) {
+                keep = false;
+                stats->removed_labels++;
+            } else {
+                dead = false;
+            }
+        } else if (dead) {
+            keep = false;
+            stats->unreachable_operations++;
+        } else if (is_jump(operation) && jumps_to_next(module, i)) {
+            keep = false;
+            stats->removed_jumps++;
+        }
+        dead = dead || (is_branch(operation) && !is_call(operation));
+
+        if (keep) {
+            append_operation(out, *operation);
+        } else {
+            free_operation(operation);
+            changed = true;
+        }
+    }
+
+    free(module->operations);
+    module->operations = out->operations;
+    module->length = out->length;
+    module->capacity = out->capacity;
+    free(out);
+    free_label_map(referenced);
+    return changed;
+}
+
+static void add_edge(struct edges* edges, int from, int to, double weight) {
+    if (edges->count == edges->capacity) {
+        edges->capacity = edges->capacity > 0 ? 2 * edges->capacity : 16;
+        edges->items =
+            realloc(edges->items, edges->capacity * sizeof *edges->items);
+    }
+    struct edge* edge = &edges->items[edges->count++];
+    edge->from = from;
+    edge->to = to;
+    edge->weight = weight;
+}
+
+static int compare_edges(const void* a, const void* b) {
+    const struct edge* x = a;
+    const struct edge* y = b;
+    if (x->weight != y->weight) {
+        return x->weight < y->weight ? 1 : -1;
+    }
+    if ((x->to == x->from + 1) != (y->to == y->from + 1)) {
+        return x->to == x->from + 1 ? -1 : 1;
+    }
+    if (x->from != y->from) {
+        return x->from - y->from;
+    }
+    return x->to - y->to;
+}
+
+static double branch_probability(struct cfg* cfg,
+                                 struct loop* loops,
+                                 int loop_count,
+                                 int b,
+                                 int on_true,
+                                 int on_false) {
+    struct operation* branch =
+        &cfg->module->operations[cfg->blocks[b].end - 1];
+    long taken, not_taken;
+    if (count_branch(branch, &taken, &not_taken)) {
+        return (double)taken / (taken + not_taken);
+    }
+
+    int i;
+    for (i = 0; i < loop_count && !loops[i].body[b]; i++) {
+    }
+    if (i == loop_count) {
+        return 0.5;
+    }
+
+    bool stays_true = loops[i].body[on_true];
+    bool stays_false = loops[i].body[on_false];
+    if (stays_true != stays_false) {
+        return stays_true ? LIKELY_PROBABILITY : 1 - LIKELY_PROBABILITY;
+    }
+    return 0.5;
+}
+
+static void set_successor(struct successor* succ,
+                          int block,
+                          double probability,
+                          bool forced) {
+    succ->block = block;
+    succ->probability = probability;
+    succ->forced = forced;
+}
+
+static int find_successors(struct cfg* cfg,
+                           struct loop* loops,
+                           int loop_count,
+                           struct label_map* blocks,
+                           int b,
+                           struct successor* succs) {
+    struct module* module = cfg->module;
+    struct block* block = &cfg->blocks[b];
+    struct operation* last = &module->operations[block->end - 1];
+    if (last->opcode == CBR) {
+        int on_true = find_label(blocks, last->dst[0].name);
+        int on_false = find_label(blocks, last->dst[1].name);
+        if (on_true == -1 || on_false == -1) {
+            return 0;
+        }
+        double p = branch_probability(
+            cfg, loops, loop_count, b, on_true, on_false);
+        set_successor(&succs[0], on_true, p, false);
+        set_successor(&succs[1], on_false, 1 - p, false);
+        return 2;
+    }
+    if (is_jump(last)) {
+        int target = find_label(blocks, last->dst[0].name);
+        set_successor(&succs[0], target, 1, false);
+        return target != -1;
+    }
+    if (b + 1 < cfg->count && (!is_branch(last) || is_call(last))) {
+        bool forced = is_call(last) ||
+                      module->operations[block->end].opcode != LABEL;
+        set_successor(&succs[0], b + 1, 1, forced);
+        return 1;
+    }
+    return 0;
+}
+
+static void collect_edges(struct cfg* cfg,
+                          struct label_map* blocks,
+                          struct edges* edges) {
+    struct module* module = cfg->module;
+    struct loop* loops;
+    int loop_count = find_loops(cfg, &loops);
+    double* frequency = calloc(cfg->count, sizeof *frequency);
+    frequency[0] = 1;
+
+    struct successor succs[2];
+    int i, j, k;
+    for (i = 0; i < cfg->order_count; i++) {
+        int b = cfg->order[i];
+        for (j = 0; j < loop_count; j++) {
+            if (loops[j].header == b) {
+                frequency[b] *= LOOP_WEIGHT;
+            }
+        }
+
+        int count =
+            find_successors(cfg, loops, loop_count, blocks, b, succs);
+        bool branch = module->operations[cfg->blocks[b].end - 1].opcode == CBR;
+        for (k = 0; k < count; k++) {
+            struct successor* succ = &succs[k];
+            bool back = dominates(cfg, succ->block, b);
+            if (!back) {
+                frequency[succ->block] += frequency[b] * succ->probability;
+            }
+            if (succ->forced) {
+                add_edge(edges, b, succ->block, FORCED_WEIGHT);
+            } else if (!branch ||
+                       (succ->probability != 0.5 && !back)) {
+                add_edge(edges,
+                         b,
+                         succ->block,
+                         frequency[b] * succ->probability);
+            }
+        }
+    }
+
+    free(frequency);
+    free_loops(loops, loop_count);
+}
+
+static bool falls_off_end(struct cfg* cfg) {
+    struct operation* last =
+        &cfg->module->operations[cfg->blocks[cfg->count - 1].end - 1];
+    return !is_branch(last) || is_call(last);
+}
+
+static void append_block(struct module* out,
+                         struct module* module,
+                         struct block* block,
+                         bool drop_jump) {
+    int i;
+    for (i = block->start; i < block->end; i++) {
+        if (drop_jump && i == block->end - 1) {
+            free_operation(&module->operations[i]);
+        } else {
+            append_operation(out, module->operations[i]);
+        }
+    }
+}
+
+static void layout_function(struct module* module,
+                            int start,
+                            int end,
+                            struct module* out,
+                            struct opt_stats* stats) {
+    struct cfg* cfg = build_cfg(module, start, end);
+    if (falls_off_end(cfg)) {
+        int i;
+        for (i = start; i < end; i++) {
+            append_operation(out, module->operations[i]);
+        }
+        free_cfg(cfg);
+        return;
+    }
+
+    struct label_map* blocks = alloc_label_map();
+    int b, i;
+    for (b = 0; b < cfg->count; b++) {
+        for (i = cfg->blocks[b].start;
+             i < cfg->blocks[b].end &&
+             module->operations[i].opcode == LABEL;
+             i++) {
+            add_label(blocks, module->operations[i].src[0].name, b);
+        }
+    }
+
+    struct edges edges = {0, 0, 0};
+    collect_edges(cfg, blocks, &edges);
+    qsort(edges.items, edges.count, sizeof *edges.items, compare_edges);
+
+    int* next = malloc(cfg->count * sizeof *next);
+    int* prev = malloc(cfg->count * sizeof *prev);
+    for (b = 0; b < cfg->count; b++) {
+        next[b] = -1;
+        prev[b] = -1;
+    }
+
+    for (i = 0; i < edges.count; i++) {
+        struct edge* edge = &edges.items[i];
+        if (edge->to == 0 || edge->from == edge->to ||
+            next[edge->from] != -1 || prev[edge->to] != -1) {
+            continue;
+        }
+        int tail = edge->to;
+        while (next[tail] != -1) {
+            tail = next[tail];
+        }
+        if (tail != edge->from) {
+            next[edge->from] = edge->to;
+            prev[edge->to] = edge->from;
+        }
+    }
+
+    int* order = malloc(cfg->count * sizeof *order);
+    int count = 0;
+    for (b = 0; b < cfg->count; b++) {
+        if (prev[b] != -1) {
+            continue;
+        }
+        int k;
+        for (k = b; k != -1; k = next[k]) {
+            order[count++] = k;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        b = order[i];
+        int following = i + 1 < count ? order[i + 1] : -1;
+        struct block* block = &cfg->blocks[b];
+        struct operation* last = &module->operations[block->end - 1];
+
+        bool drop_jump =
+            is_jump(last) && following != -1 &&
+            find_label(blocks, last->dst[0].name) == following;
+        if (drop_jump) {
+            stats->removed_jumps++;
+        }
+
+        bool falls_through = !is_branch(last) || is_call(last);
+        append_block(out, module, block, drop_jump);
+        if (falls_through && following != b + 1) {
+            struct operation jump;
+            memset(&jump, 0, sizeof jump);
+            jump.opcode = JUMP_I;
+            jump.dst[0] =
+                make_label(module->operations[block->end].src[0].name);
+            append_operation(out, jump);
+        }
+    }
+
+    free(order);
+    free(next);
+    free(prev);
+    free(edges.items);
+    free_label_map(blocks);
+    free_cfg(cfg);
+}
+
+void layout_module(struct module* module, struct opt_stats* stats) {
+    thread_jumps(module, stats);
+    while (compact_module(module, stats)) {
+    }
+
+    struct module* out = alloc_module();
+    int i = 0;
+    while (i < module->length) {
+        if (!is_function_label(&module->operations[i])) {
+            append_operation(out, module->operations[i++]);
+            continue;
+        }
+        int end = function_end(module, i);
+        layout_function(module, i, end, out, stats);
+        i = end;
+    }
+
+    free(module->operations);
+    module->operations = out->operations;
+    module->length = out->length;
+    module->capacity = out->capacity;
+    free(out);
+
+    while (compact_module(module, stats)) {
+    }
+}
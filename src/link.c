@@ -0,0 +1,237 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../include/link.h"
+
+struct layout {
+    struct label_map* offsets;
+    struct label_map* sizes;
+    int size;
+};
+
+static enum link_status layout_globals(struct module** modules,
+                                       int count,
+                                       struct layout* layout) {
+    int k, i;
+    for (k = 0; k < count; k++) {
+        for (i = 0; i < modules[k]->length; i++) {
+            struct operation* operation = &modules[k]->operations[i];
+            if (operation->opcode != GLOBAL_DECL) {
+                continue;
+            }
+
+            char* name = operation->src[0].name;
+            int size = operation->src[1].val;
+            int declared = find_label(layout->sizes, name);
+
+            if (declared == -1) {
+                add_label(layout->offsets, name, layout->size);
+                add_label(layout->sizes, name, size);
+                layout->size += size;
+            } else if (declared != size) {
+                fprintf(stderr,
+                        "Global %s declared with sizes %d and %d\n",
+                        name,
+                        declared,
+                        size);
+                return LINK_MISMATCHED_GLOBAL;
+            }
+        }
+    }
+
+    return LINK_SUCCESS;
+}
+
+static enum link_status define_functions(struct module** modules,
+                                         int count) {
+    struct label_map* functions = alloc_label_map();
+    enum link_status status = LINK_SUCCESS;
+
+    int k, i;
+    for (k = 0; k < count && status == LINK_SUCCESS; k++) {
+        for (i = 0; i < modules[k]->length; i++) {
+            struct operation* operation = &modules[k]->operations[i];
+            if (operation->opcode == LABEL &&
+                !is_local_label(operation->src[0].name) &&
+                !add_label(functions, operation->src[0].name, k)) {
+                fprintf(stderr,
+                        "Duplicate definition of function %s\n",
+                        operation->src[0].name + 1);
+                status = LINK_DUPLICATE;
+                break;
+            }
+        }
+    }
+
+    free_label_map(functions);
+    return status;
+}
+
+static void append_prologue(struct module* program, int global_size) {
+    int base = global_size > STACK_BASE ? global_size : STACK_BASE;
+    struct operation operation;
+
+    memset(&operation, 0, sizeof operation);
+    operation.opcode = LOAD_I;
+    operation.src[0] = make_imm(base);
+    operation.dst[0] = make_reg(ILOC_RFP);
+    append_operation(program, operation);
+
+    operation.dst[0] = make_reg(ILOC_RSP);
+    append_operation(program, operation);
+
+    operation.src[0] = make_imm(0);
+    operation.dst[0] = make_reg(ILOC_RBSS);
+    append_operation(program, operation);
+
+    memset(&operation, 0, sizeof operation);
+    operation.opcode = JUMP_I;
+    operation.dst[0] = make_label("lmain");
+    append_operation(program, operation);
+}
+
+static void relocate(struct operand* operand, int module) {
+    if (operand->type == OPERAND_LABEL && module > 0 &&
+        is_local_label(operand->name)) {
+        char* name = malloc(strlen(operand->name) + 16);
+        sprintf(name, "l%d_%s", module, operand->name + 1);
+        free(operand->name);
+        operand->name = name;
+    }
+}
+
+static enum link_status resolve_symbol(struct operand* operand,
+                                       struct layout* layout) {
+    if (operand->type != OPERAND_SYMBOL) {
+        return LINK_SUCCESS;
+    }
+
+    int offset = find_label(layout->offsets, operand->name);
+    if (offset == -1) {
+        fprintf(stderr,
+                "Undefined reference to global %s\n",
+                operand->name);
+        return LINK_UNDEFINED;
+    }
+
+    free_operand(operand);
+    *operand = make_imm(offset);
+    return LINK_SUCCESS;
+}
+
+static enum link_status resolve(struct operand* operand,
+                                struct label_map* labels,
+                                struct layout* layout) {
+    if (operand->type != OPERAND_LABEL) {
+        return resolve_symbol(operand, layout);
+    }
+
+    if (find_label(labels, operand->name) == -1) {
+        if (is_local_label(operand->name)) {
+            fprintf(stderr, "Undefined label %s\n", operand->name);
+        } else {
+            fprintf(stderr,
+                    "Undefined reference to function %s\n",
+                    operand->name + 1);
+        }
+        return LINK_UNDEFINED;
+    }
+
+    return LINK_SUCCESS;
+}
+
+static enum link_status resolve_labels(struct module* program,
+                                      struct layout* layout) {
+    struct label_map* labels = alloc_label_map();
+    enum link_status status = LINK_SUCCESS;
+
+    int i, j, index = 0;
+    for (i = 0; i < program->length; i++) {
+        struct operation* operation = &program->operations[i];
+        if (operation->opcode != LABEL) {
+            index++;
+        } else if (!add_label(labels, operation->src[0].name, index)) {
+            fprintf(stderr, "Duplicate label %s\n", operation->src[0].name);
+            status = LINK_DUPLICATE;
+        }
+    }
+
+    for (i = 0; i < program->length && status == LINK_SUCCESS; i++) {
+        struct operation* operation = &program->operations[i];
+        if (operation->opcode == LABEL) {
+            continue;
+        }
+
+        for (j = 0; j < 2 && status == LINK_SUCCESS; j++) {
+            status = resolve(&operation->src[j], labels, layout);
+            if (status == LINK_SUCCESS) {
+                status = resolve(&operation->dst[j], labels, layout);
+            }
+        }
+
+        if (status == LINK_SUCCESS && operation->opcode == LOAD_I &&
+            operation->src[0].type == OPERAND_LABEL) {
+            int address = find_label(labels, operation->src[0].name);
+            free_operand(&operation->src[0]);
+            operation->src[0] = make_imm(address);
+        }
+    }
+
+    free_label_map(labels);
+    return status;
+}
+
+struct link_result link_modules(struct module** modules,
+                                int count,
+                                int passes) {
+    struct link_result result;
+    result.program = 0;
+    memset(&result.stats, 0, sizeof result.stats);
+
+    struct layout layout;
+    layout.offsets = alloc_label_map();
+    layout.sizes = alloc_label_map();
+    layout.size = 0;
+
+    result.status = layout_globals(modules, count, &layout);
+    if (result.status == LINK_SUCCESS) {
+        result.status = define_functions(modules, count);
+    }
+
+    struct module* program = alloc_module();
+    append_prologue(program, layout.size);
+
+    int k, i, j;
+    for (k = 0; k < count && result.status == LINK_SUCCESS; k++) {
+        for (i = 0; i < modules[k]->length; i++) {
+            if (modules[k]->operations[i].opcode == GLOBAL_DECL) {
+                continue;
+            }
+
+            struct operation operation =
+                copy_operation(&modules[k]->operations[i]);
+            for (j = 0; j < 2; j++) {
+                relocate(&operation.src[j], k);
+                relocate(&operation.dst[j], k);
+            }
+            append_operation(program, operation);
+        }
+    }
+
+    if (result.status == LINK_SUCCESS && passes != 0) {
+        optimize_program(program, passes, &result.stats);
+    }
+
+    if (result.status == LINK_SUCCESS) {
+        result.status = resolve_labels(program, &layout);
+    }
+
+    if (result.status == LINK_SUCCESS) {
+        result.program = program;
+    } else {
+        free_module(program);
+    }
+
+    free_label_map(layout.offsets);
+    free_label_map(layout.sizes);
+    return result;
+}
@@ -0,0 +1,556 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../include/lto.h"
+
+static bool is_reg(struct operand* operand, int reg) {
+    return operand->type == OPERAND_REG && operand->val == reg;
+}
+
+static bool is_imm(struct operand* operand, int val) {
+    return operand->type == OPERAND_IMM && operand->val == val;
+}
+
+static void replace_operations(struct module* program, struct module* out) {
+    int i;
+    for (i = 0; i < program->length; i++) {
+        free_operation(&program->operations[i]);
+    }
+    free(program->operations);
+
+    program->operations = out->operations;
+    program->length = out->length;
+    program->capacity = out->capacity;
+    free(out);
+}
+
+static bool is_frame_load(struct operation* operation, int offset) {
+    return operation->opcode == LOAD_AI &&
+           is_reg(&operation->src[0], ILOC_RFP) &&
+           is_imm(&operation->src[1], offset);
+}
+
+static bool is_return(struct module* program, int i, int end) {
+    if (i + 3 >= end) {
+        return false;
+    }
+
+    struct operation* ops = &program->operations[i];
+    return is_frame_load(&ops[0], 0) && ops[0].dst[0].type == OPERAND_REG &&
+           ops[0].dst[0].val >= 0 && is_frame_load(&ops[1], 4) &&
+           is_reg(&ops[1].dst[0], ILOC_RSP) && is_frame_load(&ops[2], 8) &&
+           is_reg(&ops[2].dst[0], ILOC_RFP) && ops[3].opcode == JUMP &&
+           is_reg(&ops[3].dst[0], ops[0].dst[0].val);
+}
+
+static bool is_leaf_return(struct module* program, int i, int end) {
+    if (i + 1 >= end) {
+        return false;
+    }
+
+    struct operation* ops = &program->operations[i];
+    return ops[0].opcode == LOAD_AI && is_reg(&ops[0].src[0], ILOC_RSP) &&
+           is_imm(&ops[0].src[1], 0) && ops[0].dst[0].type == OPERAND_REG &&
+           ops[0].dst[0].val >= 0 && ops[1].opcode == JUMP &&
+           is_reg(&ops[1].dst[0], ops[0].dst[0].val);
+}
+
+static bool is_frameless(struct module* program, int start, int end) {
+    int i, j;
+    for (i = start + 1; i < end; i++) {
+        struct operation* operation = &program->operations[i];
+        for (j = 0; j < 2; j++) {
+            if (is_reg(&operation->src[j], ILOC_RFP) ||
+                is_reg(&operation->dst[j], ILOC_RFP)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool has_prologue(struct module* program, int start, int end) {
+    if (start + 4 >= end) {
+        return false;
+    }
+
+    struct operation* ops = &program->operations[start + 1];
+    return ops[0].opcode == STORE_AI && is_reg(&ops[0].src[0], ILOC_RSP) &&
+           is_reg(&ops[0].dst[0], ILOC_RSP) && is_imm(&ops[0].dst[1], 4) &&
+           ops[1].opcode == STORE_AI && is_reg(&ops[1].src[0], ILOC_RFP) &&
+           is_reg(&ops[1].dst[0], ILOC_RSP) && is_imm(&ops[1].dst[1], 8) &&
+           ops[2].opcode == I2I && is_reg(&ops[2].src[0], ILOC_RSP) &&
+           is_reg(&ops[2].dst[0], ILOC_RFP) && ops[3].opcode == ADD_I &&
+           is_reg(&ops[3].src[0], ILOC_RSP) && is_reg(&ops[3].dst[0], ILOC_RSP);
+}
+
+static bool is_inlinable(struct module* program, int start) {
+    int end = function_end(program, start);
+    if (strcmp(program->operations[start].src[0].name, "lmain") == 0 ||
+        !(has_prologue(program, start, end) ||
+          is_frameless(program, start, end))) {
+        return false;
+    }
+
+    int i, size = 0;
+    for (i = start + 1; i < end; i++) {
+        struct operation* operation = &program->operations[i];
+        if (operation->opcode == LABEL) {
+            continue;
+        }
+
+        if (is_return(program, i, end)) {
+            size += 3;
+            i += 3;
+            continue;
+        }
+        if (is_leaf_return(program, i, end)) {
+            size++;
+            i++;
+            continue;
+        }
+
+        switch (operation->opcode) {
+            case JUMP_I:
+                if (!is_local_label(operation->dst[0].name)) {
+                    return false;
+                }
+                break;
+            case JUMP:
+            case HALT:
+                return false;
+            case LOAD_I:
+                if (operation->src[0].type == OPERAND_LABEL) {
+                    return false;
+                }
+                break;
+            case LOAD_AI:
+                if (is_frame_load(operation, 0) ||
+                    (is_reg(&operation->src[0], ILOC_RSP) &&
+                     is_imm(&operation->src[1], 0))) {
+                    return false;
+                }
+                break;
+            default:
+                break;
+        }
+        size++;
+    }
+
+    return size <= INLINE_THRESHOLD;
+}
+
+static int max_register(struct module* program, int start, int end) {
+    int max = -1;
+    int i, j;
+    for (i = start; i < end; i++) {
+        struct operation* operation = &program->operations[i];
+        for (j = 0; j < 2; j++) {
+            if (operation->src[j].type == OPERAND_REG &&
+                operation->src[j].val > max) {
+                max = operation->src[j].val;
+            }
+            if (operation->dst[j].type == OPERAND_REG &&
+                operation->dst[j].val > max) {
+                max = operation->dst[j].val;
+            }
+        }
+    }
+    return max;
+}
+
+static struct label_map* collect_labels(struct module* program) {
+    struct label_map* labels = alloc_label_map();
+    int i;
+    for (i = 0; i < program->length; i++) {
+        if (program->operations[i].opcode == LABEL) {
+            add_label(labels, program->operations[i].src[0].name, i);
+        }
+    }
+    return labels;
+}
+
+static char* fresh_label(struct label_map* labels, int* counter) {
+    char name[32];
+    do {
+        sprintf(name, "l0_%d", (*counter)++);
+    } while (find_label(labels, name) != -1);
+
+    add_label(labels, name, 0);
+    return strdup(name);
+}
+
+static void rename_operand(struct operand* operand,
+                           int base,
+                           struct label_map* locals,
+                           char** names) {
+    if (operand->type == OPERAND_REG && operand->val >= 0) {
+        operand->val += base;
+    } else if (operand->type == OPERAND_LABEL &&
+               is_local_label(operand->name)) {
+        int index = find_label(locals, operand->name);
+        free(operand->name);
+        operand->name = strdup(names[index]);
+    }
+}
+
+static void emit_clone(struct module* out,
+                       struct module* program,
+                       int start,
+                       int base,
+                       const char* l_return,
+                       struct label_map* labels,
+                       int* counter) {
+    int end = function_end(program, start);
+    struct label_map* locals = alloc_label_map();
+    char** names = malloc((end - start) * sizeof *names);
+    int count = 0;
+
+    int i, j;
+    for (i = start + 1; i < end; i++) {
+        if (program->operations[i].opcode == LABEL) {
+            add_label(locals, program->operations[i].src[0].name, count);
+            names[count++] = fresh_label(labels, counter);
+        }
+    }
+
+    for (i = start + 1; i < end; i++) {
+        if (is_return(program, i, end)) {
+            append_operation(out, copy_operation(&program->operations[i + 1]));
+            append_operation(out, copy_operation(&program->operations[i + 2]));
+
+            struct operation jump;
+            memset(&jump, 0, sizeof jump);
+            jump.opcode = JUMP_I;
+            jump.dst[0] = make_label(l_return);
+            append_operation(out, jump);
+
+            i += 3;
+            continue;
+        }
+
+        if (is_leaf_return(program, i, end)) {
+            struct operation jump;
+            memset(&jump, 0, sizeof jump);
+            jump.opcode = JUMP_I;
+            jump.dst[0] = make_label(l_return);
+            append_operation(out, jump);
+
+            i++;
+            continue;
+        }
+
+        struct operation operation = copy_operation(&program->operations[i]);
+        for (j = 0; j < 2; j++) {
+            rename_operand(&operation.src[j], base, locals, names);
+            rename_operand(&operation.dst[j], base, locals, names);
+        }
+        append_operation(out, operation);
+    }
+
+    for (i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+    free_label_map(locals);
+}
+
+static bool is_return_address(struct module* program, int i) {
+    struct operation* ops = &program->operations[i];
+    return i + 1 < program->length && ops[0].opcode == LOAD_I &&
+           ops[0].src[0].type == OPERAND_LABEL &&
+           ops[1].opcode == STORE_AI && ops[0].dst[0].type == OPERAND_REG &&
+           is_reg(&ops[1].src[0], ops[0].dst[0].val) &&
+           is_reg(&ops[1].dst[0], ILOC_RSP) && is_imm(&ops[1].dst[1], 0);
+}
+
+static bool returns_in_memory(struct module* program, int i) {
+    for (i++; i < program->length; i++) {
+        struct operation* operation = &program->operations[i];
+        if (operation->opcode != LOAD_AI ||
+            !(is_reg(&operation->src[0], ILOC_RFP) ||
+              is_reg(&operation->src[0], ILOC_RSP))) {
+            return false;
+        }
+        if (is_reg(&operation->src[0], ILOC_RSP) &&
+            is_imm(&operation->src[1], 12)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void inline_calls(struct module* program, struct lto_stats* stats) {
+    struct label_map* callees = alloc_label_map();
+    struct label_map* returns = alloc_label_map();
+    struct label_map* sites = alloc_label_map();
+
+    int i;
+    for (i = 0; i < program->length; i++) {
+        struct operation* operation = &program->operations[i];
+        if (is_function_label(operation) && is_inlinable(program, i)) {
+            add_label(callees, operation->src[0].name, i);
+        } else if (is_return_address(program, i)) {
+            add_label(returns, operation->src[0].name, i);
+        }
+    }
+
+    for (i = 0; i + 1 < program->length; i++) {
+        struct operation* operation = &program->operations[i];
+        struct operation* next = &program->operations[i + 1];
+        if (operation->opcode == JUMP_I &&
+            find_label(callees, operation->dst[0].name) != -1 &&
+            next->opcode == LABEL &&
+            find_label(returns, next->src[0].name) != -1 &&
+            returns_in_memory(program, i + 1)) {
+            add_label(sites, next->src[0].name, i);
+        }
+    }
+
+    if (sites->count > 0) {
+        struct label_map* labels = collect_labels(program);
+        struct module* out = alloc_module();
+        int counter = 0;
+        int base = 0;
+
+        for (i = 0; i < program->length; i++) {
+            struct operation* operation = &program->operations[i];
+
+            if (is_function_label(operation)) {
+                base = max_register(
+                           program, i, function_end(program, i)) + 1;
+            }
+
+            if (is_return_address(program, i) &&
+                find_label(sites, operation->src[0].name) != -1) {
+                i++;
+                continue;
+            }
+
+            if (operation->opcode == JUMP_I && i + 1 < program->length &&
+                program->operations[i + 1].opcode == LABEL &&
+                find_label(sites, program->operations[i + 1].src[0].name) ==
+                    i) {
+                emit_clone(out,
+                           program,
+                           find_label(callees, operation->dst[0].name),
+                           base,
+                           program->operations[i + 1].src[0].name,
+                           labels,
+                           &counter);
+                stats->inlined_calls++;
+                continue;
+            }
+
+            append_operation(out, copy_operation(operation));
+        }
+
+        replace_operations(program, out);
+        free_label_map(labels);
+    }
+
+    free_label_map(callees);
+    free_label_map(returns);
+    free_label_map(sites);
+}
+
+static void mark_references(struct module* program,
+                            int start,
+                            int end,
+                            struct label_map* reachable,
+                            int* worklist,
+                            int* count) {
+    int i, j;
+    for (i = start; i < end; i++) {
+        struct operation* operation = &program->operations[i];
+        if (operation->opcode == LABEL) {
+            continue;
+        }
+
+        for (j = 0; j < 2; j++) {
+            struct operand* operands[2] = {&operation->src[j],
+                                           &operation->dst[j]};
+            int k;
+            for (k = 0; k < 2; k++) {
+                if (operands[k]->type != OPERAND_LABEL ||
+                    is_local_label(operands[k]->name) ||
+                    find_label(reachable, operands[k]->name) != -1) {
+                    continue;
+                }
+
+                int function = find_function(program, operands[k]->name);
+                if (function != -1) {
+                    add_label(reachable, operands[k]->name, function);
+                    worklist[(*count)++] = function;
+                }
+            }
+        }
+    }
+}
+
+static void remove_dead_functions(struct module* program,
+                                  struct lto_stats* stats) {
+    int first = 0;
+    while (first < program->length &&
+           !is_function_label(&program->operations[first])) {
+        first++;
+    }
+
+    int main = find_function(program, "lmain");
+    if (main == -1) {
+        return;
+    }
+
+    struct label_map* reachable = alloc_label_map();
+    int* worklist = malloc(program->length * sizeof *worklist);
+    int count = 0;
+
+    add_label(reachable, "lmain", main);
+    worklist[count++] = main;
+    mark_references(program, 0, first, reachable, worklist, &count);
+
+    while (count > 0) {
+        int start = worklist[--count];
+        mark_references(program,
+                        start,
+                        function_end(program, start),
+                        reachable,
+                        worklist,
+                        &count);
+    }
+
+    struct module* out = alloc_module();
+    int i = 0;
+    while (i < program->length) {
+        struct operation* operation = &program->operations[i];
+        if (is_function_label(operation) &&
+            find_label(reachable, operation->src[0].name) == -1) {
+            int end = function_end(program, i);
+            stats->removed_functions++;
+            for (; i < end; i++) {
+                if (program->operations[i].opcode != LABEL) {
+                    stats->removed_operations++;
+                }
+            }
+            continue;
+        }
+
+        append_operation(out, copy_operation(operation));
+        i++;
+    }
+
+    replace_operations(program, out);
+    free(worklist);
+    free_label_map(reachable);
+}
+
+static bool is_global_access(struct operation* operation) {
+    return (operation->opcode == LOAD_AI &&
+            is_reg(&operation->src[0], ILOC_RBSS) &&
+            operation->src[1].type == OPERAND_SYMBOL) ||
+           (operation->opcode == STORE_AI &&
+            is_reg(&operation->dst[0], ILOC_RBSS) &&
+            operation->dst[1].type == OPERAND_SYMBOL);
+}
+
+static bool may_alias_globals(struct operation* operation) {
+    if (operation->opcode == STORE || operation->opcode == STORE_AO) {
+        return true;
+    }
+
+    if (operation->opcode == LOAD_I && is_reg(&operation->dst[0], ILOC_RBSS)) {
+        return false;
+    }
+
+    int j;
+    for (j = 0; j < 2; j++) {
+        if (is_reg(&operation->src[j], ILOC_RBSS) ||
+            is_reg(&operation->dst[j], ILOC_RBSS)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void fold_const_globals(struct module* program,
+                               struct lto_stats* stats) {
+    struct label_map* written = alloc_label_map();
+
+    int i;
+    for (i = 0; i < program->length; i++) {
+        struct operation* operation = &program->operations[i];
+        if (!is_global_access(operation) && may_alias_globals(operation)) {
+            free_label_map(written);
+            return;
+        }
+
+        if (operation->opcode == STORE_AI && is_global_access(operation)) {
+            add_label(written, operation->dst[1].name, i);
+        }
+    }
+
+    for (i = 0; i < program->length; i++) {
+        struct operation* operation = &program->operations[i];
+        if (operation->opcode == LOAD_AI && is_global_access(operation) &&
+            find_label(written, operation->src[1].name) == -1) {
+            struct operand dst = operation->dst[0];
+            operation->dst[0].type = OPERAND_NONE;
+            free_operation(operation);
+            memset(operation, 0, sizeof *operation);
+            operation->opcode = LOAD_I;
+            operation->src[0] = make_imm(0);
+            operation->dst[0] = dst;
+            stats->folded_loads++;
+        }
+    }
+
+    free_label_map(written);
+}
+
+int parse_lto_passes(const char* list) {
+    char* copy = strdup(list);
+    int passes = 0;
+
+    char* name;
+    for (name = strtok(copy, ","); name != 0; name = strtok(0, ",")) {
+        if (strcmp(name, "inline") == 0) {
+            passes |= LTO_INLINE;
+        } else if (strcmp(name, "dead-functions") == 0) {
+            passes |= LTO_DEAD_FUNCTIONS;
+        } else if (strcmp(name, "const-globals") == 0) {
+            passes |= LTO_CONST_GLOBALS;
+        } else if (strcmp(name, "all") == 0) {
+            passes |= LTO_ALL;
+        } else {
+            passes = -1;
+            break;
+        }
+    }
+
+    free(copy);
+    return passes;
+}
+
+void optimize_program(struct module* program,
+                      int passes,
+                      struct lto_stats* stats) {
+    if (passes & LTO_INLINE) {
+        inline_calls(program, stats);
+    }
+
+    if (passes & LTO_DEAD_FUNCTIONS) {
+        remove_dead_functions(program, stats);
+    }
+
+    if (passes & LTO_CONST_GLOBALS) {
+        fold_const_globals(program, stats);
+    }
+}
+
+void print_lto_stats(FILE* out, struct lto_stats* stats) {
+    fprintf(out, "inlined calls: %d\n", stats->inlined_calls);
+    fprintf(out,
+            "removed functions: %d (%d operations)\n",
+            stats->removed_functions,
+            stats->removed_operations);
+    fprintf(out, "folded global loads: %d\n", stats->folded_loads);
+}
@@ -0,0 +1,501 @@
+#include <endian.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../include/generate.h"
+#include "../include/module.h"
+#include "../include/parser.tab.h"
+
+struct interface_writer {
+    struct interface_class* classes;
+    uint32_t class_count;
+    struct interface_field* fields;
+    uint32_t field_count;
+    struct interface_global* globals;
+    uint32_t global_count;
+    struct interface_function* functions;
+    uint32_t function_count;
+    struct interface_param* params;
+    uint32_t param_count;
+    char* strings;
+    uint32_t string_size;
+};
+
+static uint32_t add_string(struct interface_writer* writer, char* string) {
+    uint32_t size = strlen(string) + 1;
+    uint32_t offset = writer->string_size;
+
+    writer->strings = realloc(writer->strings, offset + size);
+    memcpy(writer->strings + offset, string, size);
+    writer->string_size += size;
+
+    return htole32(offset);
+}
+
+static void add_type(struct interface_writer* writer,
+                     struct type type,
+                     uint32_t* key,
+                     uint32_t* val) {
+    *key = htole32(type.key);
+    if (type.key == CUSTOM) {
+        *val = add_string(writer, type.val.custom);
+    } else {
+        *val = htole32(type.val.primitive);
+    }
+}
+
+static void add_class(struct interface_writer* writer,
+                      struct class_def class_def) {
+    writer->classes = realloc(
+        writer->classes, (writer->class_count + 1) * sizeof *writer->classes);
+    struct interface_class* class = &writer->classes[writer->class_count++];
+
+    class->name = add_string(writer, class_def.token.val.string_v);
+    class->line = htole32(class_def.token.line);
+    class->column = htole32(class_def.token.column);
+    class->first_field = htole32(writer->field_count);
+
+    uint32_t count = 0;
+    struct node* node = class_def.field_list;
+    while (node != 0) {
+        writer->fields =
+            realloc(writer->fields,
+                    (writer->field_count + 1) * sizeof *writer->fields);
+        struct interface_field* field = &writer->fields[writer->field_count++];
+
+        field->name = add_string(writer, node->val.field.token.val.string_v);
+        field->line = htole32(node->val.field.token.line);
+        field->column = htole32(node->val.field.token.column);
+        field->access = htole32(node->val.field.access);
+        add_type(writer,
+                 node->val.field.type,
+                 &field->type_key,
+                 &field->type_val);
+        field->offset = htole32(4 * count);
+
+        count++;
+        node = node->val.field.next;
+    }
+
+    class->field_count = htole32(count);
+    class->size = htole32(4 * count);
+}
+
+static void add_global(struct interface_writer* writer,
+                       struct global_var_decl global_var) {
+    writer->globals = realloc(
+        writer->globals, (writer->global_count + 1) * sizeof *writer->globals);
+    struct interface_global* global = &writer->globals[writer->global_count++];
+
+    global->name = add_string(writer, global_var.token.val.string_v);
+    global->line = htole32(global_var.token.line);
+    global->column = htole32(global_var.token.column);
+    global->size = htole32(global_var.size);
+    global->is_static = htole32(global_var.is_static);
+    add_type(writer, global_var.type, &global->type_key, &global->type_val);
+}
+
+static void add_function(struct interface_writer* writer,
+                         struct function_def function_def) {
+    writer->functions =
+        realloc(writer->functions,
+                (writer->function_count + 1) * sizeof *writer->functions);
+    struct interface_function* function =
+        &writer->functions[writer->function_count++];
+
+    function->name = add_string(writer, function_def.token.val.string_v);
+    function->line = htole32(function_def.token.line);
+    function->column = htole32(function_def.token.column);
+    add_type(writer,
+             function_def.type,
+             &function->type_key,
+             &function->type_val);
+    function->first_param = htole32(writer->param_count);
+
+    uint32_t count = 0;
+    struct node* node = function_def.params;
+    while (node != 0) {
+        writer->params =
+            realloc(writer->params,
+                    (writer->param_count + 1) * sizeof *writer->params);
+        struct interface_param* param = &writer->params[writer->param_count++];
+
+        param->name = add_string(writer, node->val.parameter.token.val.string_v);
+        param->line = htole32(node->val.parameter.token.line);
+        param->column = htole32(node->val.parameter.token.column);
+        param->is_const = htole32(node->val.parameter.is_const);
+        add_type(writer,
+                 node->val.parameter.type,
+                 &param->type_key,
+                 &param->type_val);
+
+        count++;
+        node = node->val.parameter.next;
+    }
+
+    function->param_count = htole32(count);
+}
+
+static void add_element(struct interface_writer* writer, struct node* node) {
+    if (node == 0) {
+        return;
+    }
+
+    switch (node->type) {
+        case N_UNIT:
+            add_element(writer, node->val.unit.unit);
+            add_element(writer, node->val.unit.element);
+            break;
+        case N_CLASS_DEF:
+            add_class(writer, node->val.class_def);
+            break;
+        case N_GLOBAL_VAR_DECL:
+            add_global(writer, node->val.global_var_decl);
+            break;
+        case N_FUNCTION_DEF:
+            if (!node->val.function_def.is_static) {
+                add_function(writer, node->val.function_def);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+bool save_interface(struct node* node, FILE* out) {
+    struct interface_writer writer;
+    memset(&writer, 0, sizeof writer);
+
+    add_element(&writer, node);
+
+    struct interface_header header;
+    header.magic = htole32(INTERFACE_MAGIC);
+    header.version = htole32(INTERFACE_VERSION);
+    header.class_count = htole32(writer.class_count);
+    header.field_count = htole32(writer.field_count);
+    header.global_count = htole32(writer.global_count);
+    header.function_count = htole32(writer.function_count);
+    header.param_count = htole32(writer.param_count);
+    header.string_size = htole32(writer.string_size);
+
+    bool written =
+        fwrite(&header, sizeof header, 1, out) == 1 &&
+        fwrite(writer.classes,
+               sizeof *writer.classes,
+               writer.class_count,
+               out) == writer.class_count &&
+        fwrite(writer.fields,
+               sizeof *writer.fields,
+               writer.field_count,
+               out) == writer.field_count &&
+        fwrite(writer.globals,
+               sizeof *writer.globals,
+               writer.global_count,
+               out) == writer.global_count &&
+        fwrite(writer.functions,
+               sizeof *writer.functions,
+               writer.function_count,
+               out) == writer.function_count &&
+        fwrite(writer.params,
+               sizeof *writer.params,
+               writer.param_count,
+               out) == writer.param_count &&
+        fwrite(writer.strings, 1, writer.string_size, out) ==
+            writer.string_size;
+
+    free(writer.classes);
+    free(writer.fields);
+    free(writer.globals);
+    free(writer.functions);
+    free(writer.params);
+    free(writer.strings);
+
+    return written;
+}
+
+static bool is_valid_string(struct interface* interface, uint32_t offset) {
+    return le32toh(offset) < le32toh(interface->header->string_size);
+}
+
+static bool is_valid_type(struct interface* interface,
+                          uint32_t key,
+                          uint32_t val) {
+    return le32toh(key) != CUSTOM || is_valid_string(interface, val);
+}
+
+static bool is_valid_interface(struct interface* interface) {
+    const struct interface_header* header = interface->header;
+    uint32_t class_count = le32toh(header->class_count);
+    uint32_t field_count = le32toh(header->field_count);
+    uint32_t global_count = le32toh(header->global_count);
+    uint32_t function_count = le32toh(header->function_count);
+    uint32_t param_count = le32toh(header->param_count);
+    uint32_t string_size = le32toh(header->string_size);
+
+    if (le32toh(header->magic) != INTERFACE_MAGIC ||
+        le32toh(header->version) != INTERFACE_VERSION ||
+        (uint64_t)sizeof *header +
+                (uint64_t)class_count * sizeof *interface->classes +
+                (uint64_t)field_count * sizeof *interface->fields +
+                (uint64_t)global_count * sizeof *interface->globals +
+                (uint64_t)function_count * sizeof *interface->functions +
+                (uint64_t)param_count * sizeof *interface->params +
+                string_size !=
+            interface->map_size ||
+        (string_size > 0 && interface->strings[string_size - 1] != '\0')) {
+        return false;
+    }
+
+    uint32_t i;
+    for (i = 0; i < class_count; i++) {
+        const struct interface_class* class = &interface->classes[i];
+        if (!is_valid_string(interface, class->name) ||
+            (uint64_t)le32toh(class->first_field) +
+                    le32toh(class->field_count) >
+                field_count) {
+            return false;
+        }
+    }
+
+    for (i = 0; i < field_count; i++) {
+        const struct interface_field* field = &interface->fields[i];
+        if (!is_valid_string(interface, field->name) ||
+            !is_valid_type(interface, field->type_key, field->type_val)) {
+            return false;
+        }
+    }
+
+    for (i = 0; i < global_count; i++) {
+        const struct interface_global* global = &interface->globals[i];
+        if (!is_valid_string(interface, global->name) ||
+            !is_valid_type(interface, global->type_key, global->type_val)) {
+            return false;
+        }
+    }
+
+    for (i = 0; i < function_count; i++) {
+        const struct interface_function* function = &interface->functions[i];
+        if (!is_valid_string(interface, function->name) ||
+            !is_valid_type(interface, function->type_key, function->type_val) ||
+            (uint64_t)le32toh(function->first_param) +
+                    le32toh(function->param_count) >
+                param_count) {
+            return false;
+        }
+    }
+
+    for (i = 0; i < param_count; i++) {
+        const struct interface_param* param = &interface->params[i];
+        if (!is_valid_string(interface, param->name) ||
+            !is_valid_type(interface, param->type_key, param->type_val)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+struct interface* load_interface(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        (size_t)st.st_size < sizeof(struct interface_header)) {
+        close(fd);
+        return 0;
+    }
+
+    void* map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+
+    struct interface* interface = malloc(sizeof *interface);
+    interface->map = map;
+    interface->map_size = st.st_size;
+    interface->header = map;
+    interface->classes =
+        (const struct interface_class*)(interface->header + 1);
+    interface->fields = (const struct interface_field*)(
+        interface->classes + le32toh(interface->header->class_count));
+    interface->globals = (const struct interface_global*)(
+        interface->fields + le32toh(interface->header->field_count));
+    interface->functions = (const struct interface_function*)(
+        interface->globals + le32toh(interface->header->global_count));
+    interface->params = (const struct interface_param*)(
+        interface->functions + le32toh(interface->header->function_count));
+    interface->strings = (const char*)(
+        interface->params + le32toh(interface->header->param_count));
+    interface->field_nodes = 0;
+    interface->param_nodes = 0;
+
+    if (!is_valid_interface(interface)) {
+        free_interface(interface);
+        return 0;
+    }
+
+    return interface;
+}
+
+static char* get_string(struct interface* interface, uint32_t offset) {
+    return (char*)interface->strings + le32toh(offset);
+}
+
+static struct type get_type(struct interface* interface,
+                            uint32_t key,
+                            uint32_t val) {
+    if (le32toh(key) == CUSTOM) {
+        return make_custom(get_string(interface, val));
+    }
+    return make_primitive(le32toh(val));
+}
+
+static struct token get_token(struct interface* interface,
+                              uint32_t name,
+                              int32_t line,
+                              int32_t column) {
+    struct token token;
+    token.line = le32toh(line);
+    token.column = le32toh(column);
+    token.type = ID;
+    token.val.string_v = get_string(interface, name);
+    return token;
+}
+
+static void push_symbol(struct table* table, struct symbol* symbol) {
+    symbol->is_new_context = false;
+    symbol->next = table->head;
+    table->head = symbol;
+}
+
+void import_interface(struct interface* interface, struct table* table) {
+    uint32_t field_count = le32toh(interface->header->field_count);
+    interface->field_nodes =
+        malloc((field_count > 0 ? field_count : 1) *
+               sizeof *interface->field_nodes);
+
+    uint32_t i;
+    for (i = 0; i < field_count; i++) {
+        const struct interface_field* field = &interface->fields[i];
+        struct node* node = &interface->field_nodes[i];
+
+        node->type = N_FIELD;
+        node->val.field.access = le32toh(field->access);
+        node->val.field.type =
+            get_type(interface, field->type_key, field->type_val);
+        node->val.field.token =
+            get_token(interface, field->name, field->line, field->column);
+        node->val.field.next = 0;
+    }
+
+    uint32_t class_count = le32toh(interface->header->class_count);
+    for (i = 0; i < class_count; i++) {
+        const struct interface_class* class = &interface->classes[i];
+        uint32_t first = le32toh(class->first_field);
+        uint32_t count = le32toh(class->field_count);
+
+        uint32_t j;
+        for (j = 0; j + 1 < count; j++) {
+            interface->field_nodes[first + j].val.field.next =
+                &interface->field_nodes[first + j + 1];
+        }
+
+        struct symbol* symbol = malloc(sizeof *symbol);
+        symbol->id = get_string(interface, class->name);
+        symbol->type = SYMBOL_CLASS_DEF;
+        symbol->data.class_def.token =
+            get_token(interface, class->name, class->line, class->column);
+        symbol->data.class_def.field_list =
+            count > 0 ? &interface->field_nodes[first] : 0;
+        symbol->var_access = ACCESS_CLASS;
+        push_symbol(table, symbol);
+    }
+
+    uint32_t global_count = le32toh(interface->header->global_count);
+    for (i = 0; i < global_count; i++) {
+        const struct interface_global* global = &interface->globals[i];
+
+        struct symbol* symbol = malloc(sizeof *symbol);
+        symbol->id = get_string(interface, global->name);
+        symbol->type = SYMBOL_GLOBAL_VAR_DECL;
+        symbol->data.global_var_decl.token =
+            get_token(interface, global->name, global->line, global->column);
+        symbol->data.global_var_decl.size = (int32_t)le32toh(global->size);
+        symbol->data.global_var_decl.is_static = le32toh(global->is_static);
+        symbol->data.global_var_decl.type =
+            get_type(interface, global->type_key, global->type_val);
+
+        bool is_array = symbol->data.global_var_decl.size != -1;
+        if (symbol->data.global_var_decl.type.key == CUSTOM) {
+            symbol->var_access =
+                is_array ? ACCESS_CLASS_ARRAY : ACCESS_CLASS;
+        } else {
+            symbol->var_access =
+                is_array ? ACCESS_PRIMITIVE_ARRAY : ACCESS_PRIMITIVE;
+        }
+        push_symbol(table, symbol);
+
+        import_global(symbol->id);
+    }
+
+    uint32_t param_count = le32toh(interface->header->param_count);
+    interface->param_nodes =
+        malloc((param_count > 0 ? param_count : 1) *
+               sizeof *interface->param_nodes);
+
+    for (i = 0; i < param_count; i++) {
+        const struct interface_param* param = &interface->params[i];
+        struct node* node = &interface->param_nodes[i];
+
+        node->type = N_PARAM;
+        node->val.parameter.is_const = le32toh(param->is_const);
+        node->val.parameter.type =
+            get_type(interface, param->type_key, param->type_val);
+        node->val.parameter.token =
+            get_token(interface, param->name, param->line, param->column);
+        node->val.parameter.next = 0;
+    }
+
+    uint32_t function_count = le32toh(interface->header->function_count);
+    for (i = 0; i < function_count; i++) {
+        const struct interface_function* function = &interface->functions[i];
+        uint32_t first = le32toh(function->first_param);
+        uint32_t count = le32toh(function->param_count);
+
+        uint32_t j;
+        for (j = 0; j + 1 < count; j++) {
+            interface->param_nodes[first + j].val.parameter.next =
+                &interface->param_nodes[first + j + 1];
+        }
+
+        struct symbol* symbol = malloc(sizeof *symbol);
+        symbol->id = get_string(interface, function->name);
+        symbol->type = SYMBOL_FUNCTION_DEF;
+        symbol->data.function_def.is_static = false;
+        symbol->data.function_def.type =
+            get_type(interface, function->type_key, function->type_val);
+        symbol->data.function_def.token = get_token(
+            interface, function->name, function->line, function->column);
+        symbol->data.function_def.params =
+            count > 0 ? &interface->param_nodes[first] : 0;
+        symbol->data.function_def.cmd_block = 0;
+        symbol->var_access = ACCESS_FUNCTION;
+        push_symbol(table, symbol);
+    }
+}
+
+void free_interface(struct interface* interface) {
+    if (interface != 0) {
+        free(interface->field_nodes);
+        free(interface->param_nodes);
+        munmap(interface->map, interface->map_size);
+        free(interface);
+    }
+}
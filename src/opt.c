@@ -0,0 +1,1180 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../include/cfg.h"
+#include "../include/generate.h"
+#include "../include/layout.h"
+#include "../include/opt.h"
+
+struct loop_rewrite {
+    bool* removed;
+    struct operation* preheader;
+    int preheader_count;
+    struct operation* updates;
+    int* update_at;
+    int update_count;
+};
+
+struct memory_effects {
+    int frame;
+    int* slots;
+    int slot_count;
+    struct label_map* globals;
+    bool all;
+    bool calls;
+};
+
+static bool is_reg(struct operand* operand, int reg) {
+    return operand->type == OPERAND_REG && operand->val == reg;
+}
+
+static int max_register(struct module* module, int start, int end) {
+    int max = -1;
+    int i, j;
+    for (i = start; i < end; i++) {
+        struct operation* operation = &module->operations[i];
+        for (j = 0; j < 2; j++) {
+            if (operation->src[j].type == OPERAND_REG &&
+                operation->src[j].val > max) {
+                max = operation->src[j].val;
+            }
+            if (operation->dst[j].type == OPERAND_REG &&
+                operation->dst[j].val > max) {
+                max = operation->dst[j].val;
+            }
+        }
+    }
+    return max;
+}
+
+static void count_register_params(int* defs, int* def_at, int max) {
+    int reg;
+    for (reg = 0; reg < call_registers && reg <= max; reg++) {
+        defs[reg]++;
+        def_at[reg] = -1;
+    }
+}
+
+static bool defines_special(struct operation* operation) {
+    int reg = operation_defines(operation);
+    return reg < 0 && reg != CFG_NO_REG;
+}
+
+static void collect_effects(struct cfg* cfg,
+                            bool* body,
+                            struct memory_effects* effects) {
+    effects->frame = cfg->frame;
+    effects->slots = malloc((cfg->end - cfg->start) * sizeof(int));
+    effects->slot_count = 0;
+    effects->globals = alloc_label_map();
+    effects->all = false;
+    effects->calls = false;
+
+    int b, i;
+    for (b = 0; b < cfg->count; b++) {
+        if (!body[b]) {
+            continue;
+        }
+
+        for (i = cfg->blocks[b].start; i < cfg->blocks[b].end; i++) {
+            struct operation* operation = &cfg->module->operations[i];
+            if (is_call(operation)) {
+                effects->calls = true;
+            }
+            if (operation->opcode == STORE || operation->opcode == STORE_AO ||
+                defines_special(operation)) {
+                effects->all = true;
+            } else if (operation->opcode != STORE_AI) {
+                continue;
+            } else if (is_reg(&operation->dst[0], cfg->frame) &&
+                       operation->dst[1].type == OPERAND_IMM) {
+                effects->slots[effects->slot_count++] = operation->dst[1].val;
+            } else if (is_reg(&operation->dst[0], ILOC_RBSS) &&
+                       operation->dst[1].type == OPERAND_SYMBOL) {
+                add_label(effects->globals, operation->dst[1].name, i);
+            } else if (!is_reg(&operation->dst[0], ILOC_RSP)) {
+                effects->all = true;
+            }
+        }
+    }
+}
+
+static bool is_invariant_load(struct operation* operation,
+                              struct memory_effects* effects) {
+    if (effects->all) {
+        return false;
+    }
+
+    if (is_reg(&operation->src[0], effects->frame) &&
+        operation->src[1].type == OPERAND_IMM) {
+        int i;
+        for (i = 0; i < effects->slot_count; i++) {
+            if (effects->slots[i] == operation->src[1].val) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    return is_reg(&operation->src[0], ILOC_RBSS) &&
+           operation->src[1].type == OPERAND_SYMBOL &&
+           find_label(effects->globals, operation->src[1].name) == -1;
+}
+
+static bool is_pure(struct operation* operation) {
+    switch (operation->opcode) {
+        case LOAD_I:
+        case ADD:
+        case SUB:
+        case MULT:
+        case ADD_I:
+        case SUB_I:
+        case RSUB_I:
+        case MULT_I:
+        case LSHIFT:
+        case LSHIFT_I:
+        case RSHIFT:
+        case RSHIFT_I:
+        case AND:
+        case AND_I:
+        case OR:
+        case OR_I:
+        case XOR:
+        case XOR_I:
+        case CMP_LT:
+        case CMP_LE:
+        case CMP_GT:
+        case CMP_GE:
+        case CMP_EQ:
+        case CMP_NE:
+        case I2I:
+            return true;
+        case DIV_I:
+            return operation->src[1].type == OPERAND_IMM &&
+                   operation->src[1].val != 0;
+        default:
+            return false;
+    }
+}
+
+static bool can_preheader(struct cfg* cfg, struct loop* loop) {
+    struct operation* ops = cfg->module->operations;
+    struct block* header = &cfg->blocks[loop->header];
+    if (ops[header->start].opcode != LABEL) {
+        return false;
+    }
+
+    if (loop->header > 0 && loop->body[loop->header - 1] &&
+        !is_branch(&ops[header->start - 1])) {
+        return false;
+    }
+
+    int i;
+    for (i = cfg->start; i < cfg->end; i++) {
+        if (ops[i].opcode == LOAD_I && ops[i].src[0].type == OPERAND_LABEL &&
+            strcmp(ops[i].src[0].name, ops[header->start].src[0].name) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void retarget(struct operand* operand, char* from, char* to) {
+    if (operand->type == OPERAND_LABEL && strcmp(operand->name, from) == 0) {
+        free(operand->name);
+        operand->name = strdup(to);
+    }
+}
+
+static void insert_preheader(struct cfg* cfg,
+                             struct loop* loop,
+                             struct loop_rewrite* rewrite,
+                             int* next_label) {
+    struct module* module = cfg->module;
+    struct block* header = &cfg->blocks[loop->header];
+    char* header_label = module->operations[header->start].src[0].name;
+
+    char l_pre[32];
+    sprintf(l_pre, "l%d", (*next_label)++);
+
+    int p;
+    for (p = 0; p < header->pred_count; p++) {
+        if (loop->body[header->preds[p]]) {
+            continue;
+        }
+
+        struct block* pred = &cfg->blocks[header->preds[p]];
+        struct operation* last = &module->operations[pred->end - 1];
+        if (last->opcode == CBR || last->opcode == JUMP_I) {
+            retarget(&last->dst[0], header_label, l_pre);
+            retarget(&last->dst[1], header_label, l_pre);
+        }
+    }
+
+    struct module* out = alloc_module();
+    int i;
+    for (i = 0; i < module->length; i++) {
+        if (i == header->start) {
+            struct operation label;
+            memset(&label, 0, sizeof label);
+            label.opcode = LABEL;
+            label.src[0] = make_label(l_pre);
+            append_operation(out, label);
+
+            int k;
+            for (k = 0; k < rewrite->preheader_count; k++) {
+                append_operation(out, rewrite->preheader[k]);
+            }
+        }
+
+        if (i >= cfg->start && i < cfg->end &&
+            rewrite->removed[i - cfg->start]) {
+            continue;
+        }
+
+        append_operation(out, module->operations[i]);
+        int k;
+        for (k = 0; k < rewrite->update_count; k++) {
+            if (rewrite->update_at[k] == i) {
+                append_operation(out, rewrite->updates[k]);
+            }
+        }
+    }
+
+    free(module->operations);
+    module->operations = out->operations;
+    module->length = out->length;
+    module->capacity = out->capacity;
+    free(out);
+}
+
+static bool hoist_invariants(struct cfg* cfg,
+                             struct loop* loop,
+                             int* next_label,
+                             struct opt_stats* stats) {
+    if (loop->has_call || !can_preheader(cfg, loop)) {
+        return false;
+    }
+
+    struct operation* ops = cfg->module->operations;
+    int size = cfg->end - cfg->start;
+    int max = max_register(cfg->module, cfg->start, cfg->end);
+    int* defs = calloc(max + 1, sizeof *defs);
+    int* loop_defs = calloc(max + 1, sizeof *loop_defs);
+    int* def_at = calloc(max + 1, sizeof *def_at);
+    bool* in_loop = calloc(size, sizeof *in_loop);
+    bool* hoisted = calloc(size, sizeof *hoisted);
+    int* order = malloc(size * sizeof *order);
+    int count = 0;
+    count_register_params(defs, def_at, max);
+
+    int b, i, j;
+    for (b = 0; b < cfg->count; b++) {
+        for (i = cfg->blocks[b].start; i < cfg->blocks[b].end; i++) {
+            in_loop[i - cfg->start] = loop->body[b];
+            int reg = operation_defines(&ops[i]);
+            if (reg < 0) {
+                continue;
+            }
+            defs[reg]++;
+            if (loop->body[b]) {
+                loop_defs[reg]++;
+                def_at[reg] = i;
+            }
+        }
+    }
+
+    struct memory_effects effects;
+    collect_effects(cfg, loop->body, &effects);
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (i = cfg->start; i < cfg->end; i++) {
+            if (!in_loop[i - cfg->start] || hoisted[i - cfg->start]) {
+                continue;
+            }
+
+            struct operation* operation = &ops[i];
+            int reg = operation_defines(operation);
+            if (reg < 0 || defs[reg] != 1 ||
+                !(is_pure(operation) ||
+                  (operation->opcode == LOAD_AI &&
+                   is_invariant_load(operation, &effects)))) {
+                continue;
+            }
+
+            int uses[CFG_MAX_USES];
+            int use_count = operation_uses(operation, uses);
+            for (j = 0; j < use_count; j++) {
+                int use = uses[j];
+                if (use == cfg->frame || use == ILOC_RBSS) {
+                    continue;
+                }
+                if (use < 0 || (loop_defs[use] != 0 &&
+                                !hoisted[def_at[use] - cfg->start])) {
+                    break;
+                }
+            }
+
+            if (j == use_count) {
+                hoisted[i - cfg->start] = true;
+                order[count++] = i;
+                changed = true;
+            }
+        }
+    }
+
+    if (count > 0) {
+        struct loop_rewrite rewrite;
+        memset(&rewrite, 0, sizeof rewrite);
+        rewrite.removed = hoisted;
+        rewrite.preheader = malloc(count * sizeof *rewrite.preheader);
+        rewrite.preheader_count = count;
+        for (i = 0; i < count; i++) {
+            rewrite.preheader[i] = ops[order[i]];
+        }
+        insert_preheader(cfg, loop, &rewrite, next_label);
+        free(rewrite.preheader);
+        stats->hoisted_operations += count;
+        stats->preheaders++;
+    }
+
+    free(effects.slots);
+    free_label_map(effects.globals);
+    free(defs);
+    free(loop_defs);
+    free(def_at);
+    free(in_loop);
+    free(hoisted);
+    free(order);
+    return count > 0;
+}
+
+static struct operation make_operation(enum instruction_constant opcode,
+                                       struct operand src,
+                                       struct operand factor,
+                                       int dst) {
+    struct operation operation;
+    memset(&operation, 0, sizeof operation);
+    operation.opcode = opcode;
+    operation.src[0] = src;
+    operation.src[1] = factor;
+    operation.dst[0] = make_reg(dst);
+    return operation;
+}
+
+struct strength_context {
+    struct cfg* cfg;
+    int* defs;
+    int* def_at;
+    int* uses;
+    int* block_at;
+    bool* in_loop;
+};
+
+static bool frame_load(struct cfg* cfg,
+                       struct operation* operation,
+                       int* slot) {
+    if (operation->opcode != LOAD_AI ||
+        !is_reg(&operation->src[0], cfg->frame) ||
+        operation->src[1].type != OPERAND_IMM) {
+        return false;
+    }
+    *slot = operation->src[1].val;
+    return true;
+}
+
+static int single_def(struct strength_context* context,
+                      struct operand* operand) {
+    if (operand->type != OPERAND_REG || operand->val < 0 ||
+        context->defs[operand->val] != 1) {
+        return -1;
+    }
+    return context->def_at[operand->val];
+}
+
+static bool same_block(struct strength_context* context, int a, int b) {
+    int start = context->cfg->start;
+    return context->block_at[a - start] == context->block_at[b - start];
+}
+
+static bool find_induction(struct strength_context* context,
+                           int slot,
+                           int* store,
+                           int* step) {
+    struct cfg* cfg = context->cfg;
+    struct operation* ops = cfg->module->operations;
+    int count = 0;
+    int i;
+    for (i = cfg->start; i < cfg->end; i++) {
+        if (context->in_loop[i - cfg->start] && ops[i].opcode == STORE_AI &&
+            is_reg(&ops[i].dst[0], cfg->frame) &&
+            ops[i].dst[1].type == OPERAND_IMM && ops[i].dst[1].val == slot) {
+            *store = i;
+            count++;
+        }
+    }
+    if (count != 1) {
+        return false;
+    }
+
+    int update = single_def(context, &ops[*store].src[0]);
+    if (update == -1 || !same_block(context, update, *store) ||
+        (ops[update].opcode != ADD_I && ops[update].opcode != SUB_I) ||
+        ops[update].src[1].type != OPERAND_IMM) {
+        return false;
+    }
+
+    int load = single_def(context, &ops[update].src[0]);
+    int loaded;
+    if (load == -1 || !same_block(context, load, update) || load > update ||
+        !frame_load(cfg, &ops[load], &loaded) || loaded != slot) {
+        return false;
+    }
+
+    *step = ops[update].opcode == ADD_I ? ops[update].src[1].val
+                                        : -ops[update].src[1].val;
+    return true;
+}
+
+static bool is_derived(struct strength_context* context,
+                       int i,
+                       int v,
+                       int* load,
+                       int* store,
+                       int* step) {
+    struct cfg* cfg = context->cfg;
+    struct operation* ops = cfg->module->operations;
+    int slot;
+    *load = single_def(context, &ops[i].src[v]);
+    if (*load == -1 || !context->in_loop[*load - cfg->start] ||
+        !same_block(context, *load, i) || *load > i ||
+        !frame_load(cfg, &ops[*load], &slot) ||
+        !find_induction(context, slot, store, step)) {
+        return false;
+    }
+
+    if (same_block(context, *store, i) && *store > *load && *store < i) {
+        return false;
+    }
+
+    struct operand* factor = &ops[i].src[1 - v];
+    if (factor->type == OPERAND_REG) {
+        int def = single_def(context, factor);
+        return def != -1 && !context->in_loop[def - cfg->start];
+    }
+    return factor->type == OPERAND_IMM;
+}
+
+static bool reduce_strength(struct cfg* cfg,
+                            struct loop* loop,
+                            int* next_label,
+                            struct opt_stats* stats) {
+    if (loop->has_call || !can_preheader(cfg, loop)) {
+        return false;
+    }
+
+    struct memory_effects effects;
+    collect_effects(cfg, loop->body, &effects);
+    free(effects.slots);
+    free_label_map(effects.globals);
+    if (effects.all) {
+        return false;
+    }
+
+    struct operation* ops = cfg->module->operations;
+    int size = cfg->end - cfg->start;
+    int next_reg = max_register(cfg->module, cfg->start, cfg->end) + 1;
+    struct strength_context context;
+    context.cfg = cfg;
+    context.defs = calloc(next_reg, sizeof *context.defs);
+    context.def_at = calloc(next_reg, sizeof *context.def_at);
+    context.uses = calloc(next_reg, sizeof *context.uses);
+    context.block_at = malloc(size * sizeof *context.block_at);
+    context.in_loop = malloc(size * sizeof *context.in_loop);
+    count_register_params(context.defs, context.def_at, next_reg - 1);
+
+    int b, i, j;
+    for (b = 0; b < cfg->count; b++) {
+        for (i = cfg->blocks[b].start; i < cfg->blocks[b].end; i++) {
+            context.block_at[i - cfg->start] = b;
+            context.in_loop[i - cfg->start] = loop->body[b];
+
+            int uses[CFG_MAX_USES];
+            int use_count = operation_uses(&ops[i], uses);
+            for (j = 0; j < use_count; j++) {
+                if (uses[j] >= 0) {
+                    context.uses[uses[j]]++;
+                }
+            }
+
+            int reg = operation_defines(&ops[i]);
+            if (reg >= 0) {
+                context.defs[reg]++;
+                context.def_at[reg] = i;
+            }
+        }
+    }
+
+    struct loop_rewrite rewrite;
+    rewrite.removed = calloc(size, sizeof *rewrite.removed);
+    rewrite.preheader = malloc(3 * size * sizeof *rewrite.preheader);
+    rewrite.preheader_count = 0;
+    rewrite.updates = malloc(size * sizeof *rewrite.updates);
+    rewrite.update_at = malloc(size * sizeof *rewrite.update_at);
+    rewrite.update_count = 0;
+
+    for (i = cfg->start; i < cfg->end; i++) {
+        struct operation* operation = &ops[i];
+        if (!context.in_loop[i - cfg->start] ||
+            (operation->opcode != MULT && operation->opcode != MULT_I)) {
+            continue;
+        }
+
+        int load, store, step;
+        int v;
+        int candidates = operation->opcode == MULT ? 2 : 1;
+        for (v = 0; v < candidates; v++) {
+            if (is_derived(&context, i, v, &load, &store, &step)) {
+                break;
+            }
+        }
+        if (v == candidates) {
+            continue;
+        }
+
+        int base = next_reg++;
+        int reduced = next_reg++;
+        struct operand factor = operation->src[1 - v];
+        rewrite.preheader[rewrite.preheader_count++] =
+            make_operation(LOAD_AI,
+                           make_reg(cfg->frame),
+                           copy_operand(ops[load].src[1]),
+                           base);
+        rewrite.preheader[rewrite.preheader_count++] =
+            make_operation(operation->opcode, make_reg(base), factor, reduced);
+
+        struct operand delta;
+        enum instruction_constant update = ADD_I;
+        if (factor.type == OPERAND_IMM) {
+            delta = make_imm((int)((unsigned)factor.val * (unsigned)step));
+        } else {
+            delta = make_reg(next_reg++);
+            update = ADD;
+            rewrite.preheader[rewrite.preheader_count++] =
+                make_operation(MULT_I, factor, make_imm(step), delta.val);
+        }
+        rewrite.updates[rewrite.update_count] =
+            make_operation(update, make_reg(reduced), delta, reduced);
+        rewrite.update_at[rewrite.update_count++] = store;
+
+        if (context.uses[ops[load].dst[0].val] == 1) {
+            rewrite.removed[load - cfg->start] = true;
+        }
+        operation->opcode = I2I;
+        operation->src[0] = make_reg(reduced);
+        memset(&operation->src[1], 0, sizeof operation->src[1]);
+        stats->strength_reduced++;
+    }
+
+    bool changed = rewrite.update_count > 0;
+    if (changed) {
+        insert_preheader(cfg, loop, &rewrite, next_label);
+        stats->preheaders++;
+    }
+
+    free(context.defs);
+    free(context.def_at);
+    free(context.uses);
+    free(context.block_at);
+    free(context.in_loop);
+    free(rewrite.removed);
+    free(rewrite.preheader);
+    free(rewrite.updates);
+    free(rewrite.update_at);
+    return changed;
+}
+
+static bool rewrite_function(struct module* module,
+                             int start,
+                             int* next_label,
+                             struct opt_stats* stats,
+                             bool (*rewrite)(struct cfg*,
+                                             struct loop*,
+                                             int*,
+                                             struct opt_stats*)) {
+    struct cfg* cfg = build_cfg(module, start, function_end(module, start));
+    struct loop* loops;
+    int count = find_loops(cfg, &loops);
+
+    bool changed = false;
+    int i;
+    for (i = 0; i < count && !changed; i++) {
+        changed = rewrite(cfg, &loops[i], next_label, stats);
+    }
+
+    free_loops(loops, count);
+    free_cfg(cfg);
+    return changed;
+}
+
+static void rewrite_loops(struct module* module,
+                          struct opt_stats* stats,
+                          bool (*rewrite)(struct cfg*,
+                                          struct loop*,
+                                          int*,
+                                          struct opt_stats*)) {
+    int next_label = max_local_label(module) + 1;
+
+    int i;
+    for (i = 0; i < module->length; i++) {
+        if (is_function_label(&module->operations[i])) {
+            while (rewrite_function(module, i, &next_label, stats, rewrite)) {
+            }
+        }
+    }
+}
+
+struct value {
+    int opcode;
+    struct operand args[2];
+    int reg;
+};
+
+struct value_table {
+    struct value* values;
+    int count;
+    int capacity;
+};
+
+struct numbering {
+    struct cfg* cfg;
+    int* block_at;
+    int* def_at;
+    bool* single;
+    int* number;
+    int* rename;
+    bool* removed;
+};
+
+static bool is_commutative(int opcode) {
+    switch (opcode) {
+        case ADD:
+        case MULT:
+        case AND:
+        case OR:
+        case XOR:
+        case CMP_EQ:
+        case CMP_NE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool same_operand(struct operand* a, struct operand* b) {
+    if (a->type != b->type) {
+        return false;
+    }
+    if (a->type == OPERAND_SYMBOL) {
+        return strcmp(a->name, b->name) == 0;
+    }
+    return a->type == OPERAND_NONE || a->val == b->val;
+}
+
+static bool dominates_use(struct numbering* numbering, int def, int use) {
+    int start = numbering->cfg->start;
+    int a = numbering->block_at[def - start];
+    int b = numbering->block_at[use - start];
+    if (a == b) {
+        return def < use;
+    }
+    return dominates(numbering->cfg, a, b);
+}
+
+static void find_single_defs(struct numbering* numbering, int max) {
+    struct cfg* cfg = numbering->cfg;
+    struct operation* ops = cfg->module->operations;
+    int* defs = calloc(max + 1, sizeof *defs);
+
+    int i, j;
+    for (i = cfg->start; i < cfg->end; i++) {
+        int reg = operation_defines(&ops[i]);
+        if (reg >= 0) {
+            defs[reg]++;
+            numbering->def_at[reg] = i;
+        }
+        if (is_call(&ops[i])) {
+            for (reg = 0; reg < call_registers; reg++) {
+                defs[reg]++;
+                numbering->def_at[reg] = i;
+            }
+        }
+    }
+
+    for (i = 0; i <= max; i++) {
+        numbering->single[i] =
+            defs[i] == 1 &&
+            numbering->block_at[numbering->def_at[i] - cfg->start] != -1;
+    }
+
+    for (i = cfg->start; i < cfg->end; i++) {
+        int uses[CFG_MAX_USES];
+        int count = operation_uses(&ops[i], uses);
+        for (j = 0; j < count; j++) {
+            int reg = uses[j];
+            if (reg >= 0 && numbering->single[reg] &&
+                (numbering->block_at[i - cfg->start] == -1 ||
+                 !dominates_use(numbering, numbering->def_at[reg], i))) {
+                numbering->single[reg] = false;
+            }
+        }
+    }
+
+    free(defs);
+}
+
+static bool value_operand(struct numbering* numbering,
+                          struct operand* operand,
+                          struct operand* arg) {
+    *arg = *operand;
+    if (operand->type == OPERAND_LABEL) {
+        return false;
+    }
+    if (operand->type != OPERAND_REG) {
+        return true;
+    }
+    if (operand->val < 0 || !numbering->single[operand->val]) {
+        return false;
+    }
+    arg->val = numbering->number[operand->val];
+    return true;
+}
+
+static bool make_value(struct numbering* numbering,
+                       struct operation* operation,
+                       struct value* value) {
+    int frame = numbering->cfg->frame;
+    value->opcode = operation->opcode;
+    value->args[0] = operation->src[0];
+    value->args[1] = operation->src[1];
+
+    if (operation->opcode == LOAD_AI) {
+        return (is_reg(&operation->src[0], frame) &&
+                operation->src[1].type == OPERAND_IMM) ||
+               (is_reg(&operation->src[0], ILOC_RBSS) &&
+                operation->src[1].type == OPERAND_SYMBOL);
+    }
+
+    if (!is_pure(operation) || operation->opcode == I2I ||
+        !value_operand(numbering, &operation->src[0], &value->args[0]) ||
+        !value_operand(numbering, &operation->src[1], &value->args[1])) {
+        return false;
+    }
+
+    if (is_commutative(value->opcode) &&
+        value->args[0].type == OPERAND_REG &&
+        value->args[1].type == OPERAND_REG &&
+        value->args[0].val > value->args[1].val) {
+        struct operand arg = value->args[0];
+        value->args[0] = value->args[1];
+        value->args[1] = arg;
+    }
+    return true;
+}
+
+static struct value* find_value(struct value_table* table,
+                                struct value* value) {
+    int i;
+    for (i = 0; i < table->count; i++) {
+        struct value* other = &table->values[i];
+        if (other->opcode == value->opcode &&
+            same_operand(&other->args[0], &value->args[0]) &&
+            same_operand(&other->args[1], &value->args[1])) {
+            return other;
+        }
+    }
+    return 0;
+}
+
+static void add_value(struct value_table* table, struct value* value) {
+    if (table->count == table->capacity) {
+        table->capacity = table->capacity > 0 ? 2 * table->capacity : 16;
+        table->values =
+            realloc(table->values, table->capacity * sizeof *table->values);
+    }
+    table->values[table->count++] = *value;
+}
+
+static bool is_killed(struct value* value, struct memory_effects* effects) {
+    if (value->opcode != LOAD_AI || effects->all) {
+        return value->opcode == LOAD_AI;
+    }
+    if (value->args[1].type == OPERAND_SYMBOL) {
+        return find_label(effects->globals, value->args[1].name) != -1;
+    }
+
+    int i;
+    for (i = 0; i < effects->slot_count; i++) {
+        if (effects->slots[i] == value->args[1].val) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void kill_loads(struct value_table* table,
+                       struct memory_effects* effects) {
+    int kept = 0;
+    int i;
+    for (i = 0; i < table->count; i++) {
+        if (!is_killed(&table->values[i], effects)) {
+            table->values[kept++] = table->values[i];
+        }
+    }
+    table->count = kept;
+}
+
+static void kill_store(struct value_table* table, struct operation* store) {
+    int kept = 0;
+    int i;
+    for (i = 0; i < table->count; i++) {
+        struct value* value = &table->values[i];
+        if (value->opcode != LOAD_AI ||
+            !same_operand(&value->args[0], &store->dst[0]) ||
+            !same_operand(&value->args[1], &store->dst[1])) {
+            table->values[kept++] = *value;
+        }
+    }
+    table->count = kept;
+}
+
+static void inherit_values(struct cfg* cfg,
+                           struct value_table* tables,
+                           int b) {
+    struct value_table* table = &tables[b];
+    int idom = cfg->blocks[b].idom;
+    if (b == 0) {
+        return;
+    }
+
+    struct value_table* parent = &tables[idom];
+    int i;
+    for (i = 0; i < parent->count; i++) {
+        add_value(table, &parent->values[i]);
+    }
+
+    bool* region = calloc(cfg->count, sizeof *region);
+    int* stack = malloc(cfg->count * sizeof *stack);
+    int top = 0;
+    stack[top++] = b;
+    while (top > 0) {
+        struct block* block = &cfg->blocks[stack[--top]];
+        int p;
+        for (p = 0; p < block->pred_count; p++) {
+            int pred = block->preds[p];
+            if (pred != idom && !region[pred]) {
+                region[pred] = true;
+                stack[top++] = pred;
+            }
+        }
+    }
+
+    struct memory_effects effects;
+    collect_effects(cfg, region, &effects);
+    if (effects.calls) {
+        table->count = 0;
+    } else {
+        kill_loads(table, &effects);
+    }
+
+    free(effects.slots);
+    free_label_map(effects.globals);
+    free(region);
+    free(stack);
+}
+
+static bool is_slot_store(struct cfg* cfg, struct operation* operation) {
+    return operation->opcode == STORE_AI &&
+           ((is_reg(&operation->dst[0], cfg->frame) &&
+             operation->dst[1].type == OPERAND_IMM) ||
+            (is_reg(&operation->dst[0], ILOC_RBSS) &&
+             operation->dst[1].type == OPERAND_SYMBOL));
+}
+
+static int number_block(struct numbering* numbering,
+                        struct value_table* table,
+                        int b) {
+    struct cfg* cfg = numbering->cfg;
+    struct operation* ops = cfg->module->operations;
+    struct memory_effects stores;
+    memset(&stores, 0, sizeof stores);
+    stores.all = true;
+    int eliminated = 0;
+
+    int i;
+    for (i = cfg->blocks[b].start; i < cfg->blocks[b].end; i++) {
+        struct operation* operation = &ops[i];
+        struct value value;
+        struct operand arg;
+
+        if (is_call(operation)) {
+            int reg;
+            for (reg = 0; reg < call_registers; reg++) {
+                numbering->number[reg] = reg;
+            }
+            table->count = 0;
+            continue;
+        }
+
+        if (is_slot_store(cfg, operation)) {
+            kill_store(table, operation);
+            if (value_operand(numbering, &operation->src[0], &arg)) {
+                value.opcode = LOAD_AI;
+                value.args[0] = operation->dst[0];
+                value.args[1] = operation->dst[1];
+                value.reg = arg.val;
+                add_value(table, &value);
+            }
+            continue;
+        }
+
+        if (operation->opcode == STORE || operation->opcode == STORE_AI ||
+            operation->opcode == STORE_AO || defines_special(operation)) {
+            kill_loads(table, &stores);
+        }
+
+        int reg = operation_defines(operation);
+        if (reg < 0 || !numbering->single[reg]) {
+            continue;
+        }
+        numbering->number[reg] = reg;
+
+        if (operation->opcode == I2I) {
+            if (value_operand(numbering, &operation->src[0], &arg)) {
+                numbering->number[reg] = arg.val;
+            }
+        } else if (make_value(numbering, operation, &value)) {
+            struct value* found = find_value(table, &value);
+            if (found != 0) {
+                numbering->number[reg] = found->reg;
+                numbering->rename[reg] = found->reg;
+                numbering->removed[i - cfg->start] = true;
+                eliminated++;
+            } else {
+                value.reg = reg;
+                add_value(table, &value);
+            }
+        }
+    }
+    return eliminated;
+}
+
+static void rename_operand(struct numbering* numbering,
+                           struct operand* operand) {
+    if (operand->type == OPERAND_REG && operand->val >= 0 &&
+        numbering->rename[operand->val] != -1) {
+        operand->val = numbering->rename[operand->val];
+    }
+}
+
+static void remove_values(struct numbering* numbering) {
+    struct cfg* cfg = numbering->cfg;
+    struct module* module = cfg->module;
+    struct module* out = alloc_module();
+
+    int i, j;
+    for (i = 0; i < module->length; i++) {
+        struct operation* operation = &module->operations[i];
+        if (i < cfg->start || i >= cfg->end) {
+            append_operation(out, *operation);
+            continue;
+        }
+        if (numbering->removed[i - cfg->start]) {
+            free_operation(operation);
+            continue;
+        }
+
+        for (j = 0; j < 2; j++) {
+            rename_operand(numbering, &operation->src[j]);
+            if (operation->opcode == STORE || operation->opcode == STORE_AI ||
+                operation->opcode == STORE_AO || operation->opcode == JUMP) {
+                rename_operand(numbering, &operation->dst[j]);
+            }
+        }
+        append_operation(out, *operation);
+    }
+
+    free(module->operations);
+    module->operations = out->operations;
+    module->length = out->length;
+    module->capacity = out->capacity;
+    free(out);
+}
+
+static int number_function(struct module* module, int start) {
+    struct cfg* cfg = build_cfg(module, start, function_end(module, start));
+    int size = cfg->end - cfg->start;
+    int max = max_register(module, cfg->start, cfg->end);
+    if (max < call_registers - 1) {
+        max = call_registers - 1;
+    }
+
+    struct numbering numbering;
+    numbering.cfg = cfg;
+    numbering.block_at = malloc(size * sizeof *numbering.block_at);
+    numbering.def_at = calloc(max + 1, sizeof *numbering.def_at);
+    numbering.single = calloc(max + 1, sizeof *numbering.single);
+    numbering.number = malloc((max + 1) * sizeof *numbering.number);
+    numbering.rename = malloc((max + 1) * sizeof *numbering.rename);
+    numbering.removed = calloc(size, sizeof *numbering.removed);
+
+    int b, i;
+    for (b = 0; b < cfg->count; b++) {
+        for (i = cfg->blocks[b].start; i < cfg->blocks[b].end; i++) {
+            numbering.block_at[i - cfg->start] =
+                b == 0 || cfg->blocks[b].idom != -1 ? b : -1;
+        }
+    }
+    for (i = 0; i <= max; i++) {
+        numbering.number[i] = i;
+        numbering.rename[i] = -1;
+    }
+    find_single_defs(&numbering, max);
+
+    struct value_table* tables = calloc(cfg->count, sizeof *tables);
+    int eliminated = 0;
+    for (i = 0; i < cfg->order_count; i++) {
+        b = cfg->order[i];
+        inherit_values(cfg, tables, b);
+        eliminated += number_block(&numbering, &tables[b], b);
+    }
+
+    if (eliminated > 0) {
+        remove_values(&numbering);
+    }
+
+    for (b = 0; b < cfg->count; b++) {
+        free(tables[b].values);
+    }
+    free(tables);
+    free(numbering.block_at);
+    free(numbering.def_at);
+    free(numbering.single);
+    free(numbering.number);
+    free(numbering.rename);
+    free(numbering.removed);
+    free_cfg(cfg);
+    return eliminated;
+}
+
+static void number_values(struct module* module, struct opt_stats* stats) {
+    int i;
+    for (i = 0; i < module->length; i++) {
+        struct operation* operation = &module->operations[i];
+        if (!is_function_label(operation)) {
+            continue;
+        }
+
+        char* name = strdup(operation->src[0].name + 1);
+        int eliminated = number_function(module, i);
+        stats->functions = realloc(
+            stats->functions,
+            (stats->function_count + 1) * sizeof *stats->functions);
+        stats->functions[stats->function_count].name = name;
+        stats->functions[stats->function_count].eliminated = eliminated;
+        stats->function_count++;
+        stats->eliminated_operations += eliminated;
+    }
+}
+
+int parse_opt_passes(const char* list) {
+    char* copy = strdup(list);
+    int passes = 0;
+
+    char* name;
+    for (name = strtok(copy, ","); name != 0; name = strtok(0, ",")) {
+        if (strcmp(name, "licm") == 0) {
+            passes |= OPT_LICM;
+        } else if (strcmp(name, "unroll") == 0) {
+            passes |= OPT_UNROLL;
+        } else if (strcmp(name, "strength") == 0) {
+            passes |= OPT_STRENGTH;
+        } else if (strcmp(name, "inline") == 0) {
+            passes |= OPT_INLINE;
+        } else if (strcmp(name, "tail-calls") == 0) {
+            passes |= OPT_TAIL_CALLS;
+        } else if (strcmp(name, "shrink-wrap") == 0) {
+            passes |= OPT_SHRINK_WRAP;
+        } else if (strcmp(name, "if-convert") == 0) {
+            passes |= OPT_IF_CONVERT;
+        } else if (strcmp(name, "layout") == 0) {
+            passes |= OPT_LAYOUT;
+        } else if (strcmp(name, "gvn") == 0) {
+            passes |= OPT_GVN;
+        } else if (strcmp(name, "all") == 0) {
+            passes |= OPT_ALL;
+        } else {
+            passes = -1;
+            break;
+        }
+    }
+
+    free(copy);
+    return passes;
+}
+
+void optimize_module(struct module* module,
+                     int passes,
+                     struct opt_stats* stats) {
+    if (passes & OPT_LICM) {
+        rewrite_loops(module, stats, hoist_invariants);
+    }
+    if (passes & OPT_STRENGTH) {
+        rewrite_loops(module, stats, reduce_strength);
+    }
+    if (passes & OPT_GVN) {
+        number_values(module, stats);
+    }
+    if (passes & OPT_LAYOUT) {
+        layout_module(module, stats);
+    }
+}
+
+void print_opt_stats(FILE* out, struct opt_stats* stats) {
+    fprintf(out,
+            "hoisted operations: %d\n"
+            "strength-reduced operations: %d\n"
+            "preheaders: %d\n"
+            "threaded jumps: %d\n"
+            "removed jumps: %d\n"
+            "unreachable operations: %d\n"
+            "removed labels: %d\n"
+            "eliminated operations: %d\n",
+            stats->hoisted_operations,
+            stats->strength_reduced,
+            stats->preheaders,
+            stats->threaded_jumps,
+            stats->removed_jumps,
+            stats->unreachable_operations,
+            stats->removed_labels,
+            stats->eliminated_operations);
+
+    int i;
+    for (i = 0; i < stats->function_count; i++) {
+        fprintf(out,
+                "  %-16s eliminated %d\n",
+                stats->functions[i].name,
+                stats->functions[i].eliminated);
+    }
+}
+
+void free_opt_stats(struct opt_stats* stats) {
+    int i;
+    for (i = 0; i < stats->function_count; i++) {
+        free(stats->functions[i].name);
+    }
+    free(stats->functions);
+    stats->functions = 0;
+    stats->function_count = 0;
+}
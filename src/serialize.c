@@ -0,0 +1,650 @@
+#include <endian.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../include/parser.tab.h"
+#include "../include/serialize.h"
+
+struct writer {
+    struct ast_record* records;
+    uint32_t node_count;
+    uint32_t node_capacity;
+
+    char* strings;
+    uint32_t string_size;
+    uint32_t string_capacity;
+
+    uint32_t* slots;
+    uint32_t slot_capacity;
+    uint32_t slot_count;
+};
+
+static uint32_t hash_string(const char* string) {
+    uint32_t hash = 2166136261u;
+    while (*string != '\0') {
+        hash ^= (unsigned char)*string++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void grow_slots(struct writer* writer) {
+    uint32_t* old = writer->slots;
+    uint32_t old_capacity = writer->slot_capacity;
+
+    writer->slot_capacity = old_capacity == 0 ? 64 : old_capacity * 2;
+    writer->slots = malloc(writer->slot_capacity * sizeof *writer->slots);
+    memset(writer->slots, 0xff, writer->slot_capacity * sizeof *writer->slots);
+
+    uint32_t i;
+    for (i = 0; i < old_capacity; i++) {
+        if (old[i] != AST_NONE) {
+            uint32_t slot = hash_string(writer->strings + old[i]) &
+                            (writer->slot_capacity - 1);
+            while (writer->slots[slot] != AST_NONE) {
+                slot = (slot + 1) & (writer->slot_capacity - 1);
+            }
+            writer->slots[slot] = old[i];
+        }
+    }
+
+    free(old);
+}
+
+static uint32_t write_string(struct writer* writer, const char* string) {
+    if (string == 0) {
+        return AST_NONE;
+    }
+
+    if (2 * (writer->slot_count + 1) > writer->slot_capacity) {
+        grow_slots(writer);
+    }
+
+    uint32_t slot = hash_string(string) & (writer->slot_capacity - 1);
+    while (writer->slots[slot] != AST_NONE) {
+        if (strcmp(writer->strings + writer->slots[slot], string) == 0) {
+            return writer->slots[slot];
+        }
+        slot = (slot + 1) & (writer->slot_capacity - 1);
+    }
+
+    uint32_t size = strlen(string) + 1;
+    while (writer->string_size + size > writer->string_capacity) {
+        writer->string_capacity =
+            writer->string_capacity == 0 ? 256 : writer->string_capacity * 2;
+        writer->strings = realloc(writer->strings, writer->string_capacity);
+    }
+
+    uint32_t offset = writer->string_size;
+    memcpy(writer->strings + offset, string, size);
+    writer->string_size += size;
+
+    writer->slots[slot] = offset;
+    writer->slot_count++;
+    return offset;
+}
+
+static bool is_string_token(struct token token) {
+    return token.type == ID || token.type == STRING;
+}
+
+static struct ast_token write_token(struct writer* writer, struct token token) {
+    struct ast_token ast_token;
+    ast_token.line = htole32(token.line);
+    ast_token.column = htole32(token.column);
+    ast_token.type = htole32(token.type);
+
+    uint32_t val = 0;
+    switch (token.type) {
+        case INT:
+            val = (uint32_t)token.val.int_v;
+            break;
+        case FLOAT:
+            memcpy(&val, &token.val.float_v, sizeof val);
+            break;
+        case CHAR:
+            val = (unsigned char)token.val.char_v;
+            break;
+        case BOOL:
+            val = token.val.bool_v;
+            break;
+        default:
+            if (is_string_token(token)) {
+                val = write_string(writer, token.val.string_v);
+            }
+            break;
+    }
+    ast_token.val = htole32(val);
+
+    return ast_token;
+}
+
+static void write_type(struct writer* writer,
+                       struct ast_record* record,
+                       struct type type) {
+    if (type.key == CUSTOM) {
+        record->flags |= AST_CUSTOM;
+        record->type_val = write_string(writer, type.val.custom);
+    } else {
+        record->type_val = type.val.primitive;
+    }
+}
+
+static uint32_t write_node(struct writer* writer, struct node* node) {
+    if (node == 0) {
+        return AST_NONE;
+    }
+
+    if (writer->node_count == writer->node_capacity) {
+        writer->node_capacity =
+            writer->node_capacity == 0 ? 64 : writer->node_capacity * 2;
+        writer->records =
+            realloc(writer->records,
+                    writer->node_capacity * sizeof *writer->records);
+    }
+
+    uint32_t index = writer->node_count++;
+
+    struct ast_record record;
+    memset(&record, 0, sizeof record);
+    record.type = node->type;
+    record.str = AST_NONE;
+    record.child[0] = AST_NONE;
+    record.child[1] = AST_NONE;
+    record.child[2] = AST_NONE;
+    record.child[3] = AST_NONE;
+
+    union node_value* val = &node->val;
+    switch (node->type) {
+        case N_LITERAL:
+            record.token = write_token(writer, val->token);
+            break;
+        case N_UNARY_EXP:
+            record.op = val->unary_exp.op;
+            record.child[0] = write_node(writer, val->unary_exp.operand);
+            break;
+        case N_BINARY_EXP:
+            record.op = val->binary_exp.op;
+            record.child[0] = write_node(writer, val->binary_exp.left);
+            record.child[1] = write_node(writer, val->binary_exp.right);
+            break;
+        case N_TERNARY_EXP:
+            record.child[0] = write_node(writer, val->ternary_exp.condition);
+            record.child[1] = write_node(writer, val->ternary_exp.exp1);
+            record.child[2] = write_node(writer, val->ternary_exp.exp2);
+            break;
+        case N_EXP_LIST:
+            record.child[0] = write_node(writer, val->exp_list.exp);
+            record.child[1] = write_node(writer, val->exp_list.exp_list);
+            break;
+        case N_SWITCH:
+            record.child[0] = write_node(writer, val->switch_cmd.control_exp);
+            record.child[1] = write_node(writer, val->switch_cmd.cmd_block);
+            break;
+        case N_DO_WHILE:
+            record.child[0] = write_node(writer, val->do_while_cmd.cmd_block);
+            record.child[1] = write_node(writer, val->do_while_cmd.condition);
+            break;
+        case N_WHILE:
+            record.child[0] = write_node(writer, val->while_cmd.condition);
+            record.child[1] = write_node(writer, val->while_cmd.cmd_block);
+            break;
+        case N_FOR:
+            record.child[0] =
+                write_node(writer, val->for_cmd.initialization);
+            record.child[1] = write_node(writer, val->for_cmd.condition);
+            record.child[2] = write_node(writer, val->for_cmd.update);
+            record.child[3] = write_node(writer, val->for_cmd.cmd_block);
+            break;
+        case N_FOREACH:
+            record.str = write_string(writer, val->foreach_cmd.item);
+            record.child[0] = write_node(writer, val->foreach_cmd.exp_list);
+            record.child[1] = write_node(writer, val->foreach_cmd.cmd_block);
+            break;
+        case N_ARG_LIST:
+            record.child[0] = write_node(writer, val->arg_list.arg);
+            record.child[1] = write_node(writer, val->arg_list.next);
+            break;
+        case N_FUNCTION:
+            record.token = write_token(writer, val->function_cmd.token);
+            record.child[0] = write_node(writer, val->function_cmd.arg_list);
+            break;
+        case N_PIPE:
+            record.op = val->pipe_cmd.pipe_op;
+            record.child[0] = write_node(writer, val->pipe_cmd.pipe_cmd);
+            record.child[1] = write_node(writer, val->pipe_cmd.function_cmd);
+            break;
+        case N_IF:
+            record.child[0] = write_node(writer, val->if_cmd.condition);
+            record.child[1] = write_node(writer, val->if_cmd.then_cmd_block);
+            record.child[2] = write_node(writer, val->if_cmd.else_cmd_block);
+            break;
+        case N_OUTPUT:
+            record.child[0] = write_node(writer, val->out_cmd.exp_list);
+            break;
+        case N_INPUT:
+            record.child[0] = write_node(writer, val->in_cmd.exp);
+            break;
+        case N_CASE:
+            record.op = val->case_label.case_val;
+            break;
+        case N_RETURN:
+            record.child[0] = write_node(writer, val->return_cmd.exp);
+            break;
+        case N_SHIFT:
+            record.op = val->shift_cmd.shift_op;
+            record.child[0] = write_node(writer, val->shift_cmd.var);
+            record.child[1] = write_node(writer, val->shift_cmd.exp);
+            break;
+        case N_VAR:
+            record.token = write_token(writer, val->var.token);
+            record.str = write_string(writer, val->var.field_access);
+            record.child[0] = write_node(writer, val->var.array_access);
+            break;
+        case N_ATTRIBUTION:
+            record.child[0] = write_node(writer, val->attr_cmd.var);
+            record.child[1] = write_node(writer, val->attr_cmd.exp);
+            break;
+        case N_LOCAL_VAR_DECL:
+            record.flags |= val->local_var_decl.is_static ? AST_STATIC : 0;
+            record.flags |= val->local_var_decl.is_const ? AST_CONST : 0;
+            write_type(writer, &record, val->local_var_decl.type);
+            record.token = write_token(writer, val->local_var_decl.token);
+            record.child[0] = write_node(writer, val->local_var_decl.init);
+            break;
+        case N_CMD_LIST:
+            record.child[0] = write_node(writer, val->cmd_list.cmd_list);
+            record.child[1] = write_node(writer, val->cmd_list.cmd);
+            break;
+        case N_HIGH_LIST:
+            record.child[0] = write_node(writer, val->high_list.high_list);
+            record.child[1] = write_node(writer, val->high_list.cmd);
+            break;
+        case N_CMD_BLOCK:
+            record.child[0] = write_node(writer, val->cmd_block.high_list);
+            break;
+        case N_PARAM:
+            record.flags |= val->parameter.is_const ? AST_CONST : 0;
+            write_type(writer, &record, val->parameter.type);
+            record.token = write_token(writer, val->parameter.token);
+            record.child[0] = write_node(writer, val->parameter.next);
+            break;
+        case N_FUNCTION_DEF:
+            record.flags |= val->function_def.is_static ? AST_STATIC : 0;
+            write_type(writer, &record, val->function_def.type);
+            record.token = write_token(writer, val->function_def.token);
+            record.child[0] = write_node(writer, val->function_def.params);
+            record.child[1] = write_node(writer, val->function_def.cmd_block);
+            break;
+        case N_FIELD:
+            record.op = val->field.access;
+            write_type(writer, &record, val->field.type);
+            record.token = write_token(writer, val->field.token);
+            record.child[0] = write_node(writer, val->field.next);
+            break;
+        case N_CLASS_DEF:
+            record.token = write_token(writer, val->class_def.token);
+            record.child[0] = write_node(writer, val->class_def.field_list);
+            break;
+        case N_GLOBAL_VAR_DECL:
+            record.op = val->global_var_decl.size;
+            record.flags |= val->global_var_decl.is_static ? AST_STATIC : 0;
+            write_type(writer, &record, val->global_var_decl.type);
+            record.token = write_token(writer, val->global_var_decl.token);
+            break;
+        case N_UNIT:
+            record.child[0] = write_node(writer, val->unit.unit);
+            record.child[1] = write_node(writer, val->unit.element);
+            break;
+        default:
+            break;
+    }
+
+    record.type = htole16(record.type);
+    record.flags = htole16(record.flags);
+    record.op = htole32(record.op);
+    record.type_val = htole32(record.type_val);
+    record.str = htole32(record.str);
+    int i;
+    for (i = 0; i < 4; i++) {
+        record.child[i] = htole32(record.child[i]);
+    }
+
+    writer->records[index] = record;
+    return index;
+}
+
+bool save_ast(struct node* node, FILE* out) {
+    struct writer writer;
+    memset(&writer, 0, sizeof writer);
+
+    uint32_t root = write_node(&writer, node);
+    write_string(&writer, "");
+
+    struct ast_header header;
+    header.magic = htole32(AST_MAGIC);
+    header.version = htole32(AST_VERSION);
+    header.node_count = htole32(writer.node_count);
+    header.root = htole32(root);
+    header.string_size = htole32(writer.string_size);
+
+    bool written =
+        fwrite(&header, sizeof header, 1, out) == 1 &&
+        fwrite(writer.records,
+               sizeof *writer.records,
+               writer.node_count,
+               out) == writer.node_count &&
+        fwrite(writer.strings, 1, writer.string_size, out) ==
+            writer.string_size;
+
+    free(writer.records);
+    free(writer.strings);
+    free(writer.slots);
+
+    return written;
+}
+
+struct reader {
+    const struct ast_record* records;
+    uint32_t node_count;
+    const char* strings;
+    uint32_t string_size;
+    struct node* nodes;
+    bool valid;
+};
+
+static struct node* read_child(struct reader* reader,
+                               uint32_t first,
+                               uint32_t index) {
+    index = le32toh(index);
+    if (index == AST_NONE) {
+        return 0;
+    }
+    if (index < first || index >= reader->node_count) {
+        reader->valid = false;
+        return 0;
+    }
+    return reader->nodes + index;
+}
+
+static char* read_string(struct reader* reader, uint32_t offset) {
+    offset = le32toh(offset);
+    if (offset == AST_NONE) {
+        return 0;
+    }
+    if (offset >= reader->string_size) {
+        reader->valid = false;
+        return 0;
+    }
+    return (char*)reader->strings + offset;
+}
+
+static struct token read_token(struct reader* reader,
+                               struct ast_token ast_token) {
+    struct token token;
+    token.line = le32toh(ast_token.line);
+    token.column = le32toh(ast_token.column);
+    token.type = le32toh(ast_token.type);
+
+    uint32_t val = le32toh(ast_token.val);
+    switch (token.type) {
+        case INT:
+            token.val.int_v = (int32_t)val;
+            break;
+        case FLOAT:
+            memcpy(&token.val.float_v, &val, sizeof val);
+            break;
+        case CHAR:
+            token.val.char_v = (char)val;
+            break;
+        case BOOL:
+            token.val.bool_v = val != 0;
+            break;
+        default:
+            token.val.string_v =
+                is_string_token(token) ? read_string(reader, htole32(val)) : 0;
+            break;
+    }
+
+    return token;
+}
+
+static struct type read_type(struct reader* reader,
+                             const struct ast_record* record) {
+    if (le16toh(record->flags) & AST_CUSTOM) {
+        return make_custom(read_string(reader, record->type_val));
+    }
+    return make_primitive(le32toh(record->type_val));
+}
+
+static void read_node(struct reader* reader, uint32_t index) {
+    const struct ast_record* record = reader->records + index;
+    struct node* node = reader->nodes + index;
+    union node_value* val = &node->val;
+    uint16_t flags = le16toh(record->flags);
+    int op = (int32_t)le32toh(record->op);
+    const uint32_t* child = record->child;
+    uint32_t first = index + 1;
+
+    node->type = le16toh(record->type);
+    switch (node->type) {
+        case N_LITERAL:
+            val->token = read_token(reader, record->token);
+            break;
+        case N_UNARY_EXP:
+            val->unary_exp.op = op;
+            val->unary_exp.operand = read_child(reader, first, child[0]);
+            break;
+        case N_BINARY_EXP:
+            val->binary_exp.op = op;
+            val->binary_exp.left = read_child(reader, first, child[0]);
+            val->binary_exp.right = read_child(reader, first, child[1]);
+            break;
+        case N_TERNARY_EXP:
+            val->ternary_exp.condition = read_child(reader, first, child[0]);
+            val->ternary_exp.exp1 = read_child(reader, first, child[1]);
+            val->ternary_exp.exp2 = read_child(reader, first, child[2]);
+            break;
+        case N_EXP_LIST:
+            val->exp_list.exp = read_child(reader, first, child[0]);
+            val->exp_list.exp_list = read_child(reader, first, child[1]);
+            break;
+        case N_SWITCH:
+            val->switch_cmd.control_exp = read_child(reader, first, child[0]);
+            val->switch_cmd.cmd_block = read_child(reader, first, child[1]);
+            break;
+        case N_DO_WHILE:
+            val->do_while_cmd.cmd_block = read_child(reader, first, child[0]);
+            val->do_while_cmd.condition = read_child(reader, first, child[1]);
+            break;
+        case N_WHILE:
+            val->while_cmd.condition = read_child(reader, first, child[0]);
+            val->while_cmd.cmd_block = read_child(reader, first, child[1]);
+            break;
+        case N_FOR:
+            val->for_cmd.initialization = read_child(reader, first, child[0]);
+            val->for_cmd.condition = read_child(reader, first, child[1]);
+            val->for_cmd.update = read_child(reader, first, child[2]);
+            val->for_cmd.cmd_block = read_child(reader, first, child[3]);
+            break;
+        case N_FOREACH:
+            val->foreach_cmd.item = read_string(reader, record->str);
+            val->foreach_cmd.exp_list = read_child(reader, first, child[0]);
+            val->foreach_cmd.cmd_block = read_child(reader, first, child[1]);
+            break;
+        case N_ARG_LIST:
+            val->arg_list.arg = read_child(reader, first, child[0]);
+            val->arg_list.next = read_child(reader, first, child[1]);
+            break;
+        case N_FUNCTION:
+            val->function_cmd.token = read_token(reader, record->token);
+            val->function_cmd.arg_list = read_child(reader, first, child[0]);
+            break;
+        case N_PIPE:
+            val->pipe_cmd.pipe_op = op;
+            val->pipe_cmd.pipe_cmd = read_child(reader, first, child[0]);
+            val->pipe_cmd.function_cmd = read_child(reader, first, child[1]);
+            break;
+        case N_IF:
+            val->if_cmd.condition = read_child(reader, first, child[0]);
+            val->if_cmd.then_cmd_block = read_child(reader, first, child[1]);
+            val->if_cmd.else_cmd_block = read_child(reader, first, child[2]);
+            break;
+        case N_OUTPUT:
+            val->out_cmd.exp_list = read_child(reader, first, child[0]);
+            break;
+        case N_INPUT:
+            val->in_cmd.exp = read_child(reader, first, child[0]);
+            break;
+        case N_CASE:
+            val->case_label.case_val = op;
+            break;
+        case N_RETURN:
+            val->return_cmd.exp = read_child(reader, first, child[0]);
+            break;
+        case N_SHIFT:
+            val->shift_cmd.shift_op = op;
+            val->shift_cmd.var = read_child(reader, first, child[0]);
+            val->shift_cmd.exp = read_child(reader, first, child[1]);
+            break;
+        case N_VAR:
+            val->var.token = read_token(reader, record->token);
+            val->var.field_access = read_string(reader, record->str);
+            val->var.array_access = read_child(reader, first, child[0]);
+            break;
+        case N_ATTRIBUTION:
+            val->attr_cmd.var = read_child(reader, first, child[0]);
+            val->attr_cmd.exp = read_child(reader, first, child[1]);
+            break;
+        case N_LOCAL_VAR_DECL:
+            val->local_var_decl.is_static = flags & AST_STATIC;
+            val->local_var_decl.is_const = flags & AST_CONST;
+            val->local_var_decl.type = read_type(reader, record);
+            val->local_var_decl.token = read_token(reader, record->token);
+            val->local_var_decl.init = read_child(reader, first, child[0]);
+            break;
+        case N_CMD_LIST:
+            val->cmd_list.cmd_list = read_child(reader, first, child[0]);
+            val->cmd_list.cmd = read_child(reader, first, child[1]);
+            break;
+        case N_HIGH_LIST:
+            val->high_list.high_list = read_child(reader, first, child[0]);
+            val->high_list.cmd = read_child(reader, first, child[1]);
+            break;
+        case N_CMD_BLOCK:
+            val->cmd_block.high_list = read_child(reader, first, child[0]);
+            break;
+        case N_PARAM:
+            val->parameter.is_const = flags & AST_CONST;
+            val->parameter.type = read_type(reader, record);
+            val->parameter.token = read_token(reader, record->token);
+            val->parameter.next = read_child(reader, first, child[0]);
+            break;
+        case N_FUNCTION_DEF:
+            val->function_def.is_static = flags & AST_STATIC;
+            val->function_def.type = read_type(reader, record);
+            val->function_def.token = read_token(reader, record->token);
+            val->function_def.params = read_child(reader, first, child[0]);
+            val->function_def.cmd_block = read_child(reader, first, child[1]);
+            break;
+        case N_FIELD:
+            val->field.access = op;
+            val->field.type = read_type(reader, record);
+            val->field.token = read_token(reader, record->token);
+            val->field.next = read_child(reader, first, child[0]);
+            break;
+        case N_CLASS_DEF:
+            val->class_def.token = read_token(reader, record->token);
+            val->class_def.field_list = read_child(reader, first, child[0]);
+            break;
+        case N_GLOBAL_VAR_DECL:
+            val->global_var_decl.size = op;
+            val->global_var_decl.is_static = flags & AST_STATIC;
+            val->global_var_decl.type = read_type(reader, record);
+            val->global_var_decl.token = read_token(reader, record->token);
+            break;
+        case N_UNIT:
+            val->unit.unit = read_child(reader, first, child[0]);
+            val->unit.element = read_child(reader, first, child[1]);
+            break;
+        case N_DOT_ARG:
+        case N_BREAK:
+        case N_CONTINUE:
+            break;
+        default:
+            reader->valid = false;
+            break;
+    }
+}
+
+struct ast* load_ast(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        (size_t)st.st_size < sizeof(struct ast_header)) {
+        close(fd);
+        return 0;
+    }
+
+    void* map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+
+    const struct ast_header* header = map;
+    struct reader reader;
+    reader.node_count = le32toh(header->node_count);
+    reader.string_size = le32toh(header->string_size);
+    reader.records = (const struct ast_record*)(header + 1);
+    reader.strings = (const char*)(reader.records + reader.node_count);
+    reader.valid =
+        le32toh(header->magic) == AST_MAGIC &&
+        le32toh(header->version) == AST_VERSION &&
+        reader.string_size > 0 &&
+        (uint64_t)sizeof *header +
+                (uint64_t)reader.node_count * sizeof *reader.records +
+                reader.string_size ==
+            (uint64_t)st.st_size &&
+        reader.strings[reader.string_size - 1] == '\0';
+
+    struct ast* ast = malloc(sizeof *ast);
+    ast->map = map;
+    ast->map_size = st.st_size;
+    ast->nodes = 0;
+    ast->root = 0;
+
+    if (reader.valid && reader.node_count > 0) {
+        ast->nodes = malloc(reader.node_count * sizeof *ast->nodes);
+        reader.nodes = ast->nodes;
+
+        uint32_t i;
+        for (i = 0; i < reader.node_count && reader.valid; i++) {
+            read_node(&reader, i);
+        }
+
+        ast->root = read_child(&reader, 0, header->root);
+    }
+
+    if (!reader.valid) {
+        free_ast(ast);
+        return 0;
+    }
+
+    return ast;
+}
+
+void free_ast(struct ast* ast) {
+    if (ast != 0) {
+        free(ast->nodes);
+        munmap(ast->map, ast->map_size);
+        free(ast);
+    }
+}
@@ -0,0 +1,626 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../include/simulate.h"
+
+struct sim_config default_sim_config() {
+    struct sim_config config;
+    int i;
+    for (i = 0; i < OPCODE_COUNT; i++) {
+        config.latency[i] = 1;
+    }
+
+    config.latency[LOAD] = 3;
+    config.latency[LOAD_AI] = 3;
+    config.latency[LOAD_AO] = 3;
+    config.latency[STORE] = 3;
+    config.latency[STORE_AI] = 3;
+    config.latency[STORE_AO] = 3;
+    config.latency[MULT] = 3;
+    config.latency[MULT_I] = 3;
+    config.latency[DIV] = 5;
+    config.latency[DIV_I] = 5;
+    config.latency[RDIV_I] = 5;
+    config.branch_penalty = 0;
+
+    config.memory_size = SIM_MEMORY_SIZE;
+    config.max_steps = SIM_MAX_STEPS;
+    return config;
+}
+
+static int find_opcode(const char* name) {
+    int opcode;
+    for (opcode = 0; opcode < OPCODE_COUNT; opcode++) {
+        if (mnemonic[opcode] != 0 && strcmp(mnemonic[opcode], name) == 0) {
+            return opcode;
+        }
+    }
+    return -1;
+}
+
+bool load_latencies(struct sim_config* config, const char* path) {
+    FILE* in = fopen(path, "r");
+    if (in == 0) {
+        return false;
+    }
+
+    char line[256];
+    char name[64];
+    int cycles;
+    int number = 0;
+    bool valid = true;
+
+    while (valid && fgets(line, sizeof line, in) != 0) {
+        number++;
+        char* comment = strchr(line, '#');
+        if (comment != 0) {
+            *comment = '\0';
+        }
+
+        int fields = sscanf(line, "%63s %d", name, &cycles);
+        if (fields <= 0) {
+            continue;
+        }
+
+        int opcode = find_opcode(name);
+        if (fields != 2 || opcode == -1 || cycles < 0) {
+            fprintf(stderr, "Invalid latency at line %d of %s\n", number, path);
+            valid = false;
+        } else {
+            config->latency[opcode] = cycles;
+        }
+    }
+
+    fclose(in);
+    return valid;
+}
+
+int register_slot(int reg) {
+    return reg >= 0 ? reg + SIM_SPECIAL_REGISTERS : -reg - 1;
+}
+
+static const char* operand_kinds[OPCODE_COUNT] = {[NOP] = "",
+                                                  [HALT] = "",
+                                                  [LOAD_I] = "vr",
+                                                  [I2I] = "rr",
+                                                  [LOAD] = "rr",
+                                                  [LOAD_AI] = "rir",
+                                                  [LOAD_AO] = "rrr",
+                                                  [STORE] = "rr",
+                                                  [STORE_AI] = "rri",
+                                                  [STORE_AO] = "rrr",
+                                                  [ADD] = "rrr",
+                                                  [SUB] = "rrr",
+                                                  [MULT] = "rrr",
+                                                  [DIV] = "rrr",
+                                                  [ADD_I] = "rir",
+                                                  [SUB_I] = "rir",
+                                                  [RSUB_I] = "rir",
+                                                  [MULT_I] = "rir",
+                                                  [DIV_I] = "rir",
+                                                  [RDIV_I] = "rir",
+                                                  [LSHIFT] = "rrr",
+                                                  [LSHIFT_I] = "rir",
+                                                  [RSHIFT] = "rrr",
+                                                  [RSHIFT_I] = "rir",
+                                                  [AND] = "rrr",
+                                                  [AND_I] = "rir",
+                                                  [OR] = "rrr",
+                                                  [OR_I] = "rir",
+                                                  [XOR] = "rrr",
+                                                  [XOR_I] = "rir",
+                                                  [CMP_LT] = "rrr",
+                                                  [CMP_LE] = "rrr",
+                                                  [CMP_GT] = "rrr",
+                                                  [CMP_GE] = "rrr",
+                                                  [CMP_EQ] = "rrr",
+                                                  [CMP_NE] = "rrr",
+                                                  [CBR] = "rll",
+                                                  [JUMP_I] = "l",
+                                                  [JUMP] = "r"};
+
+static bool has_kind(struct operand* operand, char kind) {
+    switch (kind) {
+        case 'r':
+            return operand->type == OPERAND_REG && operand->val >= ILOC_RPC &&
+                   operand->val < SIM_MAX_REGISTERS - SIM_SPECIAL_REGISTERS;
+        case 'i':
+            return operand->type == OPERAND_IMM;
+        case 'l':
+            return operand->type == OPERAND_LABEL;
+        case 'v':
+            return operand->type == OPERAND_IMM ||
+                   operand->type == OPERAND_LABEL;
+    }
+    return false;
+}
+
+static bool decode_operand(struct operand* operand,
+                           struct label_map* labels,
+                           int* value) {
+    switch (operand->type) {
+        case OPERAND_REG:
+            *value = register_slot(operand->val);
+            return true;
+        case OPERAND_IMM:
+            *value = operand->val;
+            return true;
+        case OPERAND_LABEL:
+            *value = find_label(labels, operand->name);
+            if (*value == -1) {
+                fprintf(stderr, "Undefined label %s\n", operand->name);
+                return false;
+            }
+            return true;
+        case OPERAND_SYMBOL:
+            fprintf(stderr, "Unresolved global @%s\n", operand->name);
+            return false;
+        case OPERAND_NONE:
+            break;
+    }
+    return true;
+}
+
+static bool decode_operation(struct operation* operation,
+                             struct label_map* labels,
+                             struct sim_ins* ins) {
+    struct operand* operands[4] = {&operation->src[0],
+                                   &operation->src[1],
+                                   &operation->dst[0],
+                                   &operation->dst[1]};
+    int* fields[3] = {&ins->a, &ins->b, &ins->c};
+    const char* kinds = operand_kinds[operation->opcode];
+    int count = 0;
+
+    ins->opcode = operation->opcode;
+    ins->a = 0;
+    ins->b = 0;
+    ins->c = 0;
+    if (kinds == 0) {
+        return false;
+    }
+
+    int i;
+    for (i = 0; i < 4; i++) {
+        if (operands[i]->type == OPERAND_NONE) {
+            continue;
+        }
+        if (kinds[count] == '\0' ||
+            !decode_operand(operands[i], labels, fields[count]) ||
+            !has_kind(operands[i], kinds[count++])) {
+            return false;
+        }
+    }
+
+    return kinds[count] == '\0';
+}
+
+struct sim_program* decode_program(struct module* module) {
+    struct label_map* labels = alloc_label_map();
+    struct sim_program* program = malloc(sizeof *program);
+    program->code = malloc((module->length + 1) * sizeof *program->code);
+    program->length = 0;
+    program->register_count = SIM_SPECIAL_REGISTERS;
+    program->functions = malloc((module->length + 1) * sizeof(char*));
+    program->functions[0] = strdup("_start");
+    program->function_count = 1;
+    program->uses_pc = false;
+
+    int i, j;
+    for (i = 0; i < module->length; i++) {
+        struct operation* operation = &module->operations[i];
+        if (operation->opcode == LABEL) {
+            add_label(labels, operation->src[0].name, program->length);
+        } else if (operation->opcode == GLOBAL_DECL) {
+            fprintf(stderr, "Program is not linked\n");
+            free_label_map(labels);
+            free_sim_program(program);
+            return 0;
+        } else {
+            program->length++;
+        }
+    }
+
+    int function = 0;
+    int index = 0;
+    bool entry = false;
+    for (i = 0; i < module->length; i++) {
+        struct operation* operation = &module->operations[i];
+        if (operation->opcode == LABEL) {
+            if (is_function_label(operation)) {
+                function = program->function_count++;
+                program->functions[function] =
+                    strdup(operation->src[0].name + 1);
+                entry = true;
+            }
+            continue;
+        }
+
+        struct sim_ins* ins = &program->code[index++];
+        if (!decode_operation(operation, labels, ins)) {
+            fprintf(stderr, "Invalid operation %d: ", index - 1);
+            print_operation(stderr, operation);
+            free_label_map(labels);
+            free_sim_program(program);
+            return 0;
+        }
+        ins->function = function;
+        ins->entry = entry ? function : -1;
+        entry = false;
+
+        for (j = 0; j < 2; j++) {
+            if ((operation->src[j].type == OPERAND_REG &&
+                 operation->src[j].val == ILOC_RPC) ||
+                (operation->dst[j].type == OPERAND_REG &&
+                 operation->dst[j].val == ILOC_RPC)) {
+                program->uses_pc = true;
+            }
+            if (operation->src[j].type == OPERAND_REG &&
+                register_slot(operation->src[j].val) >=
+                    program->register_count) {
+                program->register_count =
+                    register_slot(operation->src[j].val) + 1;
+            }
+            if (operation->dst[j].type == OPERAND_REG &&
+                register_slot(operation->dst[j].val) >=
+                    program->register_count) {
+                program->register_count =
+                    register_slot(operation->dst[j].val) + 1;
+            }
+        }
+    }
+
+    free_label_map(labels);
+    return program;
+}
+
+void free_sim_program(struct sim_program* program) {
+    if (program != 0) {
+        int i;
+        for (i = 0; i < program->function_count; i++) {
+            free(program->functions[i]);
+        }
+        free(program->functions);
+        free(program->code);
+        free(program);
+    }
+}
+
+int sim_divide(int dividend, int divisor) {
+    if (divisor == -1) {
+        return 0u - (unsigned)dividend;
+    }
+    return dividend / divisor;
+}
+
+bool predict_branch(unsigned char* counter, bool taken) {
+    bool hit = (*counter >= 2) == taken;
+    if (taken && *counter < 3) {
+        (*counter)++;
+    } else if (!taken && *counter > 0) {
+        (*counter)--;
+    }
+    return hit;
+}
+
+static bool is_valid_address(struct sim_config* config, int address) {
+    return address >= 0 && (size_t)address + 4 <= config->memory_size;
+}
+
+static int jump(struct sim_program* program,
+                struct sim_result* result,
+                int target) {
+    if (target < 0 || target >= program->length) {
+        result->status = SIM_INVALID_JUMP;
+        return -1;
+    }
+
+    int entry = program->code[target].entry;
+    if (entry >= 0) {
+        result->functions[entry].calls++;
+    }
+    return target;
+}
+
+struct sim_result simulate(struct sim_program* program,
+                           struct sim_config* config) {
+    struct sim_result result;
+    memset(&result, 0, sizeof result);
+    result.function_count = program->function_count;
+    result.functions =
+        calloc(program->function_count, sizeof *result.functions);
+
+    int i;
+    for (i = 0; i < program->function_count; i++) {
+        result.functions[i].name = program->functions[i];
+    }
+    result.functions[0].calls = 1;
+    result.branches = calloc(2 * program->length, sizeof *result.branches);
+
+    int* r = calloc(program->register_count, sizeof *r);
+    char* memory = calloc(config->memory_size, 1);
+    unsigned char* predictor = malloc(program->length);
+    memset(predictor, 1, program->length);
+    int* rfp = &r[register_slot(ILOC_RFP)];
+    int pc = 0;
+
+    while (result.status == SIM_HALTED) {
+        if (pc < 0 || pc >= program->length) {
+            result.status = SIM_INVALID_JUMP;
+            break;
+        }
+
+        if (result.instructions == config->max_steps) {
+            result.status = SIM_STEP_LIMIT;
+            break;
+        }
+
+        struct sim_ins* ins = &program->code[pc];
+        int latency = config->latency[ins->opcode];
+        result.instructions++;
+        result.cycles += latency;
+        result.counts[ins->opcode]++;
+        result.functions[ins->function].instructions++;
+        result.functions[ins->function].cycles += latency;
+        r[register_slot(ILOC_RPC)] = pc;
+
+        int address;
+        pc++;
+
+        switch (ins->opcode) {
+            case NOP:
+                break;
+            case HALT:
+                if (is_valid_address(config, *rfp + 12)) {
+                    memcpy(&result.exit_value, memory + *rfp + 12, 4);
+                }
+                free(r);
+                free(memory);
+                free(predictor);
+                return result;
+            case LOAD_I:
+                r[ins->b] = ins->a;
+                break;
+            case I2I:
+                r[ins->b] = r[ins->a];
+                break;
+            case LOAD:
+            case LOAD_AI:
+            case LOAD_AO:
+                if (ins->opcode == LOAD) {
+                    address = r[ins->a];
+                } else if (ins->opcode == LOAD_AI) {
+                    address = r[ins->a] + ins->b;
+                } else {
+                    address = r[ins->a] + r[ins->b];
+                }
+                if (!is_valid_address(config, address)) {
+                    result.status = SIM_INVALID_ADDRESS;
+                    break;
+                }
+                memcpy(&r[ins->opcode == LOAD ? ins->b : ins->c],
+                       memory + address,
+                       4);
+                result.loads++;
+                break;
+            case STORE:
+            case STORE_AI:
+            case STORE_AO:
+                if (ins->opcode == STORE) {
+                    address = r[ins->b];
+                } else if (ins->opcode == STORE_AI) {
+                    address = r[ins->b] + ins->c;
+                } else {
+                    address = r[ins->b] + r[ins->c];
+                }
+                if (!is_valid_address(config, address)) {
+                    result.status = SIM_INVALID_ADDRESS;
+                    break;
+                }
+                memcpy(memory + address, &r[ins->a], 4);
+                result.stores++;
+                break;
+            case ADD:
+                r[ins->c] = (unsigned)r[ins->a] + (unsigned)r[ins->b];
+                break;
+            case SUB:
+                r[ins->c] = (unsigned)r[ins->a] - (unsigned)r[ins->b];
+                break;
+            case MULT:
+                r[ins->c] = (unsigned)r[ins->a] * (unsigned)r[ins->b];
+                break;
+            case DIV:
+                if (r[ins->b] == 0) {
+                    result.status = SIM_DIVISION_BY_ZERO;
+                    break;
+                }
+                r[ins->c] = sim_divide(r[ins->a], r[ins->b]);
+                break;
+            case ADD_I:
+                r[ins->c] = (unsigned)r[ins->a] + (unsigned)ins->b;
+                break;
+            case SUB_I:
+                r[ins->c] = (unsigned)r[ins->a] - (unsigned)ins->b;
+                break;
+            case RSUB_I:
+                r[ins->c] = (unsigned)ins->b - (unsigned)r[ins->a];
+                break;
+            case MULT_I:
+                r[ins->c] = (unsigned)r[ins->a] * (unsigned)ins->b;
+                break;
+            case DIV_I:
+                if (ins->b == 0) {
+                    result.status = SIM_DIVISION_BY_ZERO;
+                    break;
+                }
+                r[ins->c] = sim_divide(r[ins->a], ins->b);
+                break;
+            case RDIV_I:
+                if (r[ins->a] == 0) {
+                    result.status = SIM_DIVISION_BY_ZERO;
+                    break;
+                }
+                r[ins->c] = sim_divide(ins->b, r[ins->a]);
+                break;
+            case LSHIFT:
+                r[ins->c] = (unsigned)r[ins->a] << (r[ins->b] & 31);
+                break;
+            case LSHIFT_I:
+                r[ins->c] = (unsigned)r[ins->a] << (ins->b & 31);
+                break;
+            case RSHIFT:
+                r[ins->c] = r[ins->a] >> (r[ins->b] & 31);
+                break;
+            case RSHIFT_I:
+                r[ins->c] = r[ins->a] >> (ins->b & 31);
+                break;
+            case AND:
+                r[ins->c] = r[ins->a] & r[ins->b];
+                break;
+            case AND_I:
+                r[ins->c] = r[ins->a] & ins->b;
+                break;
+            case OR:
+                r[ins->c] = r[ins->a] | r[ins->b];
+                break;
+            case OR_I:
+                r[ins->c] = r[ins->a] | ins->b;
+                break;
+            case XOR:
+                r[ins->c] = r[ins->a] ^ r[ins->b];
+                break;
+            case XOR_I:
+                r[ins->c] = r[ins->a] ^ ins->b;
+                break;
+            case CMP_LT:
+                r[ins->c] = r[ins->a] < r[ins->b];
+                break;
+            case CMP_LE:
+                r[ins->c] = r[ins->a] <= r[ins->b];
+                break;
+            case CMP_GT:
+                r[ins->c] = r[ins->a] > r[ins->b];
+                break;
+            case CMP_GE:
+                r[ins->c] = r[ins->a] >= r[ins->b];
+                break;
+            case CMP_EQ:
+                r[ins->c] = r[ins->a] == r[ins->b];
+                break;
+            case CMP_NE:
+                r[ins->c] = r[ins->a] != r[ins->b];
+                break;
+            case CBR:
+                if (!predict_branch(&predictor[pc - 1], r[ins->a] != 0)) {
+                    result.mispredictions++;
+                    result.cycles += config->branch_penalty;
+                    result.functions[ins->function].cycles +=
+                        config->branch_penalty;
+                }
+                result.branches[2 * (pc - 1) + (r[ins->a] == 0)]++;
+                pc = jump(program, &result, r[ins->a] ? ins->b : ins->c);
+                break;
+            case JUMP_I:
+                pc = jump(program, &result, ins->a);
+                break;
+            case JUMP:
+                pc = jump(program, &result, r[ins->a]);
+                break;
+            default:
+                result.status = SIM_INVALID_PROGRAM;
+                break;
+        }
+    }
+
+    free(r);
+    free(memory);
+    free(predictor);
+    return result;
+}
+
+void free_sim_result(struct sim_result* result) {
+    free(result->functions);
+    free(result->branches);
+    result->functions = 0;
+    result->branches = 0;
+}
+
+const char* sim_status_name(enum sim_status status) {
+    switch (status) {
+        case SIM_HALTED:
+            return "halted";
+        case SIM_INVALID_PROGRAM:
+            return "invalid program";
+        case SIM_INVALID_ADDRESS:
+            return "invalid memory address";
+        case SIM_INVALID_JUMP:
+            return "invalid jump target";
+        case SIM_DIVISION_BY_ZERO:
+            return "division by zero";
+        case SIM_STEP_LIMIT:
+            return "step limit reached";
+    }
+    return "unknown";
+}
+
+void print_sim_report(FILE* out, struct sim_result* result, bool profile) {
+    fprintf(out, "status: %s\n", sim_status_name(result->status));
+    fprintf(out, "exit value: %d\n", result->exit_value);
+    fprintf(out, "instructions: %ld\n", result->instructions);
+    fprintf(out, "cycles: %ld\n", result->cycles);
+    fprintf(out, "loads: %ld\n", result->loads);
+    fprintf(out, "stores: %ld\n", result->stores);
+    fprintf(out, "mispredictions: %ld\n", result->mispredictions);
+
+    if (!profile) {
+        return;
+    }
+
+    fprintf(out, "opcodes:\n");
+    int i;
+    for (i = 0; i < OPCODE_COUNT; i++) {
+        if (result->counts[i] > 0) {
+            fprintf(out, "  %-8s %ld\n", mnemonic[i], result->counts[i]);
+        }
+    }
+
+    fprintf(out, "functions:\n");
+    for (i = 0; i < result->function_count; i++) {
+        struct function_profile* function = &result->functions[i];
+        if (function->instructions > 0) {
+            fprintf(out,
+                    "  %-16s calls %ld instructions %ld cycles %ld\n",
+                    function->name,
+                    function->calls,
+                    function->instructions,
+                    function->cycles);
+        }
+    }
+}
+
+void print_branch_profile(FILE* out,
+                          struct module* module,
+                          struct sim_result* result) {
+    if (result->branches == 0) {
+        return;
+    }
+
+    int pc = 0;
+    int i;
+    for (i = 0; i < module->length; i++) {
+        struct operation* operation = &module->operations[i];
+        if (operation->opcode == LABEL) {
+            continue;
+        }
+        long taken = result->branches[2 * pc];
+        long not_taken = result->branches[2 * pc + 1];
+        if (operation->opcode == CBR && taken + not_taken > 0) {
+            fprintf(out,
+                    "%s %s %ld %ld\n",
+                    operation->dst[0].name,
+                    operation->dst[1].name,
+                    taken,
+                    not_taken);
+        }
+        pc++;
+    }
+}
@@ -0,0 +1,389 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../include/simulate.h"
+
+enum superinstruction {
+    FUSED_LOAD_AI_ADD = OPCODE_COUNT,
+    FUSED_LOAD_I_STORE_AI,
+    FUSED_CMP_LT_CBR,
+    FUSED_CMP_LE_CBR,
+    FUSED_CMP_GT_CBR,
+    FUSED_CMP_GE_CBR,
+    FUSED_CMP_EQ_CBR,
+    FUSED_CMP_NE_CBR,
+    SENTINEL,
+    HANDLER_COUNT
+};
+
+struct fast_ins {
+    void* handler;
+    int a;
+    int b;
+    int c;
+    int d;
+    int e;
+    int f;
+    int width;
+    int latency;
+};
+
+static int fuse(struct sim_ins* first, struct sim_ins* second) {
+    if (first->opcode == LOAD_AI && second->opcode == ADD) {
+        return FUSED_LOAD_AI_ADD;
+    }
+
+    if (first->opcode == LOAD_I && second->opcode == STORE_AI) {
+        return FUSED_LOAD_I_STORE_AI;
+    }
+
+    if (second->opcode == CBR) {
+        switch (first->opcode) {
+            case CMP_LT:
+                return FUSED_CMP_LT_CBR;
+            case CMP_LE:
+                return FUSED_CMP_LE_CBR;
+            case CMP_GT:
+                return FUSED_CMP_GT_CBR;
+            case CMP_GE:
+                return FUSED_CMP_GE_CBR;
+            case CMP_EQ:
+                return FUSED_CMP_EQ_CBR;
+            case CMP_NE:
+                return FUSED_CMP_NE_CBR;
+            default:
+                break;
+        }
+    }
+
+    return -1;
+}
+
+static struct fast_ins* predecode(struct sim_program* program,
+                                  struct sim_config* config,
+                                  void** handlers) {
+    struct fast_ins* code = malloc((program->length + 1) * sizeof *code);
+
+    int i;
+    for (i = 0; i < program->length; i++) {
+        struct sim_ins* ins = &program->code[i];
+        struct fast_ins* fast = &code[i];
+        int kind = ins->opcode;
+
+        fast->a = ins->a;
+        fast->b = ins->b;
+        fast->c = ins->c;
+        fast->d = 0;
+        fast->e = 0;
+        fast->f = 0;
+        fast->width = 1;
+        fast->latency = config->latency[ins->opcode];
+
+        if (i + 1 < program->length) {
+            struct sim_ins* next = &program->code[i + 1];
+            int fused = fuse(ins, next);
+            if (fused != -1) {
+                kind = fused;
+                fast->d = next->a;
+                fast->e = next->b;
+                fast->f = next->c;
+                fast->width = 2;
+                fast->latency += config->latency[next->opcode];
+            }
+        }
+
+        fast->handler = handlers[kind];
+    }
+
+    code[program->length].handler = handlers[SENTINEL];
+    code[program->length].width = 0;
+    code[program->length].latency = 0;
+    return code;
+}
+
+#define DISPATCH()                         \
+    do {                                   \
+        result.instructions += ins->width; \
+        result.cycles += ins->latency;     \
+        goto* ins->handler;                \
+    } while (0)
+
+#define NEXT(n)       \
+    do {              \
+        ins += (n);   \
+        DISPATCH();   \
+    } while (0)
+
+#define JUMP_TO(target)                                       \
+    do {                                                      \
+        if (result.instructions >= config->max_steps) {       \
+            result.status = SIM_STEP_LIMIT;                   \
+            goto done;                                        \
+        }                                                     \
+        ins = code + (target);                                \
+        DISPATCH();                                           \
+    } while (0)
+
+#define PREDICT(taken)                                           \
+    do {                                                         \
+        int branch = ins - code + ins->width - 1;                \
+        if (!predict_branch(&predictor[branch], (taken) != 0)) { \
+            result.mispredictions++;                             \
+            result.cycles += config->branch_penalty;             \
+        }                                                        \
+    } while (0)
+
+#define CHECK_ADDRESS(address)                   \
+    do {                                         \
+        if ((unsigned)(address) > limit) {       \
+            result.status = SIM_INVALID_ADDRESS; \
+            goto done;                           \
+        }                                        \
+    } while (0)
+
+#define BINARY(name, expression) \
+    name:                        \
+    r[ins->c] = (expression);    \
+    NEXT(1);
+
+#define FUSED_CMP_CBR(name, operator)         \
+    name:                                     \
+    r[ins->c] = r[ins->a] operator r[ins->b]; \
+    PREDICT(r[ins->d]);                       \
+    JUMP_TO(r[ins->d] ? ins->e : ins->f);
+
+struct sim_result simulate_threaded(struct sim_program* program,
+                                    struct sim_config* config) {
+    void* handlers[HANDLER_COUNT];
+    struct sim_result result;
+    memset(&result, 0, sizeof result);
+
+    int i;
+    for (i = 0; i < HANDLER_COUNT; i++) {
+        handlers[i] = &&invalid;
+    }
+    handlers[NOP] = &&nop;
+    handlers[HALT] = &&halt;
+    handlers[LOAD_I] = &&load_i;
+    handlers[I2I] = &&i2i;
+    handlers[LOAD] = &&load;
+    handlers[LOAD_AI] = &&load_ai;
+    handlers[LOAD_AO] = &&load_ao;
+    handlers[STORE] = &&store;
+    handlers[STORE_AI] = &&store_ai;
+    handlers[STORE_AO] = &&store_ao;
+    handlers[ADD] = &&add;
+    handlers[SUB] = &&sub;
+    handlers[MULT] = &&mult;
+    handlers[DIV] = &&div;
+    handlers[ADD_I] = &&add_i;
+    handlers[SUB_I] = &&sub_i;
+    handlers[RSUB_I] = &&rsub_i;
+    handlers[MULT_I] = &&mult_i;
+    handlers[DIV_I] = &&div_i;
+    handlers[RDIV_I] = &&rdiv_i;
+    handlers[LSHIFT] = &&lshift;
+    handlers[LSHIFT_I] = &&lshift_i;
+    handlers[RSHIFT] = &&rshift;
+    handlers[RSHIFT_I] = &&rshift_i;
+    handlers[AND] = &&and;
+    handlers[AND_I] = &&and_i;
+    handlers[OR] = &&or;
+    handlers[OR_I] = &&or_i;
+    handlers[XOR] = &&xor;
+    handlers[XOR_I] = &&xor_i;
+    handlers[CMP_LT] = &&cmp_lt;
+    handlers[CMP_LE] = &&cmp_le;
+    handlers[CMP_GT] = &&cmp_gt;
+    handlers[CMP_GE] = &&cmp_ge;
+    handlers[CMP_EQ] = &&cmp_eq;
+    handlers[CMP_NE] = &&cmp_ne;
+    handlers[CBR] = &&cbr;
+    handlers[JUMP_I] = &&jump_i;
+    handlers[JUMP] = &&jump;
+    handlers[FUSED_LOAD_AI_ADD] = &&load_ai_add;
+    handlers[FUSED_LOAD_I_STORE_AI] = &&load_i_store_ai;
+    handlers[FUSED_CMP_LT_CBR] = &&cmp_lt_cbr;
+    handlers[FUSED_CMP_LE_CBR] = &&cmp_le_cbr;
+    handlers[FUSED_CMP_GT_CBR] = &&cmp_gt_cbr;
+    handlers[FUSED_CMP_GE_CBR] = &&cmp_ge_cbr;
+    handlers[FUSED_CMP_EQ_CBR] = &&cmp_eq_cbr;
+    handlers[FUSED_CMP_NE_CBR] = &&cmp_ne_cbr;
+    handlers[SENTINEL] = &&sentinel;
+
+    struct fast_ins* code = predecode(program, config, handlers);
+    int* r = calloc(program->register_count, sizeof *r);
+    char* memory = calloc(config->memory_size, 1);
+    unsigned char* predictor = malloc(program->length);
+    memset(predictor, 1, program->length);
+    size_t limit = config->memory_size >= 4 ? config->memory_size - 4 : 0;
+    unsigned length = program->length;
+    int address;
+    int value;
+
+    struct fast_ins* ins = code;
+    if (config->memory_size < 4) {
+        result.status = SIM_INVALID_ADDRESS;
+        goto done;
+    }
+    DISPATCH();
+
+nop:
+    NEXT(1);
+
+halt:
+    address = r[register_slot(ILOC_RFP)] + 12;
+    if ((unsigned)address <= limit) {
+        memcpy(&result.exit_value, memory + address, 4);
+    }
+    goto done;
+
+load_i:
+    r[ins->b] = ins->a;
+    NEXT(1);
+
+i2i:
+    r[ins->b] = r[ins->a];
+    NEXT(1);
+
+load:
+    address = r[ins->a];
+    CHECK_ADDRESS(address);
+    memcpy(&r[ins->b], memory + address, 4);
+    result.loads++;
+    NEXT(1);
+
+load_ai:
+    address = r[ins->a] + ins->b;
+    CHECK_ADDRESS(address);
+    memcpy(&r[ins->c], memory + address, 4);
+    result.loads++;
+    NEXT(1);
+
+load_ao:
+    address = r[ins->a] + r[ins->b];
+    CHECK_ADDRESS(address);
+    memcpy(&r[ins->c], memory + address, 4);
+    result.loads++;
+    NEXT(1);
+
+store:
+    address = r[ins->b];
+    CHECK_ADDRESS(address);
+    memcpy(memory + address, &r[ins->a], 4);
+    result.stores++;
+    NEXT(1);
+
+store_ai:
+    address = r[ins->b] + ins->c;
+    CHECK_ADDRESS(address);
+    memcpy(memory + address, &r[ins->a], 4);
+    result.stores++;
+    NEXT(1);
+
+store_ao:
+    address = r[ins->b] + r[ins->c];
+    CHECK_ADDRESS(address);
+    memcpy(memory + address, &r[ins->a], 4);
+    result.stores++;
+    NEXT(1);
+
+    BINARY(add, (unsigned)r[ins->a] + (unsigned)r[ins->b])
+    BINARY(sub, (unsigned)r[ins->a] - (unsigned)r[ins->b])
+    BINARY(mult, (unsigned)r[ins->a] * (unsigned)r[ins->b])
+    BINARY(add_i, (unsigned)r[ins->a] + (unsigned)ins->b)
+    BINARY(sub_i, (unsigned)r[ins->a] - (unsigned)ins->b)
+    BINARY(rsub_i, (unsigned)ins->b - (unsigned)r[ins->a])
+    BINARY(mult_i, (unsigned)r[ins->a] * (unsigned)ins->b)
+    BINARY(lshift, (unsigned)r[ins->a] << (r[ins->b] & 31))
+    BINARY(lshift_i, (unsigned)r[ins->a] << (ins->b & 31))
+    BINARY(rshift, r[ins->a] >> (r[ins->b] & 31))
+    BINARY(rshift_i, r[ins->a] >> (ins->b & 31))
+    BINARY(and, r[ins->a] & r[ins->b])
+    BINARY(and_i, r[ins->a] & ins->b)
+    BINARY(or, r[ins->a] | r[ins->b])
+    BINARY(or_i, r[ins->a] | ins->b)
+    BINARY(xor, r[ins->a] ^ r[ins->b])
+    BINARY(xor_i, r[ins->a] ^ ins->b)
+    BINARY(cmp_lt, r[ins->a] < r[ins->b])
+    BINARY(cmp_le, r[ins->a] <= r[ins->b])
+    BINARY(cmp_gt, r[ins->a] > r[ins->b])
+    BINARY(cmp_ge, r[ins->a] >= r[ins->b])
+    BINARY(cmp_eq, r[ins->a] == r[ins->b])
+    BINARY(cmp_ne, r[ins->a] != r[ins->b])
+
+div:
+    if (r[ins->b] == 0) {
+        result.status = SIM_DIVISION_BY_ZERO;
+        goto done;
+    }
+    r[ins->c] = sim_divide(r[ins->a], r[ins->b]);
+    NEXT(1);
+
+div_i:
+    if (ins->b == 0) {
+        result.status = SIM_DIVISION_BY_ZERO;
+        goto done;
+    }
+    r[ins->c] = sim_divide(r[ins->a], ins->b);
+    NEXT(1);
+
+rdiv_i:
+    if (r[ins->a] == 0) {
+        result.status = SIM_DIVISION_BY_ZERO;
+        goto done;
+    }
+    r[ins->c] = sim_divide(ins->b, r[ins->a]);
+    NEXT(1);
+
+cbr:
+    PREDICT(r[ins->a]);
+    JUMP_TO(r[ins->a] ? ins->b : ins->c);
+
+jump_i:
+    JUMP_TO(ins->a);
+
+jump:
+    value = r[ins->a];
+    if ((unsigned)value >= length) {
+        result.status = SIM_INVALID_JUMP;
+        goto done;
+    }
+    JUMP_TO(value);
+
+load_ai_add:
+    address = r[ins->a] + ins->b;
+    CHECK_ADDRESS(address);
+    memcpy(&r[ins->c], memory + address, 4);
+    result.loads++;
+    r[ins->f] = (unsigned)r[ins->d] + (unsigned)r[ins->e];
+    NEXT(2);
+
+load_i_store_ai:
+    r[ins->b] = ins->a;
+    address = r[ins->e] + ins->f;
+    CHECK_ADDRESS(address);
+    memcpy(memory + address, &r[ins->d], 4);
+    result.stores++;
+    NEXT(2);
+
+    FUSED_CMP_CBR(cmp_lt_cbr, <)
+    FUSED_CMP_CBR(cmp_le_cbr, <=)
+    FUSED_CMP_CBR(cmp_gt_cbr, >)
+    FUSED_CMP_CBR(cmp_ge_cbr, >=)
+    FUSED_CMP_CBR(cmp_eq_cbr, ==)
+    FUSED_CMP_CBR(cmp_ne_cbr, !=)
+
+sentinel:
+    result.status = SIM_INVALID_JUMP;
+    goto done;
+
+invalid:
+    result.status = SIM_INVALID_PROGRAM;
+
+done:
+    free(code);
+    free(r);
+    free(memory);
+    free(predictor);
+    return result;
+}
@@ -0,0 +1,330 @@
+#include "../include/x86.h"
+
+static const char* stub_names[] = {".Linvalid_jump",
+                                   ".Linvalid_address",
+                                   ".Ldivision_by_zero"};
+
+static void print_address(FILE* out,
+                          int base,
+                          int offset,
+                          bool offset_is_register,
+                          size_t memory_size) {
+    fprintf(out, "\tmovl %d(%%rbx), %%eax\n", 4 * base);
+    if (offset_is_register) {
+        fprintf(out, "\taddl %d(%%rbx), %%eax\n", 4 * offset);
+    } else if (offset != 0) {
+        fprintf(out, "\taddl $%d, %%eax\n", offset);
+    }
+    fprintf(out, "\tcmpl $%zu, %%eax\n", memory_size - 4);
+    fprintf(out, "\tja %s\n", stub_names[1]);
+}
+
+static void print_load(FILE* out, int slot) {
+    fprintf(out, "\tmovl (%%r12,%%rax), %%ecx\n");
+    fprintf(out, "\tmovl %%ecx, %d(%%rbx)\n", 4 * slot);
+}
+
+static void print_store(FILE* out, int slot) {
+    fprintf(out, "\tmovl %d(%%rbx), %%ecx\n", 4 * slot);
+    fprintf(out, "\tmovl %%ecx, (%%r12,%%rax)\n");
+}
+
+static void print_binary(FILE* out, const char* name, struct sim_ins* ins) {
+    fprintf(out, "\tmovl %d(%%rbx), %%eax\n", 4 * ins->a);
+    fprintf(out, "\t%s %d(%%rbx), %%eax\n", name, 4 * ins->b);
+    fprintf(out, "\tmovl %%eax, %d(%%rbx)\n", 4 * ins->c);
+}
+
+static void print_immediate(FILE* out, const char* name, struct sim_ins* ins) {
+    fprintf(out, "\tmovl %d(%%rbx), %%eax\n", 4 * ins->a);
+    fprintf(out, "\t%s $%d, %%eax\n", name, ins->b);
+    fprintf(out, "\tmovl %%eax, %d(%%rbx)\n", 4 * ins->c);
+}
+
+static void print_shift(FILE* out,
+                        const char* name,
+                        struct sim_ins* ins,
+                        bool immediate) {
+    fprintf(out, "\tmovl %d(%%rbx), %%eax\n", 4 * ins->a);
+    if (immediate) {
+        fprintf(out, "\t%s $%d, %%eax\n", name, ins->b & 31);
+    } else {
+        fprintf(out, "\tmovl %d(%%rbx), %%ecx\n", 4 * ins->b);
+        fprintf(out, "\t%s %%cl, %%eax\n", name);
+    }
+    fprintf(out, "\tmovl %%eax, %d(%%rbx)\n", 4 * ins->c);
+}
+
+/* eax / ecx into eax; INT_MIN / -1 wraps like the simulator. */
+static void print_divide(FILE* out, int slot) {
+    fprintf(out, "\ttestl %%ecx, %%ecx\n");
+    fprintf(out, "\tje %s\n", stub_names[2]);
+    fprintf(out, "\tcmpl $-1, %%ecx\n");
+    fprintf(out, "\tjne 1f\n");
+    fprintf(out, "\tnegl %%eax\n");
+    fprintf(out, "\tjmp 2f\n");
+    fprintf(out, "1:\n");
+    fprintf(out, "\tcltd\n");
+    fprintf(out, "\tidivl %%ecx\n");
+    fprintf(out, "2:\n");
+    fprintf(out, "\tmovl %%eax, %d(%%rbx)\n", 4 * slot);
+}
+
+static void print_compare(FILE* out, const char* set, struct sim_ins* ins) {
+    fprintf(out, "\tmovl %d(%%rbx), %%eax\n", 4 * ins->a);
+    fprintf(out, "\tcmpl %d(%%rbx), %%eax\n", 4 * ins->b);
+    fprintf(out, "\t%s %%al\n", set);
+    fprintf(out, "\tmovzbl %%al, %%eax\n");
+    fprintf(out, "\tmovl %%eax, %d(%%rbx)\n", 4 * ins->c);
+}
+
+static void print_target(FILE* out,
+                         const char* jump,
+                         struct sim_program* program,
+                         int target) {
+    if (target < program->length) {
+        fprintf(out, "\t%s .L%d\n", jump, target);
+    } else {
+        fprintf(out, "\t%s %s\n", jump, stub_names[0]);
+    }
+}
+
+static bool print_instruction(FILE* out,
+                              struct sim_program* program,
+                              struct sim_ins* ins,
+                              size_t memory_size) {
+    int next = ins - program->code + 1;
+    if (next == program->length) {
+        next = -1;
+    }
+    switch (ins->opcode) {
+        case NOP:
+            fprintf(out, "\tnop\n");
+            break;
+        case HALT:
+            fprintf(out, "\tjmp .Lhalt\n");
+            break;
+        case LOAD_I:
+            fprintf(out, "\tmovl $%d, %d(%%rbx)\n", ins->a, 4 * ins->b);
+            break;
+        case I2I:
+            fprintf(out, "\tmovl %d(%%rbx), %%eax\n", 4 * ins->a);
+            fprintf(out, "\tmovl %%eax, %d(%%rbx)\n", 4 * ins->b);
+            break;
+        case LOAD:
+            print_address(out, ins->a, 0, false, memory_size);
+            print_load(out, ins->b);
+            break;
+        case LOAD_AI:
+            print_address(out, ins->a, ins->b, false, memory_size);
+            print_load(out, ins->c);
+            break;
+        case LOAD_AO:
+            print_address(out, ins->a, ins->b, true, memory_size);
+            print_load(out, ins->c);
+            break;
+        case STORE:
+            print_address(out, ins->b, 0, false, memory_size);
+            print_store(out, ins->a);
+            break;
+        case STORE_AI:
+            print_address(out, ins->b, ins->c, false, memory_size);
+            print_store(out, ins->a);
+            break;
+        case STORE_AO:
+            print_address(out, ins->b, ins->c, true, memory_size);
+            print_store(out, ins->a);
+            break;
+        case ADD:
+            print_binary(out, "addl", ins);
+            break;
+        case SUB:
+            print_binary(out, "subl", ins);
+            break;
+        case MULT:
+            print_binary(out, "imull", ins);
+            break;
+        case DIV:
+            fprintf(out, "\tmovl %d(%%rbx), %%eax\n", 4 * ins->a);
+            fprintf(out, "\tmovl %d(%%rbx), %%ecx\n", 4 * ins->b);
+            print_divide(out, ins->c);
+            break;
+        case ADD_I:
+            print_immediate(out, "addl", ins);
+            break;
+        case SUB_I:
+            print_immediate(out, "subl", ins);
+            break;
+        case RSUB_I:
+            fprintf(out, "\tmovl $%d, %%eax\n", ins->b);
+            fprintf(out, "\tsubl %d(%%rbx), %%eax\n", 4 * ins->a);
+            fprintf(out, "\tmovl %%eax, %d(%%rbx)\n", 4 * ins->c);
+            break;
+        case MULT_I:
+            print_immediate(out, "imull", ins);
+            break;
+        case DIV_I:
+            fprintf(out, "\tmovl %d(%%rbx), %%eax\n", 4 * ins->a);
+            fprintf(out, "\tmovl $%d, %%ecx\n", ins->b);
+            print_divide(out, ins->c);
+            break;
+        case RDIV_I:
+            fprintf(out, "\tmovl $%d, %%eax\n", ins->b);
+            fprintf(out, "\tmovl %d(%%rbx), %%ecx\n", 4 * ins->a);
+            print_divide(out, ins->c);
+            break;
+        case LSHIFT:
+        case LSHIFT_I:
+            print_shift(out, "shll", ins, ins->opcode == LSHIFT_I);
+            break;
+        case RSHIFT:
+        case RSHIFT_I:
+            print_shift(out, "sarl", ins, ins->opcode == RSHIFT_I);
+            break;
+        case AND:
+            print_binary(out, "andl", ins);
+            break;
+        case AND_I:
+            print_immediate(out, "andl", ins);
+            break;
+        case OR:
+            print_binary(out, "orl", ins);
+            break;
+        case OR_I:
+            print_immediate(out, "orl", ins);
+            break;
+        case XOR:
+            print_binary(out, "xorl", ins);
+            break;
+        case XOR_I:
+            print_immediate(out, "xorl", ins);
+            break;
+        case CMP_LT:
+            print_compare(out, "setl", ins);
+            break;
+        case CMP_LE:
+            print_compare(out, "setle", ins);
+            break;
+        case CMP_GT:
+            print_compare(out, "setg", ins);
+            break;
+        case CMP_GE:
+            print_compare(out, "setge", ins);
+            break;
+        case CMP_EQ:
+            print_compare(out, "sete", ins);
+            break;
+        case CMP_NE:
+            print_compare(out, "setne", ins);
+            break;
+        case CBR:
+            fprintf(out, "\tcmpl $0, %d(%%rbx)\n", 4 * ins->a);
+            if (ins->b == next) {
+                print_target(out, "je", program, ins->c);
+            } else {
+                print_target(out, "jne", program, ins->b);
+                if (ins->c != next) {
+                    print_target(out, "jmp", program, ins->c);
+                }
+            }
+            break;
+        case JUMP_I:
+            if (ins->a != next) {
+                print_target(out, "jmp", program, ins->a);
+            }
+            break;
+        case JUMP:
+            fprintf(out, "\tmovl %d(%%rbx), %%eax\n", 4 * ins->a);
+            fprintf(out, "\tcmpl $%d, %%eax\n", program->length);
+            fprintf(out, "\tjae %s\n", stub_names[0]);
+            fprintf(out, "\tjmp *(%%r13,%%rax,8)\n");
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+static void print_stub(FILE* out, const char* name, enum sim_status status) {
+    fprintf(out, "%s:\n", name);
+    fprintf(out, "\tmovl $%d, %%eax\n", status);
+    fprintf(out, "\tjmp .Lexit\n");
+}
+
+bool print_x86_program(FILE* out,
+                       struct sim_program* program,
+                       size_t memory_size) {
+    if (program->uses_pc) {
+        fprintf(stderr, "Cannot compile programs that read rpc\n");
+        return false;
+    }
+
+    fprintf(out, "\t.local iloc_registers\n");
+    fprintf(out,
+            "\t.comm iloc_registers, %d, 16\n",
+            4 * program->register_count);
+    fprintf(out, "\t.local iloc_memory\n");
+    fprintf(out, "\t.comm iloc_memory, %zu, 16\n", memory_size);
+
+    fprintf(out, "\t.section .rodata\n");
+    fprintf(out, ".Lformat:\n");
+    fprintf(out, "\t.string \"%%d\\n\"\n");
+
+    fprintf(out, "\t.section .data.rel.ro, \"aw\"\n");
+    fprintf(out, "\t.align 8\n");
+    fprintf(out, "iloc_targets:\n");
+    int i;
+    for (i = 0; i < program->length; i++) {
+        fprintf(out, "\t.quad .L%d\n", i);
+    }
+
+    fprintf(out, "\t.text\n");
+    fprintf(out, "\t.globl main\n");
+    fprintf(out, "\t.type main, @function\n");
+    fprintf(out, "main:\n");
+    fprintf(out, "\tpushq %%rbx\n");
+    fprintf(out, "\tpushq %%r12\n");
+    fprintf(out, "\tpushq %%r13\n");
+    fprintf(out, "\tleaq iloc_registers(%%rip), %%rbx\n");
+    fprintf(out, "\tleaq iloc_memory(%%rip), %%r12\n");
+    fprintf(out, "\tleaq iloc_targets(%%rip), %%r13\n");
+
+    for (i = 0; i < program->length; i++) {
+        struct sim_ins* ins = &program->code[i];
+        if (ins->entry >= 0) {
+            fprintf(out, "# %s\n", program->functions[ins->entry]);
+        }
+        fprintf(out, ".L%d:\n", i);
+        if (!print_instruction(out, program, ins, memory_size)) {
+            fprintf(stderr,
+                    "Cannot compile opcode %s\n",
+                    mnemonic[ins->opcode]);
+            return false;
+        }
+    }
+
+    print_stub(out, stub_names[0], SIM_INVALID_JUMP);
+    print_stub(out, stub_names[1], SIM_INVALID_ADDRESS);
+    print_stub(out, stub_names[2], SIM_DIVISION_BY_ZERO);
+
+    fprintf(out, ".Lhalt:\n");
+    fprintf(out, "\tmovl %d(%%rbx), %%eax\n", 4 * register_slot(ILOC_RFP));
+    fprintf(out, "\taddl $12, %%eax\n");
+    fprintf(out, "\txorl %%esi, %%esi\n");
+    fprintf(out, "\tcmpl $%zu, %%eax\n", memory_size - 4);
+    fprintf(out, "\tja 1f\n");
+    fprintf(out, "\tmovl (%%r12,%%rax), %%esi\n");
+    fprintf(out, "1:\n");
+    fprintf(out, "\tleaq .Lformat(%%rip), %%rdi\n");
+    fprintf(out, "\txorl %%eax, %%eax\n");
+    fprintf(out, "\tcall printf@PLT\n");
+    fprintf(out, "\txorl %%eax, %%eax\n");
+    fprintf(out, ".Lexit:\n");
+    fprintf(out, "\tpopq %%r13\n");
+    fprintf(out, "\tpopq %%r12\n");
+    fprintf(out, "\tpopq %%rbx\n");
+    fprintf(out, "\tret\n");
+    fprintf(out, "\t.size main, .-main\n");
+    fprintf(out, "\t.section .note.GNU-stack, \"\", @progbits\n");
+    return true;
+}
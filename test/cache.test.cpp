@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern "C" {
+#include "../include/cache.h"
+}
+
+static struct cache* make_temp_cache(long max_size) {
+    char dir[] = "/tmp/etapa6-cache-XXXXXX";
+    EXPECT_NE(nullptr, mkdtemp(dir));
+    return alloc_cache(dir, max_size);
+}
+
+static void remove_temp_cache(struct cache* cache) {
+    char command[256];
+    snprintf(command, sizeof command, "rm -rf %s", cache->dir);
+    EXPECT_EQ(0, system(command));
+    free_cache(cache);
+}
+
+static struct cache_entry make_entry(int status,
+                                     const char* diagnostics,
+                                     const char* code) {
+    struct cache_entry entry;
+    entry.status = status;
+    entry.diagnostics = strdup(diagnostics);
+    entry.diagnostics_size = strlen(diagnostics);
+    entry.code = strdup(code);
+    entry.code_size = strlen(code);
+    return entry;
+}
+
+TEST(CacheKey, IsDeterministic) {
+    struct cache_key a = hash_key("v1", "", "int main() {}", 13);
+    struct cache_key b = hash_key("v1", "", "int main() {}", 13);
+    EXPECT_STREQ(a.hex, b.hex);
+    EXPECT_EQ(32u, strlen(a.hex));
+}
+
+TEST(CacheKey, DependsOnSourceVersionAndOptions) {
+    struct cache_key base = hash_key("v1", "", "int main() {}", 13);
+    EXPECT_STRNE(base.hex, hash_key("v1", "", "int main() {} ", 14).hex);
+    EXPECT_STRNE(base.hex, hash_key("v2", "", "int main() {}", 13).hex);
+    EXPECT_STRNE(base.hex, hash_key("v1", "-O", "int main() {}", 13).hex);
+}
+
+TEST(CacheLookup, MissesOnEmptyCache) {
+    struct cache* cache = make_temp_cache(CACHE_DEFAULT_SIZE);
+    struct cache_entry entry;
+    EXPECT_FALSE(cache_lookup(cache, hash_key("v1", "", "x", 1), &entry));
+
+    struct cache_stats stats = get_cache_stats(cache);
+    EXPECT_EQ(0, stats.hits);
+    EXPECT_EQ(1, stats.misses);
+    remove_temp_cache(cache);
+}
+
+TEST(CacheLookup, HitsStoredEntry) {
+    struct cache* cache = make_temp_cache(CACHE_DEFAULT_SIZE);
+    struct cache_key key = hash_key("v1", "", "x", 1);
+    struct cache_entry stored = make_entry(11, "Identifier already declared\n",
+                                           "loadI 0 => rfp\nhalt\n");
+    EXPECT_TRUE(cache_store(cache, key, &stored));
+
+    struct cache_entry entry;
+    ASSERT_TRUE(cache_lookup(cache, key, &entry));
+    EXPECT_EQ(11, entry.status);
+    EXPECT_STREQ(stored.diagnostics, entry.diagnostics);
+    EXPECT_STREQ(stored.code, entry.code);
+    EXPECT_EQ(1, get_cache_stats(cache).hits);
+
+    free_cache_entry(&entry);
+    free_cache_entry(&stored);
+    remove_temp_cache(cache);
+}
+
+TEST(CacheStore, EvictsLeastRecentlyUsed) {
+    struct cache* cache = make_temp_cache(160);
+    struct cache_key first = hash_key("v1", "", "first", 5);
+    struct cache_key second = hash_key("v1", "", "second", 6);
+    struct cache_key third = hash_key("v1", "", "third", 5);
+    struct cache_entry entry = make_entry(0, "", "loadI 1024 => rfp\n");
+    struct cache_entry found;
+
+    EXPECT_TRUE(cache_store(cache, first, &entry));
+    usleep(20000);
+    EXPECT_TRUE(cache_store(cache, second, &entry));
+    usleep(20000);
+    ASSERT_TRUE(cache_lookup(cache, first, &found));
+    free_cache_entry(&found);
+    usleep(20000);
+    EXPECT_TRUE(cache_store(cache, third, &entry));
+
+    EXPECT_TRUE(cache_lookup(cache, first, &found));
+    free_cache_entry(&found);
+    EXPECT_FALSE(cache_lookup(cache, second, &found));
+    EXPECT_TRUE(cache_lookup(cache, third, &found));
+    free_cache_entry(&found);
+    EXPECT_EQ(2, get_cache_stats(cache).entries);
+
+    free_cache_entry(&entry);
+    remove_temp_cache(cache);
+}
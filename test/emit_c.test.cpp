@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "helpers.h"
+
+extern "C" {
+#include "../include/emit_c.h"
+#include "../include/generate.h"
+#include "../include/iloc.h"
+#include "../include/lex.yy.h"
+#include "../include/parser.tab.h"
+#include "../include/simulate.h"
+}
+
+static int simulate_source(const char* source) {
+    struct module* module = compile_source(source);
+    struct sim_result result = run_module(module, 0);
+    free_sim_result(&result);
+    free_module(module);
+    return result.exit_value;
+}
+
+static std::string run_c(const char* source) {
+    struct node* tree = 0;
+    yy_scan_string(source);
+    EXPECT_EQ(0, yyparse(&tree));
+    yylex_destroy();
+
+    struct table* table = alloc_table();
+    EXPECT_EQ(SUCCESS, analyze_node(tree, table).status);
+
+    char path[] = "/tmp/etapa6-c-XXXXXX";
+    close(mkstemp(path));
+    std::string c_path = std::string(path) + ".c";
+    FILE* out = fopen(c_path.c_str(), "w");
+    EXPECT_TRUE(emit_c(out, tree));
+    fclose(out);
+    free_table(table);
+    free_node(tree);
+
+    std::string command =
+        "cc -O2 -fwrapv " + c_path + " -o " + path + " -lm";
+    EXPECT_EQ(0, system(command.c_str()));
+
+    std::string output;
+    FILE* run = popen(path, "r");
+    char buffer[256];
+    while (fgets(buffer, sizeof buffer, run) != 0) {
+        output += buffer;
+    }
+    pclose(run);
+
+    unlink(c_path.c_str());
+    unlink(path);
+    return output;
+}
+
+TEST(EmitC, MatchesSimulator) {
+    if (system("cc --version > /dev/null 2>&1") != 0) {
+        GTEST_SKIP();
+    }
+
+    const char* source =
+        "calls int;\n"
+        "int fib(int n) {\n"
+        "  calls = calls + 1;\n"
+        "  if (n < 2) then { return n; };\n"
+        "  return fib(n - 1) + fib(n - 2);\n"
+        "}\n"
+        "int main() {\n"
+        "  int total <= 0;\n"
+        "  int i <= 0;\n"
+        "  while (i < 10 && total >= 0) do {\n"
+        "    total = total + fib(i) / 2;\n"
+        "    i = i + 1;\n"
+        "  };\n"
+        "  do { total = total - 1; } while (total > 50 || i == 0);\n"
+        "  return total * 100 + calls;\n"
+        "}\n";
+
+    int expected = simulate_source(source);
+    EXPECT_EQ(std::to_string(expected) + "\n", run_c(source));
+}
+
+TEST(EmitC, EmitsClassesLoopsAndOutput) {
+    if (system("cc --version > /dev/null 2>&1") != 0) {
+        GTEST_SKIP();
+    }
+
+    EXPECT_EQ(
+        "1.5\n"
+        "x\n"
+        "7\n"
+        "24\n",
+        run_c("class point [ int x : float y ];\n"
+              "p point;\n"
+              "values[4] int;\n"
+              "int main() {\n"
+              "  int i <= 0;\n"
+              "  int sum <= 0;\n"
+              "  p$y = 1.5;\n"
+              "  output p$y, \"x\";\n"
+              "  for (i = 0 : i < 4 : i = i + 1) {\n"
+              "    values[i] = i * 2;\n"
+              "  };\n"
+              "  foreach (i : 1, 2, 3) {\n"
+              "    sum = sum + values[i];\n"
+              "  };\n"
+              "  switch (sum) {\n"
+              "    case 12:\n"
+              "      output 7;\n"
+              "      break;\n"
+              "    case 0:\n"
+              "      output 0;\n"
+              "  };\n"
+              "  return sum * 2;\n"
+              "}\n"));
+}
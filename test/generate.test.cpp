@@ -0,0 +1,519 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "helpers.h"
+
+extern "C" {
+#include "../include/generate.h"
+#include "../include/iloc.h"
+#include "../include/simulate.h"
+}
+
+static struct sim_result run_source(const char* source, std::string* iloc) {
+    struct module* module = compile_source(source);
+    if (iloc != 0) {
+        *iloc = module_text(module);
+    }
+    struct sim_result result = run_module(module, 0);
+    free_module(module);
+    return result;
+}
+
+static int run_value(const char* source) {
+    struct sim_result result = run_source(source, 0);
+    free_sim_result(&result);
+    return result.exit_value;
+}
+
+static std::string switch_program(int cases, int stride, int iterations) {
+    std::string n = std::to_string(cases);
+    std::string source = "int main() { int r <= 0; int i <= 0; while (i < " +
+                         std::to_string(iterations) + ") do {" +
+                         " switch ((i - i / " + n + " * " + n + ") * " +
+                         std::to_string(stride) + ") {";
+    for (int k = 0; k < cases; k++) {
+        source += " case " + std::to_string(k * stride) + ": r = r + " +
+                  std::to_string(k) + "; break;";
+    }
+    return source + " }; i = i + 1; }; return r; }";
+}
+
+static long dispatch_cost(int cases, int stride) {
+    struct sim_result small =
+        run_source(switch_program(cases, stride, 100).c_str(), 0);
+    struct sim_result large =
+        run_source(switch_program(cases, stride, 200).c_str(), 0);
+    long cost = (large.instructions - small.instructions) / 100;
+
+    free_sim_result(&small);
+    free_sim_result(&large);
+    return cost;
+}
+
+TEST(Generate, SwitchFallsThroughUntilBreak) {
+    const char* source =
+        "int f(int x) { int r <= 0; switch (x) {"
+        " case 1: r = 10;"
+        " case 2: r = r + 2; break;"
+        " case 3: r = 30; break;"
+        " case 7: r = 70;"
+        " }; return r; }"
+        "int main() { return f(1) + f(2) * 100 + f(3) * 1000 + f(7) * 10000 +"
+        " f(4) * 1000000; }";
+
+    EXPECT_EQ(12 + 200 + 30000 + 700000, run_value(source));
+}
+
+TEST(Generate, BreakLeavesInnermostLoop) {
+    const char* source =
+        "int main() { int i <= 0; int n <= 0;"
+        " while (i < 10) do { int j <= 0;"
+        "  while (j < 10) do { if (j == i) then { break; }; n = n + 1;"
+        "   j = j + 1; };"
+        "  i = i + 1; };"
+        " return n; }";
+
+    EXPECT_EQ(45, run_value(source));
+}
+
+TEST(Generate, CallsSaveOnlyRegistersOfTheCurrentStatement) {
+    std::string source = "int id(int x) { return x; }"
+                         "int main() { int a <= 1;";
+    for (int k = 0; k < 20; k++) {
+        source += " a = a + 1;";
+    }
+    source += " a = a * 2 + id(a); return a; }";
+
+    struct sim_result result = run_source(source.c_str(), 0);
+    EXPECT_EQ(63, result.exit_value);
+    EXPECT_LT(result.counts[STORE_AI], 40);
+    free_sim_result(&result);
+}
+
+TEST(Generate, SwitchLowersDenseCasesToJumpTable) {
+    std::string iloc;
+    struct sim_result result =
+        run_source(switch_program(32, 1, 64).c_str(), &iloc);
+    EXPECT_EQ(2 * (31 * 32 / 2), result.exit_value);
+    EXPECT_NE(std::string::npos, iloc.find(".global main.switch"));
+    free_sim_result(&result);
+
+    result = run_source(switch_program(32, 5, 64).c_str(), &iloc);
+    EXPECT_EQ(2 * (31 * 32 / 2), result.exit_value);
+    EXPECT_EQ(std::string::npos, iloc.find(".global"));
+    free_sim_result(&result);
+}
+
+static std::string edge_switch(long first, int count, long extra) {
+    std::string source = "int f(int x) { int r <= 0; switch (x) {";
+    for (int k = 0; k < count; k++) {
+        source += " case " + std::to_string(first + k) + ": r = " +
+                  std::to_string(k + 1) + "; break;";
+    }
+    if (extra >= 0) {
+        source += " case " + std::to_string(extra) + ": r = 99; break;";
+    }
+    return source + " }; return r; }";
+}
+
+TEST(Generate, SwitchTablesHandleCasesAtTheIntLimits) {
+    std::string iloc;
+    std::string source = edge_switch(0, 15, 2147483648) +
+                         "int main() { return f(2147483648) * 10000 +"
+                         " f(3) * 100 + f(20); }";
+    struct sim_result result = run_source(source.c_str(), &iloc);
+    EXPECT_EQ(990400, result.exit_value);
+    EXPECT_EQ(std::string::npos, iloc.find(".global"));
+    free_sim_result(&result);
+
+    source = edge_switch(2147483648, 16, -1) +
+             "int main() { return f(2147483653) * 10000 +"
+             " f(2147483663) * 100 + f(2147483647) + f(0); }";
+    result = run_source(source.c_str(), &iloc);
+    EXPECT_EQ(61600, result.exit_value);
+    EXPECT_NE(std::string::npos, iloc.find(".global f.switch"));
+    free_sim_result(&result);
+
+    source = edge_switch(2147483632, 16, -1) +
+             "int main() { return f(2147483647) * 100 + f(2147483648); }";
+    result = run_source(source.c_str(), &iloc);
+    EXPECT_EQ(1600, result.exit_value);
+    EXPECT_NE(std::string::npos, iloc.find(".global f.switch"));
+    free_sim_result(&result);
+}
+
+TEST(Generate, SwitchDispatchCostScalesWithStrategy) {
+    EXPECT_EQ(dispatch_cost(16, 1), dispatch_cost(128, 1));
+
+    long sparse_small = dispatch_cost(16, 7);
+    long sparse_large = dispatch_cost(128, 7);
+    EXPECT_GT(sparse_large, sparse_small);
+    EXPECT_LE(sparse_large - sparse_small, 3 * 3);
+}
+
+TEST(Generate, ForRunsInitializationConditionAndUpdate) {
+    const char* source =
+        "int main() { int i <= 0; int s <= 0;"
+        " for (i = 1, s = 100 : i <= 10 : i = i + 1, s = s - 1) {"
+        "  s = s + i * 2; };"
+        " for (i = 5 : i < 3 : i = i + 1) { s = 0; };"
+        " return s; }";
+
+    EXPECT_EQ(100 + 110 - 10, run_value(source));
+}
+
+TEST(Generate, ForeachVisitsItemsInOrder) {
+    const char* source =
+        "total int;"
+        "int main() { int x <= 0; int s <= 0; total = 0;"
+        " foreach (x : 3, s + 1, 5 * 2) { s = s * 10 + x; };"
+        " foreach (total : 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,"
+        "  15, 16, 17, 18) { s = s + total; if (total == 4) then { break; }; };"
+        " return s + total * 1000; }";
+
+    EXPECT_EQ(350 + 1 + 2 + 3 + 4 + 4000, run_value(source));
+}
+
+TEST(Generate, ContinueSkipsToTheNextIteration) {
+    struct {
+        const char* source;
+        int value;
+    } cases[] = {
+        {"int main() { int i <= 0; int s <= 0;"
+         " for (i = 0 : i < 10 : i = i + 1) {"
+         "  if (i - i / 2 * 2 == 1) then { continue; }; s = s + i; };"
+         " return s * 100 + i; }",
+         2010},
+        {"int main() { int i <= 0; int s <= 0;"
+         " for (i = 0 : i < 103 : i = i + 1) {"
+         "  if (i - i / 2 * 2 == 1) then { continue; }; s = s + i; };"
+         " return s * 1000 + i; }",
+         2652103},
+        {"int main() { int x <= 0; int s <= 0;"
+         " foreach (x : 1, 2, 3, 4, 5) {"
+         "  if (x == 2) then { continue; }; s = s * 10 + x; };"
+         " return s; }",
+         1345},
+        {"int main() { int i <= 0; int s <= 0;"
+         " while (i < 10) do { i = i + 1;"
+         "  switch (i) { case 4: continue; case 5: s = s + 100; break; };"
+         "  s = s + i; };"
+         " do { i = i - 1; if (i > 5) then { continue; }; s = s + 1000; }"
+         " while (i > 0);"
+         " return s; }",
+         6151},
+    };
+
+    for (auto& c : cases) {
+        for (int factor : {0, 1, 4}) {
+            unroll_factor = factor;
+            EXPECT_EQ(c.value, run_value(c.source)) << factor << c.source;
+        }
+        unroll_factor = 0;
+    }
+}
+
+TEST(Generate, LoopsRunOneBranchPerIteration) {
+    const char* source =
+        "int main() { int i <= 0; int s <= 0;"
+        " while (i < 50) do { s = s + i; i = i + 1; };"
+        " for (i = 0 : i < 50 : i = i + 1) { s = s + i; };"
+        " return s; }";
+
+    struct sim_result result = run_source(source, 0);
+    EXPECT_EQ(2 * (49 * 50 / 2), result.exit_value);
+    EXPECT_EQ(1, result.counts[JUMP_I]);
+    EXPECT_EQ(2 * 51, result.counts[CBR]);
+    free_sim_result(&result);
+}
+
+TEST(Generate, UnrollsCountedLoopsWithRemainder) {
+    const char* sources[] = {
+        "int main() { int i <= 0; int s <= 0;"
+        " for (i = 0 : i < 103 : i = i + 1) { s = s + i * 3; };"
+        " return s + i; }",
+        "int main() { int i <= 0; int s <= 0;"
+        " for (i = 50 : i >= 1 : i = i - 3) { s = s * 2 + i; s = s / 3; };"
+        " return s * 1000 + i; }",
+        "int main() { int i <= 0; int s <= 0;"
+        " for (i = 2 : i != 62 : i = i + 4) { s = s + i;"
+        "  if (s > 300) then { break; }; };"
+        " return s * 1000 + i; }",
+        "int main() { int i <= 0; int s <= 0;"
+        " for (i = 9 : i < 3 : i = i + 1) { s = s + 1; };"
+        " return s * 1000 + i; }",
+        "int main() { int x <= 0; int s <= 0;"
+        " foreach (x : 4, 5, s + 6) { s = s * 10 + x; };"
+        " return s; }",
+    };
+
+    for (const char* source : sources) {
+        unroll_factor = 0;
+        struct sim_result rolled = run_source(source, 0);
+        unroll_factor = 4;
+        struct sim_result unrolled = run_source(source, 0);
+        unroll_factor = 0;
+
+        EXPECT_EQ(rolled.exit_value, unrolled.exit_value) << source;
+        EXPECT_LE(unrolled.counts[CBR], rolled.counts[CBR]) << source;
+        free_sim_result(&rolled);
+        free_sim_result(&unrolled);
+    }
+}
+
+TEST(Generate, FullyUnrollsSmallLoops) {
+    const char* source =
+        "int main() { int i <= 0; int s <= 0;"
+        " for (i = 0 : i < 5 : i = i + 1) { s = s + i; };"
+        " return s; }";
+
+    unroll_factor = 1;
+    struct sim_result result = run_source(source, 0);
+    unroll_factor = 0;
+
+    EXPECT_EQ(10, result.exit_value);
+    EXPECT_EQ(0, result.counts[CBR]);
+    free_sim_result(&result);
+}
+
+TEST(Generate, ShiftsPowerOfTwoMultipliesAndDivides) {
+    std::string iloc;
+    struct sim_result result = run_source(
+        "int main() { int z <= 0; int a <= 7; int b <= 9;"
+        " a = z - a; b = z - b;"
+        " return a / 2 + b / 4 * 100 + 9 / 8 * 1000 + a * 8; }",
+        &iloc);
+
+    EXPECT_EQ(-3 - 200 + 1000 - 56, result.exit_value);
+    EXPECT_NE(std::string::npos, iloc.find("rshiftI"));
+    EXPECT_NE(std::string::npos, iloc.find("lshiftI"));
+    EXPECT_NE(std::string::npos, iloc.find("multI"));
+    EXPECT_EQ(std::string::npos, iloc.find("div"));
+    EXPECT_EQ(0, result.counts[MULT]);
+    free_sim_result(&result);
+}
+
+TEST(Generate, SelectsImmediateFormsForConstantOperands) {
+    std::string iloc;
+    struct sim_result result = run_source(
+        "int main() { int a <= 3; int b <= 40;"
+        " return (10 - a) + 120 / b * 100 + (2 * 3 + 4) * a + a * 1 + 0"
+        " + (0 - 8) / (0 - 1); }",
+        &iloc);
+
+    EXPECT_EQ(7 + 300 + 30 + 3 + 8, result.exit_value);
+    EXPECT_NE(std::string::npos, iloc.find("rsubI"));
+    EXPECT_NE(std::string::npos, iloc.find("rdivI"));
+    EXPECT_NE(std::string::npos, iloc.find("multI r"));
+    EXPECT_EQ(0, result.counts[SUB]);
+    EXPECT_EQ(0, result.counts[MULT]);
+    EXPECT_EQ(0, result.counts[DIV]);
+    EXPECT_EQ(5, result.counts[LOAD_I]);
+    free_sim_result(&result);
+}
+
+TEST(Generate, InlinesSmallAndSingleSiteFunctions) {
+    const char* source =
+        "base int;"
+        "int get() { return base; }"
+        "int clamp(int v, int hi) { if (v > hi) then { return hi; };"
+        " return v; }"
+        "int body(int n) { int i <= 0; int s <= 0;"
+        " while (i < n) do { s = s + clamp(i, 5) + get(); i = i + 1; };"
+        " return s; }"
+        "int main() { int s <= 3; base = 2; return s + body(10); }";
+
+    struct sim_result called = run_source(source, 0);
+    inline_limit = 32;
+    struct sim_result inlined = run_source(source, 0);
+    inline_limit = 0;
+
+    EXPECT_EQ(3 + 35 + 20, called.exit_value);
+    EXPECT_EQ(called.exit_value, inlined.exit_value);
+    EXPECT_EQ(0, inlined.counts[JUMP]);
+    EXPECT_LT(inlined.cycles, called.cycles);
+    free_sim_result(&called);
+    free_sim_result(&inlined);
+}
+
+TEST(Generate, NeverInlinesRecursiveFunctions) {
+    const char* source =
+        "int sum(int n) { if (n == 0) then { return 0; };"
+        " return n + sum(n - 1); }"
+        "int twice(int n) { return sum(n) + sum(n + 1); }"
+        "int main() { int n <= 7; return n * 100 + twice(n); }";
+
+    inline_limit = 32;
+    struct sim_result result = run_source(source, 0);
+    inline_limit = 0;
+
+    EXPECT_EQ(700 + 28 + 36, result.exit_value);
+    EXPECT_GT(result.counts[JUMP], 0);
+    free_sim_result(&result);
+}
+
+TEST(Generate, TailCallsRunInConstantStack) {
+    const char* source =
+        "int sum(int n, int acc) { if (n == 0) then { return acc; };"
+        " return sum(n - 1, acc + 1); }"
+        "int start(int n) { int bias <= 0; bias = n * 2;"
+        " return sum(n, bias - n * 2); }"
+        "int main() { int k <= 3; return k + start(100000); }";
+
+    tail_calls = true;
+    struct sim_result result = run_source(source, 0);
+    tail_calls = false;
+
+    EXPECT_EQ(100003, result.exit_value);
+    EXPECT_EQ(1, result.counts[JUMP]);
+    free_sim_result(&result);
+}
+
+TEST(Generate, ElidesLeafFrames) {
+    const char* source =
+        "int scale(int v, int k) { int t <= 0; t = v * k; return t + 1; }"
+        "int main() { int i <= 0; int s <= 0;"
+        " while (i < 20) do { s = s + scale(i, 3); i = i + 1; };"
+        " return s; }";
+
+    struct sim_result framed = run_source(source, 0);
+    shrink_wrap = true;
+    std::string iloc;
+    struct sim_result leaf = run_source(source, &iloc);
+    shrink_wrap = false;
+
+    EXPECT_EQ(570 + 20, framed.exit_value);
+    EXPECT_EQ(framed.exit_value, leaf.exit_value);
+    EXPECT_EQ(std::string::npos, iloc.find("storeAI rfp => rsp, 8"));
+    EXPECT_LT(leaf.counts[STORE_AI], framed.counts[STORE_AI]);
+    EXPECT_LT(leaf.cycles, framed.cycles);
+    free_sim_result(&framed);
+    free_sim_result(&leaf);
+}
+
+TEST(Generate, ShrinkWrapsEarlyReturns) {
+    const char* source =
+        "int fib(int n) { if (n < 2) then { return n; };"
+        " return fib(n - 1) + fib(n - 2); }"
+        "int main() { int n <= 12; return fib(n); }";
+
+    struct sim_result framed = run_source(source, 0);
+    shrink_wrap = true;
+    struct sim_result wrapped = run_source(source, 0);
+    shrink_wrap = false;
+
+    EXPECT_EQ(144, framed.exit_value);
+    EXPECT_EQ(framed.exit_value, wrapped.exit_value);
+    EXPECT_LT(wrapped.cycles, framed.cycles);
+    free_sim_result(&framed);
+    free_sim_result(&wrapped);
+}
+
+TEST(Generate, PassesArgumentsInRegisters) {
+    const char* source =
+        "int mix(int a, int b, int c) { a = a + c; return a * 2 - b; }"
+        "int wide(int a, int b, int c, int d) { return a - b + c - d; }"
+        "int down(int n, int acc) { if (n == 0) then { return acc; };"
+        " return down(n - 1, acc + mix(n, 1, 2)) + n; }"
+        "int main() { int i <= 0; int s <= 0;"
+        " while (i < 10) do { s = s + wide(i, 1, mix(i, 2, 3), 4);"
+        " i = i + 1; }; return s + down(6, 0); }";
+
+    struct sim_result memory = run_source(source, 0);
+    call_registers = 2;
+    std::string iloc;
+    struct sim_result registers = run_source(source, &iloc);
+    call_registers = 0;
+
+    EXPECT_EQ(memory.exit_value, registers.exit_value);
+    EXPECT_EQ(std::string::npos, iloc.find("=> rsp, 16\n"));
+    EXPECT_NE(std::string::npos, iloc.find("=> rsp, 28\n"));
+    EXPECT_LT(registers.counts[LOAD_AI], memory.counts[LOAD_AI]);
+    EXPECT_LT(registers.counts[STORE_AI], memory.counts[STORE_AI]);
+    EXPECT_LT(registers.cycles, memory.cycles);
+    free_sim_result(&memory);
+    free_sim_result(&registers);
+}
+
+TEST(Generate, EvaluatesArgumentsBeforePassingThem) {
+    const char* source =
+        "int id(int x) { return x; }"
+        "int sub(int a, int b) { return a - b; }"
+        "int main() { int k <= 10; return sub(id(k), id(3)); }";
+
+    EXPECT_EQ(7, run_value(source));
+    call_registers = 1;
+    EXPECT_EQ(7, run_value(source));
+    call_registers = 0;
+}
+
+TEST(Generate, SharesStackSlotsBetweenDisjointLifetimes) {
+    const char* source =
+        "int work(int n) { int a <= 0; a = n * 2; int b <= 0; b = a + 1;"
+        " n = b; int c <= 0; c = n * 3; int d <= 0; d = c - 1;"
+        " return d + n; }"
+        "int main() { int s <= 0; int i <= 0;"
+        " while (i < 5) do { int t <= 0; t = i * 2; s = s + t;"
+        " int u <= 1; u = s + u; s = u - 1; i = i + 1; };"
+        " int z <= 0; z = s * 10;"
+        " for (int k <= 0 : k < 3 : k = k + 1) { int w <= 0; w = k;"
+        " z = z + w; };"
+        " return z + s + work(3); }";
+
+    std::string iloc;
+    struct sim_result result = run_source(source, &iloc);
+
+    EXPECT_EQ(203 + 20 + 27, result.exit_value);
+    EXPECT_NE(std::string::npos, iloc.find("lwork:\n"));
+    EXPECT_NE(std::string::npos, iloc.find("addI rsp, 28 => rsp"));
+    free_sim_result(&result);
+}
+
+TEST(Generate, EvaluatesRegisterHungrySideFirst) {
+    const char* source =
+        "int inc(int x) { return x + 1; }"
+        "int main() { int a <= 3; int b <= 4;"
+        " return a * b - (a + b) * inc(a + b); }";
+
+    std::string iloc;
+    struct sim_result result = run_source(source, &iloc);
+
+    EXPECT_EQ(12 - 7 * 8, result.exit_value);
+    EXPECT_LT(iloc.find("jumpI -> linc"), iloc.find("mult"));
+    EXPECT_NE(std::string::npos, iloc.find("lmain:\naddI rsp, 24 => rsp"));
+    free_sim_result(&result);
+}
+
+TEST(Generate, KeepsOrderWhenCallsObserveGlobals) {
+    const char* source =
+        "g int;"
+        "int bump(int x) { g = g + x; return g; }"
+        "int main() { int a <= 2; g = 10; return g - a * bump(5); }";
+
+    EXPECT_EQ(10 - 2 * 15, run_value(source));
+}
+
+TEST(Generate, IfConvertsSideEffectFreeSelects) {
+    const char* source =
+        "int main() { int i <= 0; int s <= 0; int t <= 0;"
+        " while (i < 20) do {"
+        "  s = s + (i < 10 ? i : 0 - i);"
+        "  if (i > 4 && i < 15) then { t = t + 2; } else { t = t - 1; };"
+        "  s = s + (i != 0 ? 100 / i : 0);"
+        "  i = i + 1; };"
+        " return s * 1000 + t; }";
+
+    struct sim_result branchy = run_source(source, 0);
+    if_conversion = true;
+    struct sim_result converted = run_source(source, 0);
+    if_conversion = false;
+
+    EXPECT_EQ((45 - 145 + 349) * 1000 + 10, branchy.exit_value);
+    EXPECT_EQ(branchy.exit_value, converted.exit_value);
+    EXPECT_EQ(0, branchy.counts[XOR]);
+    EXPECT_EQ(2 * 2 * 20, converted.counts[XOR]);
+    EXPECT_EQ(21 + 20, converted.counts[CBR]);
+    free_sim_result(&branchy);
+    free_sim_result(&converted);
+}
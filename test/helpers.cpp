@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "helpers.h"
+
+extern "C" {
+#include "../include/analyze.h"
+#include "../include/generate.h"
+#include "../include/lex.yy.h"
+#include "../include/link.h"
+#include "../include/parser.tab.h"
+}
+
+struct module* parse_module(const char* text) {
+    FILE* in = fmemopen((void*)text, strlen(text), "r");
+    struct module* module = read_module(in);
+    fclose(in);
+    return module;
+}
+
+std::string module_text(struct module* module) {
+    char* buffer = 0;
+    size_t size = 0;
+    FILE* out = open_memstream(&buffer, &size);
+    print_module(out, module);
+    fclose(out);
+    std::string text(buffer, size);
+    free(buffer);
+    return text;
+}
+
+struct module* compile_source(const char* source) {
+    struct node* tree = 0;
+    yy_scan_string(source);
+    EXPECT_EQ(0, yyparse(&tree));
+    yylex_destroy();
+
+    struct table* table = alloc_table();
+    EXPECT_EQ(SUCCESS, analyze_node(tree, table).status);
+    generate_code(tree);
+    struct module* module = code_to_module(code.head);
+    free_code(code.head);
+
+    free_table(table);
+    free_node(tree);
+    return module;
+}
+
+struct sim_result run_module(struct module* module, std::string* profile) {
+    struct link_result linked = link_modules(&module, 1, 0);
+    EXPECT_EQ(LINK_SUCCESS, linked.status);
+    struct sim_program* program = decode_program(linked.program);
+    struct sim_config config = default_sim_config();
+    struct sim_result result = simulate(program, &config);
+    EXPECT_EQ(SIM_HALTED, result.status);
+
+    if (profile != 0) {
+        char* buffer = 0;
+        size_t size = 0;
+        FILE* out = open_memstream(&buffer, &size);
+        print_branch_profile(out, linked.program, &result);
+        fclose(out);
+        profile->assign(buffer, size);
+        free(buffer);
+    }
+
+    free_sim_program(program);
+    free_module(linked.program);
+    return result;
+}
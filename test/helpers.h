@@ -0,0 +1,15 @@
+#ifndef TEST_HELPERS_H
+#define TEST_HELPERS_H
+#include <string>
+
+extern "C" {
+#include "../include/iloc.h"
+#include "../include/simulate.h"
+}
+
+struct module* parse_module(const char* text);
+std::string module_text(struct module* module);
+struct module* compile_source(const char* source);
+struct sim_result run_module(struct module* module, std::string* profile);
+
+#endif
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "helpers.h"
+
+extern "C" {
+#include "../include/iloc.h"
+#include "../include/layout.h"
+#include "../include/simulate.h"
+}
+
+static struct branch_profile* parse_profile(const char* text) {
+    FILE* in = fmemopen((void*)text, strlen(text), "r");
+    struct branch_profile* profile = read_branch_profile(in);
+    fclose(in);
+    return profile;
+}
+
+TEST(Layout, ThreadsJumpsAndDropsDeadCode) {
+    struct module* module = parse_module(
+        "lmain:\n"
+        "loadI 1 => r0\n"
+        "cbr r0 -> l1, l2\n"
+        "l1:\n"
+        "jumpI -> l3\n"
+        "l2:\n"
+        "loadI 5 => r1\n"
+        "storeAI r1 => rfp, 12\n"
+        "jumpI -> l3\n"
+        "loadI 9 => r2\n"
+        "l3:\n"
+        "halt\n");
+
+    struct opt_stats stats;
+    memset(&stats, 0, sizeof stats);
+    layout_module(module, &stats);
+
+    EXPECT_EQ("lmain:\n"
+              "loadI 1 => r0\n"
+              "cbr r0 -> l3, l2\n"
+              "l2:\n"
+              "loadI 5 => r1\n"
+              "storeAI r1 => rfp, 12\n"
+              "l3:\n"
+              "halt\n",
+              module_text(module));
+    EXPECT_EQ(1, stats.threaded_jumps);
+    EXPECT_EQ(1, stats.removed_jumps);
+    EXPECT_EQ(2, stats.unreachable_operations);
+    EXPECT_EQ(1, stats.removed_labels);
+
+    free_module(module);
+}
+
+TEST(Layout, ThreadsNestedIfsWithoutChangingResults) {
+    const char* source =
+        "int main() { int i <= 0; int s <= 0;"
+        " while (i < 50) do {"
+        "  if (i > 10) then {"
+        "   if (i > 40) then { s = s - 1; } else { s = s + 2; };"
+        "  } else { s = s + 3; };"
+        "  i = i + 1; };"
+        " return s; }";
+    struct module* plain = compile_source(source);
+    struct module* laid_out = compile_source(source);
+
+    struct opt_stats stats;
+    memset(&stats, 0, sizeof stats);
+    layout_module(laid_out, &stats);
+    EXPECT_GE(stats.threaded_jumps, 1);
+
+    struct sim_result expected = run_module(plain, 0);
+    struct sim_result actual = run_module(laid_out, 0);
+    EXPECT_EQ(expected.exit_value, actual.exit_value);
+    EXPECT_LT(actual.counts[JUMP_I], expected.counts[JUMP_I]);
+    EXPECT_EQ(expected.counts[CBR], actual.counts[CBR]);
+
+    free_sim_result(&expected);
+    free_sim_result(&actual);
+    free_module(plain);
+    free_module(laid_out);
+}
+
+TEST(Layout, PlacesProfiledTargetAfterBranch) {
+    const char* source =
+        "int main() { int i <= 0; int s <= 0;"
+        " while (i < 100) do {"
+        "  if (i >= 90) then { s = s + 1; } else { s = s + 2; };"
+        "  i = i + 1; };"
+        " return s; }";
+    struct module* module = compile_source(source);
+
+    std::string text;
+    struct sim_result expected = run_module(module, &text);
+    layout_profile = parse_profile(text.c_str());
+    ASSERT_NE(nullptr, layout_profile);
+
+    struct branch_count* rare = 0;
+    int i;
+    for (i = 0; i < layout_profile->count; i++) {
+        if (layout_profile->counts[i].taken == 10) {
+            rare = &layout_profile->counts[i];
+        }
+    }
+    ASSERT_NE(nullptr, rare);
+    EXPECT_EQ(90, rare->not_taken);
+
+    struct opt_stats stats;
+    memset(&stats, 0, sizeof stats);
+    layout_module(module, &stats);
+
+    bool found = false;
+    for (i = 0; i + 1 < module->length; i++) {
+        struct operation* operation = &module->operations[i];
+        if (operation->opcode == CBR &&
+            strcmp(operation->dst[0].name, rare->on_true) == 0) {
+            found = true;
+            EXPECT_EQ(LABEL, module->operations[i + 1].opcode);
+            EXPECT_STREQ(rare->on_false,
+                         module->operations[i + 1].src[0].name);
+        }
+    }
+    EXPECT_TRUE(found);
+
+    struct sim_result actual = run_module(module, 0);
+    EXPECT_EQ(expected.exit_value, actual.exit_value);
+
+    free_branch_profile(layout_profile);
+    layout_profile = 0;
+    free_sim_result(&expected);
+    free_sim_result(&actual);
+    free_module(module);
+}
+
+TEST(Layout, RejectsMalformedProfiles) {
+    struct branch_profile* profile =
+        parse_profile("# hot loop\nl0 l1 5 7\n\nl2 l3 1 0 # exit\n");
+    ASSERT_NE(nullptr, profile);
+    ASSERT_EQ(2, profile->count);
+    EXPECT_STREQ("l2", profile->counts[1].on_true);
+    EXPECT_EQ(7, profile->counts[0].not_taken);
+    free_branch_profile(profile);
+
+    EXPECT_EQ(nullptr, parse_profile("l0 l1 5\n"));
+    EXPECT_EQ(nullptr, parse_profile("l0 l1 5 -2\n"));
+}
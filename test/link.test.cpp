@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "helpers.h"
+
+extern "C" {
+#include "../include/iloc.h"
+#include "../include/link.h"
+}
+
+TEST(Iloc, PrintsParsedOperations) {
+    const char* text =
+        ".global counter 4\n"
+        "lmain:\n"
+        "loadAI rbss, @counter => r0\n"
+        "cmp_LT r0, r1 -> r2\n"
+        "cbr r2 -> l0, l1\n"
+        "l0:\n"
+        "storeAI r0 => rfp, -4\n"
+        "jumpI -> l1\n"
+        "l1:\n"
+        "halt\n";
+
+    struct module* module = parse_module(text);
+    ASSERT_NE(nullptr, module);
+    EXPECT_EQ(10, module->length);
+    EXPECT_EQ(OPERAND_SYMBOL, module->operations[2].src[1].type);
+    EXPECT_EQ(ILOC_RBSS, module->operations[2].src[0].val);
+    EXPECT_EQ(-4, module->operations[6].dst[1].val);
+    EXPECT_EQ(text, module_text(module));
+    free_module(module);
+}
+
+TEST(Iloc, RejectsUnknownMnemonic) {
+    testing::internal::CaptureStderr();
+    EXPECT_EQ(nullptr, parse_module("lmain:\nfrobnicate r0 => r1\n"));
+    std::string error = testing::internal::GetCapturedStderr();
+    EXPECT_NE(std::string::npos, error.find("line 2"));
+}
+
+TEST(Iloc, RecognizesLocalLabels) {
+    EXPECT_TRUE(is_local_label("l0"));
+    EXPECT_TRUE(is_local_label("l12_3"));
+    EXPECT_FALSE(is_local_label("lmain"));
+    EXPECT_FALSE(is_local_label("l1_"));
+}
+
+TEST(Link, ResolvesReturnAddressesAndGlobals) {
+    struct module* modules[2];
+    modules[0] = parse_module(
+        ".global total 4\n"
+        "lmain:\n"
+        "loadI l0 => r0\n"
+        "storeAI r0 => rsp, 0\n"
+        "jumpI -> linc\n"
+        "l0:\n"
+        "loadAI rbss, @total => r1\n"
+        "halt\n");
+    modules[1] = parse_module(
+        ".global step 4\n"
+        ".global total 4\n"
+        "linc:\n"
+        "loadAI rbss, @step => r0\n"
+        "storeAI r0 => rbss, @total\n"
+        "jumpI -> l0\n"
+        "l0:\n"
+        "loadAI rfp, 0 => r1\n"
+        "jump -> r1\n");
+    ASSERT_NE(nullptr, modules[0]);
+    ASSERT_NE(nullptr, modules[1]);
+
+    struct link_result result = link_modules(modules, 2, 0);
+    ASSERT_EQ(LINK_SUCCESS, result.status);
+    EXPECT_EQ(
+        "loadI 1024 => rfp\n"
+        "loadI 1024 => rsp\n"
+        "loadI 0 => rbss\n"
+        "jumpI -> lmain\n"
+        "lmain:\n"
+        "loadI 7 => r0\n"
+        "storeAI r0 => rsp, 0\n"
+        "jumpI -> linc\n"
+        "l0:\n"
+        "loadAI rbss, 0 => r1\n"
+        "halt\n"
+        "linc:\n"
+        "loadAI rbss, 4 => r0\n"
+        "storeAI r0 => rbss, 0\n"
+        "jumpI -> l1_0\n"
+        "l1_0:\n"
+        "loadAI rfp, 0 => r1\n"
+        "jump -> r1\n",
+        module_text(result.program));
+
+    free_module(result.program);
+    free_module(modules[0]);
+    free_module(modules[1]);
+}
+
+TEST(Link, ReportsDuplicateFunctions) {
+    struct module* modules[2];
+    modules[0] = parse_module("lmain:\nhalt\n");
+    modules[1] = parse_module("lmain:\nhalt\n");
+
+    testing::internal::CaptureStderr();
+    EXPECT_EQ(LINK_DUPLICATE, link_modules(modules, 2, 0).status);
+    EXPECT_EQ("Duplicate definition of function main\n",
+              testing::internal::GetCapturedStderr());
+
+    free_module(modules[0]);
+    free_module(modules[1]);
+}
+
+TEST(Link, ReportsUndefinedFunctions) {
+    struct module* module = parse_module("lmain:\njumpI -> lmissing\n");
+
+    testing::internal::CaptureStderr();
+    EXPECT_EQ(LINK_UNDEFINED, link_modules(&module, 1, 0).status);
+    EXPECT_EQ("Undefined reference to function missing\n",
+              testing::internal::GetCapturedStderr());
+
+    free_module(module);
+}
+
+TEST(Link, ReportsMismatchedGlobals) {
+    struct module* modules[2];
+    modules[0] = parse_module(".global table 4\nlmain:\nhalt\n");
+    modules[1] = parse_module(".global table 40\n");
+
+    testing::internal::CaptureStderr();
+    EXPECT_EQ(LINK_MISMATCHED_GLOBAL, link_modules(modules, 2, 0).status);
+    testing::internal::GetCapturedStderr();
+
+    free_module(modules[0]);
+    free_module(modules[1]);
+}
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "helpers.h"
+
+extern "C" {
+#include "../include/link.h"
+#include "../include/lto.h"
+}
+
+static const char* caller =
+    ".global seed 4\n"
+    "lmain:\n"
+    "loadI 2 => r0\n"
+    "storeAI r0 => rsp, 16\n"
+    "loadI l0 => r1\n"
+    "storeAI r1 => rsp, 0\n"
+    "storeAI r0 => rfp, 0\n"
+    "storeAI r1 => rfp, 4\n"
+    "jumpI -> ltwice\n"
+    "l0:\n"
+    "loadAI rfp, 0 => r0\n"
+    "loadAI rfp, 4 => r1\n"
+    "loadAI rsp, 12 => r2\n"
+    "loadAI rbss, @seed => r3\n"
+    "halt\n";
+
+static const char* callee =
+    ".global seed 4\n"
+    "ltwice:\n"
+    "storeAI rsp => rsp, 4\n"
+    "storeAI rfp => rsp, 8\n"
+    "i2i rsp => rfp\n"
+    "addI rsp, 20 => rsp\n"
+    "loadAI rfp, 16 => r0\n"
+    "add r0, r0 => r1\n"
+    "storeAI r1 => rfp, 12\n"
+    "loadAI rfp, 0 => r2\n"
+    "loadAI rfp, 4 => rsp\n"
+    "loadAI rfp, 8 => rfp\n"
+    "jump -> r2\n"
+    "lunused:\n"
+    "storeAI rsp => rsp, 4\n"
+    "loadAI rfp, 0 => r0\n"
+    "jump -> r0\n";
+
+TEST(Lto, InlinesLeafCallsAcrossModules) {
+    struct module* modules[2] = {parse_module(caller), parse_module(callee)};
+
+    struct link_result result = link_modules(modules, 2, LTO_INLINE);
+    ASSERT_EQ(LINK_SUCCESS, result.status);
+    EXPECT_EQ(1, result.stats.inlined_calls);
+
+    std::string text = module_text(result.program);
+    EXPECT_EQ(std::string::npos, text.find("jumpI -> ltwice"));
+    EXPECT_EQ(std::string::npos, text.find("storeAI r1 => rsp, 0"));
+    EXPECT_NE(std::string::npos, text.find("add r4, r4 => r5"));
+    EXPECT_NE(std::string::npos, text.find("jumpI -> l0\nl0:\n"));
+
+    free_module(result.program);
+    free_module(modules[0]);
+    free_module(modules[1]);
+}
+
+TEST(Lto, RemovesUnreachableFunctions) {
+    struct module* modules[2] = {parse_module(caller), parse_module(callee)};
+
+    struct link_result result =
+        link_modules(modules, 2, LTO_INLINE | LTO_DEAD_FUNCTIONS);
+    ASSERT_EQ(LINK_SUCCESS, result.status);
+    EXPECT_EQ(2, result.stats.removed_functions);
+    EXPECT_EQ(std::string::npos, module_text(result.program).find("ltwice:"));
+
+    free_module(result.program);
+
+    result = link_modules(modules, 2, LTO_DEAD_FUNCTIONS);
+    ASSERT_EQ(LINK_SUCCESS, result.status);
+    EXPECT_EQ(1, result.stats.removed_functions);
+    EXPECT_NE(std::string::npos, module_text(result.program).find("ltwice:"));
+
+    free_module(result.program);
+    free_module(modules[0]);
+    free_module(modules[1]);
+}
+
+TEST(Lto, FoldsGlobalsThatAreNeverWritten) {
+    struct module* module = parse_module(caller);
+
+    testing::internal::CaptureStderr();
+    struct link_result result = link_modules(&module, 1, LTO_CONST_GLOBALS);
+    testing::internal::GetCapturedStderr();
+    ASSERT_EQ(LINK_UNDEFINED, result.status);
+
+    struct module* modules[2] = {module, parse_module(callee)};
+    result = link_modules(modules, 2, LTO_CONST_GLOBALS);
+    ASSERT_EQ(LINK_SUCCESS, result.status);
+    EXPECT_EQ(1, result.stats.folded_loads);
+    EXPECT_NE(std::string::npos,
+              module_text(result.program).find("loadI 0 => r3\nhalt\n"));
+    free_module(result.program);
+    free_module(modules[1]);
+
+    std::string writer = std::string(callee) +
+                         "lset:\n"
+                         "loadI 1 => r0\n"
+                         "storeAI r0 => rbss, @seed\n";
+    modules[1] = parse_module(writer.c_str());
+    result = link_modules(modules, 2, LTO_CONST_GLOBALS);
+    ASSERT_EQ(LINK_SUCCESS, result.status);
+    EXPECT_EQ(0, result.stats.folded_loads);
+
+    free_module(result.program);
+    free_module(modules[0]);
+    free_module(modules[1]);
+}
+
+TEST(Lto, ParsesPassList) {
+    EXPECT_EQ(LTO_INLINE | LTO_CONST_GLOBALS,
+              parse_lto_passes("inline,const-globals"));
+    EXPECT_EQ(LTO_ALL, parse_lto_passes("all"));
+    EXPECT_EQ(-1, parse_lto_passes("inline,unknown"));
+}
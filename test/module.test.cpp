@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <unistd.h>
+
+extern "C" {
+#include "../include/generate.h"
+#include "../include/lex.yy.h"
+#include "../include/module.h"
+#include "../include/parser.tab.h"
+}
+
+static std::string save_prelude(const char* prelude) {
+    struct node* tree = 0;
+    yy_scan_string(prelude);
+    EXPECT_EQ(0, yyparse(&tree));
+
+    char path[] = "/tmp/etapa6-pmi-XXXXXX";
+    close(mkstemp(path));
+    FILE* out = fopen(path, "wb");
+    EXPECT_TRUE(save_interface(tree, out));
+    fclose(out);
+
+    free_node(tree);
+    yylex_destroy();
+    return path;
+}
+
+static void discard_imported_globals() {
+    generate_code(0);
+    free_code(code.head);
+}
+
+TEST(ModuleInterface, ExportsFunctionSignatures) {
+    std::string path = save_prelude(
+        "int add(int a, int b) { return a + b; }"
+        "static int hidden() { return 0; }");
+
+    struct interface* interface = load_interface(path.c_str());
+    ASSERT_NE(nullptr, interface);
+    EXPECT_EQ(1u, interface->header->function_count);
+    EXPECT_EQ(2u, interface->header->param_count);
+
+    struct table* table = alloc_table();
+    import_interface(interface, table);
+
+    struct node* tree = 0;
+    yy_scan_string(
+        "int main() { int x; x = add(1, 2); }"
+        "int f() { int x; x = add(1); }");
+    ASSERT_EQ(0, yyparse(&tree));
+    testing::internal::CaptureStderr();
+    EXPECT_EQ(ERROR_MISSING_ARGS, analyze_node(tree, table).status);
+    EXPECT_NE(std::string::npos,
+              testing::internal::GetCapturedStderr().find("add"));
+
+    free_node(tree);
+    yylex_destroy();
+    free_table(table);
+    discard_imported_globals();
+    free_interface(interface);
+    unlink(path.c_str());
+}
+
+TEST(ModuleInterface, ImportsClassesAndGlobals) {
+    std::string path = save_prelude(
+        "class point [ public int x : float y ];"
+        "origin point;"
+        "values[10] int;");
+
+    struct interface* interface = load_interface(path.c_str());
+    ASSERT_NE(nullptr, interface);
+    EXPECT_EQ(1u, interface->header->class_count);
+    EXPECT_EQ(2u, interface->header->field_count);
+    EXPECT_EQ(2u, interface->header->global_count);
+    EXPECT_EQ(4u, interface->fields[1].offset);
+
+    struct table* table = alloc_table();
+    import_interface(interface, table);
+
+    struct node* tree = 0;
+    yy_scan_string(
+        "int main() {"
+        "  point p;"
+        "  float f <= 1.0;"
+        "  f = origin$y;"
+        "  values[1] = 2;"
+        "}");
+    ASSERT_EQ(0, yyparse(&tree));
+    EXPECT_EQ(SUCCESS, analyze_node(tree, table).status);
+
+    free_node(tree);
+    yylex_destroy();
+    free_table(table);
+    discard_imported_globals();
+    free_interface(interface);
+    unlink(path.c_str());
+}
+
+TEST(ModuleInterface, DetectsRedeclaration) {
+    std::string path = save_prelude("counter int;");
+
+    struct interface* interface = load_interface(path.c_str());
+    ASSERT_NE(nullptr, interface);
+    struct table* table = alloc_table();
+    import_interface(interface, table);
+
+    struct node* tree = 0;
+    yy_scan_string("counter int;");
+    ASSERT_EQ(0, yyparse(&tree));
+    testing::internal::CaptureStderr();
+    EXPECT_EQ(ERROR_ALREADY_DECLARED, analyze_node(tree, table).status);
+    testing::internal::GetCapturedStderr();
+
+    free_node(tree);
+    yylex_destroy();
+    free_table(table);
+    discard_imported_globals();
+    free_interface(interface);
+    unlink(path.c_str());
+}
+
+TEST(ModuleInterface, RejectsCorruptFile) {
+    char path[] = "/tmp/etapa6-pmi-XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_EQ(4, write(fd, "PMI1", 4));
+    close(fd);
+    EXPECT_EQ(nullptr, load_interface(path));
+    unlink(path);
+}
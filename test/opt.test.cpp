@@ -0,0 +1,213 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "helpers.h"
+
+extern "C" {
+#include "../include/cfg.h"
+#include "../include/generate.h"
+#include "../include/iloc.h"
+#include "../include/opt.h"
+#include "../include/simulate.h"
+}
+
+static struct opt_stats expect_same_result(const char* source,
+                                           int passes,
+                                           long* saved) {
+    struct module* plain = compile_source(source);
+    struct module* optimized = compile_source(source);
+
+    struct opt_stats stats;
+    memset(&stats, 0, sizeof stats);
+    optimize_module(optimized, passes, &stats);
+
+    struct sim_result expected = run_module(plain, 0);
+    struct sim_result actual = run_module(optimized, 0);
+    EXPECT_EQ(expected.exit_value, actual.exit_value);
+    *saved = expected.instructions - actual.instructions;
+
+    free_sim_result(&expected);
+    free_sim_result(&actual);
+    free_module(plain);
+    free_module(optimized);
+    return stats;
+}
+
+TEST(Cfg, FindsNestedLoops) {
+    struct module* module = compile_source(
+        "int main() { int i <= 0; int s <= 0;"
+        " while (i < 10) do { int j <= 0;"
+        "  while (j < i) do { s = s + j; j = j + 1; };"
+        "  i = i + 1; };"
+        " return s; }");
+
+    int start = find_function(module, "lmain");
+    struct cfg* cfg = build_cfg(module, start, function_end(module, start));
+    struct loop* loops;
+    int count = find_loops(cfg, &loops);
+
+    ASSERT_EQ(2, count);
+    EXPECT_LT(loops[0].size, loops[1].size);
+    EXPECT_TRUE(loops[1].body[loops[0].header]);
+    EXPECT_FALSE(loops[0].body[loops[1].header]);
+    EXPECT_TRUE(dominates(cfg, loops[1].header, loops[0].header));
+    EXPECT_FALSE(loops[0].has_call);
+
+    free_loops(loops, count);
+    free_cfg(cfg);
+    free_module(module);
+}
+
+TEST(Opt, HoistsInvariantLoadsAndConstants) {
+    long saved;
+    struct opt_stats stats = expect_same_result(
+        "scale int;"
+        "int main() { int i <= 0; int s <= 0; int k <= 7; scale = 3;"
+        " while (i < 100) do { s = s + k * scale + i; i = i + 1; };"
+        " return s; }",
+        OPT_LICM,
+        &saved);
+
+    EXPECT_EQ(1, stats.preheaders);
+    EXPECT_GE(stats.hoisted_operations, 4);
+    EXPECT_GE(saved, 4 * 99);
+}
+
+TEST(Opt, KeepsLoadsOfStoredVariables) {
+    long saved;
+    struct opt_stats stats = expect_same_result(
+        "g int;"
+        "int main() { int i <= 0; int s <= 0; g = 1;"
+        " while (i < 10) do { s = s + g; if (i == 5) then { g = 100; };"
+        "  i = i + 1; };"
+        " return s; }",
+        OPT_LICM,
+        &saved);
+
+    EXPECT_GE(stats.hoisted_operations, 1);
+    EXPECT_GT(saved, 0);
+}
+
+TEST(Opt, SkipsLoopsWithCalls) {
+    long saved;
+    struct opt_stats stats = expect_same_result(
+        "g int;"
+        "int bump(int x) { g = g + x; return g; }"
+        "int main() { int i <= 0; int s <= 0; g = 0;"
+        " while (i < 10) do { s = s + g * 2 + bump(i); i = i + 1; };"
+        " return s; }",
+        OPT_LICM,
+        &saved);
+
+    EXPECT_EQ(0, stats.hoisted_operations);
+    EXPECT_EQ(0, saved);
+}
+
+TEST(Opt, KeepsRegisterParametersAssignedInLoops) {
+    long saved;
+    call_registers = 2;
+    struct opt_stats stats = expect_same_result(
+        "int f(int n, int m) { int i <= 0; int s <= 0;"
+        " while (i < 3) do { s = s + m * 100 + i * n; m = 5; i = i + 1; };"
+        " return s + m; }"
+        "int main() { return f(1, 2); }",
+        OPT_LICM | OPT_STRENGTH,
+        &saved);
+    call_registers = 0;
+
+    EXPECT_GE(stats.hoisted_operations, 1);
+}
+
+TEST(Opt, ReducesInductionVariableMultiplies) {
+    const char* source =
+        "int main() { int i <= 0; int s <= 0; int k <= 5;"
+        " while (i < 100) do { s = s + i * 12 + k * i; i = i + 1; };"
+        " int j <= 90;"
+        " while (j > 0) do { s = s + j * 3; j = j - 3; };"
+        " return s; }";
+    struct module* plain = compile_source(source);
+    struct module* reduced = compile_source(source);
+
+    struct opt_stats stats;
+    memset(&stats, 0, sizeof stats);
+    optimize_module(plain, OPT_LICM, &stats);
+    memset(&stats, 0, sizeof stats);
+    optimize_module(reduced, OPT_LICM | OPT_STRENGTH, &stats);
+    EXPECT_EQ(3, stats.strength_reduced);
+
+    struct sim_result expected = run_module(plain, 0);
+    struct sim_result actual = run_module(reduced, 0);
+    EXPECT_EQ(expected.exit_value, actual.exit_value);
+    EXPECT_LT(actual.cycles, expected.cycles);
+    EXPECT_LE(actual.counts[MULT] + actual.counts[MULT_I], 4);
+
+    free_sim_result(&expected);
+    free_sim_result(&actual);
+    free_module(plain);
+    free_module(reduced);
+}
+
+TEST(Opt, NumbersRepeatedExpressionsAndLoads) {
+    long saved;
+    struct opt_stats stats = expect_same_result(
+        "int mix(int a, int b) { int x <= 0;"
+        " x = a * b + a * b;"
+        " if (x > 10) then { x = x + a * b; } else { x = x - b * a; };"
+        " return x + a * b; }"
+        "int main() { int i <= 0; int s <= 0;"
+        " while (i < 20) do { s = s + mix(i, 3); i = i + 1; };"
+        " return s; }",
+        OPT_GVN,
+        &saved);
+
+    ASSERT_EQ(2, stats.function_count);
+    EXPECT_STREQ("mix", stats.functions[0].name);
+    EXPECT_GE(stats.functions[0].eliminated, 8);
+    EXPECT_EQ(stats.eliminated_operations,
+              stats.functions[0].eliminated + stats.functions[1].eliminated);
+    EXPECT_GE(saved, 20 * 8);
+    free_opt_stats(&stats);
+}
+
+TEST(Opt, KillsValuesAtStoresAndCalls) {
+    long saved;
+    struct opt_stats stats = expect_same_result(
+        "g int;"
+        "int bump(int x) { g = g + x; return g; }"
+        "int main() { int s <= 0; int k <= 0; g = 7;"
+        " s = g * 3; g = g + 1; s = s + g * 3;"
+        " if (s > 5) then { k = bump(2); } else { g = 1; };"
+        " s = s + g * 3 + k;"
+        " k = bump(1); s = s + g * 3;"
+        " return s; }",
+        OPT_GVN,
+        &saved);
+
+    EXPECT_EQ(2, stats.function_count);
+    free_opt_stats(&stats);
+}
+
+TEST(Opt, TreatsCallsAsDefsOfCallRegisters) {
+    long saved;
+    call_registers = 1;
+    struct opt_stats stats = expect_same_result(
+        "int id(int x) { return x + 100; }"
+        "int main() { int a <= 7; int y <= 0; y = id(a); return y; }",
+        OPT_GVN,
+        &saved);
+    call_registers = 0;
+
+    EXPECT_EQ(2, stats.function_count);
+    free_opt_stats(&stats);
+}
+
+TEST(Opt, ParsesPassList) {
+    EXPECT_EQ(OPT_LICM, parse_opt_passes("licm"));
+    EXPECT_EQ(OPT_LICM | OPT_STRENGTH, parse_opt_passes("licm,strength"));
+    EXPECT_EQ(OPT_IF_CONVERT | OPT_SHRINK_WRAP,
+              parse_opt_passes("if-convert,shrink-wrap"));
+    EXPECT_EQ(OPT_LAYOUT | OPT_GVN, parse_opt_passes("layout,gvn"));
+    EXPECT_EQ(OPT_ALL, parse_opt_passes("all"));
+    EXPECT_EQ(-1, parse_opt_passes("licm,unknown"));
+}
@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+extern "C" {
+#include "../include/lex.yy.h"
+#include "../include/parser.tab.h"
+#include "../include/serialize.h"
+}
+
+static const char* program =
+    "class point [ public int x : private float y ];"
+    "origin point;"
+    "values[10] static int;"
+    "int add(const int a, point p) {"
+    "  int c <= 1;"
+    "  float f <= 2.5;"
+    "  char k <= 'k';"
+    "  bool b <= true;"
+    "  string s <= \"text\";"
+    "  c = a + p$x * 2;"
+    "  values[c] >> 1;"
+    "  return c;"
+    "}"
+    "int main() {"
+    "  static const int i <= 0;"
+    "  while (i < 10 && !b) do { i = i + 1; };"
+    "  do { i = i - 1; } while (i > 0);"
+    "  for (i = 0, c = 1 : i <= 10 : i = i + 1) { output i, \"x\"; };"
+    "  foreach (v : 1, 2, 3) { break; };"
+    "  switch (i) { case 1: continue; };"
+    "  if (i == 0) then { input i; } else { add(i, .) %>% add(.); };"
+    "  i = i != 0 ? 1 : 2;"
+    "}";
+
+static std::string decompile(struct node* node) {
+    testing::internal::CaptureStdout();
+    decompile_node(node);
+    return testing::internal::GetCapturedStdout();
+}
+
+static std::string temp_path() {
+    char path[] = "/tmp/etapa6-ast-XXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    return path;
+}
+
+TEST(SerializeAst, RoundTripsProgram) {
+    struct node* tree = 0;
+    yy_scan_string(program);
+    ASSERT_EQ(0, yyparse(&tree));
+
+    std::string path = temp_path();
+    FILE* out = fopen(path.c_str(), "wb");
+    ASSERT_TRUE(save_ast(tree, out));
+    fclose(out);
+
+    struct ast* ast = load_ast(path.c_str());
+    ASSERT_NE(nullptr, ast);
+    EXPECT_EQ(decompile(tree), decompile(ast->root));
+
+    free_ast(ast);
+    free_node(tree);
+    yylex_destroy();
+    unlink(path.c_str());
+}
+
+TEST(SerializeAst, KeepsSourcePositions) {
+    struct node* tree = 0;
+    yy_scan_string("var int;\nint main() {\n  var = 1;\n}");
+    ASSERT_EQ(0, yyparse(&tree));
+
+    std::string path = temp_path();
+    FILE* out = fopen(path.c_str(), "wb");
+    ASSERT_TRUE(save_ast(tree, out));
+    fclose(out);
+
+    struct ast* ast = load_ast(path.c_str());
+    ASSERT_NE(nullptr, ast);
+    struct node* function = ast->root->val.unit.element;
+    ASSERT_EQ(N_FUNCTION_DEF, function->type);
+    EXPECT_EQ(2, function->val.function_def.token.line);
+    EXPECT_STREQ("main", function->val.function_def.token.val.string_v);
+
+    free_ast(ast);
+    free_node(tree);
+    yylex_destroy();
+    unlink(path.c_str());
+}
+
+TEST(SerializeAst, RejectsTruncatedFile) {
+    struct node* tree = 0;
+    yy_scan_string("var int;");
+    ASSERT_EQ(0, yyparse(&tree));
+
+    std::string path = temp_path();
+    FILE* out = fopen(path.c_str(), "wb");
+    ASSERT_TRUE(save_ast(tree, out));
+    fclose(out);
+    ASSERT_EQ(0, truncate(path.c_str(), 24));
+
+    EXPECT_EQ(nullptr, load_ast(path.c_str()));
+
+    free_node(tree);
+    yylex_destroy();
+    unlink(path.c_str());
+}
+
+static void patch_child(const std::string& path,
+                        uint32_t record,
+                        int child,
+                        uint32_t index) {
+    FILE* file = fopen(path.c_str(), "r+b");
+    ASSERT_NE(nullptr, file);
+    long offset = sizeof(struct ast_header) +
+                  record * sizeof(struct ast_record) +
+                  offsetof(struct ast_record, child) + child * sizeof index;
+    ASSERT_EQ(0, fseek(file, offset, SEEK_SET));
+    ASSERT_EQ(1u, fwrite(&index, sizeof index, 1, file));
+    fclose(file);
+}
+
+TEST(SerializeAst, RejectsCyclicChildren) {
+    struct node* tree = 0;
+    yy_scan_string("var int;\nint main() {\n  var = 1;\n}");
+    ASSERT_EQ(0, yyparse(&tree));
+
+    std::string path = temp_path();
+    FILE* out = fopen(path.c_str(), "wb");
+    ASSERT_TRUE(save_ast(tree, out));
+    fclose(out);
+
+    struct ast* ast = load_ast(path.c_str());
+    ASSERT_NE(nullptr, ast);
+    uint32_t function = ast->root->val.unit.element - ast->nodes;
+    free_ast(ast);
+
+    patch_child(path, function, 1, 0);
+    EXPECT_EQ(nullptr, load_ast(path.c_str()));
+    patch_child(path, function, 1, function);
+    EXPECT_EQ(nullptr, load_ast(path.c_str()));
+    patch_child(path, function, 1, 1000);
+    EXPECT_EQ(nullptr, load_ast(path.c_str()));
+
+    free_node(tree);
+    yylex_destroy();
+    unlink(path.c_str());
+}
@@ -0,0 +1,393 @@
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+extern "C" {
+#include "../include/jit.h"
+#include "../include/link.h"
+#include "../include/simulate.h"
+}
+
+static struct sim_result run(const char* text, struct sim_config* config) {
+    FILE* in = fmemopen((void*)text, strlen(text), "r");
+    struct module* module = read_module(in);
+    fclose(in);
+
+    struct link_result linked = link_modules(&module, 1, 0);
+    free_module(module);
+    EXPECT_EQ(LINK_SUCCESS, linked.status);
+
+    struct sim_program* program = decode_program(linked.program);
+    free_module(linked.program);
+    EXPECT_NE(nullptr, program);
+
+    struct sim_result result = simulate(program, config);
+    free_sim_program(program);
+    free_sim_result(&result);
+    return result;
+}
+
+TEST(Simulate, ComputesExitValueFromMainFrame) {
+    struct sim_config config = default_sim_config();
+    struct sim_result result = run(
+        ".global g 4\n"
+        "lmain:\n"
+        "loadI 7 => r0\n"
+        "multI r0, 6 => r1\n"
+        "storeAI r1 => rbss, @g\n"
+        "loadAI rbss, @g => r2\n"
+        "rsubI r2, 100 => r3\n"
+        "lshiftI r3, 1 => r4\n"
+        "storeAI r4 => rfp, 12\n"
+        "halt\n",
+        &config);
+
+    EXPECT_EQ(SIM_HALTED, result.status);
+    EXPECT_EQ(116, result.exit_value);
+    EXPECT_EQ(12, result.instructions);
+    EXPECT_EQ(1, result.loads);
+    EXPECT_EQ(2, result.stores);
+    EXPECT_EQ(4 + 1 + 3 + 3 + 3 + 1 + 1 + 3 + 1, result.cycles);
+}
+
+TEST(Simulate, ProfilesCallsAndBranches) {
+    struct sim_config config = default_sim_config();
+    const char* program =
+        "lmain:\n"
+        "loadI 0 => r0\n"
+        "l0:\n"
+        "loadI l1 => r1\n"
+        "storeAI r1 => rsp, 0\n"
+        "jumpI -> lnext\n"
+        "l1:\n"
+        "addI r0, 1 => r0\n"
+        "loadI 3 => r2\n"
+        "cmp_LT r0, r2 -> r3\n"
+        "cbr r3 -> l0, l2\n"
+        "l2:\n"
+        "storeAI r0 => rfp, 12\n"
+        "halt\n"
+        "lnext:\n"
+        "loadAI rsp, 0 => r4\n"
+        "jump -> r4\n";
+
+    FILE* in = fmemopen((void*)program, strlen(program), "r");
+    struct module* module = read_module(in);
+    fclose(in);
+    struct link_result linked = link_modules(&module, 1, 0);
+    struct sim_program* decoded = decode_program(linked.program);
+    struct sim_result result = simulate(decoded, &config);
+
+    EXPECT_EQ(SIM_HALTED, result.status);
+    EXPECT_EQ(3, result.exit_value);
+    EXPECT_EQ(3, result.counts[CBR]);
+    ASSERT_EQ(3, result.function_count);
+    EXPECT_STREQ("next", result.functions[2].name);
+    EXPECT_EQ(3, result.functions[2].calls);
+    EXPECT_EQ(6, result.functions[2].instructions);
+
+    free_sim_result(&result);
+    free_sim_program(decoded);
+    free_module(linked.program);
+    free_module(module);
+}
+
+TEST(Simulate, ReportsRuntimeErrors) {
+    struct sim_config config = default_sim_config();
+    EXPECT_EQ(SIM_DIVISION_BY_ZERO,
+              run("lmain:\nloadI 0 => r0\ndiv r0, r0 => r1\nhalt\n", &config)
+                  .status);
+    EXPECT_EQ(SIM_INVALID_ADDRESS,
+              run("lmain:\nloadI -8 => r0\nload r0 => r1\nhalt\n", &config)
+                  .status);
+    EXPECT_EQ(SIM_INVALID_JUMP,
+              run("lmain:\nloadI 99 => r0\njump -> r0\n", &config).status);
+
+    config.max_steps = 100;
+    EXPECT_EQ(SIM_STEP_LIMIT, run("lmain:\nl0:\njumpI -> l0\n", &config).status);
+}
+
+static bool decodes(const char* text) {
+    FILE* in = fmemopen((void*)text, strlen(text), "r");
+    struct module* module = read_module(in);
+    fclose(in);
+
+    struct sim_program* program = decode_program(module);
+    free_module(module);
+    if (program == 0) {
+        return false;
+    }
+    free_sim_program(program);
+    return true;
+}
+
+TEST(Simulate, RejectsMalformedOperands) {
+    EXPECT_TRUE(decodes("loadI l0 => r1\nl0:\nadd r1, r1 => r2\nhalt\n"));
+    EXPECT_FALSE(decodes("add r0, 99999999 => r1\nhalt\n"));
+    EXPECT_FALSE(decodes("loadI 7 => 99999999\nhalt\n"));
+    EXPECT_FALSE(decodes("loadI 7 => r99999999\nhalt\n"));
+    EXPECT_FALSE(decodes("l0:\ncbr r0 -> l0, 4\n"));
+    EXPECT_FALSE(decodes("jump -> l0\nl0:\nhalt\n"));
+    EXPECT_FALSE(decodes("addI r0, 1\nhalt\n"));
+    EXPECT_FALSE(decodes("halt r0\n"));
+}
+
+TEST(Simulate, LoadsLatencyTable) {
+    char path[] = "/tmp/etapa6-latency-XXXXXX";
+    int fd = mkstemp(path);
+    const char* table = "# cycles per opcode\nloadI 2\nhalt 0\n";
+    ASSERT_EQ((ssize_t)strlen(table), write(fd, table, strlen(table)));
+    close(fd);
+
+    struct sim_config config = default_sim_config();
+    ASSERT_TRUE(load_latencies(&config, path));
+    EXPECT_EQ(2, config.latency[LOAD_I]);
+
+    struct sim_result result = run("lmain:\nhalt\n", &config);
+    EXPECT_EQ(3 * 2 + 1, result.cycles);
+
+    fd = open(path, O_WRONLY | O_TRUNC);
+    ASSERT_EQ(8, write(fd, "bogus 1\n", 8));
+    close(fd);
+    testing::internal::CaptureStderr();
+    EXPECT_FALSE(load_latencies(&config, path));
+    testing::internal::GetCapturedStderr();
+    unlink(path);
+}
+
+static void expect_same_result(const char* text, struct sim_config* config) {
+    FILE* in = fmemopen((void*)text, strlen(text), "r");
+    struct module* module = read_module(in);
+    fclose(in);
+    struct link_result linked = link_modules(&module, 1, 0);
+    struct sim_program* program = decode_program(linked.program);
+    ASSERT_NE(nullptr, program);
+
+    struct sim_result expected = simulate(program, config);
+    struct sim_result actual = simulate_threaded(program, config);
+    EXPECT_EQ(expected.status, actual.status);
+    EXPECT_EQ(expected.exit_value, actual.exit_value);
+    EXPECT_EQ(expected.instructions, actual.instructions);
+    EXPECT_EQ(expected.cycles, actual.cycles);
+    EXPECT_EQ(expected.loads, actual.loads);
+    EXPECT_EQ(expected.stores, actual.stores);
+    EXPECT_EQ(expected.mispredictions, actual.mispredictions);
+
+    free_sim_result(&expected);
+    free_sim_result(&actual);
+    free_sim_program(program);
+    free_module(linked.program);
+    free_module(module);
+}
+
+TEST(Simulate, ThreadedEngineMatchesSwitchEngine) {
+    struct sim_config config = default_sim_config();
+    expect_same_result(
+        "lmain:\n"
+        "loadI 0 => r0\n"
+        "loadI 0 => r1\n"
+        "storeAI r0 => rfp, 16\n"
+        "l0:\n"
+        "loadAI rfp, 16 => r2\n"
+        "add r1, r2 => r1\n"
+        "addI r2, 1 => r2\n"
+        "loadI 100 => r3\n"
+        "storeAI r2 => rfp, 16\n"
+        "cmp_LT r2, r3 -> r4\n"
+        "cbr r4 -> l0, l1\n"
+        "l1:\n"
+        "storeAI r1 => rfp, 12\n"
+        "halt\n",
+        &config);
+
+    expect_same_result(
+        "lmain:\n"
+        "loadI 5 => r0\n"
+        "l0:\n"
+        "loadI l1 => r1\n"
+        "storeAI r1 => rsp, 0\n"
+        "jumpI -> ldouble\n"
+        "l1:\n"
+        "subI r0, 1 => r0\n"
+        "loadI 0 => r2\n"
+        "cmp_GT r0, r2 -> r3\n"
+        "cbr r3 -> l0, l2\n"
+        "l2:\n"
+        "loadAI rbss, 0 => r4\n"
+        "storeAI r4 => rfp, 12\n"
+        "halt\n"
+        "ldouble:\n"
+        "loadAI rbss, 0 => r5\n"
+        "addI r5, 3 => r5\n"
+        "storeAI r5 => rbss, 0\n"
+        "loadAI rsp, 0 => r6\n"
+        "jump -> r6\n",
+        &config);
+
+    expect_same_result("lmain:\nloadI 0 => r0\ndiv r0, r0 => r1\nhalt\n",
+                       &config);
+    expect_same_result("lmain:\nloadI -8 => r0\nload r0 => r1\nhalt\n",
+                       &config);
+    expect_same_result("lmain:\nloadI 99 => r0\njump -> r0\n", &config);
+}
+
+TEST(Simulate, ChargesMispredictedBranches) {
+    const char* loop =
+        "lmain:\n"
+        "loadI 0 => r0\n"
+        "l0:\n"
+        "addI r0, 1 => r0\n"
+        "loadI 100 => r1\n"
+        "cmp_LT r0, r1 -> r2\n"
+        "cbr r2 -> l0, l1\n"
+        "l1:\n"
+        "storeAI r0 => rfp, 12\n"
+        "halt\n";
+
+    struct sim_config config = default_sim_config();
+    struct sim_result free_branches = run(loop, &config);
+    config.branch_penalty = 7;
+    struct sim_result charged = run(loop, &config);
+
+    EXPECT_EQ(100, charged.exit_value);
+    EXPECT_EQ(2, charged.mispredictions);
+    EXPECT_EQ(free_branches.cycles + 2 * 7, charged.cycles);
+    expect_same_result(loop, &config);
+}
+
+TEST(Simulate, PredictsFusedBranchesAtTheBranch) {
+    const char* loop =
+        "lmain:\n"
+        "loadI 0 => r0\n"
+        "loadI 1 => r2\n"
+        "jumpI -> l1\n"
+        "l0:\n"
+        "addI r0, 1 => r0\n"
+        "loadI 3 => r1\n"
+        "cmp_LT r0, r1 -> r2\n"
+        "l1:\n"
+        "cbr r2 -> l0, l2\n"
+        "l2:\n"
+        "storeAI r0 => rfp, 12\n"
+        "halt\n";
+
+    struct sim_config config = default_sim_config();
+    config.branch_penalty = 5;
+    EXPECT_EQ(2, run(loop, &config).mispredictions);
+    expect_same_result(loop, &config);
+}
+
+TEST(Simulate, ThreadedEngineStopsAtStepLimit) {
+    struct sim_config config = default_sim_config();
+    config.max_steps = 100;
+    const char* text = "lmain:\nl0:\njumpI -> l0\n";
+    FILE* in = fmemopen((void*)text, strlen(text), "r");
+    struct module* module = read_module(in);
+    fclose(in);
+    struct link_result linked = link_modules(&module, 1, 0);
+    struct sim_program* program = decode_program(linked.program);
+
+    struct sim_result result = simulate_threaded(program, &config);
+    EXPECT_EQ(SIM_STEP_LIMIT, result.status);
+
+    free_sim_program(program);
+    free_module(linked.program);
+    free_module(module);
+}
+
+static void expect_jit_matches(const char* text, struct sim_config* config) {
+    FILE* in = fmemopen((void*)text, strlen(text), "r");
+    struct module* module = read_module(in);
+    fclose(in);
+    struct link_result linked = link_modules(&module, 1, 0);
+    struct sim_program* program = decode_program(linked.program);
+    ASSERT_NE(nullptr, program);
+
+    struct sim_result expected = simulate(program, config);
+    struct sim_result actual = run_jit(program, config);
+    EXPECT_EQ(expected.status, actual.status);
+    EXPECT_EQ(expected.exit_value, actual.exit_value);
+
+    free_sim_result(&expected);
+    free_sim_program(program);
+    free_module(linked.program);
+    free_module(module);
+}
+
+TEST(Jit, MatchesInterpreter) {
+    if (!jit_supported()) {
+        GTEST_SKIP();
+    }
+
+    struct sim_config config = default_sim_config();
+    expect_jit_matches(
+        ".global g 4\n"
+        "lmain:\n"
+        "loadI 7 => r0\n"
+        "multI r0, 6 => r1\n"
+        "storeAI r1 => rbss, @g\n"
+        "loadAI rbss, @g => r2\n"
+        "rsubI r2, 100 => r3\n"
+        "lshiftI r3, 3 => r4\n"
+        "loadI 3 => r5\n"
+        "rshift r4, r5 => r6\n"
+        "divI r6, 4 => r7\n"
+        "rdivI r5, 100 => r8\n"
+        "add r7, r8 => r9\n"
+        "xorI r9, 5 => r9\n"
+        "storeAI r9 => rfp, 12\n"
+        "halt\n",
+        &config);
+
+    expect_jit_matches(
+        "lmain:\n"
+        "loadI 5 => r0\n"
+        "l0:\n"
+        "loadI l1 => r1\n"
+        "storeAI r1 => rsp, 0\n"
+        "jumpI -> ldouble\n"
+        "l1:\n"
+        "subI r0, 1 => r0\n"
+        "loadI 0 => r2\n"
+        "cmp_GT r0, r2 -> r3\n"
+        "cbr r3 -> l0, l2\n"
+        "l2:\n"
+        "loadAI rbss, 0 => r4\n"
+        "storeAI r4 => rfp, 12\n"
+        "halt\n"
+        "ldouble:\n"
+        "loadAI rbss, 0 => r5\n"
+        "addI r5, 3 => r5\n"
+        "storeAI r5 => rbss, 0\n"
+        "loadAI rsp, 0 => r6\n"
+        "jump -> r6\n",
+        &config);
+
+    expect_jit_matches(
+        "lmain:\n"
+        "loadI -2147483648 => r0\n"
+        "loadI -1 => r1\n"
+        "div r0, r1 => r2\n"
+        "cmp_EQ r0, r2 -> r3\n"
+        "storeAI r3 => rfp, 12\n"
+        "halt\n",
+        &config);
+}
+
+TEST(Jit, ReportsRuntimeErrors) {
+    if (!jit_supported()) {
+        GTEST_SKIP();
+    }
+
+    struct sim_config config = default_sim_config();
+    expect_jit_matches("lmain:\nloadI 0 => r0\ndiv r0, r0 => r1\nhalt\n",
+                       &config);
+    expect_jit_matches("lmain:\nloadI -8 => r0\nload r0 => r1\nhalt\n",
+                       &config);
+    expect_jit_matches("lmain:\nloadI 99 => r0\njump -> r0\n", &config);
+
+    config.max_steps = 100;
+    expect_jit_matches("lmain:\nl0:\njumpI -> l0\n", &config);
+}
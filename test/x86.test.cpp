@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern "C" {
+#include "../include/link.h"
+#include "../include/simulate.h"
+#include "../include/x86.h"
+}
+
+static struct sim_program* decode_text(const char* text) {
+    FILE* in = fmemopen((void*)text, strlen(text), "r");
+    struct module* module = read_module(in);
+    fclose(in);
+    struct link_result linked = link_modules(&module, 1, 0);
+    free_module(module);
+    struct sim_program* program = decode_program(linked.program);
+    free_module(linked.program);
+    return program;
+}
+
+static void expect_native_matches(const char* text) {
+    struct sim_program* program = decode_text(text);
+    ASSERT_NE(nullptr, program);
+
+    char path[] = "/tmp/etapa6-x86-XXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    std::string source = std::string(path) + ".s";
+    FILE* out = fopen(source.c_str(), "w");
+    ASSERT_TRUE(print_x86_program(out, program, SIM_MEMORY_SIZE));
+    fclose(out);
+
+    std::string command = "cc " + source + " -o " + path;
+    ASSERT_EQ(0, system(command.c_str()));
+
+    FILE* run = popen(path, "r");
+    int value = 0;
+    int fields = fscanf(run, "%d", &value);
+    int status = WEXITSTATUS(pclose(run));
+
+    struct sim_config config = default_sim_config();
+    struct sim_result expected = simulate(program, &config);
+    EXPECT_EQ(expected.status, status);
+    if (expected.status == SIM_HALTED) {
+        EXPECT_EQ(1, fields);
+        EXPECT_EQ(expected.exit_value, value);
+    }
+
+    free_sim_result(&expected);
+    free_sim_program(program);
+    unlink(source.c_str());
+    unlink(path);
+}
+
+TEST(X86, MatchesSimulator) {
+    if (system("cc --version > /dev/null 2>&1") != 0) {
+        GTEST_SKIP();
+    }
+
+    expect_native_matches(
+        ".global g 4\n"
+        "lmain:\n"
+        "loadI 7 => r0\n"
+        "multI r0, 6 => r1\n"
+        "storeAI r1 => rbss, @g\n"
+        "loadAI rbss, @g => r2\n"
+        "rsubI r2, 100 => r3\n"
+        "lshiftI r3, 3 => r4\n"
+        "loadI 3 => r5\n"
+        "rshift r4, r5 => r6\n"
+        "divI r6, 4 => r7\n"
+        "rdivI r5, 100 => r8\n"
+        "add r7, r8 => r9\n"
+        "xorI r9, 5 => r9\n"
+        "storeAI r9 => rfp, 12\n"
+        "halt\n");
+
+    expect_native_matches(
+        "lmain:\n"
+        "loadI 5 => r0\n"
+        "l0:\n"
+        "loadI l1 => r1\n"
+        "storeAI r1 => rsp, 0\n"
+        "jumpI -> ldouble\n"
+        "l1:\n"
+        "subI r0, 1 => r0\n"
+        "loadI 0 => r2\n"
+        "cmp_GT r0, r2 -> r3\n"
+        "cbr r3 -> l0, l2\n"
+        "l2:\n"
+        "loadAI rbss, 0 => r4\n"
+        "storeAI r4 => rfp, 12\n"
+        "halt\n"
+        "ldouble:\n"
+        "loadAI rbss, 0 => r5\n"
+        "addI r5, 3 => r5\n"
+        "storeAI r5 => rbss, 0\n"
+        "loadAI rsp, 0 => r6\n"
+        "jump -> r6\n");
+}
+
+TEST(X86, ReportsRuntimeErrors) {
+    if (system("cc --version > /dev/null 2>&1") != 0) {
+        GTEST_SKIP();
+    }
+
+    expect_native_matches("lmain:\nloadI 0 => r0\ndiv r0, r0 => r1\nhalt\n");
+    expect_native_matches("lmain:\nloadI -8 => r0\nload r0 => r1\nhalt\n");
+    expect_native_matches("lmain:\nloadI 99 => r0\njump -> r0\n");
+}